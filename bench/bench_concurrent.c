@@ -0,0 +1,463 @@
+/*
+ * read scaling of the concurrent trees: lookups from 1, 2, 4, ... threads 
+ * against one tree, comparing rb_concurrent's per-slot locks and rb_rcu's 
+ * lock free reads with a single mutex and a single reader/writer lock 
+ * around a RedBlack_T. a second pass makes one operation in WRITE_EVERY a 
+ * delete and reinsert. a third measures write scaling: each thread inserts 
+ * its own keys into a fresh tree, behind a single mutex or spread over 
+ * SHARDS hash or range shards. another times rb_map_parallel_reduce over 
+ * the tree with a deliberately costly function, and the last merges 
+ * deltas of several sizes into a copy of the tree, one rb_search and 
+ * rb_insert_value per value against a single rb_union
+ * 
+ * usage: bench_concurrent.out [-n keys] [-t max threads]
+ */
+
+/* barriers need a later POSIX than the rest of the benchmarks */
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+
+#include "bench_util.h"
+#include "../src/rb_concurrent.h"
+#include "../src/rb_rcu.h"
+#include "../src/rb_sharded.h"
+#include "../src/rb_parallel.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_N 100000
+#define OPS_PER_THREAD 1000000
+#define WRITE_EVERY 100
+#define MAX_THREADS 64
+#define INSERTS_PER_THREAD 50000
+#define SHARDS 64
+#define MAP_WORK 200
+
+enum lock_kind { LOCK_MUTEX, LOCK_RWLOCK, LOCK_SLOTTED, LOCK_RCU }; 
+
+const char *lock_names[] = { "mutex", "rwlock", "slotted", "rcu" }; 
+
+enum write_kind { WRITE_MUTEX, WRITE_HASH, WRITE_RANGE }; 
+
+const char *write_names[] = { "mutex", "hash", "range" }; 
+
+int int_comparison(void *val_one, void *val_two)
+{
+        int64_t a = *(int64_t *) val_one; 
+        int64_t b = *(int64_t *) val_two; 
+
+        return (a > b) - (a < b); 
+}
+
+/* one tree behind whichever lock is being measured */
+struct shared {
+        enum lock_kind kind; 
+        RedBlack_T tree;                        /* LOCK_MUTEX, LOCK_RWLOCK */
+        RedBlack_Concurrent_T concurrent;       /* LOCK_SLOTTED */
+        RedBlack_RCU_T rcu;                     /* LOCK_RCU */
+        pthread_mutex_t mutex; 
+        pthread_rwlock_t rwlock; 
+        pthread_barrier_t start; 
+        int64_t *keys; 
+        size_t n; 
+        bool writes; 
+}; 
+
+struct worker {
+        struct shared *shared; 
+        uint64_t seed; 
+        size_t misses; 
+}; 
+
+void *search(struct shared *shared, void *key)
+{
+        void *found; 
+
+        switch (shared->kind) {
+        case LOCK_MUTEX: 
+                pthread_mutex_lock(&shared->mutex); 
+                found = rb_search(shared->tree, key); 
+                pthread_mutex_unlock(&shared->mutex); 
+                return found; 
+        case LOCK_RWLOCK: 
+                pthread_rwlock_rdlock(&shared->rwlock); 
+                found = rb_search(shared->tree, key); 
+                pthread_rwlock_unlock(&shared->rwlock); 
+                return found; 
+        case LOCK_SLOTTED: 
+                return rb_concurrent_search(shared->concurrent, key); 
+        default: 
+                return rb_rcu_search(shared->rcu, key); 
+        }
+}
+
+/* deletes and reinserts key in one critical section, so lookups never miss */
+void rewrite(struct shared *shared, void *key)
+{
+        switch (shared->kind) {
+        case LOCK_MUTEX: 
+                pthread_mutex_lock(&shared->mutex); 
+                rb_delete_value(shared->tree, key); 
+                rb_insert_value(shared->tree, key); 
+                pthread_mutex_unlock(&shared->mutex); 
+                break; 
+        case LOCK_RWLOCK: 
+                pthread_rwlock_wrlock(&shared->rwlock); 
+                rb_delete_value(shared->tree, key); 
+                rb_insert_value(shared->tree, key); 
+                pthread_rwlock_unlock(&shared->rwlock); 
+                break; 
+        case LOCK_SLOTTED: 
+                /* two write sections: the key may briefly be missing */
+                rb_concurrent_delete(shared->concurrent, key); 
+                rb_concurrent_insert(shared->concurrent, key); 
+                break; 
+        default: 
+                rb_rcu_delete(shared->rcu, key); 
+                rb_rcu_insert(shared->rcu, key); 
+                break; 
+        }
+}
+
+void *worker_main(void *arg)
+{
+        struct worker *worker = (struct worker *) arg; 
+        struct shared *shared = worker->shared; 
+
+        pthread_barrier_wait(&shared->start); 
+
+        for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+                void *key = &shared->keys[bench_rand(&worker->seed) % shared->n]; 
+
+                if (shared->writes && i % WRITE_EVERY == 0)
+                        rewrite(shared, key); 
+                else if (search(shared, key) == NULL)
+                        worker->misses++; 
+        }
+
+        pthread_barrier_wait(&shared->start); 
+        return NULL; 
+}
+
+/* returns the total operations per second over all threads */
+double measure(struct shared *shared, size_t threads)
+{
+        pthread_t ids[MAX_THREADS]; 
+        struct worker workers[MAX_THREADS]; 
+        size_t misses = 0; 
+
+        pthread_barrier_init(&shared->start, NULL, threads + 1); 
+
+        for (size_t i = 0; i < threads; i++) {
+                workers[i] = (struct worker) { shared, 0x9e3779b97f4a7c15ull * (i + 1), 0 }; 
+                pthread_create(&ids[i], NULL, &worker_main, &workers[i]); 
+        }
+
+        pthread_barrier_wait(&shared->start); 
+        uint64_t start = bench_now_ns(); 
+        pthread_barrier_wait(&shared->start); 
+        uint64_t elapsed = bench_now_ns() - start; 
+
+        for (size_t i = 0; i < threads; i++) {
+                pthread_join(ids[i], NULL); 
+                misses += workers[i].misses; 
+        }
+        pthread_barrier_destroy(&shared->start); 
+
+        if (misses != 0 && !(shared->writes && shared->kind >= LOCK_SLOTTED))
+                fprintf(stderr, "%s: %zu lookups missed\n", lock_names[shared->kind], misses); 
+
+        return (double) (threads * OPS_PER_THREAD) * 1e9 / (double) elapsed; 
+}
+
+uint64_t int_hash(void *value)
+{
+        return (uint64_t) *(int64_t *) value; 
+}
+
+/* a fresh tree filled by threads at once, each inserting its own keys */
+struct insert_run {
+        enum write_kind kind; 
+        RedBlack_T tree;                /* WRITE_MUTEX */
+        pthread_mutex_t mutex; 
+        RedBlack_Sharded_T sharded;     /* WRITE_HASH, WRITE_RANGE */
+        pthread_barrier_t start; 
+        int64_t *keys; 
+}; 
+
+struct inserter {
+        struct insert_run *run; 
+        size_t first; 
+}; 
+
+void *inserter_main(void *arg)
+{
+        struct inserter *inserter = (struct inserter *) arg; 
+        struct insert_run *run = inserter->run; 
+        int64_t *keys = run->keys + inserter->first; 
+
+        pthread_barrier_wait(&run->start); 
+
+        for (size_t i = 0; i < INSERTS_PER_THREAD; i++) {
+                if (run->kind == WRITE_MUTEX) {
+                        pthread_mutex_lock(&run->mutex); 
+                        rb_insert_value(run->tree, &keys[i]); 
+                        pthread_mutex_unlock(&run->mutex); 
+                } else {
+                        rb_sharded_insert(run->sharded, &keys[i]); 
+                }
+        }
+
+        pthread_barrier_wait(&run->start); 
+        return NULL; 
+}
+
+/* 
+ * returns the total inserts per second over all threads. keys holds a 
+ * shuffle of the multiples of 16 below 16 * key_count, which bounds splits 
+ * into SHARDS even ranges
+ */
+double measure_inserts(enum write_kind kind, int64_t *keys, void **bounds, size_t threads)
+{
+        struct insert_run run; 
+        pthread_t ids[MAX_THREADS]; 
+        struct inserter inserters[MAX_THREADS]; 
+
+        run.kind = kind; 
+        run.keys = keys; 
+        run.tree = rb_new(&int_comparison); 
+        pthread_mutex_init(&run.mutex, NULL); 
+        if (kind == WRITE_HASH)
+                run.sharded = rb_sharded_new_hash(&int_comparison, 0, SHARDS, &int_hash); 
+        else
+                run.sharded = rb_sharded_new_range(&int_comparison, 0, SHARDS - 1, bounds); 
+        pthread_barrier_init(&run.start, NULL, threads + 1); 
+
+        for (size_t i = 0; i < threads; i++) {
+                inserters[i] = (struct inserter) { &run, i * INSERTS_PER_THREAD }; 
+                pthread_create(&ids[i], NULL, &inserter_main, &inserters[i]); 
+        }
+
+        pthread_barrier_wait(&run.start); 
+        uint64_t start = bench_now_ns(); 
+        pthread_barrier_wait(&run.start); 
+        uint64_t elapsed = bench_now_ns() - start; 
+
+        for (size_t i = 0; i < threads; i++) 
+                pthread_join(ids[i], NULL); 
+
+        pthread_barrier_destroy(&run.start); 
+        rb_sharded_free(run.sharded); 
+        pthread_mutex_destroy(&run.mutex); 
+        rb_tree_free(run.tree); 
+
+        return (double) (threads * INSERTS_PER_THREAD) * 1e9 / (double) elapsed; 
+}
+
+/* stands in for an expensive per value computation, summed per thread */
+void costly_sum(void *value, void *thread_cl)
+{
+        uint64_t x = (uint64_t) *(int64_t *) value | 1; 
+
+        for (int i = 0; i < MAP_WORK; i++) 
+                bench_rand(&x); 
+
+        *(uint64_t *) thread_cl += x; 
+}
+
+void *new_sum(void *cl)
+{
+        uint64_t *sum = calloc(1, sizeof(uint64_t)); 
+
+        (void) cl; 
+        assert(sum != NULL); 
+
+        return sum; 
+}
+
+void add_sum(void *cl, void *thread_cl)
+{
+        *(uint64_t *) cl += *(uint64_t *) thread_cl; 
+        free(thread_cl); 
+}
+
+/* 
+ * merges m delta keys, every other one already present, into a tree of the 
+ * n base keys and returns the seconds taken; building the trees is not 
+ * timed
+ */
+double measure_merge(int64_t *base_keys, size_t n, int64_t *delta_keys, size_t m, 
+                     bool use_union)
+{
+        RedBlack_T base = rb_new(&int_comparison); 
+        RedBlack_T delta = rb_new(&int_comparison); 
+
+        for (size_t i = 0; i < n; i++) 
+                rb_insert_value(base, &base_keys[i]); 
+        for (size_t i = 0; i < m; i++) {
+                delta_keys[i] = (int64_t) (i * n / m) * 16 + (i % 2 ? 8 : 0); 
+                rb_insert_value(delta, &delta_keys[i]); 
+        }
+
+        uint64_t start = bench_now_ns(); 
+
+        if (use_union) {
+                base = rb_union(base, delta); 
+        } else {
+                for (size_t i = 0; i < m; i++) 
+                        if (rb_search(base, &delta_keys[i]) == NULL)
+                                rb_insert_value(base, &delta_keys[i]); 
+                rb_tree_free(delta); 
+        }
+
+        double seconds = (double) (bench_now_ns() - start) / 1e9; 
+
+        if (rb_tree_size(base) != n + m / 2)
+                fprintf(stderr, "merge lost values\n"); 
+
+        rb_tree_free(base); 
+
+        return seconds; 
+}
+
+int main(int argc, char *argv[])
+{
+        size_t n = DEFAULT_N; 
+        long max_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN); 
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+                        n = strtoul(argv[++i], NULL, 10); 
+                } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+                        max_threads = strtol(argv[++i], NULL, 10); 
+                } else {
+                        fprintf(stderr, "usage: %s [-n keys] [-t max threads]\n", argv[0]); 
+                        return 1; 
+                }
+        }
+
+        if (n == 0)
+                n = 1; 
+        if (max_threads < 1)
+                max_threads = 1; 
+        if (max_threads > MAX_THREADS)
+                max_threads = MAX_THREADS; 
+
+        struct shared shared; 
+        shared.n = n; 
+        shared.keys = malloc(n * sizeof(int64_t)); 
+        assert(shared.keys != NULL); 
+        for (size_t i = 0; i < n; i++) 
+                shared.keys[i] = (int64_t) i * 16; 
+
+        shared.tree = rb_new(&int_comparison); 
+        shared.concurrent = rb_concurrent_new(&int_comparison, 0); 
+        shared.rcu = rb_rcu_new(&int_comparison); 
+        pthread_mutex_init(&shared.mutex, NULL); 
+        pthread_rwlock_init(&shared.rwlock, NULL); 
+        for (size_t i = 0; i < n; i++) {
+                rb_insert_value(shared.tree, &shared.keys[i]); 
+                rb_concurrent_insert(shared.concurrent, &shared.keys[i]); 
+                rb_rcu_insert(shared.rcu, &shared.keys[i]); 
+        }
+
+        printf("%zu keys, %d operations per thread, %ld online processors\n", 
+               n, OPS_PER_THREAD, sysconf(_SC_NPROCESSORS_ONLN)); 
+
+        printf("\nparallel map\n%-8s %14s   (values/sec)\n", "threads", "reduce"); 
+        for (long threads = 1; threads <= max_threads; threads *= 2) {
+                uint64_t sum = 0; 
+                uint64_t start = bench_now_ns(); 
+
+                rb_map_parallel_reduce(shared.tree, (size_t) threads, &costly_sum, 
+                                       &new_sum, &add_sum, &sum); 
+
+                double seconds = (double) (bench_now_ns() - start) / 1e9; 
+                printf("%-8ld %14.0f\n", threads, (double) n / seconds); 
+        }
+
+        for (int writes = 0; writes <= 1; writes++) {
+                shared.writes = writes; 
+                printf("\n%s\n%-8s", writes ? "1% writes" : "lookups only", "threads"); 
+                for (int kind = LOCK_MUTEX; kind <= LOCK_RCU; kind++) 
+                        printf(" %14s", lock_names[kind]); 
+                printf("   (ops/sec)\n"); 
+
+                for (long threads = 1; threads <= max_threads; threads *= 2) {
+                        printf("%-8ld", threads); 
+                        for (int kind = LOCK_MUTEX; kind <= LOCK_RCU; kind++) {
+                                shared.kind = kind; 
+                                printf(" %14.0f", measure(&shared, threads)); 
+                                fflush(stdout); 
+                        }
+                        printf("\n"); 
+                }
+        }
+
+        pthread_rwlock_destroy(&shared.rwlock); 
+        pthread_mutex_destroy(&shared.mutex); 
+        rb_rcu_free(shared.rcu); 
+        rb_concurrent_free(shared.concurrent); 
+        rb_tree_free(shared.tree); 
+        free(shared.keys); 
+
+        size_t key_count = (size_t) max_threads * INSERTS_PER_THREAD; 
+        int64_t *insert_keys = malloc(key_count * sizeof(int64_t)); 
+        int64_t bound_keys[SHARDS - 1]; 
+        void *bounds[SHARDS - 1]; 
+        uint64_t state = 0x2545f4914f6cdd1dull; 
+
+        assert(insert_keys != NULL); 
+        for (size_t i = 0; i < key_count; i++) 
+                insert_keys[i] = (int64_t) i * 16; 
+        for (size_t i = key_count - 1; i > 0; i--) {
+                size_t j = bench_rand(&state) % (i + 1); 
+                int64_t tmp = insert_keys[i]; 
+
+                insert_keys[i] = insert_keys[j]; 
+                insert_keys[j] = tmp; 
+        }
+        for (size_t i = 0; i < SHARDS - 1; i++) {
+                bound_keys[i] = (int64_t) ((i + 1) * key_count / SHARDS) * 16; 
+                bounds[i] = &bound_keys[i]; 
+        }
+
+        printf("\ninserts, %d shards\n%-8s", SHARDS, "threads"); 
+        for (int kind = WRITE_MUTEX; kind <= WRITE_RANGE; kind++) 
+                printf(" %14s", write_names[kind]); 
+        printf("   (ops/sec)\n"); 
+
+        for (long threads = 1; threads <= max_threads; threads *= 2) {
+                printf("%-8ld", threads); 
+                for (int kind = WRITE_MUTEX; kind <= WRITE_RANGE; kind++) {
+                        printf(" %14.0f", measure_inserts(kind, insert_keys, bounds, threads)); 
+                        fflush(stdout); 
+                }
+                printf("\n"); 
+        }
+
+        free(insert_keys); 
+
+        int64_t *base_keys = malloc(n * sizeof(int64_t)); 
+        int64_t *delta_keys = malloc(n * sizeof(int64_t)); 
+
+        assert(base_keys != NULL && delta_keys != NULL); 
+        for (size_t i = 0; i < n; i++) 
+                base_keys[i] = (int64_t) i * 16; 
+
+        printf("\nmerging a delta into %zu keys\n%-8s %14s %14s   (seconds)\n", 
+               n, "delta", "insert", "union"); 
+        for (size_t m = n / 1000 > 0 ? n / 1000 : 1; m <= n; m *= 10) {
+                printf("%-8zu", m); 
+                printf(" %14.6f", measure_merge(base_keys, n, delta_keys, m, false)); 
+                printf(" %14.6f\n", measure_merge(base_keys, n, delta_keys, m, true)); 
+                fflush(stdout); 
+        }
+
+        free(delta_keys); 
+        free(base_keys); 
+
+        return 0; 
+}
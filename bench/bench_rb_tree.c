@@ -0,0 +1,377 @@
+/*
+ * workloads against the RedBlack_T API, reporting throughput and latency
+ * percentiles for each
+ * 
+ * usage: bench_rb_tree.out [-n keys] [--json path] [--perf]
+ * 
+ * --perf also samples hardware counters around each workload, where the 
+ * system allows it
+ */
+
+#include "bench_util.h"
+#include "../src/rb_tree.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_N 200000
+#define LOOKUPS_PER_KEY 2
+#define SCANS 20
+#define SAVES 5
+#define ZIPF_EXPONENT 0.99
+#define KEY_LENGTH 24
+
+int int_comparison(void *val_one, void *val_two)
+{
+        int64_t a = *(int64_t *) val_one; 
+        int64_t b = *(int64_t *) val_two; 
+
+        return (a > b) - (a < b); 
+}
+
+/* shared by every workload: n distinct keys in random order, as ints and strings */
+struct keyset {
+        size_t n; 
+        int64_t *ints; 
+        int64_t *sorted_ints; 
+        char **strings; 
+}; 
+
+void keyset_init(struct keyset *keys, size_t n)
+{
+        uint64_t state = 0x9e3779b97f4a7c15ull; 
+
+        keys->n = n; 
+        keys->ints = malloc(n * sizeof(int64_t)); 
+        keys->sorted_ints = malloc(n * sizeof(int64_t)); 
+        keys->strings = malloc(n * sizeof(char *)); 
+        assert(keys->ints != NULL && keys->sorted_ints != NULL && 
+               keys->strings != NULL); 
+
+        /* distinct values: a random permutation of spaced out integers */
+        for (size_t i = 0; i < n; i++) 
+                keys->sorted_ints[i] = (int64_t) i * 16; 
+        memcpy(keys->ints, keys->sorted_ints, n * sizeof(int64_t)); 
+        for (size_t i = n - 1; i > 0; i--) {
+                size_t j = bench_rand(&state) % (i + 1); 
+                int64_t tmp = keys->ints[i]; 
+
+                keys->ints[i] = keys->ints[j]; 
+                keys->ints[j] = tmp; 
+        }
+
+        /* strings share a prefix, as identifiers and paths tend to */
+        for (size_t i = 0; i < n; i++) {
+                keys->strings[i] = malloc(KEY_LENGTH); 
+                assert(keys->strings[i] != NULL); 
+                snprintf(keys->strings[i], KEY_LENGTH, "user:%016llx", 
+                         (unsigned long long) (keys->ints[i] * 0x2545f491ull)); 
+        }
+}
+
+void keyset_free(struct keyset *keys)
+{
+        for (size_t i = 0; i < keys->n; i++) 
+                free(keys->strings[i]); 
+
+        free(keys->strings); 
+        free(keys->sorted_ints); 
+        free(keys->ints); 
+}
+
+/* inserts values[0..n) one at a time, timing each insert */
+RedBlack_T bench_inserts(bench_report *report, const char *workload, 
+                         const char *key_kind, void **values, size_t n, 
+                         void *comparison_func)
+{
+        RedBlack_T tree = rb_new(comparison_func); 
+        bench_run run; 
+
+        bench_run_begin(&run, workload, key_kind, n); 
+        for (size_t i = 0; i < n; i++) {
+                uint64_t t = bench_op_begin(); 
+                rb_insert_value(tree, values[i]); 
+                bench_op_end(&run, t); 
+        }
+        bench_run_end(&run); 
+        bench_report_add(report, &run); 
+
+        return tree; 
+}
+
+/* looks up keys drawn with a Zipf distribution over values */
+void bench_zipf_lookups(bench_report *report, const char *key_kind, 
+                        RedBlack_T tree, void **values, size_t n)
+{
+        bench_zipf zipf = bench_zipf_new(n, ZIPF_EXPONENT); 
+        uint64_t state = 12345; 
+        size_t lookups = n * LOOKUPS_PER_KEY; 
+        size_t misses = 0; 
+        bench_run run; 
+
+        bench_run_begin(&run, "lookup_zipf", key_kind, lookups); 
+        for (size_t i = 0; i < lookups; i++) {
+                void *key = values[bench_zipf_next(zipf, &state)]; 
+                uint64_t t = bench_op_begin(); 
+                misses += rb_search(tree, key) == NULL; 
+                bench_op_end(&run, t); 
+        }
+        bench_run_end(&run); 
+        bench_report_add(report, &run); 
+
+        if (misses != 0)
+                fprintf(stderr, "lookup_zipf: %zu lookups missed\n", misses); 
+
+        bench_zipf_free(zipf); 
+}
+
+void count_value(void *value, int depth, void *cl)
+{
+        (void) value; 
+        (void) depth; 
+
+        (*(size_t *) cl)++; 
+}
+
+/* full inorder walks, each timed as one operation */
+void bench_scans(bench_report *report, const char *key_kind, RedBlack_T tree)
+{
+        size_t visited = 0; 
+        bench_run run; 
+
+        bench_run_begin(&run, "scan_inorder", key_kind, SCANS); 
+        for (int i = 0; i < SCANS; i++) {
+                uint64_t t = bench_op_begin(); 
+                rb_map_inorder(tree, &count_value, &visited); 
+                bench_op_end(&run, t); 
+        }
+        bench_run_end(&run); 
+        bench_report_add(report, &run); 
+
+        if (visited != SCANS * rb_tree_size(tree))
+                fprintf(stderr, "scan_inorder: visited %zu values\n", visited); 
+}
+
+void free_value(void *value, int depth, void *cl)
+{
+        (void) depth; 
+        (void) cl; 
+
+        free(value); 
+}
+
+/* 
+ * saves a string tree to a temporary file and loads it back, each timed as 
+ * one operation, to set against building the tree by insertion
+ */
+void bench_save_load(bench_report *report, RedBlack_T tree)
+{
+        FILE *file = tmpfile(); 
+        bench_run save_run; 
+        bench_run load_run; 
+
+        assert(file != NULL); 
+
+        bench_run_begin(&save_run, "save", "string", SAVES); 
+        bench_run_begin(&load_run, "load", "string", SAVES); 
+        for (int i = 0; i < SAVES; i++) {
+                lseek(fileno(file), 0, SEEK_SET); 
+
+                uint64_t t = bench_op_begin(); 
+                bool saved = rb_tree_save(tree, fileno(file), &rb_save_encode_string); 
+                bench_op_end(&save_run, t); 
+
+                lseek(fileno(file), 0, SEEK_SET); 
+
+                t = bench_op_begin(); 
+                RedBlack_T loaded = rb_tree_load(fileno(file), NULL, 
+                                                 &rb_load_decode_string, &free); 
+                bench_op_end(&load_run, t); 
+
+                if (!saved || loaded == NULL || rb_tree_size(loaded) != rb_tree_size(tree))
+                        fprintf(stderr, "save/load: round %d did not match\n", i); 
+
+                if (loaded != NULL) {
+                        rb_map_inorder(loaded, &free_value, NULL); 
+                        rb_tree_free(loaded); 
+                }
+        }
+        bench_run_end(&save_run); 
+        bench_run_end(&load_run); 
+        bench_report_add(report, &save_run); 
+        bench_report_add(report, &load_run); 
+
+        fclose(file); 
+}
+
+/* 
+ * 90% lookups, 5% inserts and 5% deletes over a tree holding half the keys. 
+ * a key is inserted only while absent and deleted only while present, so 
+ * the tree stays near n / 2
+ */
+void bench_mixed(bench_report *report, struct keyset *keys)
+{
+        RedBlack_T tree = rb_new(&int_comparison); 
+        bool *present = calloc(keys->n, sizeof(bool)); 
+        uint64_t state = 777; 
+        size_t ops = keys->n * 2; 
+        bench_run run; 
+
+        assert(present != NULL); 
+
+        for (size_t i = 0; i < keys->n; i += 2) {
+                rb_insert_value(tree, &keys->ints[i]); 
+                present[i] = true; 
+        }
+
+        bench_run_begin(&run, "mixed_90r_10w", "int", ops); 
+        for (size_t i = 0; i < ops; i++) {
+                uint64_t r = bench_rand(&state); 
+                size_t k = (size_t) (r >> 8) % keys->n; 
+                uint64_t t = bench_op_begin(); 
+
+                if (r % 100 < 90) {
+                        rb_search(tree, &keys->ints[k]); 
+                } else if (!present[k]) {
+                        rb_insert_value(tree, &keys->ints[k]); 
+                        present[k] = true; 
+                } else {
+                        rb_delete_value(tree, &keys->ints[k]); 
+                        present[k] = false; 
+                }
+
+                bench_op_end(&run, t); 
+        }
+        bench_run_end(&run); 
+        bench_report_add(report, &run); 
+
+        free(present); 
+        rb_tree_free(tree); 
+}
+
+/* 
+ * starting from a full tree, 70% deletes of a random present key and 30% 
+ * inserts of a random absent one, until the tree is a tenth of its size
+ */
+void bench_delete_churn(bench_report *report, struct keyset *keys)
+{
+        RedBlack_T tree = rb_new(&int_comparison); 
+        size_t n = keys->n; 
+        size_t *slots = malloc(n * sizeof(size_t)); 
+        size_t live = n; 
+        uint64_t state = 4242; 
+        bench_run run; 
+
+        assert(slots != NULL); 
+
+        /* slots[0..live) are the keys in the tree, the rest are out */
+        for (size_t i = 0; i < n; i++) {
+                slots[i] = i; 
+                rb_insert_value(tree, &keys->ints[i]); 
+        }
+
+        bench_run_begin(&run, "delete_heavy_churn", "int", 3 * n); 
+        while (live > n / 10 && run.ops < run.capacity) {
+                uint64_t r = bench_rand(&state); 
+                uint64_t t; 
+
+                if (r % 10 < 7 || live == n) {
+                        size_t i = (size_t) (r >> 8) % live; 
+                        size_t k = slots[i]; 
+
+                        t = bench_op_begin(); 
+                        rb_delete_value(tree, &keys->ints[k]); 
+                        bench_op_end(&run, t); 
+
+                        slots[i] = slots[--live]; 
+                        slots[live] = k; 
+                } else {
+                        size_t i = live + (size_t) (r >> 8) % (n - live); 
+                        size_t k = slots[i]; 
+
+                        t = bench_op_begin(); 
+                        rb_insert_value(tree, &keys->ints[k]); 
+                        bench_op_end(&run, t); 
+
+                        slots[i] = slots[live]; 
+                        slots[live++] = k; 
+                }
+        }
+        bench_run_end(&run); 
+        bench_report_add(report, &run); 
+
+        free(slots); 
+        rb_tree_free(tree); 
+}
+
+int main(int argc, char *argv[])
+{
+        size_t n = DEFAULT_N; 
+        const char *json_path = NULL; 
+        bool perf = false; 
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+                        n = strtoul(argv[++i], NULL, 10); 
+                } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+                        json_path = argv[++i]; 
+                } else if (strcmp(argv[i], "--perf") == 0) {
+                        perf = true; 
+                } else {
+                        fprintf(stderr, "usage: %s [-n keys] [--json path] [--perf]\n", 
+                                argv[0]); 
+                        return EXIT_FAILURE; 
+                }
+        }
+
+        if (n < 10) 
+                n = 10; 
+
+        struct keyset keys; 
+        bench_report report; 
+        void **values = malloc(n * sizeof(void *)); 
+        RedBlack_T tree; 
+
+        assert(values != NULL); 
+        keyset_init(&keys, n); 
+
+        if (perf)
+                bench_perf_open(); 
+        bench_report_open(&report, json_path, "rb_tree", n); 
+
+        for (size_t i = 0; i < n; i++) 
+                values[i] = &keys.sorted_ints[i]; 
+        tree = bench_inserts(&report, "insert_sorted", "int", values, n, &int_comparison); 
+        rb_tree_free(tree); 
+
+        for (size_t i = 0; i < n; i++) 
+                values[i] = &keys.sorted_ints[n - 1 - i]; 
+        tree = bench_inserts(&report, "insert_reverse_sorted", "int", values, n, 
+                             &int_comparison); 
+        rb_tree_free(tree); 
+
+        for (size_t i = 0; i < n; i++) 
+                values[i] = &keys.ints[i]; 
+        tree = bench_inserts(&report, "insert_random", "int", values, n, &int_comparison); 
+        bench_zipf_lookups(&report, "int", tree, values, n); 
+        bench_scans(&report, "int", tree); 
+        rb_tree_free(tree); 
+
+        for (size_t i = 0; i < n; i++) 
+                values[i] = keys.strings[i]; 
+        tree = bench_inserts(&report, "insert_random", "string", values, n, NULL); 
+        bench_zipf_lookups(&report, "string", tree, values, n); 
+        bench_scans(&report, "string", tree); 
+        bench_save_load(&report, tree); 
+        rb_tree_free(tree); 
+
+        bench_mixed(&report, &keys); 
+        bench_delete_churn(&report, &keys); 
+
+        bench_report_close(&report); 
+        bench_perf_close(); 
+        keyset_free(&keys); 
+        free(values); 
+
+        return 0; 
+}
@@ -0,0 +1,99 @@
+/*
+ * compares a generic tree of int64_t keys, which calls its comparison 
+ * function through a pointer, against the specialized rb_int64 tree
+ * 
+ * usage: bench_typed.out [n]
+ */
+
+#include "../src/rb_tree.h"
+#include "../src/rb_typed.h"
+
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_N 1000000
+
+int int64_comparison(void *val_one, void *val_two)
+{
+        int64_t a = *(int64_t *) val_one; 
+        int64_t b = *(int64_t *) val_two; 
+
+        return (a > b) - (a < b); 
+}
+
+double now_seconds(void)
+{
+        struct timespec ts; 
+
+        clock_gettime(CLOCK_MONOTONIC, &ts); 
+        return ts.tv_sec + ts.tv_nsec / 1e9; 
+}
+
+void report(const char *tree, const char *op, size_t n, double seconds)
+{
+        printf("%-8s %-8s %10.1f ns/op %12.0f ops/sec\n", tree, op, 
+               seconds * 1e9 / n, n / seconds); 
+}
+
+int main(int argc, char *argv[])
+{
+        size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_N; 
+        int64_t *keys = malloc(n * sizeof(*keys)); 
+        uint64_t state = 88172645463325252ull; 
+        size_t found = 0; 
+        double start; 
+
+        assert(keys != NULL); 
+
+        for (size_t i = 0; i < n; i++) {
+                state ^= state << 13; 
+                state ^= state >> 7; 
+                state ^= state << 17; 
+                keys[i] = (int64_t) state; 
+        }
+
+        RedBlack_T generic = rb_new(&int64_comparison); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                rb_insert_value(generic, &keys[i]); 
+        report("generic", "insert", n, now_seconds() - start); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                found += rb_search(generic, &keys[i]) != NULL; 
+        report("generic", "search", n, now_seconds() - start); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                rb_delete_value(generic, &keys[i]); 
+        report("generic", "delete", n, now_seconds() - start); 
+
+        rb_tree_free(generic); 
+
+        rb_int64_T typed = rb_int64_new(); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                rb_int64_insert(typed, keys[i]); 
+        report("int64", "insert", n, now_seconds() - start); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                found += rb_int64_contains(typed, keys[i]); 
+        report("int64", "search", n, now_seconds() - start); 
+
+        start = now_seconds(); 
+        for (size_t i = 0; i < n; i++) 
+                rb_int64_delete(typed, keys[i]); 
+        report("int64", "delete", n, now_seconds() - start); 
+
+        rb_int64_free(typed); 
+
+        /* keeps the searches from being optimized away */
+        if (found != 2 * n)
+                fprintf(stderr, "lookups missed %zu keys\n", 2 * n - found); 
+
+        free(keys); 
+        return 0; 
+}
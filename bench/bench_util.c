@@ -0,0 +1,391 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "bench_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+static const char *counter_names[BENCH_COUNTERS] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+}; 
+
+/* file descriptors of the open counters, -1 where a counter is not open */
+static int counter_fds[BENCH_COUNTERS] = { -1, -1, -1, -1, -1 }; 
+static bool counters_open = false; 
+
+struct bench_zipf {
+        size_t n; 
+        double *cdf;                    /* cdf[i] = P(rank <= i) */
+}; 
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/ 
+
+/* qsort comparison for uint64_t */
+int private_bench_compare_u64(const void *a, const void *b); 
+
+/* returns the p-th quantile (0 < p <= 1) of n sorted latencies */
+uint64_t private_bench_percentile(uint64_t *sorted, size_t n, double p); 
+
+/* resets and starts every open counter */
+void private_bench_perf_start(void); 
+
+/* stops every open counter and stores its total in the run */
+void private_bench_perf_stop(bench_run *run); 
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+uint64_t bench_now_ns(void)
+{
+        struct timespec ts; 
+
+        clock_gettime(CLOCK_MONOTONIC, &ts); 
+        return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec; 
+}
+
+int private_bench_compare_u64(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a; 
+        uint64_t y = *(const uint64_t *) b; 
+
+        return (x > y) - (x < y); 
+}
+
+uint64_t bench_clock_overhead_ns(void)
+{
+        uint64_t samples[1001]; 
+
+        for (int i = 0; i < 1001; i++) {
+                uint64_t start = bench_now_ns(); 
+                samples[i] = bench_now_ns() - start; 
+        }
+
+        qsort(samples, 1001, sizeof(uint64_t), &private_bench_compare_u64); 
+        return samples[500]; 
+}
+
+uint64_t bench_rand(uint64_t *state)
+{
+        uint64_t x = *state; 
+
+        x ^= x << 13; 
+        x ^= x >> 7; 
+        x ^= x << 17; 
+
+        return *state = x; 
+}
+
+bench_zipf bench_zipf_new(size_t n, double s)
+{
+        bench_zipf zipf = malloc(sizeof(*zipf)); 
+        double total = 0; 
+
+        assert(zipf != NULL && n > 0); 
+
+        zipf->n = n; 
+        zipf->cdf = malloc(n * sizeof(double)); 
+        assert(zipf->cdf != NULL); 
+
+        for (size_t i = 0; i < n; i++) {
+                total += 1.0 / pow((double) (i + 1), s); 
+                zipf->cdf[i] = total; 
+        }
+        for (size_t i = 0; i < n; i++) 
+                zipf->cdf[i] /= total; 
+
+        return zipf; 
+}
+
+size_t bench_zipf_next(bench_zipf zipf, uint64_t *state)
+{
+        double u = (bench_rand(state) >> 11) * (1.0 / 9007199254740992.0); 
+        size_t lo = 0; 
+        size_t hi = zipf->n - 1; 
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2; 
+
+                if (zipf->cdf[mid] < u)
+                        lo = mid + 1; 
+                else 
+                        hi = mid; 
+        }
+
+        return lo; 
+}
+
+void bench_zipf_free(bench_zipf zipf)
+{
+        free(zipf->cdf); 
+        free(zipf); 
+}
+
+#ifdef __linux__
+
+/* attr.type and attr.config for each counter */
+static const uint32_t counter_types[BENCH_COUNTERS] = {
+        PERF_TYPE_HARDWARE, 
+        PERF_TYPE_HARDWARE, 
+        PERF_TYPE_HW_CACHE, 
+        PERF_TYPE_HW_CACHE, 
+        PERF_TYPE_HARDWARE
+}; 
+
+static const uint64_t counter_configs[BENCH_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, 
+        PERF_COUNT_HW_INSTRUCTIONS, 
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) 
+                                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) 
+                               | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 
+        PERF_COUNT_HW_BRANCH_MISSES
+}; 
+
+int bench_perf_open(void)
+{
+        int opened = 0; 
+
+        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                struct perf_event_attr attr; 
+
+                memset(&attr, 0, sizeof(attr)); 
+                attr.size = sizeof(attr); 
+                attr.type = counter_types[i]; 
+                attr.config = counter_configs[i]; 
+                attr.disabled = 1; 
+                attr.exclude_kernel = 1; 
+                attr.exclude_hv = 1; 
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED 
+                                 | PERF_FORMAT_TOTAL_TIME_RUNNING; 
+
+                counter_fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); 
+
+                if (counter_fds[i] < 0) {
+                        fprintf(stderr, "perf counter %s unavailable: %s\n", 
+                                counter_names[i], strerror(errno)); 
+                        counter_fds[i] = -1; 
+                } else {
+                        opened++; 
+                }
+        }
+
+        counters_open = opened > 0; 
+
+        if (!counters_open)
+                fprintf(stderr, "no perf counters available, reporting timings only\n"); 
+
+        return opened; 
+}
+
+void bench_perf_close(void)
+{
+        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                if (counter_fds[i] >= 0)
+                        close(counter_fds[i]); 
+                counter_fds[i] = -1; 
+        }
+
+        counters_open = false; 
+}
+
+void private_bench_perf_start(void)
+{
+        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                if (counter_fds[i] >= 0) {
+                        ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0); 
+                        ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0); 
+                }
+        }
+}
+
+void private_bench_perf_stop(bench_run *run)
+{
+        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                /* value, time enabled, time running */
+                uint64_t values[3]; 
+
+                run->counter_valid[i] = false; 
+
+                if (counter_fds[i] < 0)
+                        continue; 
+
+                ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0); 
+
+                if (read(counter_fds[i], values, sizeof(values)) != sizeof(values) || 
+                    values[2] == 0)
+                        continue; 
+
+                /* scale up if the counter was multiplexed with others */
+                run->counters[i] = (double) values[0] * values[1] / values[2]; 
+                run->counter_valid[i] = true; 
+        }
+}
+
+#else
+
+int bench_perf_open(void)
+{
+        fprintf(stderr, "perf counters need linux, reporting timings only\n"); 
+        return 0; 
+}
+
+void bench_perf_close(void)
+{
+}
+
+void private_bench_perf_start(void)
+{
+}
+
+void private_bench_perf_stop(bench_run *run)
+{
+        for (int i = 0; i < BENCH_COUNTERS; i++) 
+                run->counter_valid[i] = false; 
+}
+
+#endif
+
+void bench_run_begin(bench_run *run, const char *workload, const char *keys, 
+                     size_t ops)
+{
+        run->workload = workload; 
+        run->keys = keys; 
+        run->ops = 0; 
+        run->capacity = ops; 
+        run->latencies = malloc((ops > 0 ? ops : 1) * sizeof(uint64_t)); 
+        assert(run->latencies != NULL); 
+        run->total_ns = 0; 
+
+        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                run->counters[i] = 0; 
+                run->counter_valid[i] = false; 
+        }
+
+        if (counters_open)
+                private_bench_perf_start(); 
+
+        run->start_ns = bench_now_ns(); 
+}
+
+void bench_run_end(bench_run *run)
+{
+        run->total_ns = bench_now_ns() - run->start_ns; 
+
+        if (counters_open)
+                private_bench_perf_stop(run); 
+
+        assert(run->ops <= run->capacity); 
+}
+
+uint64_t private_bench_percentile(uint64_t *sorted, size_t n, double p)
+{
+        if (n == 0)
+                return 0; 
+
+        size_t i = (size_t) ceil(p * n); 
+
+        return sorted[i == 0 ? 0 : i - 1]; 
+}
+
+void bench_report_open(bench_report *report, const char *json_path, 
+                       const char *bench_name, size_t n)
+{
+        report->json = NULL; 
+        report->runs = 0; 
+
+        printf("%s: n = %zu, clock overhead %llu ns per latency sample\n", 
+               bench_name, n, (unsigned long long) bench_clock_overhead_ns()); 
+        printf("%-22s %-7s %12s %14s %9s %9s %9s\n", "workload", "keys", "ops", 
+               "ops/sec", "p50 ns", "p99 ns", "p999 ns"); 
+
+        if (json_path != NULL) {
+                report->json = fopen(json_path, "w"); 
+                if (report->json == NULL) {
+                        perror(json_path); 
+                        exit(EXIT_FAILURE); 
+                }
+
+                fprintf(report->json, "{\n  \"benchmark\": \"%s\",\n"
+                        "  \"n\": %zu,\n  \"results\": [", bench_name, n); 
+        }
+}
+
+void bench_report_add(bench_report *report, bench_run *run)
+{
+        double seconds = run->total_ns / 1e9; 
+        double ops_per_sec = seconds > 0 ? run->ops / seconds : 0; 
+
+        qsort(run->latencies, run->ops, sizeof(uint64_t), &private_bench_compare_u64); 
+
+        unsigned long long p50 = private_bench_percentile(run->latencies, run->ops, 0.50); 
+        unsigned long long p99 = private_bench_percentile(run->latencies, run->ops, 0.99); 
+        unsigned long long p999 = private_bench_percentile(run->latencies, run->ops, 0.999); 
+
+        printf("%-22s %-7s %12zu %14.0f %9llu %9llu %9llu\n", run->workload, 
+               run->keys, run->ops, ops_per_sec, p50, p99, p999); 
+
+        if (counters_open) {
+                printf("%-30s per op:", ""); 
+                for (int i = 0; i < BENCH_COUNTERS; i++) {
+                        if (run->counter_valid[i] && run->ops > 0) 
+                                printf(" %s %.1f", counter_names[i], 
+                                       run->counters[i] / run->ops); 
+                        else 
+                                printf(" %s n/a", counter_names[i]); 
+                }
+                printf("\n"); 
+        }
+
+        if (report->json != NULL) {
+                fprintf(report->json, "%s\n    {\"workload\": \"%s\", \"keys\": \"%s\", "
+                        "\"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                        "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu", 
+                        report->runs == 0 ? "" : ",", run->workload, run->keys, 
+                        run->ops, seconds, ops_per_sec, p50, p99, p999); 
+
+                if (counters_open) {
+                        fprintf(report->json, ", \"per_op\": {"); 
+                        for (int i = 0; i < BENCH_COUNTERS; i++) {
+                                fprintf(report->json, "%s\"%s\": ", i == 0 ? "" : ", ", 
+                                        counter_names[i]); 
+                                if (run->counter_valid[i] && run->ops > 0)
+                                        fprintf(report->json, "%.3f", 
+                                                run->counters[i] / run->ops); 
+                                else 
+                                        fprintf(report->json, "null"); 
+                        }
+                        fprintf(report->json, "}"); 
+                }
+
+                fprintf(report->json, "}"); 
+        }
+
+        report->runs++; 
+        free(run->latencies); 
+        run->latencies = NULL; 
+}
+
+void bench_report_close(bench_report *report)
+{
+        if (report->json != NULL) {
+                fprintf(report->json, "\n  ]\n}\n"); 
+                fclose(report->json); 
+                report->json = NULL; 
+        }
+}
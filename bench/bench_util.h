@@ -0,0 +1,151 @@
+/**********************************************************************
+ * bench_util.h                                                       *
+ *                                                                    *
+ * Timing, latency percentiles and reporting shared by the benchmarks *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * hardware counters which bench_perf_open tries to open. any of them may 
+ * be unavailable, e.g. in a container or a virtual machine
+ */
+enum bench_counter {
+        BENCH_CYCLES, 
+        BENCH_INSTRUCTIONS, 
+        BENCH_L1D_MISSES, 
+        BENCH_LLC_MISSES, 
+        BENCH_BRANCH_MISSES, 
+        BENCH_COUNTERS
+}; 
+
+/*
+ * a run of one workload. latencies are recorded per operation, in 
+ * nanoseconds, and include the cost of reading the clock (see 
+ * bench_clock_overhead_ns). when counters are open, their totals over the 
+ * run are kept in counters, with counter_valid telling which were read
+ */
+typedef struct bench_run {
+        const char *workload; 
+        const char *keys;               /* "int" or "string" */
+        size_t ops; 
+        size_t capacity;                /* room in latencies */
+        uint64_t *latencies; 
+        uint64_t start_ns; 
+        uint64_t total_ns; 
+        double counters[BENCH_COUNTERS]; 
+        bool counter_valid[BENCH_COUNTERS]; 
+} bench_run; 
+
+/*
+ * a report collects finished runs, printing each as text as it arrives and
+ * optionally writing them all as JSON when closed
+ */
+typedef struct bench_report {
+        FILE *json;                     /* NULL if no JSON was requested */
+        size_t runs; 
+} bench_report; 
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * bench_now_ns
+ * 
+ * returns a monotonic timestamp in nanoseconds
+ */
+uint64_t bench_now_ns(void); 
+
+/*
+ * bench_clock_overhead_ns
+ * 
+ * returns the median cost of one bench_now_ns call, which every recorded 
+ * latency includes
+ */
+uint64_t bench_clock_overhead_ns(void); 
+
+/*
+ * bench_rand
+ * 
+ * advances a xorshift64 state (which must not be zero) and returns the 
+ * next value. used instead of rand so runs are repeatable everywhere
+ */
+uint64_t bench_rand(uint64_t *state); 
+
+/*
+ * bench_zipf_new / bench_zipf_next / bench_zipf_free
+ * 
+ * draws ranks in [0, n) with a Zipf distribution of exponent s, so rank 0 
+ * is the most popular. the table takes O(n) space and each draw O(log n)
+ */
+typedef struct bench_zipf *bench_zipf; 
+
+bench_zipf bench_zipf_new(size_t n, double s); 
+size_t bench_zipf_next(bench_zipf zipf, uint64_t *state); 
+void bench_zipf_free(bench_zipf zipf); 
+
+/*
+ * bench_perf_open / bench_perf_close
+ * 
+ * opens the hardware counters with perf_event_open, counting user space 
+ * only. every run begun afterwards is measured, and reported per 
+ * operation. counters which cannot be opened are skipped; returns the 
+ * number which were opened, after printing why any were not. on systems 
+ * other than linux no counters are ever opened
+ */
+int bench_perf_open(void); 
+void bench_perf_close(void); 
+
+/*
+ * bench_run_begin / bench_run_end
+ * 
+ * a run is begun with room for ops latencies, each operation is wrapped 
+ * in bench_op_begin / bench_op_end, and the run is ended, which fills in 
+ * total_ns. bench_run_end may be given fewer ops than were reserved. the 
+ * counters, if open, run from bench_run_begin to bench_run_end
+ */
+void bench_run_begin(bench_run *run, const char *workload, const char *keys, 
+                     size_t ops); 
+void bench_run_end(bench_run *run); 
+
+static inline uint64_t bench_op_begin(void)
+{
+        return bench_now_ns(); 
+}
+
+static inline void bench_op_end(bench_run *run, uint64_t op_start)
+{
+        run->latencies[run->ops++] = bench_now_ns() - op_start; 
+}
+
+/*
+ * bench_report_open / bench_report_add / bench_report_close
+ * 
+ * prints a header, then one line per run with its throughput and 
+ * p50/p99/p999 latencies, followed by its counters per operation if any 
+ * were open. if json_path is not NULL the same figures are written there 
+ * as a JSON document, with null for counters that could not be read. 
+ * bench_report_add frees the run's latencies
+ */
+void bench_report_open(bench_report *report, const char *json_path, 
+                       const char *bench_name, size_t n); 
+void bench_report_add(bench_report *report, bench_run *run); 
+void bench_report_close(bench_report *report); 
+
+#endif
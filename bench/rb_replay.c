@@ -0,0 +1,244 @@
+/*
+ * replays a trace recorded with rb_trace_start (see rb_tree.h) against a 
+ * fresh tree as fast as possible, reporting throughput and latency 
+ * percentiles per operation and overall. values are the byte strings 
+ * recorded in the trace, ordered bytewise
+ * 
+ * usage: rb_replay.out trace [--json path] [--perf] [--repeat k]
+ */
+
+#include "bench_util.h"
+#include "../src/rb_tree.h"
+
+#include <string.h>
+
+#define OP_KINDS (RB_TRACE_MAP_POSTORDER + 1)
+
+struct replay_key {
+        size_t length; 
+        unsigned char bytes[]; 
+}; 
+
+struct replay_op {
+        enum rb_trace_op op; 
+        struct replay_key *key;         /* NULL for ops without a value */
+}; 
+
+struct replay_trace {
+        size_t n; 
+        struct replay_op *ops; 
+        size_t per_kind[OP_KINDS]; 
+}; 
+
+static const char *op_names[OP_KINDS] = {
+        "", "insert", "delete", "search", "successor", "predecessor", 
+        "map_inorder", "map_preorder", "map_postorder"
+}; 
+
+int key_comparison(void *val_one, void *val_two)
+{
+        struct replay_key *a = val_one; 
+        struct replay_key *b = val_two; 
+        size_t shorter = a->length < b->length ? a->length : b->length; 
+        int c = memcmp(a->bytes, b->bytes, shorter); 
+
+        if (c != 0)
+                return c; 
+
+        return (a->length > b->length) - (a->length < b->length); 
+}
+
+void ignore_value(void *value, int depth, void *cl)
+{
+        (void) value; 
+        (void) depth; 
+        (void) cl; 
+}
+
+/* reads the whole trace into memory, exiting with a message if it is malformed */
+void load_trace(const char *path, struct replay_trace *trace)
+{
+        FILE *in = fopen(path, "rb"); 
+        char magic[RB_TRACE_MAGIC_LENGTH]; 
+        size_t capacity = 1024; 
+        int c; 
+
+        if (in == NULL) {
+                perror(path); 
+                exit(EXIT_FAILURE); 
+        }
+
+        if (fread(magic, 1, RB_TRACE_MAGIC_LENGTH, in) != RB_TRACE_MAGIC_LENGTH || 
+            memcmp(magic, RB_TRACE_MAGIC, RB_TRACE_MAGIC_LENGTH) != 0) {
+                fprintf(stderr, "%s: not an rb_tree trace\n", path); 
+                exit(EXIT_FAILURE); 
+        }
+
+        memset(trace, 0, sizeof(*trace)); 
+        trace->ops = malloc(capacity * sizeof(struct replay_op)); 
+        assert(trace->ops != NULL); 
+
+        while ((c = getc(in)) != EOF) {
+                struct replay_op op = { (enum rb_trace_op) c, NULL }; 
+
+                if (c < RB_TRACE_INSERT || c >= OP_KINDS) {
+                        fprintf(stderr, "%s: unknown op %d after %zu records\n", 
+                                path, c, trace->n); 
+                        exit(EXIT_FAILURE); 
+                }
+
+                if (c <= RB_TRACE_PREDECESSOR) {
+                        size_t length = 0; 
+                        int shift = 0; 
+                        int byte; 
+
+                        do {
+                                byte = getc(in); 
+                                if (byte == EOF || shift > 63) {
+                                        fprintf(stderr, "%s: truncated record\n", path); 
+                                        exit(EXIT_FAILURE); 
+                                }
+                                length |= (size_t) (byte & 0x7f) << shift; 
+                                shift += 7; 
+                        } while (byte & 0x80); 
+
+                        op.key = malloc(sizeof(struct replay_key) + length); 
+                        assert(op.key != NULL); 
+                        op.key->length = length; 
+
+                        if (fread(op.key->bytes, 1, length, in) != length) {
+                                fprintf(stderr, "%s: truncated record\n", path); 
+                                exit(EXIT_FAILURE); 
+                        }
+                }
+
+                if (trace->n == capacity) {
+                        capacity *= 2; 
+                        trace->ops = realloc(trace->ops, capacity * sizeof(struct replay_op)); 
+                        assert(trace->ops != NULL); 
+                }
+
+                trace->ops[trace->n++] = op; 
+                trace->per_kind[c]++; 
+        }
+
+        fclose(in); 
+}
+
+void free_trace(struct replay_trace *trace)
+{
+        for (size_t i = 0; i < trace->n; i++) 
+                free(trace->ops[i].key); 
+
+        free(trace->ops); 
+}
+
+int main(int argc, char *argv[])
+{
+        const char *trace_path = NULL; 
+        const char *json_path = NULL; 
+        bool perf = false; 
+        long repeat = 1; 
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+                        json_path = argv[++i]; 
+                } else if (strcmp(argv[i], "--perf") == 0) {
+                        perf = true; 
+                } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+                        repeat = strtol(argv[++i], NULL, 10); 
+                } else if (trace_path == NULL && argv[i][0] != '-') {
+                        trace_path = argv[i]; 
+                } else {
+                        trace_path = NULL; 
+                        break; 
+                }
+        }
+
+        if (trace_path == NULL || repeat < 1) {
+                fprintf(stderr, "usage: %s trace [--json path] [--perf] [--repeat k]\n", 
+                        argv[0]); 
+                return EXIT_FAILURE; 
+        }
+
+        struct replay_trace trace; 
+        bench_report report; 
+
+        load_trace(trace_path, &trace); 
+
+        if (perf)
+                bench_perf_open(); 
+
+        bench_report_open(&report, json_path, "rb_replay", trace.n); 
+
+        /* each repetition replays the trace into a fresh tree */
+        for (long r = 0; r < repeat; r++) {
+                RedBlack_T tree = rb_new(&key_comparison); 
+                bench_run runs[OP_KINDS]; 
+                bench_run total; 
+
+                for (int k = RB_TRACE_INSERT; k < OP_KINDS; k++) 
+                        bench_run_begin(&runs[k], op_names[k], "bytes", trace.per_kind[k]); 
+                bench_run_begin(&total, "all", "bytes", trace.n); 
+
+                for (size_t i = 0; i < trace.n; i++) {
+                        struct replay_op *op = &trace.ops[i]; 
+                        uint64_t t = bench_op_begin(); 
+
+                        switch (op->op) {
+                        case RB_TRACE_INSERT: 
+                                rb_insert_value(tree, op->key); 
+                                break; 
+                        case RB_TRACE_DELETE: 
+                                rb_delete_value(tree, op->key); 
+                                break; 
+                        case RB_TRACE_SEARCH: 
+                                rb_search(tree, op->key); 
+                                break; 
+                        case RB_TRACE_SUCCESSOR: 
+                                rb_successor_of_value(tree, op->key); 
+                                break; 
+                        case RB_TRACE_PREDECESSOR: 
+                                rb_predecessor_of_value(tree, op->key); 
+                                break; 
+                        case RB_TRACE_MAP_INORDER: 
+                                rb_map_inorder(tree, &ignore_value, NULL); 
+                                break; 
+                        case RB_TRACE_MAP_PREORDER: 
+                                rb_map_preorder(tree, &ignore_value, NULL); 
+                                break; 
+                        case RB_TRACE_MAP_POSTORDER: 
+                                rb_map_postorder(tree, &ignore_value, NULL); 
+                                break; 
+                        }
+
+                        uint64_t elapsed = bench_now_ns() - t; 
+                        bench_run *run = &runs[op->op]; 
+
+                        run->latencies[run->ops++] = elapsed; 
+                        total.latencies[total.ops++] = elapsed; 
+                }
+
+                bench_run_end(&total); 
+                for (int k = RB_TRACE_INSERT; k < OP_KINDS; k++) {
+                        /* per op totals are the sum of their latencies */
+                        runs[k].total_ns = 0; 
+                        for (size_t i = 0; i < runs[k].ops; i++) 
+                                runs[k].total_ns += runs[k].latencies[i]; 
+
+                        if (runs[k].ops > 0)
+                                bench_report_add(&report, &runs[k]); 
+                        else 
+                                free(runs[k].latencies); 
+                }
+                bench_report_add(&report, &total); 
+
+                rb_tree_free(tree); 
+        }
+
+        bench_report_close(&report); 
+        bench_perf_close(); 
+        free_trace(&trace); 
+
+        return 0; 
+}
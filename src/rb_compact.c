@@ -0,0 +1,574 @@
+/**********************************************************************
+ * rb_compact.c                                                       *
+ *                                                                    *
+ * Implementation of the compact red black tree                       *
+ **********************************************************************/
+
+/*
+ * compact nodes have no parent links, so inserts and deletes walk down
+ * from the root keeping the path on a stack, and fix the tree up by
+ * popping it. otherwise the rebalancing follows rb_tree.c case for case:
+ * the insert loop is rb_node_insert_fixup's, and a delete is split, as
+ * there, into private_rb_compact_unlink (rb_node_unlink) and
+ * private_rb_compact_delete_fixup (rb_node_erase_fixup), with the same
+ * cases in the same order, written once for both directions
+ */
+
+#include "rb_compact.h"
+#include <assert.h>
+#include <string.h>
+
+/*** MACRO DEFINITIONS ***/
+
+#define RED 0
+#define BLACK 1
+
+/*
+ * slot 0 of the node array is the nil node. it is never handed out, never
+ * written after the array is created, and is therefore always black
+ */
+#define NIL 0
+
+#define RB_COMPACT_MIN_SLOTS 64
+
+/*
+ * no path in a tree of RB_COMPACT_MAX_NODES nodes is longer than 62 nodes;
+ * deletion may push one extra level while rebalancing
+ */
+#define RB_COMPACT_MAX_DEPTH 66
+
+#define LEFT(t, i) ((t)->nodes[i].left)
+#define RIGHT(t, i) ((t)->nodes[i].right_color >> 1)
+#define COLOR(t, i) ((int) ((t)->nodes[i].right_color & 1))
+#define CHILD(t, i, dir) ((dir) == 0 ? LEFT(t, i) : RIGHT(t, i))
+
+#define SET_LEFT(t, i, c) ((t)->nodes[i].left = (c))
+#define SET_RIGHT(t, i, c) ((t)->nodes[i].right_color = ((uint32_t) (c) << 1) \
+                                | ((t)->nodes[i].right_color & 1))
+#define SET_COLOR(t, i, c) ((t)->nodes[i].right_color = \
+                                ((t)->nodes[i].right_color & ~(uint32_t) 1) \
+                                | (uint32_t) (c))
+
+typedef int (*Compare)(void *val1, void *val2);
+
+typedef struct CompactNode {
+        void *value;
+        uint32_t left;
+        uint32_t right_color;   /* right child index << 1 | color */
+} CompactNode;
+
+struct rb_compact {
+        CompactNode *nodes;
+        uint32_t capacity;      /* slots in nodes, including the nil slot */
+        uint32_t used;          /* slots handed out so far, including nil */
+        uint32_t free_slots;    /* released slots, linked through left */
+        uint32_t root;
+        size_t count;
+        Compare comparison_func;
+};
+
+typedef RedBlack_Compact_T T;
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/
+
+/*
+ * private_rb_compact_grow
+ *
+ * reallocates the node array so that it has at least capacity slots,
+ * including the nil slot
+ *
+ * CREs         n/a
+ * UREs         system out of memory
+ *
+ * @param       T - tree whose array is grown
+ * @param       size_t - minimum number of slots
+ * @return      n/a
+ */
+void private_rb_compact_grow(T tree, size_t capacity);
+
+/*
+ * private_rb_compact_alloc_slot
+ *
+ * returns the index of an unused, red slot holding value, reusing released
+ * slots first. may move the node array
+ *
+ * CREs         n/a
+ * UREs         system out of memory
+ *
+ * @param       T - tree which owns the slot
+ * @param       void * - value to store in the slot
+ * @return      uint32_t - index of the slot
+ */
+uint32_t private_rb_compact_alloc_slot(T tree, void *value);
+
+/*
+ * private_rb_compact_set_child
+ *
+ * makes child the dir child of parent, or the root if parent is NIL
+ *
+ * CREs         n/a
+ * UREs         n/a
+ *
+ * @param       T - tree being modified
+ * @param       uint32_t - parent slot, or NIL
+ * @param       int - 0 for the left child, 1 for the right child
+ * @param       uint32_t - new child
+ * @return      n/a
+ */
+void private_rb_compact_set_child(T tree, uint32_t parent, int dir,
+                                  uint32_t child);
+
+/*
+ * private_rb_compact_rotate
+ *
+ * rotates the subtree rooted at n in direction dir (0 rotates left, moving
+ * n's right child up). the caller relinks the returned subtree root into
+ * n's former parent
+ *
+ * CREs         n/a
+ * UREs         n/a
+ *
+ * @param       T - tree being modified
+ * @param       uint32_t - root of the subtree to rotate
+ * @param       int - direction of the rotation
+ * @return      uint32_t - new root of the subtree
+ */
+uint32_t private_rb_compact_rotate(T tree, uint32_t n, int dir);
+
+/*
+ * private_rb_compact_unlink
+ *
+ * helper function for rb_compact_delete. takes slot n, reached by the
+ * depth steps on path and dirs, out of the tree and releases it. a node
+ * with two children takes its successor's value and the successor is
+ * removed instead, extending the path down to it. the child which took
+ * the removed slot's place is stored to culprit
+ *
+ * CREs         n/a
+ * UREs         path does not lead to n
+ *
+ * @param       T - tree being modified
+ * @param       uint32_t - slot to remove
+ * @param       uint32_t *, int * - the path to n, as in rb_compact_insert,
+ *                      with room for RB_COMPACT_MAX_DEPTH steps
+ * @param       int * - number of steps on the path; updated
+ * @param       uint32_t * - set to the slot in the removed position
+ * @return      bool - true if a black node was removed, and
+ *                      private_rb_compact_delete_fixup must follow
+ */
+bool private_rb_compact_unlink(T tree, uint32_t n, uint32_t *path, int *dirs,
+                               int *depth, uint32_t *culprit);
+
+/*
+ * private_rb_compact_delete_fixup
+ *
+ * helper function for rb_compact_delete. restores the red black
+ * properties after private_rb_compact_unlink removed a black node from
+ * above culprit
+ *
+ * CREs         n/a
+ * UREs         n/a
+ *
+ * @param       T - tree being modified
+ * @param       uint32_t - slot in the removed position (may be NIL)
+ * @param       uint32_t *, int * - the path to that position
+ * @param       int - number of steps on the path
+ * @return      n/a
+ */
+void private_rb_compact_delete_fixup(T tree, uint32_t culprit, uint32_t *path,
+                                     int *dirs, int depth);
+
+/*
+ * private_rb_compact_inorder_map
+ *
+ * private helper function for rb_compact_map_inorder
+ *
+ * CREs         n/a
+ * UREs         n/a
+ *
+ * @param       T - tree being walked
+ * @param       uint32_t - root of the current subtree
+ * @param       int - the current depth in the tree
+ * @param       void - function to be applied to every node
+ * @param       void * - closure for func_to_apply
+ * @return      n/a
+ */
+void private_rb_compact_inorder_map(T tree, uint32_t root, int depth,
+                                    void func_to_apply(void *value, int depth, void *cl),
+                                    void *cl);
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/
+
+T rb_compact_new(void *comparison_func)
+{
+        T tree = malloc(sizeof(struct rb_compact));
+
+        tree->nodes = NULL;
+        tree->capacity = 0;
+        tree->used = 0;
+        tree->free_slots = NIL;
+        tree->root = NIL;
+        tree->count = 0;
+
+        if (comparison_func == NULL)
+                tree->comparison_func = (Compare) &strcmp;
+        else
+                tree->comparison_func = (Compare) comparison_func;
+
+        return tree;
+}
+
+void rb_compact_free(T tree)
+{
+        assert(tree != NULL);
+
+        free(tree->nodes);
+        free(tree);
+}
+
+void rb_compact_reserve(T tree, size_t capacity)
+{
+        assert(tree != NULL && capacity <= RB_COMPACT_MAX_NODES);
+
+        if (capacity + 1 > tree->capacity)
+                private_rb_compact_grow(tree, capacity + 1);
+}
+
+bool rb_compact_is_empty(T tree)
+{
+        assert(tree != NULL);
+
+        return tree->root == NIL;
+}
+
+size_t rb_compact_size(T tree)
+{
+        assert(tree != NULL);
+
+        return tree->count;
+}
+
+void private_rb_compact_grow(T tree, size_t capacity)
+{
+        bool first = tree->nodes == NULL;
+
+        tree->nodes = realloc(tree->nodes, capacity * sizeof(CompactNode));
+        tree->capacity = (uint32_t) capacity;
+
+        if (first) {
+                tree->nodes[NIL].value = NULL;
+                tree->nodes[NIL].left = NIL;
+                tree->nodes[NIL].right_color = BLACK;
+                tree->used = 1;
+        }
+}
+
+uint32_t private_rb_compact_alloc_slot(T tree, void *value)
+{
+        uint32_t slot = tree->free_slots;
+
+        if (slot != NIL) {
+                tree->free_slots = LEFT(tree, slot);
+        } else {
+                if (tree->used == tree->capacity) {
+                        size_t capacity = (size_t) tree->capacity * 2;
+
+                        if (capacity < RB_COMPACT_MIN_SLOTS)
+                                capacity = RB_COMPACT_MIN_SLOTS;
+                        if (capacity > (size_t) RB_COMPACT_MAX_NODES + 1)
+                                capacity = (size_t) RB_COMPACT_MAX_NODES + 1;
+
+                        private_rb_compact_grow(tree, capacity);
+                }
+
+                slot = tree->used++;
+        }
+
+        tree->nodes[slot].value = value;
+        tree->nodes[slot].left = NIL;
+        tree->nodes[slot].right_color = RED;
+
+        return slot;
+}
+
+void private_rb_compact_set_child(T tree, uint32_t parent, int dir,
+                                  uint32_t child)
+{
+        if (parent == NIL)
+                tree->root = child;
+        else if (dir == 0)
+                SET_LEFT(tree, parent, child);
+        else
+                SET_RIGHT(tree, parent, child);
+}
+
+uint32_t private_rb_compact_rotate(T tree, uint32_t n, int dir)
+{
+        uint32_t c = CHILD(tree, n, !dir);
+
+        private_rb_compact_set_child(tree, n, !dir, CHILD(tree, c, dir));
+        private_rb_compact_set_child(tree, c, dir, n);
+
+        return c;
+}
+
+void rb_compact_insert(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL);
+        assert(tree->count < RB_COMPACT_MAX_NODES);
+
+        uint32_t path[RB_COMPACT_MAX_DEPTH];
+        int dirs[RB_COMPACT_MAX_DEPTH];
+        int depth = 0;
+
+        uint32_t curr = tree->root;
+
+        while (curr != NIL) {
+                int dir = tree->comparison_func(value, tree->nodes[curr].value) < 0 ? 0 : 1;
+
+                path[depth] = curr;
+                dirs[depth++] = dir;
+                curr = CHILD(tree, curr, dir);
+        }
+
+        uint32_t culprit = private_rb_compact_alloc_slot(tree, value);
+
+        if (depth == 0)
+                tree->root = culprit;
+        else
+                private_rb_compact_set_child(tree, path[depth - 1], dirs[depth - 1], culprit);
+
+        tree->count++;
+
+        while (depth >= 2 && COLOR(tree, path[depth - 1]) == RED) {
+                uint32_t parent_node = path[depth - 1];
+                uint32_t grand_parent_node = path[depth - 2];
+                int parent_dir = dirs[depth - 2];
+                uint32_t uncle = CHILD(tree, grand_parent_node, !parent_dir);
+
+                if (COLOR(tree, uncle) == RED) {
+                        SET_COLOR(tree, parent_node, BLACK);
+                        SET_COLOR(tree, uncle, BLACK);
+                        SET_COLOR(tree, grand_parent_node, RED);
+
+                        culprit = grand_parent_node;
+                        depth -= 2;
+                        continue;
+                }
+
+                if (dirs[depth - 1] != parent_dir) {
+                        private_rb_compact_set_child(tree, grand_parent_node, parent_dir,
+                                private_rb_compact_rotate(tree, parent_node, parent_dir));
+                        parent_node = culprit;
+                }
+
+                uint32_t great = depth >= 3 ? path[depth - 3] : NIL;
+                int great_dir = depth >= 3 ? dirs[depth - 3] : 0;
+
+                private_rb_compact_set_child(tree, great, great_dir,
+                        private_rb_compact_rotate(tree, grand_parent_node, !parent_dir));
+
+                SET_COLOR(tree, parent_node, BLACK);
+                SET_COLOR(tree, grand_parent_node, RED);
+                break;
+        }
+
+        SET_COLOR(tree, tree->root, BLACK);
+}
+
+void *rb_compact_search(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL);
+
+        uint32_t curr = tree->root;
+
+        while (curr != NIL) {
+                int c = tree->comparison_func(value, tree->nodes[curr].value);
+
+                if (c == 0)
+                        return tree->nodes[curr].value;
+
+                curr = c < 0 ? LEFT(tree, curr) : RIGHT(tree, curr);
+        }
+
+        return NULL;
+}
+
+bool rb_compact_delete(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL);
+
+        uint32_t path[RB_COMPACT_MAX_DEPTH];
+        int dirs[RB_COMPACT_MAX_DEPTH];
+        int depth = 0;
+
+        uint32_t curr = tree->root;
+
+        while (curr != NIL) {
+                int c = tree->comparison_func(value, tree->nodes[curr].value);
+
+                if (c == 0)
+                        break;
+
+                path[depth] = curr;
+                dirs[depth++] = c < 0 ? 0 : 1;
+                curr = CHILD(tree, curr, c < 0 ? 0 : 1);
+        }
+
+        if (curr == NIL)
+                return false;
+
+        uint32_t culprit;
+
+        if (private_rb_compact_unlink(tree, curr, path, dirs, &depth, &culprit))
+                private_rb_compact_delete_fixup(tree, culprit, path, dirs, depth);
+
+        return true;
+}
+
+bool private_rb_compact_unlink(T tree, uint32_t n, uint32_t *path, int *dirs,
+                               int *depth, uint32_t *culprit)
+{
+        if (LEFT(tree, n) != NIL && RIGHT(tree, n) != NIL) {
+                uint32_t target = n;
+
+                path[*depth] = n;
+                dirs[(*depth)++] = 1;
+                n = RIGHT(tree, n);
+
+                while (LEFT(tree, n) != NIL) {
+                        path[*depth] = n;
+                        dirs[(*depth)++] = 0;
+                        n = LEFT(tree, n);
+                }
+
+                tree->nodes[target].value = tree->nodes[n].value;
+        }
+
+        int removed_color = COLOR(tree, n);
+
+        *culprit = LEFT(tree, n) != NIL ? LEFT(tree, n) : RIGHT(tree, n);
+        private_rb_compact_set_child(tree, *depth > 0 ? path[*depth - 1] : NIL,
+                                     *depth > 0 ? dirs[*depth - 1] : 0, *culprit);
+
+        SET_LEFT(tree, n, tree->free_slots);
+        tree->free_slots = n;
+        tree->count--;
+
+        return removed_color == BLACK;
+}
+
+void private_rb_compact_delete_fixup(T tree, uint32_t culprit, uint32_t *path,
+                                     int *dirs, int depth)
+{
+        /* the dirs[depth - 1] child of path[depth - 1], culprit, is short one black */
+        while (depth > 0 && COLOR(tree, culprit) == BLACK) {
+                uint32_t parent = path[depth - 1];
+                int dir = dirs[depth - 1];
+                uint32_t sibling = CHILD(tree, parent, !dir);
+
+                if (COLOR(tree, sibling) == RED) {
+                        SET_COLOR(tree, sibling, BLACK);
+                        SET_COLOR(tree, parent, RED);
+                        private_rb_compact_set_child(tree,
+                                depth > 1 ? path[depth - 2] : NIL,
+                                depth > 1 ? dirs[depth - 2] : 0,
+                                private_rb_compact_rotate(tree, parent, dir));
+
+                        path[depth - 1] = sibling;
+                        path[depth] = parent;
+                        dirs[depth++] = dir;
+
+                        sibling = CHILD(tree, parent, !dir);
+                }
+
+                uint32_t near = CHILD(tree, sibling, dir);
+                uint32_t far = CHILD(tree, sibling, !dir);
+
+                if (COLOR(tree, near) == BLACK && COLOR(tree, far) == BLACK) {
+                        SET_COLOR(tree, sibling, RED);
+                        culprit = parent;
+                        depth--;
+                } else {
+                        if (COLOR(tree, far) == BLACK) {
+                                SET_COLOR(tree, near, BLACK);
+                                SET_COLOR(tree, sibling, RED);
+                                private_rb_compact_set_child(tree, parent, !dir,
+                                        private_rb_compact_rotate(tree, sibling, !dir));
+
+                                far = sibling;
+                                sibling = near;
+                        }
+
+                        SET_COLOR(tree, sibling, COLOR(tree, parent));
+                        SET_COLOR(tree, parent, BLACK);
+                        SET_COLOR(tree, far, BLACK);
+                        private_rb_compact_set_child(tree,
+                                depth > 1 ? path[depth - 2] : NIL,
+                                depth > 1 ? dirs[depth - 2] : 0,
+                                private_rb_compact_rotate(tree, parent, dir));
+
+                        culprit = tree->root;
+                        depth = 0;
+                }
+        }
+
+        /* the nil slot is never written */
+        if (culprit != NIL)
+                SET_COLOR(tree, culprit, BLACK);
+}
+
+void *rb_compact_minimum(T tree)
+{
+        assert(tree != NULL);
+
+        uint32_t curr = tree->root;
+
+        if (curr == NIL)
+                return NULL;
+
+        while (LEFT(tree, curr) != NIL)
+                curr = LEFT(tree, curr);
+
+        return tree->nodes[curr].value;
+}
+
+void *rb_compact_maximum(T tree)
+{
+        assert(tree != NULL);
+
+        uint32_t curr = tree->root;
+
+        if (curr == NIL)
+                return NULL;
+
+        while (RIGHT(tree, curr) != NIL)
+                curr = RIGHT(tree, curr);
+
+        return tree->nodes[curr].value;
+}
+
+void rb_compact_map_inorder(T tree,
+                            void func_to_apply(void *value, int depth, void *cl),
+                            void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL);
+
+        private_rb_compact_inorder_map(tree, tree->root, 0, func_to_apply, cl);
+}
+
+void private_rb_compact_inorder_map(T tree, uint32_t root, int depth,
+                                    void func_to_apply(void *value, int depth, void *cl),
+                                    void *cl)
+{
+        if (root == NIL)
+                return;
+
+        private_rb_compact_inorder_map(tree, LEFT(tree, root), depth + 1, func_to_apply, cl);
+        func_to_apply(tree->nodes[root].value, depth, cl);
+        private_rb_compact_inorder_map(tree, RIGHT(tree, root), depth + 1, func_to_apply, cl);
+}
@@ -0,0 +1,200 @@
+/**********************************************************************
+ * rb_compact.h                                                       *
+ *                                                                    *
+ * Interface for a compact polymorphic red black tree whose nodes     *
+ * live in a single array and are linked by 32-bit indices            *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_COMPACT_H
+#define RB_COMPACT_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * a compact tree stores each node as a value pointer plus two 32-bit child
+ * indices, with the color folded into one of them (16 bytes per node on
+ * 64-bit systems). nodes have no parent links; insertions and deletions
+ * keep the path from the root on a small stack instead. a compact tree
+ * holds at most RB_COMPACT_MAX_NODES values
+ */
+typedef struct rb_compact *RedBlack_Compact_T;
+
+#define RB_COMPACT_MAX_NODES ((uint32_t) 0x7ffffffe)
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * rb_compact_new
+ *
+ * returns a pointer to a new, empty compact red black tree
+ *
+ * CREs         n/a
+ * UREs         system out of memory
+ *
+ * @param       void * - pointer to a comparison function, as described for
+ *                              rb_new. if NULL is passed, strcmp is assumed
+ * @return      pointer to empty compact tree
+ */
+RedBlack_Compact_T rb_compact_new(void *comparison_func);
+
+/*
+ * rb_compact_free
+ *
+ * deallocates the tree and its node array
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - the tree to be freed
+ * @return      n/a
+ */
+void rb_compact_free(RedBlack_Compact_T tree);
+
+/*
+ * rb_compact_reserve
+ *
+ * grows the node array so that at least capacity values can be stored
+ * without further allocation
+ *
+ * CREs         tree == NULL
+ *              capacity > RB_COMPACT_MAX_NODES
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_Compact_T - tree to grow
+ * @param       size_t - number of values to make room for
+ * @return      n/a
+ */
+void rb_compact_reserve(RedBlack_Compact_T tree, size_t capacity);
+
+/*
+ * rb_compact_is_empty
+ *
+ * returns true if the tree is empty, and false otherwise
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree to be checked
+ * @return      bool - true if empty, false otherwise
+ */
+bool rb_compact_is_empty(RedBlack_Compact_T tree);
+
+/*
+ * rb_compact_size
+ *
+ * returns the number of values stored in the tree
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree to be measured
+ * @return      size_t - number of values
+ */
+size_t rb_compact_size(RedBlack_Compact_T tree);
+
+/*
+ * rb_compact_insert
+ *
+ * inserts the value into the tree. duplicates are allowed
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ *              tree already holds RB_COMPACT_MAX_NODES values
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_Compact_T - tree in which to insert value
+ * @param       void * - a pointer to any item to be inserted
+ * @return      n/a
+ */
+void rb_compact_insert(RedBlack_Compact_T tree, void *value);
+
+/*
+ * rb_compact_search
+ *
+ * returns a pointer to the stored value equal to value, or NULL if there
+ * is none
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree in which to search
+ * @param       void * - value to search for
+ * @return      void * - pointer to the value that was found
+ */
+void *rb_compact_search(RedBlack_Compact_T tree, void *value);
+
+/*
+ * rb_compact_delete
+ *
+ * deletes one stored value equal to value. has no effect if there is none
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree to delete from
+ * @param       void * - value to be deleted
+ * @return      bool - true if a value was deleted
+ */
+bool rb_compact_delete(RedBlack_Compact_T tree, void *value);
+
+/*
+ * rb_compact_minimum
+ *
+ * returns the minimum value stored in the tree, or NULL if it is empty
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree to be searched
+ * @return      void * - pointer to min value
+ */
+void *rb_compact_minimum(RedBlack_Compact_T tree);
+
+/*
+ * rb_compact_maximum
+ *
+ * returns the maximum value stored in the tree, or NULL if it is empty
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Compact_T - tree to be searched
+ * @return      void * - pointer to max value
+ */
+void *rb_compact_maximum(RedBlack_Compact_T tree);
+
+/*
+ * rb_compact_map_inorder
+ *
+ * applies the function to every value stored in the tree via an inorder
+ * walk. see rb_map_inorder
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply changes the order of the values
+ *
+ * @param       RedBlack_Compact_T - tree to apply function to
+ * @param       void * - pointer to a function
+ * @param       void * - a closure item
+ * @return      n/a
+ */
+void rb_compact_map_inorder(RedBlack_Compact_T tree,
+                            void func_to_apply(void *value, int depth, void *cl),
+                            void *cl);
+
+#endif
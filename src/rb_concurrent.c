@@ -0,0 +1,308 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "rb_concurrent.h"
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*** MACRO DEFINITIONS ***/
+
+#define CACHE_LINE 64
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/* one reader lock, alone on its cache lines */
+typedef union ReaderSlot {
+        pthread_rwlock_t lock; 
+        char padding[2 * CACHE_LINE]; 
+} ReaderSlot; 
+
+struct rb_concurrent {
+        RedBlack_T tree; 
+        size_t slot_count; 
+        ReaderSlot *slots;      /* slot_count locks, cache line aligned */
+}; 
+
+typedef RedBlack_Concurrent_T T; 
+
+/* 
+ * each thread is numbered on its first read, and reads through slot 
+ * (number % slot_count) of any tree from then on
+ */
+static pthread_once_t thread_number_once = PTHREAD_ONCE_INIT; 
+static pthread_key_t thread_number_key; 
+static unsigned long next_thread_number = 0; 
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/ 
+
+/*
+ * private_rb_concurrent_make_key
+ * 
+ * creates the thread specific key holding each thread's number. run once,
+ * through pthread_once
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @return      n/a
+ */
+void private_rb_concurrent_make_key(void); 
+
+/*
+ * private_rb_concurrent_read_lock
+ * 
+ * takes the calling thread's reader slot lock for reading, and returns the
+ * slot so that it can be unlocked
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree to lock
+ * @return      ReaderSlot * - the slot that was locked
+ */
+ReaderSlot *private_rb_concurrent_read_lock(T tree); 
+
+/*
+ * private_rb_concurrent_write_lock / private_rb_concurrent_write_unlock
+ * 
+ * take (or release) every reader slot lock for writing, always in the same
+ * order, which excludes all readers and any other writer
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree to lock
+ * @return      n/a
+ */
+void private_rb_concurrent_write_lock(T tree); 
+void private_rb_concurrent_write_unlock(T tree); 
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+T rb_concurrent_new(void *comparison_func, unsigned mode)
+{
+        T tree = malloc(sizeof(struct rb_concurrent)); 
+        long processors = sysconf(_SC_NPROCESSORS_ONLN); 
+        pthread_rwlockattr_t attr; 
+        void *slots; 
+
+        assert(tree != NULL); 
+
+        if (processors < 1)
+                processors = 1; 
+        if (processors > RB_CONCURRENT_MAX_SLOTS)
+                processors = RB_CONCURRENT_MAX_SLOTS; 
+
+        tree->tree = rb_new_mode(comparison_func, mode); 
+        tree->slot_count = (size_t) processors; 
+
+        if (posix_memalign(&slots, CACHE_LINE, tree->slot_count * sizeof(ReaderSlot)) != 0)
+                slots = NULL; 
+        assert(slots != NULL); 
+        tree->slots = slots; 
+
+        pthread_rwlockattr_init(&attr); 
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP); 
+#endif
+
+        for (size_t i = 0; i < tree->slot_count; i++) 
+                pthread_rwlock_init(&tree->slots[i].lock, &attr); 
+
+        pthread_rwlockattr_destroy(&attr); 
+
+        return tree; 
+}
+
+void rb_concurrent_free(T tree)
+{
+        assert(tree != NULL); 
+
+        for (size_t i = 0; i < tree->slot_count; i++) 
+                pthread_rwlock_destroy(&tree->slots[i].lock); 
+
+        rb_tree_free(tree->tree); 
+        free(tree->slots); 
+        free(tree); 
+}
+
+size_t rb_concurrent_size(T tree)
+{
+        assert(tree != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        size_t size = rb_tree_size(tree->tree); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return size; 
+}
+
+void rb_concurrent_insert(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        private_rb_concurrent_write_lock(tree); 
+        rb_insert_value(tree->tree, value); 
+        private_rb_concurrent_write_unlock(tree); 
+}
+
+bool rb_concurrent_delete(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        private_rb_concurrent_write_lock(tree); 
+        bool deleted = rb_delete_one(tree->tree, value); 
+        private_rb_concurrent_write_unlock(tree); 
+
+        return deleted; 
+}
+
+void *rb_concurrent_search(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        void *found = rb_search(tree->tree, value); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return found; 
+}
+
+void *rb_concurrent_successor_of_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        void *found = rb_successor_of_value(tree->tree, value); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return found; 
+}
+
+void *rb_concurrent_predecessor_of_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        void *found = rb_predecessor_of_value(tree->tree, value); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return found; 
+}
+
+void *rb_concurrent_minimum(T tree)
+{
+        assert(tree != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        void *found = rb_tree_minimum(tree->tree); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return found; 
+}
+
+void *rb_concurrent_maximum(T tree)
+{
+        assert(tree != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        void *found = rb_tree_maximum(tree->tree); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return found; 
+}
+
+void rb_concurrent_map_inorder(T tree, 
+                               void func_to_apply(void *value, int depth, void *cl), 
+                               void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        rb_map_inorder(tree->tree, func_to_apply, cl); 
+        pthread_rwlock_unlock(&slot->lock); 
+}
+
+void rb_concurrent_map_preorder(T tree, 
+                                void func_to_apply(void *value, int depth, void *cl), 
+                                void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        rb_map_preorder(tree->tree, func_to_apply, cl); 
+        pthread_rwlock_unlock(&slot->lock); 
+}
+
+void rb_concurrent_map_postorder(T tree, 
+                                 void func_to_apply(void *value, int depth, void *cl), 
+                                 void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        rb_map_postorder(tree->tree, func_to_apply, cl); 
+        pthread_rwlock_unlock(&slot->lock); 
+}
+
+size_t rb_concurrent_map_range(T tree, 
+                               void *lo, bool lo_inclusive, 
+                               void *hi, bool hi_inclusive, 
+                               int func_to_apply(void *value, void *cl), 
+                               void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        ReaderSlot *slot = private_rb_concurrent_read_lock(tree); 
+        size_t visited = rb_map_range(tree->tree, lo, lo_inclusive, hi, hi_inclusive, 
+                                      func_to_apply, cl); 
+        pthread_rwlock_unlock(&slot->lock); 
+
+        return visited; 
+}
+
+void private_rb_concurrent_make_key(void)
+{
+        int failed = pthread_key_create(&thread_number_key, NULL); 
+
+        assert(failed == 0); 
+        (void) failed; 
+}
+
+ReaderSlot *private_rb_concurrent_read_lock(T tree)
+{
+        pthread_once(&thread_number_once, &private_rb_concurrent_make_key); 
+
+        /* numbers are stored plus one, so that NULL means not yet numbered */
+        uintptr_t number = (uintptr_t) pthread_getspecific(thread_number_key); 
+
+        if (number == 0) {
+                number = __atomic_add_fetch(&next_thread_number, 1, __ATOMIC_RELAXED); 
+                pthread_setspecific(thread_number_key, (void *) number); 
+        }
+
+        ReaderSlot *slot = &tree->slots[(number - 1) % tree->slot_count]; 
+
+        pthread_rwlock_rdlock(&slot->lock); 
+
+        return slot; 
+}
+
+void private_rb_concurrent_write_lock(T tree)
+{
+        for (size_t i = 0; i < tree->slot_count; i++) 
+                pthread_rwlock_wrlock(&tree->slots[i].lock); 
+}
+
+void private_rb_concurrent_write_unlock(T tree)
+{
+        for (size_t i = tree->slot_count; i > 0; i--) 
+                pthread_rwlock_unlock(&tree->slots[i - 1].lock); 
+}
@@ -0,0 +1,201 @@
+/**********************************************************************
+ * rb_concurrent.h                                                    *
+ *                                                                    *
+ * Interface for a thread safe red black tree which admits many       *
+ * concurrent readers and one writer at a time                        *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_CONCURRENT_H
+#define RB_CONCURRENT_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "rb_tree.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * a concurrent tree wraps a RedBlack_T. every function below may be called
+ * from any number of threads at once: lookups and walks run in parallel
+ * with one another, while inserts and deletes run alone.
+ *
+ * rather than one reader/writer lock, whose reader count every reader
+ * writes to, the tree keeps one lock per reader slot, each on its own
+ * cache line. a thread always reads through the same slot, so readers on
+ * different cores do not contend; a writer takes every slot's lock. reads
+ * therefore scale with the number of cores, at the price of writes costing
+ * a lock per slot. where the C library allows it, waiting writers are
+ * preferred over new readers so that writes are not starved.
+ *
+ * values stored in the tree are owned by the caller, as for RedBlack_T; a
+ * value returned by a lookup must not be freed while another thread may
+ * still be using it. a tree built with RB_STATS counts the work of
+ * concurrent readers exactly, with relaxed atomic increments, which costs
+ * them some contention on the counters' cache line
+ */
+typedef struct rb_concurrent *RedBlack_Concurrent_T;
+
+#define RB_CONCURRENT_MAX_SLOTS 64
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * rb_concurrent_new
+ *
+ * returns a new, empty concurrent tree, with one reader slot per online
+ * processor (at most RB_CONCURRENT_MAX_SLOTS)
+ *
+ * CREs         n/a
+ * UREs         system out of memory
+ *
+ * @param       void * - pointer to a comparison function, as described for
+ *                              rb_new. if NULL is passed, strcmp is assumed
+ * @param       unsigned - RB_* mode flags, as for rb_new_mode
+ * @return      pointer to empty concurrent tree
+ */
+RedBlack_Concurrent_T rb_concurrent_new(void *comparison_func, unsigned mode);
+
+/*
+ * rb_concurrent_free
+ *
+ * deallocates the tree. no other thread may be using it
+ *
+ * CREs         tree == NULL
+ * UREs         another thread is using the tree
+ *
+ * @param       RedBlack_Concurrent_T - the tree to be freed
+ * @return      n/a
+ */
+void rb_concurrent_free(RedBlack_Concurrent_T tree);
+
+/*
+ * rb_concurrent_size
+ *
+ * returns the number of values stored in the tree
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Concurrent_T - tree to be measured
+ * @return      size_t - number of values
+ */
+size_t rb_concurrent_size(RedBlack_Concurrent_T tree);
+
+/*
+ * rb_concurrent_insert
+ *
+ * inserts the value, as rb_insert_value, excluding all other threads
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_Concurrent_T - tree in which to insert value
+ * @param       void * - value to be inserted
+ * @return      n/a
+ */
+void rb_concurrent_insert(RedBlack_Concurrent_T tree, void *value);
+
+/*
+ * rb_concurrent_delete
+ *
+ * deletes one value equal to value, as rb_delete_one, excluding all other
+ * threads
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Concurrent_T - tree to delete from
+ * @param       void * - value to be deleted
+ * @return      bool - true if a value was deleted
+ */
+bool rb_concurrent_delete(RedBlack_Concurrent_T tree, void *value);
+
+/*
+ * rb_concurrent_search
+ *
+ * returns the stored value equal to value, or NULL if there is none
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Concurrent_T - tree in which to search
+ * @param       void * - value to search for
+ * @return      void * - the value that was found
+ */
+void *rb_concurrent_search(RedBlack_Concurrent_T tree, void *value);
+
+/*
+ * rb_concurrent_successor_of_value / rb_concurrent_predecessor_of_value
+ *
+ * as rb_successor_of_value and rb_predecessor_of_value
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Concurrent_T - tree in which to search
+ * @param       void * - value to search around
+ * @return      void * - the next larger (or smaller) stored value, or NULL
+ */
+void *rb_concurrent_successor_of_value(RedBlack_Concurrent_T tree, void *value);
+void *rb_concurrent_predecessor_of_value(RedBlack_Concurrent_T tree, void *value);
+
+/*
+ * rb_concurrent_minimum / rb_concurrent_maximum
+ *
+ * return the minimum (or maximum) stored value, or NULL if the tree is
+ * empty
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Concurrent_T - tree to be searched
+ * @return      void * - the minimum (or maximum) value
+ */
+void *rb_concurrent_minimum(RedBlack_Concurrent_T tree);
+void *rb_concurrent_maximum(RedBlack_Concurrent_T tree);
+
+/*
+ * rb_concurrent_map_inorder / _preorder / _postorder / rb_concurrent_map_range
+ *
+ * as the rb_map_* functions of the same names. the walk sees a single
+ * consistent state of the tree, since writers wait for it to finish
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply calls any rb_concurrent function on the same
+ *                      tree, which may deadlock
+ *
+ * @param       RedBlack_Concurrent_T - tree to walk
+ * @param       (see rb_tree.h)
+ * @return      (see rb_tree.h)
+ */
+void rb_concurrent_map_inorder(RedBlack_Concurrent_T tree,
+                               void func_to_apply(void *value, int depth, void *cl),
+                               void *cl);
+void rb_concurrent_map_preorder(RedBlack_Concurrent_T tree,
+                                void func_to_apply(void *value, int depth, void *cl),
+                                void *cl);
+void rb_concurrent_map_postorder(RedBlack_Concurrent_T tree,
+                                 void func_to_apply(void *value, int depth, void *cl),
+                                 void *cl);
+size_t rb_concurrent_map_range(RedBlack_Concurrent_T tree,
+                               void *lo, bool lo_inclusive,
+                               void *hi, bool hi_inclusive,
+                               int func_to_apply(void *value, void *cl),
+                               void *cl);
+
+#endif
@@ -0,0 +1,288 @@
+/**********************************************************************
+ * rb_define.h                                                        *
+ *                                                                    *
+ * Macros which generate red black trees specialized to one key type, *
+ * with the key stored in the node and the comparison inlined         *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_DEFINE_H
+#define RB_DEFINE_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdbool.h>
+
+#include "rb_tree.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * usage
+ *
+ * RB_DECLARE(name, key_type) declares a tree type name##_T and its
+ * functions, and belongs in a header. RB_DEFINE(name, key_type, cmp_expr)
+ * defines them, and belongs in exactly one source file. cmp_expr is an
+ * expression over two keys named a and b which is negative, zero or
+ * positive as a is less than, equal to or greater than b. for example
+ *
+ *      RB_DECLARE(int_tree, int)
+ *      RB_DEFINE(int_tree, int, (a > b) - (a < b))
+ *
+ * generates
+ *
+ *      int_tree_T int_tree_new(void);
+ *      void int_tree_free(int_tree_T tree);
+ *      size_t int_tree_size(int_tree_T tree);
+ *      void int_tree_insert(int_tree_T tree, int key);
+ *      int *int_tree_search(int_tree_T tree, int key);
+ *      bool int_tree_contains(int_tree_T tree, int key);
+ *      bool int_tree_delete(int_tree_T tree, int key);
+ *      int *int_tree_minimum(int_tree_T tree);
+ *      int *int_tree_maximum(int_tree_T tree);
+ *      void int_tree_map_inorder(int_tree_T tree,
+ *                                void func_to_apply(int key, void *cl),
+ *                                void *cl);
+ *
+ * which behave as their rb_tree counterparts: duplicates are allowed,
+ * delete removes one equal key, and search, minimum and maximum return a
+ * pointer to the stored key (or NULL), valid until that key is deleted.
+ * nodes are carved out of chunks owned by the tree, and balanced, by the 
+ * node level functions of rb_tree.c (see rb_tree.h), so a program using 
+ * these trees links rb_tree.c
+ */
+
+/**********************
+ * NAVIGATION         *
+ **********************/
+
+/*
+ * these work on bare rb_nodes and never compare keys, so one copy serves
+ * every key type
+ */
+
+static inline struct rb_node *rb_define_parent(struct rb_node *n)
+{
+        return (struct rb_node *) (n->parent_color & ~(uintptr_t) 1);
+}
+
+static inline struct rb_node *rb_define_first(struct rb_node *n)
+{
+        if (n != NULL)
+                while (n->left != NULL)
+                        n = n->left;
+        return n;
+}
+
+static inline struct rb_node *rb_define_last(struct rb_node *n)
+{
+        if (n != NULL)
+                while (n->right != NULL)
+                        n = n->right;
+        return n;
+}
+
+static inline struct rb_node *rb_define_next(struct rb_node *n)
+{
+        if (n->right != NULL)
+                return rb_define_first(n->right);
+
+        struct rb_node *parent = rb_define_parent(n);
+
+        while (parent != NULL && n == parent->right) {
+                n = parent;
+                parent = rb_define_parent(n);
+        }
+
+        return parent;
+}
+
+/**********************
+ * MACRO DEFINITIONS  *
+ **********************/
+
+#define RB_DECLARE(name, key_type)                                              \
+typedef struct name *name##_T;                                                  \
+name##_T name##_new(void);                                                      \
+void name##_free(name##_T tree);                                                \
+size_t name##_size(name##_T tree);                                              \
+void name##_insert(name##_T tree, key_type key);                                \
+key_type *name##_search(name##_T tree, key_type key);                           \
+bool name##_contains(name##_T tree, key_type key);                              \
+bool name##_delete(name##_T tree, key_type key);                                \
+key_type *name##_minimum(name##_T tree);                                        \
+key_type *name##_maximum(name##_T tree);                                        \
+void name##_map_inorder(name##_T tree,                                          \
+                        void func_to_apply(key_type key, void *cl),             \
+                        void *cl);
+
+#define RB_DEFINE(name, key_type, cmp_expr)                                     \
+struct name##_node {                                                            \
+        struct rb_node link;                                                    \
+        key_type key;                                                           \
+};                                                                              \
+                                                                                \
+struct name {                                                                   \
+        struct rb_node *root;                                                   \
+        size_t count;                                                           \
+        struct rb_chunk *chunks;        /* newest chunk first */                \
+        size_t chunk_used;              /* nodes handed out from chunks */      \
+        struct rb_node *free_nodes;     /* released nodes, linked by right */   \
+};                                                                              \
+                                                                                \
+static inline int private_##name##_compare(key_type a, key_type b)              \
+{                                                                               \
+        return (cmp_expr);                                                      \
+}                                                                               \
+                                                                                \
+static inline key_type *private_##name##_key(struct rb_node *n)                 \
+{                                                                               \
+        return &rb_entry(n, struct name##_node, link)->key;                     \
+}                                                                               \
+                                                                                \
+static inline struct rb_node *private_##name##_find(name##_T tree,              \
+                                                    key_type key)               \
+{                                                                               \
+        struct rb_node *curr = tree->root;                                      \
+                                                                                \
+        while (curr != NULL) {                                                  \
+                int c = private_##name##_compare(key,                           \
+                                                 *private_##name##_key(curr));  \
+                if (c == 0)                                                     \
+                        return curr;                                            \
+                curr = c < 0 ? curr->left : curr->right;                        \
+        }                                                                       \
+                                                                                \
+        return NULL;                                                            \
+}                                                                               \
+                                                                                \
+name##_T name##_new(void)                                                       \
+{                                                                               \
+        name##_T tree = malloc(sizeof(*tree));                                  \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        tree->root = NULL;                                                      \
+        tree->count = 0;                                                        \
+        tree->chunks = NULL;                                                    \
+        tree->chunk_used = 0;                                                   \
+        tree->free_nodes = NULL;                                                \
+                                                                                \
+        return tree;                                                            \
+}                                                                               \
+                                                                                \
+void name##_free(name##_T tree)                                                 \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        rb_node_free_chunks(tree->chunks);                                      \
+                                                                                \
+        free(tree);                                                             \
+}                                                                               \
+                                                                                \
+size_t name##_size(name##_T tree)                                               \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+        return tree->count;                                                     \
+}                                                                               \
+                                                                                \
+void name##_insert(name##_T tree, key_type key)                                 \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        struct rb_node **slot = &tree->root;                                    \
+        struct rb_node *parent = NULL;                                          \
+                                                                                \
+        while (*slot != NULL) {                                                 \
+                parent = *slot;                                                 \
+                if (private_##name##_compare(key,                               \
+                                             *private_##name##_key(parent)) < 0)\
+                        slot = &parent->left;                                   \
+                else                                                            \
+                        slot = &parent->right;                                  \
+        }                                                                       \
+                                                                                \
+        struct rb_node *n = rb_node_alloc(&tree->free_nodes, &tree->chunks,     \
+                                          &tree->chunk_used,                    \
+                                          sizeof(struct name##_node));          \
+                                                                                \
+        *private_##name##_key(n) = key;                                         \
+        n->parent_color = (uintptr_t) parent;   /* red */                       \
+        n->left = NULL;                                                         \
+        n->right = NULL;                                                        \
+        *slot = n;                                                              \
+        rb_node_insert_fixup(&tree->root, n, NULL, NULL, NULL);                 \
+        tree->count++;                                                          \
+}                                                                               \
+                                                                                \
+key_type *name##_search(name##_T tree, key_type key)                            \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        struct rb_node *n = private_##name##_find(tree, key);                   \
+                                                                                \
+        return n == NULL ? NULL : private_##name##_key(n);                      \
+}                                                                               \
+                                                                                \
+bool name##_contains(name##_T tree, key_type key)                               \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+        return private_##name##_find(tree, key) != NULL;                        \
+}                                                                               \
+                                                                                \
+bool name##_delete(name##_T tree, key_type key)                                 \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        struct rb_node *n = private_##name##_find(tree, key);                   \
+                                                                                \
+        if (n == NULL)                                                          \
+                return false;                                                   \
+                                                                                \
+        struct rb_node *x;                                                      \
+        struct rb_node *x_parent;                                               \
+                                                                                \
+        if (rb_node_unlink(&tree->root, n, &x, &x_parent))                      \
+                rb_node_erase_fixup(&tree->root, x, x_parent, NULL, NULL);      \
+        n->right = tree->free_nodes;                                            \
+        tree->free_nodes = n;                                                   \
+        tree->count--;                                                          \
+                                                                                \
+        return true;                                                            \
+}                                                                               \
+                                                                                \
+key_type *name##_minimum(name##_T tree)                                         \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        struct rb_node *n = rb_define_first(tree->root);                        \
+                                                                                \
+        return n == NULL ? NULL : private_##name##_key(n);                      \
+}                                                                               \
+                                                                                \
+key_type *name##_maximum(name##_T tree)                                         \
+{                                                                               \
+        assert(tree != NULL);                                                   \
+                                                                                \
+        struct rb_node *n = rb_define_last(tree->root);                         \
+                                                                                \
+        return n == NULL ? NULL : private_##name##_key(n);                      \
+}                                                                               \
+                                                                                \
+void name##_map_inorder(name##_T tree,                                          \
+                        void func_to_apply(key_type key, void *cl),             \
+                        void *cl)                                               \
+{                                                                               \
+        assert(tree != NULL && func_to_apply != NULL);                          \
+                                                                                \
+        for (struct rb_node *n = rb_define_first(tree->root); n != NULL;        \
+             n = rb_define_next(n))                                             \
+                func_to_apply(*private_##name##_key(n), cl);                    \
+}
+
+#endif
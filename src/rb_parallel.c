@@ -0,0 +1,321 @@
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+
+#include "rb_parallel.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/*** MACRO DEFINITIONS ***/
+
+#define CACHE_LINE 64
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/* a subtree still to be walked, and its root's depth in the tree */
+typedef struct Task {
+        struct rb_node *node; 
+        unsigned depth; 
+} Task; 
+
+/* 
+ * a worker's tasks. the owner pushes and pops at the bottom; thieves take 
+ * from the top, where the shallowest, and so largest, subtrees are 
+ */
+typedef struct Deque {
+        pthread_mutex_t lock; 
+        Task *tasks; 
+        size_t top; 
+        size_t bottom; 
+        char padding[CACHE_LINE];       /* keeps neighbouring locks apart */
+} Deque; 
+
+typedef struct Pool {
+        RedBlack_T tree; 
+        void (*func_to_apply)(void *value, void *cl); 
+        Deque *deques;          /* one per worker */
+        size_t worker_count; 
+        unsigned split_depth;   /* nodes this deep are walked, not split */
+        size_t pending;         /* tasks pushed and not yet finished; atomic */
+} Pool; 
+
+typedef struct Worker {
+        Pool *pool; 
+        size_t id; 
+        void *cl; 
+        pthread_t thread; 
+        bool started; 
+} Worker; 
+
+typedef struct rb_node Node; 
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/ 
+
+/*
+ * private_rb_parallel_worker
+ * 
+ * a worker's loop: runs tasks from its own deque, steals when that is 
+ * empty, and returns once no task is pending anywhere
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       void * - the Worker
+ * @return      NULL
+ */
+void *private_rb_parallel_worker(void *arg); 
+
+/*
+ * private_rb_parallel_run
+ * 
+ * runs one task: down to the split depth, applies the function to each 
+ * node on the task's leftmost path and pushes the right subtrees as new 
+ * tasks; the subtree left at the split depth is walked in full
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_parallel_run(Worker *worker, Task task); 
+
+/*
+ * private_rb_parallel_walk
+ * 
+ * applies the function to every node of a subtree, on the calling thread
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_parallel_walk(Pool *pool, Node *node, void *cl); 
+
+/*
+ * private_rb_parallel_push / private_rb_parallel_pop / private_rb_parallel_steal
+ * 
+ * push a task onto the bottom of a worker's own deque, pop one from the 
+ * bottom, or take one from the top of some other worker's deque. pop and 
+ * steal return false when they find nothing
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_parallel_push(Pool *pool, size_t id, Task task); 
+bool private_rb_parallel_pop(Pool *pool, size_t id, Task *task); 
+bool private_rb_parallel_steal(Pool *pool, size_t id, Task *task); 
+
+/*
+ * private_rb_parallel_shared_cl
+ * 
+ * the init_thread_cl behind rb_map_parallel: every thread shares cl
+ */
+void *private_rb_parallel_shared_cl(void *cl); 
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+void rb_map_parallel(RedBlack_T tree, size_t nthreads, 
+                     void func_to_apply(void *value, void *cl), 
+                     void *cl)
+{
+        rb_map_parallel_reduce(tree, nthreads, func_to_apply, 
+                               &private_rb_parallel_shared_cl, NULL, cl); 
+}
+
+void rb_map_parallel_reduce(RedBlack_T tree, size_t nthreads, 
+                            void func_to_apply(void *value, void *thread_cl), 
+                            void *init_thread_cl(void *cl), 
+                            void reduce(void *cl, void *thread_cl), 
+                            void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL && init_thread_cl != NULL); 
+        assert(nthreads <= RB_PARALLEL_MAX_THREADS); 
+
+        if (nthreads == 0) {
+                long processors = sysconf(_SC_NPROCESSORS_ONLN); 
+
+                nthreads = processors < 1 ? 1 : (size_t) processors; 
+                if (nthreads > RB_PARALLEL_MAX_THREADS)
+                        nthreads = RB_PARALLEL_MAX_THREADS; 
+        }
+
+        /* the depth at which the tree has enough subtrees for every thread */
+        Pool pool; 
+        size_t target = nthreads == 1 ? 1 : nthreads * RB_PARALLEL_TASKS_PER_THREAD; 
+
+        pool.split_depth = 0; 
+        while (((size_t) 1 << pool.split_depth) < target) 
+                pool.split_depth++; 
+
+        /* a deque never holds more tasks than there are nodes above that depth */
+        size_t capacity = (size_t) 1 << (pool.split_depth + 1); 
+
+        pool.tree = tree; 
+        pool.func_to_apply = func_to_apply; 
+        pool.worker_count = nthreads; 
+        pool.pending = 0; 
+        pool.deques = malloc(nthreads * sizeof(Deque)); 
+        Worker *workers = malloc(nthreads * sizeof(Worker)); 
+        assert(pool.deques != NULL && workers != NULL); 
+
+        for (size_t i = 0; i < nthreads; i++) {
+                pthread_mutex_init(&pool.deques[i].lock, NULL); 
+                pool.deques[i].tasks = malloc(capacity * sizeof(Task)); 
+                assert(pool.deques[i].tasks != NULL); 
+                pool.deques[i].top = 0; 
+                pool.deques[i].bottom = 0; 
+
+                workers[i].pool = &pool; 
+                workers[i].id = i; 
+                workers[i].cl = init_thread_cl(cl); 
+                workers[i].started = false; 
+        }
+
+        Node *root = rb_root_node(tree); 
+        if (root != NULL)
+                private_rb_parallel_push(&pool, 0, (Task) { root, 0 }); 
+
+        /* 
+         * a worker which cannot be started just leaves its share to the 
+         * others: only running workers push tasks onto their deques
+         */
+        for (size_t i = 1; i < nthreads; i++) 
+                workers[i].started = pthread_create(&workers[i].thread, NULL, 
+                                                    &private_rb_parallel_worker, 
+                                                    &workers[i]) == 0; 
+
+        private_rb_parallel_worker(&workers[0]); 
+
+        for (size_t i = 1; i < nthreads; i++) {
+                if (workers[i].started)
+                        pthread_join(workers[i].thread, NULL); 
+        }
+
+        for (size_t i = 0; i < nthreads; i++) {
+                if (reduce != NULL)
+                        reduce(cl, workers[i].cl); 
+
+                free(pool.deques[i].tasks); 
+                pthread_mutex_destroy(&pool.deques[i].lock); 
+        }
+
+        free(workers); 
+        free(pool.deques); 
+}
+
+void *private_rb_parallel_worker(void *arg)
+{
+        Worker *worker = (Worker *) arg; 
+        Pool *pool = worker->pool; 
+        Task task; 
+
+        for (;;) {
+                if (private_rb_parallel_pop(pool, worker->id, &task) || 
+                    private_rb_parallel_steal(pool, worker->id, &task)) {
+                        private_rb_parallel_run(worker, task); 
+                        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST); 
+                } else if (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+                        return NULL; 
+                } else {
+                        sched_yield(); 
+                }
+        }
+}
+
+void private_rb_parallel_run(Worker *worker, Task task)
+{
+        Pool *pool = worker->pool; 
+        Node *node = task.node; 
+        unsigned depth = task.depth; 
+
+        while (node != NULL && depth < pool->split_depth) {
+                if (node->right != NULL)
+                        private_rb_parallel_push(pool, worker->id, (Task) { node->right, depth + 1 }); 
+
+                pool->func_to_apply(rb_node_value(pool->tree, node), worker->cl); 
+
+                node = node->left; 
+                depth++; 
+        }
+
+        if (node != NULL)
+                private_rb_parallel_walk(pool, node, worker->cl); 
+}
+
+void private_rb_parallel_walk(Pool *pool, Node *node, void *cl)
+{
+        /* recurse on the left, loop on the right */
+        while (node != NULL) {
+                if (node->left != NULL)
+                        private_rb_parallel_walk(pool, node->left, cl); 
+
+                pool->func_to_apply(rb_node_value(pool->tree, node), cl); 
+                node = node->right; 
+        }
+}
+
+void private_rb_parallel_push(Pool *pool, size_t id, Task task)
+{
+        Deque *deque = &pool->deques[id]; 
+
+        /* counted before it can be seen, so pending never reads zero early */
+        __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST); 
+
+        pthread_mutex_lock(&deque->lock); 
+        deque->tasks[deque->bottom++] = task; 
+        pthread_mutex_unlock(&deque->lock); 
+}
+
+bool private_rb_parallel_pop(Pool *pool, size_t id, Task *task)
+{
+        Deque *deque = &pool->deques[id]; 
+        bool found = false; 
+
+        pthread_mutex_lock(&deque->lock); 
+
+        if (deque->bottom > deque->top) {
+                *task = deque->tasks[--deque->bottom]; 
+                found = true; 
+        }
+        if (deque->bottom == deque->top) {
+                deque->top = 0; 
+                deque->bottom = 0; 
+        }
+
+        pthread_mutex_unlock(&deque->lock); 
+
+        return found; 
+}
+
+bool private_rb_parallel_steal(Pool *pool, size_t id, Task *task)
+{
+        for (size_t i = 1; i < pool->worker_count; i++) {
+                Deque *deque = &pool->deques[(id + i) % pool->worker_count]; 
+                bool found = false; 
+
+                pthread_mutex_lock(&deque->lock); 
+
+                if (deque->bottom > deque->top) {
+                        *task = deque->tasks[deque->top++]; 
+                        found = true; 
+                }
+                if (deque->bottom == deque->top) {
+                        deque->top = 0; 
+                        deque->bottom = 0; 
+                }
+
+                pthread_mutex_unlock(&deque->lock); 
+
+                if (found)
+                        return true; 
+        }
+
+        return false; 
+}
+
+void *private_rb_parallel_shared_cl(void *cl)
+{
+        return cl; 
+}
@@ -0,0 +1,97 @@
+/**********************************************************************
+ * rb_parallel.h                                                      *
+ *                                                                    *
+ * Interface for walking a red black tree on many threads             *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_PARALLEL_H
+#define RB_PARALLEL_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+
+#include "rb_tree.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * a parallel walk splits the tree into subtree tasks, about
+ * RB_PARALLEL_TASKS_PER_THREAD per thread, taken from the top of the tree
+ * down to the depth which yields that many. each thread keeps its own
+ * deque of tasks: it works from the bottom, while a thread which runs out
+ * steals from the top of another's, where the largest subtrees are. the
+ * threads are started for each walk and the caller's thread is one of
+ * them.
+ *
+ * values are visited once each, in no particular order, from whichever
+ * thread runs their task. the tree must not be modified during the walk
+ */
+#define RB_PARALLEL_TASKS_PER_THREAD 8
+#define RB_PARALLEL_MAX_THREADS 256
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * rb_map_parallel
+ *
+ * applies func_to_apply to every value in the tree, on nthreads threads.
+ * every call shares cl, so func_to_apply must be safe to run on many
+ * threads at once
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ *              nthreads > RB_PARALLEL_MAX_THREADS
+ * UREs         the tree is modified during the walk
+ *              system out of memory, or out of threads
+ *
+ * @param       RedBlack_T - tree to walk
+ * @param       size_t - number of threads, counting the caller's; 0 uses
+ *                              one per online processor
+ * @param       void func_to_apply(value, cl) - applied to each value
+ * @param       void * - a closure item for func_to_apply
+ * @return      n/a
+ */
+void rb_map_parallel(RedBlack_T tree, size_t nthreads,
+                     void func_to_apply(void *value, void *cl),
+                     void *cl);
+
+/*
+ * rb_map_parallel_reduce
+ *
+ * as rb_map_parallel, but each thread works on a closure of its own, so
+ * that an aggregation needs no locking: init_thread_cl(cl) makes a
+ * thread's closure before the walk, func_to_apply gets that closure, and
+ * after every thread has finished reduce(cl, thread_cl) is called on the
+ * caller's thread for each closure in turn, to fold it into cl and free it
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL or init_thread_cl == NULL
+ *              nthreads > RB_PARALLEL_MAX_THREADS
+ * UREs         the tree is modified during the walk
+ *              system out of memory, or out of threads
+ *
+ * @param       RedBlack_T - tree to walk
+ * @param       size_t - number of threads, as for rb_map_parallel
+ * @param       void func_to_apply(value, thread_cl) - applied to each value
+ * @param       void *init_thread_cl(cl) - returns a new thread closure
+ * @param       void reduce(cl, thread_cl) - folds a thread closure into
+ *                      cl; may be NULL
+ * @param       void * - the closure item passed to init_thread_cl and
+ *                      reduce
+ * @return      n/a
+ */
+void rb_map_parallel_reduce(RedBlack_T tree, size_t nthreads,
+                            void func_to_apply(void *value, void *thread_cl),
+                            void *init_thread_cl(void *cl),
+                            void reduce(void *cl, void *thread_cl),
+                            void *cl);
+
+#endif
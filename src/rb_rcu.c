@@ -0,0 +1,1000 @@
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+
+#include "rb_rcu.h"
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+/*** MACRO DEFINITIONS ***/
+
+#define RED 0
+#define BLACK 1
+
+#define IS_RED(n) ((n) != NULL && (n)->color == RED)
+#define IS_BLACK(n) ((n) != NULL && (n)->color == BLACK)
+
+#define CACHE_LINE 64
+
+/* 
+ * every access to memory shared between readers and writers is sequentially
+ * consistent, which is what makes a reader's announced epoch and the root it
+ * then loads agree with a writer's scan of the epochs
+ */
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/* 
+ * a node is never modified once a published version can reach it. refs 
+ * counts the parents, versions and snapshots that point to it, and size 
+ * the values in its subtree, so that a version knows its own size
+ */
+typedef struct PNode {
+        struct PNode *left; 
+        struct PNode *right; 
+        void *value; 
+        size_t refs; 
+        size_t size; 
+        int color; 
+} PNode; 
+
+/* a replaced root, released once no reader can still be walking it */
+typedef struct Retired {
+        PNode *root; 
+        unsigned long epoch; 
+        struct Retired *next; 
+} Retired; 
+
+struct rb_rcu {
+        PNode *root;            /* loaded by readers, stored by writers */
+        int (*comparison_func)(void *, void *); 
+        pthread_mutex_t write_lock; 
+        Retired *retired;       /* oldest first */
+        Retired *retired_last; 
+}; 
+
+/* a version of a tree kept alive by its own reference to the root */
+struct rb_snapshot {
+        PNode *root; 
+        int (*comparison_func)(void *, void *); 
+}; 
+
+/* 
+ * one per thread that has read any rcu tree, on its own cache line. 
+ * records are never freed, but are reused once their thread exits
+ */
+typedef struct EpochRecord {
+        unsigned long state;    /* (epoch << 1) | 1 while reading, else 0 */
+        unsigned depth;         /* nesting of reads, used by the owner only */
+        bool in_use; 
+        struct EpochRecord *next; 
+} EpochRecord; 
+
+typedef RedBlack_RCU_T T; 
+
+static unsigned long global_epoch = 0; 
+static EpochRecord *epoch_records = NULL; 
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT; 
+static pthread_key_t epoch_key; 
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/ 
+
+/*
+ * private_rb_rcu_node / private_rb_rcu_ref / private_rb_rcu_release
+ * 
+ * make a new node holding one reference, owning the references to left and
+ * right it is given; take another reference to a node; or drop one, freeing
+ * the node, and dropping its children, when it was the last. NULL is 
+ * accepted by ref and release
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ */
+PNode *private_rb_rcu_node(int color, PNode *left, void *value, PNode *right); 
+PNode *private_rb_rcu_ref(PNode *n); 
+void private_rb_rcu_release(PNode *n); 
+
+/*
+ * private_rb_rcu_open
+ * 
+ * takes apart a node the caller holds a reference to, giving the caller a
+ * reference to each child in its place. a node nobody else refers to is 
+ * freed without touching the children's counts
+ * 
+ * CREs         n/a
+ * UREs         n is NULL
+ * 
+ * @return      void * - the node's value
+ */
+void *private_rb_rcu_open(PNode *n, PNode **left, PNode **right); 
+
+/*
+ * private_rb_rcu_paint
+ * 
+ * returns n with the given color, recoloring it in place when the caller 
+ * holds the only reference and copying it otherwise
+ * 
+ * CREs         n/a
+ * UREs         n is NULL
+ */
+PNode *private_rb_rcu_paint(PNode *n, int color); 
+
+/*
+ * private_rb_rcu_balance, private_rb_rcu_balance_left, 
+ * private_rb_rcu_balance_right, private_rb_rcu_append
+ * 
+ * the rebalancing steps of Kahrs' functional red black tree. each takes 
+ * ownership of its subtree arguments and returns a new subtree. balance 
+ * builds a black node, removing a red child with a red child; 
+ * balance_left (or balance_right) builds a node whose left (or right) 
+ * subtree has lost one black node; append joins the two children of a 
+ * deleted node
+ * 
+ * CREs         n/a
+ * UREs         the subtrees break the invariants the steps assume
+ */
+PNode *private_rb_rcu_balance(PNode *left, void *value, PNode *right); 
+PNode *private_rb_rcu_balance_left(PNode *left, void *value, PNode *right); 
+PNode *private_rb_rcu_balance_right(PNode *left, void *value, PNode *right); 
+PNode *private_rb_rcu_append(PNode *left, PNode *right); 
+
+/*
+ * private_rb_rcu_insert / private_rb_rcu_delete
+ * 
+ * return a new version of the subtree n, which the caller does not give up,
+ * with value inserted (or removed). when nothing changes, *inserted stays 
+ * false (or *removed stays NULL) and the return value is meaningless
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ */
+PNode *private_rb_rcu_insert(T tree, PNode *n, void *value, bool *inserted); 
+PNode *private_rb_rcu_delete(T tree, PNode *n, void *value, void **removed); 
+
+/*
+ * private_rb_rcu_publish
+ * 
+ * makes root the tree's current version, retires the version it replaces 
+ * and frees whatever retired versions no reader can still see. called with 
+ * the write lock held
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_rcu_publish(T tree, PNode *root); 
+
+/*
+ * private_rb_rcu_advance
+ * 
+ * moves the global epoch on by one if every thread that is reading started
+ * in the current epoch
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @return      bool - true if the epoch was advanced
+ */
+bool private_rb_rcu_advance(void); 
+
+/*
+ * private_rb_rcu_read_begin / private_rb_rcu_read_end
+ * 
+ * bracket a read: begin announces the current epoch in the calling thread's
+ * record, registering the thread on its first read, and end withdraws it. 
+ * reads may nest, as when a map function searches
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ */
+EpochRecord *private_rb_rcu_read_begin(void); 
+void private_rb_rcu_read_end(EpochRecord *record); 
+
+/*
+ * private_rb_rcu_make_key / private_rb_rcu_thread_exit
+ * 
+ * create the key holding each thread's record (once, through pthread_once),
+ * and give a record up when its thread exits
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_rcu_make_key(void); 
+void private_rb_rcu_thread_exit(void *record); 
+
+/*
+ * private_rb_rcu_search, private_rb_rcu_inorder, private_rb_rcu_range
+ * 
+ * the lookup and walks shared by trees and snapshots, over a root the 
+ * caller keeps alive. the range walk only enters subtrees which may hold 
+ * values in the range, and returns true once func_to_apply has asked it to 
+ * stop
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void *private_rb_rcu_search(int comparison_func(void *, void *), PNode *n, void *value); 
+void private_rb_rcu_inorder(PNode *n, int depth, 
+                            void func_to_apply(void *value, int depth, void *cl), 
+                            void *cl); 
+bool private_rb_rcu_range(int comparison_func(void *, void *), PNode *n, 
+                          void *lo, bool lo_inclusive, 
+                          void *hi, bool hi_inclusive, 
+                          int func_to_apply(void *value, void *cl), 
+                          void *cl, size_t *visited); 
+
+/*
+ * private_rb_rcu_save
+ * 
+ * writes the values of the subtree to save in order, stopping at the first
+ * failure
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       PNode * - subtree, kept alive by the caller
+ * @param       RedBlack_Save_T - the writer
+ * @return      bool - false if a write failed
+ */
+bool private_rb_rcu_save(PNode *n, RedBlack_Save_T save); 
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+T rb_rcu_new(void *comparison_func)
+{
+        T tree = malloc(sizeof(struct rb_rcu)); 
+        assert(tree != NULL); 
+
+        tree->root = NULL; 
+        tree->retired = NULL; 
+        tree->retired_last = NULL; 
+        pthread_mutex_init(&tree->write_lock, NULL); 
+
+        if (comparison_func == NULL) {
+                tree->comparison_func = (int (*)(void *, void *)) &strcmp; 
+        } else {
+                tree->comparison_func = (int (*)(void *, void *)) comparison_func; 
+        }
+
+        return tree; 
+}
+
+void rb_rcu_free(T tree)
+{
+        assert(tree != NULL); 
+
+        while (tree->retired != NULL) {
+                Retired *retired = tree->retired; 
+
+                tree->retired = retired->next; 
+                private_rb_rcu_release(retired->root); 
+                free(retired); 
+        }
+
+        private_rb_rcu_release(tree->root); 
+        pthread_mutex_destroy(&tree->write_lock); 
+        free(tree); 
+}
+
+size_t rb_rcu_size(T tree)
+{
+        assert(tree != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        PNode *root = LOAD(&tree->root); 
+        size_t size = root != NULL ? root->size : 0; 
+
+        private_rb_rcu_read_end(record); 
+
+        return size; 
+}
+
+bool rb_rcu_insert(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        bool inserted = false; 
+
+        pthread_mutex_lock(&tree->write_lock); 
+
+        PNode *root = private_rb_rcu_insert(tree, tree->root, value, &inserted); 
+
+        if (inserted)
+                private_rb_rcu_publish(tree, private_rb_rcu_paint(root, BLACK)); 
+
+        pthread_mutex_unlock(&tree->write_lock); 
+
+        return inserted; 
+}
+
+void *rb_rcu_delete(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        void *removed = NULL; 
+
+        pthread_mutex_lock(&tree->write_lock); 
+
+        PNode *root = private_rb_rcu_delete(tree, tree->root, value, &removed); 
+
+        if (removed != NULL) {
+                if (root != NULL)
+                        root = private_rb_rcu_paint(root, BLACK); 
+
+                private_rb_rcu_publish(tree, root); 
+        }
+
+        pthread_mutex_unlock(&tree->write_lock); 
+
+        return removed; 
+}
+
+void rb_rcu_synchronize(void)
+{
+        /* 
+         * a read in progress now started in the current epoch or earlier, 
+         * and the epoch cannot pass the next one until that read has ended
+         */
+        unsigned long target = LOAD(&global_epoch) + 2; 
+
+        while ((long) (LOAD(&global_epoch) - target) < 0) {
+                if (!private_rb_rcu_advance())
+                        sched_yield(); 
+        }
+}
+
+void *rb_rcu_search(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        void *found = private_rb_rcu_search(tree->comparison_func, LOAD(&tree->root), value); 
+
+        private_rb_rcu_read_end(record); 
+
+        return found; 
+}
+
+void *rb_rcu_successor_of_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        PNode *n = LOAD(&tree->root); 
+        void *successor = NULL; 
+
+        while (n != NULL) {
+                if (tree->comparison_func(value, n->value) < 0) {
+                        successor = n->value; 
+                        n = n->left; 
+                } else {
+                        n = n->right; 
+                }
+        }
+
+        private_rb_rcu_read_end(record); 
+
+        return successor; 
+}
+
+void *rb_rcu_predecessor_of_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        PNode *n = LOAD(&tree->root); 
+        void *predecessor = NULL; 
+
+        while (n != NULL) {
+                if (tree->comparison_func(value, n->value) > 0) {
+                        predecessor = n->value; 
+                        n = n->right; 
+                } else {
+                        n = n->left; 
+                }
+        }
+
+        private_rb_rcu_read_end(record); 
+
+        return predecessor; 
+}
+
+void *rb_rcu_minimum(T tree)
+{
+        assert(tree != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        PNode *n = LOAD(&tree->root); 
+        void *minimum = NULL; 
+
+        for (; n != NULL; n = n->left) 
+                minimum = n->value; 
+
+        private_rb_rcu_read_end(record); 
+
+        return minimum; 
+}
+
+void *rb_rcu_maximum(T tree)
+{
+        assert(tree != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        PNode *n = LOAD(&tree->root); 
+        void *maximum = NULL; 
+
+        for (; n != NULL; n = n->right) 
+                maximum = n->value; 
+
+        private_rb_rcu_read_end(record); 
+
+        return maximum; 
+}
+
+void rb_rcu_map_inorder(T tree, 
+                        void func_to_apply(void *value, int depth, void *cl), 
+                        void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+
+        private_rb_rcu_inorder(LOAD(&tree->root), 0, func_to_apply, cl); 
+
+        private_rb_rcu_read_end(record); 
+}
+
+size_t rb_rcu_map_range(T tree, 
+                        void *lo, bool lo_inclusive, 
+                        void *hi, bool hi_inclusive, 
+                        int func_to_apply(void *value, void *cl), 
+                        void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        size_t visited = 0; 
+
+        private_rb_rcu_range(tree->comparison_func, LOAD(&tree->root), lo, lo_inclusive, 
+                             hi, hi_inclusive, func_to_apply, cl, &visited); 
+
+        private_rb_rcu_read_end(record); 
+
+        return visited; 
+}
+
+RedBlack_Snapshot_T rb_snapshot(T tree)
+{
+        assert(tree != NULL); 
+
+        RedBlack_Snapshot_T snapshot = malloc(sizeof(struct rb_snapshot)); 
+        assert(snapshot != NULL); 
+
+        /* the root cannot be freed while this read is in progress */
+        EpochRecord *record = private_rb_rcu_read_begin(); 
+        snapshot->root = private_rb_rcu_ref(LOAD(&tree->root)); 
+        private_rb_rcu_read_end(record); 
+
+        snapshot->comparison_func = tree->comparison_func; 
+
+        return snapshot; 
+}
+
+void rb_snapshot_release(RedBlack_Snapshot_T snapshot)
+{
+        assert(snapshot != NULL); 
+
+        private_rb_rcu_release(snapshot->root); 
+        free(snapshot); 
+}
+
+size_t rb_snapshot_size(RedBlack_Snapshot_T snapshot)
+{
+        assert(snapshot != NULL); 
+
+        return snapshot->root != NULL ? snapshot->root->size : 0; 
+}
+
+void *rb_snapshot_search(RedBlack_Snapshot_T snapshot, void *value)
+{
+        assert(snapshot != NULL && value != NULL); 
+
+        return private_rb_rcu_search(snapshot->comparison_func, snapshot->root, value); 
+}
+
+void rb_snapshot_map_inorder(RedBlack_Snapshot_T snapshot, 
+                             void func_to_apply(void *value, int depth, void *cl), 
+                             void *cl)
+{
+        assert(snapshot != NULL && func_to_apply != NULL); 
+
+        private_rb_rcu_inorder(snapshot->root, 0, func_to_apply, cl); 
+}
+
+size_t rb_snapshot_map_range(RedBlack_Snapshot_T snapshot, 
+                             void *lo, bool lo_inclusive, 
+                             void *hi, bool hi_inclusive, 
+                             int func_to_apply(void *value, void *cl), 
+                             void *cl)
+{
+        assert(snapshot != NULL && func_to_apply != NULL); 
+
+        size_t visited = 0; 
+
+        private_rb_rcu_range(snapshot->comparison_func, snapshot->root, lo, lo_inclusive, 
+                             hi, hi_inclusive, func_to_apply, cl, &visited); 
+
+        return visited; 
+}
+
+bool rb_snapshot_save(RedBlack_Snapshot_T snapshot, int fd, 
+                      size_t encode(void *value, unsigned char *buf, size_t capacity))
+{
+        assert(snapshot != NULL && encode != NULL); 
+
+        RedBlack_Save_T save = rb_save_begin(fd, rb_snapshot_size(snapshot), encode); 
+
+        private_rb_rcu_save(snapshot->root, save); 
+
+        return rb_save_end(save); 
+}
+
+PNode *private_rb_rcu_node(int color, PNode *left, void *value, PNode *right)
+{
+        PNode *n = malloc(sizeof(PNode)); 
+        assert(n != NULL); 
+
+        n->left = left; 
+        n->right = right; 
+        n->value = value; 
+        n->refs = 1; 
+        n->size = 1 + (left != NULL ? left->size : 0) + (right != NULL ? right->size : 0); 
+        n->color = color; 
+
+        return n; 
+}
+
+PNode *private_rb_rcu_ref(PNode *n)
+{
+        if (n != NULL)
+                __atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED); 
+
+        return n; 
+}
+
+void private_rb_rcu_release(PNode *n)
+{
+        /* recurse on the left, loop on the right */
+        while (n != NULL && __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+                PNode *right = n->right; 
+
+                private_rb_rcu_release(n->left); 
+                free(n); 
+                n = right; 
+        }
+}
+
+void *private_rb_rcu_open(PNode *n, PNode **left, PNode **right)
+{
+        void *value = n->value; 
+
+        if (__atomic_load_n(&n->refs, __ATOMIC_ACQUIRE) == 1) {
+                *left = n->left; 
+                *right = n->right; 
+                free(n); 
+        } else {
+                *left = private_rb_rcu_ref(n->left); 
+                *right = private_rb_rcu_ref(n->right); 
+                private_rb_rcu_release(n); 
+        }
+
+        return value; 
+}
+
+PNode *private_rb_rcu_paint(PNode *n, int color)
+{
+        if (n->color == color)
+                return n; 
+
+        if (__atomic_load_n(&n->refs, __ATOMIC_ACQUIRE) == 1) {
+                n->color = color; 
+                return n; 
+        }
+
+        PNode *left, *right; 
+        void *value = private_rb_rcu_open(n, &left, &right); 
+
+        return private_rb_rcu_node(color, left, value, right); 
+}
+
+PNode *private_rb_rcu_balance(PNode *left, void *value, PNode *right)
+{
+        PNode *a, *b, *c, *d; 
+        void *x, *y; 
+
+        if (IS_RED(left) && IS_RED(right)) {
+                return private_rb_rcu_node(RED, private_rb_rcu_paint(left, BLACK), value, 
+                                           private_rb_rcu_paint(right, BLACK)); 
+        }
+
+        if (IS_RED(left) && IS_RED(left->left)) {
+                /* (a y c) value right, with a and its parent red */
+                y = private_rb_rcu_open(left, &a, &c); 
+                return private_rb_rcu_node(RED, private_rb_rcu_paint(a, BLACK), y, 
+                                           private_rb_rcu_node(BLACK, c, value, right)); 
+        }
+
+        if (IS_RED(left) && IS_RED(left->right)) {
+                /* (a x (b y c)) value right */
+                x = private_rb_rcu_open(left, &a, &d); 
+                y = private_rb_rcu_open(d, &b, &c); 
+                return private_rb_rcu_node(RED, private_rb_rcu_node(BLACK, a, x, b), y, 
+                                           private_rb_rcu_node(BLACK, c, value, right)); 
+        }
+
+        if (IS_RED(right) && IS_RED(right->right)) {
+                /* left value (b y (c z d)) */
+                y = private_rb_rcu_open(right, &b, &d); 
+                return private_rb_rcu_node(RED, private_rb_rcu_node(BLACK, left, value, b), 
+                                           y, private_rb_rcu_paint(d, BLACK)); 
+        }
+
+        if (IS_RED(right) && IS_RED(right->left)) {
+                /* left value ((b y c) x d) */
+                x = private_rb_rcu_open(right, &a, &d); 
+                y = private_rb_rcu_open(a, &b, &c); 
+                return private_rb_rcu_node(RED, private_rb_rcu_node(BLACK, left, value, b), 
+                                           y, private_rb_rcu_node(BLACK, c, x, d)); 
+        }
+
+        return private_rb_rcu_node(BLACK, left, value, right); 
+}
+
+PNode *private_rb_rcu_balance_left(PNode *left, void *value, PNode *right)
+{
+        PNode *a, *b, *c, *inner; 
+        void *y, *z; 
+
+        if (IS_RED(left))
+                return private_rb_rcu_node(RED, private_rb_rcu_paint(left, BLACK), value, right); 
+
+        if (IS_BLACK(right))
+                return private_rb_rcu_balance(left, value, private_rb_rcu_paint(right, RED)); 
+
+        /* left value ((a y b) z c), with (a y b) black */
+        assert(IS_RED(right) && IS_BLACK(right->left)); 
+
+        z = private_rb_rcu_open(right, &inner, &c); 
+        y = private_rb_rcu_open(inner, &a, &b); 
+
+        assert(IS_BLACK(c)); 
+
+        return private_rb_rcu_node(RED, private_rb_rcu_node(BLACK, left, value, a), y, 
+                                   private_rb_rcu_balance(b, z, private_rb_rcu_paint(c, RED))); 
+}
+
+PNode *private_rb_rcu_balance_right(PNode *left, void *value, PNode *right)
+{
+        PNode *a, *b, *c, *inner; 
+        void *x, *y; 
+
+        if (IS_RED(right))
+                return private_rb_rcu_node(RED, left, value, private_rb_rcu_paint(right, BLACK)); 
+
+        if (IS_BLACK(left))
+                return private_rb_rcu_balance(private_rb_rcu_paint(left, RED), value, right); 
+
+        /* (a x (b y c)) value right, with (b y c) black */
+        assert(IS_RED(left) && IS_BLACK(left->right)); 
+
+        x = private_rb_rcu_open(left, &a, &inner); 
+        y = private_rb_rcu_open(inner, &b, &c); 
+
+        assert(IS_BLACK(a)); 
+
+        return private_rb_rcu_node(RED, 
+                                   private_rb_rcu_balance(private_rb_rcu_paint(a, RED), x, b), 
+                                   y, private_rb_rcu_node(BLACK, c, value, right)); 
+}
+
+PNode *private_rb_rcu_append(PNode *left, PNode *right)
+{
+        PNode *a, *b, *c, *d, *middle; 
+        void *x, *y, *z; 
+
+        if (left == NULL)
+                return right; 
+        if (right == NULL)
+                return left; 
+
+        if (IS_RED(left) && IS_RED(right)) {
+                x = private_rb_rcu_open(left, &a, &b); 
+                y = private_rb_rcu_open(right, &c, &d); 
+                middle = private_rb_rcu_append(b, c); 
+
+                if (IS_RED(middle)) {
+                        z = private_rb_rcu_open(middle, &b, &c); 
+                        return private_rb_rcu_node(RED, private_rb_rcu_node(RED, a, x, b), z, 
+                                                   private_rb_rcu_node(RED, c, y, d)); 
+                }
+
+                return private_rb_rcu_node(RED, a, x, private_rb_rcu_node(RED, middle, y, d)); 
+        }
+
+        if (IS_BLACK(left) && IS_BLACK(right)) {
+                x = private_rb_rcu_open(left, &a, &b); 
+                y = private_rb_rcu_open(right, &c, &d); 
+                middle = private_rb_rcu_append(b, c); 
+
+                if (IS_RED(middle)) {
+                        z = private_rb_rcu_open(middle, &b, &c); 
+                        return private_rb_rcu_node(RED, private_rb_rcu_node(BLACK, a, x, b), z, 
+                                                   private_rb_rcu_node(BLACK, c, y, d)); 
+                }
+
+                return private_rb_rcu_balance_left(a, x, private_rb_rcu_node(BLACK, middle, y, d)); 
+        }
+
+        if (IS_RED(right)) {
+                y = private_rb_rcu_open(right, &c, &d); 
+                return private_rb_rcu_node(RED, private_rb_rcu_append(left, c), y, d); 
+        }
+
+        x = private_rb_rcu_open(left, &a, &b); 
+        return private_rb_rcu_node(RED, a, x, private_rb_rcu_append(b, right)); 
+}
+
+PNode *private_rb_rcu_insert(T tree, PNode *n, void *value, bool *inserted)
+{
+        if (n == NULL) {
+                *inserted = true; 
+                return private_rb_rcu_node(RED, NULL, value, NULL); 
+        }
+
+        int c = tree->comparison_func(value, n->value); 
+
+        if (c < 0) {
+                PNode *left = private_rb_rcu_insert(tree, n->left, value, inserted); 
+
+                if (!*inserted)
+                        return NULL; 
+                if (n->color == BLACK)
+                        return private_rb_rcu_balance(left, n->value, private_rb_rcu_ref(n->right)); 
+
+                return private_rb_rcu_node(RED, left, n->value, private_rb_rcu_ref(n->right)); 
+        } else if (c > 0) {
+                PNode *right = private_rb_rcu_insert(tree, n->right, value, inserted); 
+
+                if (!*inserted)
+                        return NULL; 
+                if (n->color == BLACK)
+                        return private_rb_rcu_balance(private_rb_rcu_ref(n->left), n->value, right); 
+
+                return private_rb_rcu_node(RED, private_rb_rcu_ref(n->left), n->value, right); 
+        }
+
+        return NULL; 
+}
+
+PNode *private_rb_rcu_delete(T tree, PNode *n, void *value, void **removed)
+{
+        if (n == NULL)
+                return NULL; 
+
+        int c = tree->comparison_func(value, n->value); 
+
+        if (c < 0) {
+                PNode *left = private_rb_rcu_delete(tree, n->left, value, removed); 
+
+                if (*removed == NULL)
+                        return NULL; 
+                if (IS_BLACK(n->left))
+                        return private_rb_rcu_balance_left(left, n->value, private_rb_rcu_ref(n->right)); 
+
+                return private_rb_rcu_node(RED, left, n->value, private_rb_rcu_ref(n->right)); 
+        } else if (c > 0) {
+                PNode *right = private_rb_rcu_delete(tree, n->right, value, removed); 
+
+                if (*removed == NULL)
+                        return NULL; 
+                if (IS_BLACK(n->right))
+                        return private_rb_rcu_balance_right(private_rb_rcu_ref(n->left), n->value, right); 
+
+                return private_rb_rcu_node(RED, private_rb_rcu_ref(n->left), n->value, right); 
+        }
+
+        *removed = n->value; 
+
+        return private_rb_rcu_append(private_rb_rcu_ref(n->left), private_rb_rcu_ref(n->right)); 
+}
+
+void private_rb_rcu_publish(T tree, PNode *root)
+{
+        PNode *old_root = tree->root; 
+
+        STORE(&tree->root, root); 
+
+        if (old_root != NULL) {
+                Retired *retired = malloc(sizeof(Retired)); 
+                assert(retired != NULL); 
+
+                /* readers which may hold old_root announced this epoch or an earlier one */
+                retired->root = old_root; 
+                retired->epoch = LOAD(&global_epoch); 
+                retired->next = NULL; 
+
+                if (tree->retired == NULL)
+                        tree->retired = retired; 
+                else
+                        tree->retired_last->next = retired; 
+                tree->retired_last = retired; 
+        }
+
+        private_rb_rcu_advance(); 
+
+        unsigned long epoch = LOAD(&global_epoch); 
+
+        while (tree->retired != NULL && epoch - tree->retired->epoch >= 2) {
+                Retired *retired = tree->retired; 
+
+                tree->retired = retired->next; 
+                private_rb_rcu_release(retired->root); 
+                free(retired); 
+        }
+}
+
+bool private_rb_rcu_advance(void)
+{
+        unsigned long epoch = LOAD(&global_epoch); 
+
+        for (EpochRecord *record = LOAD(&epoch_records); record != NULL; record = record->next) {
+                unsigned long state = LOAD(&record->state); 
+
+                if ((state & 1) && (state >> 1) != epoch)
+                        return false; 
+        }
+
+        return __atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, false, 
+                                           __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); 
+}
+
+EpochRecord *private_rb_rcu_read_begin(void)
+{
+        pthread_once(&epoch_once, &private_rb_rcu_make_key); 
+
+        EpochRecord *record = pthread_getspecific(epoch_key); 
+
+        if (record == NULL) {
+                /* take over the record of a thread which has exited, or add one */
+                for (record = LOAD(&epoch_records); record != NULL; record = record->next) {
+                        bool unused = false; 
+
+                        if (__atomic_compare_exchange_n(&record->in_use, &unused, true, false, 
+                                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                                break; 
+                }
+
+                if (record == NULL) {
+                        void *memory; 
+
+                        if (posix_memalign(&memory, CACHE_LINE, CACHE_LINE) != 0)
+                                memory = NULL; 
+                        assert(memory != NULL && sizeof(EpochRecord) <= CACHE_LINE); 
+
+                        record = memory; 
+                        record->state = 0; 
+                        record->depth = 0; 
+                        record->in_use = true; 
+                        record->next = LOAD(&epoch_records); 
+
+                        while (!__atomic_compare_exchange_n(&epoch_records, &record->next, record, 
+                                                            false, __ATOMIC_SEQ_CST, 
+                                                            __ATOMIC_SEQ_CST))
+                                ; 
+                }
+
+                pthread_setspecific(epoch_key, record); 
+        }
+
+        if (record->depth++ == 0) 
+                __atomic_exchange_n(&record->state, (LOAD(&global_epoch) << 1) | 1, 
+                                    __ATOMIC_SEQ_CST); 
+
+        return record; 
+}
+
+void private_rb_rcu_read_end(EpochRecord *record)
+{
+        if (--record->depth == 0) 
+                STORE(&record->state, 0ul); 
+}
+
+void private_rb_rcu_make_key(void)
+{
+        int failed = pthread_key_create(&epoch_key, &private_rb_rcu_thread_exit); 
+
+        assert(failed == 0); 
+        (void) failed; 
+}
+
+void private_rb_rcu_thread_exit(void *record)
+{
+        STORE(&((EpochRecord *) record)->in_use, false); 
+}
+
+void *private_rb_rcu_search(int comparison_func(void *, void *), PNode *n, void *value)
+{
+        while (n != NULL) {
+                int c = comparison_func(value, n->value); 
+
+                if (c == 0)
+                        return n->value; 
+
+                n = c < 0 ? n->left : n->right; 
+        }
+
+        return NULL; 
+}
+
+void private_rb_rcu_inorder(PNode *n, int depth, 
+                            void func_to_apply(void *value, int depth, void *cl), 
+                            void *cl)
+{
+        if (n == NULL)
+                return; 
+
+        private_rb_rcu_inorder(n->left, depth + 1, func_to_apply, cl); 
+        func_to_apply(n->value, depth, cl); 
+        private_rb_rcu_inorder(n->right, depth + 1, func_to_apply, cl); 
+}
+
+bool private_rb_rcu_save(PNode *n, RedBlack_Save_T save)
+{
+        if (n == NULL)
+                return true; 
+
+        return private_rb_rcu_save(n->left, save) && rb_save_value(save, n->value) 
+               && private_rb_rcu_save(n->right, save); 
+}
+
+bool private_rb_rcu_range(int comparison_func(void *, void *), PNode *n, 
+                          void *lo, bool lo_inclusive, 
+                          void *hi, bool hi_inclusive, 
+                          int func_to_apply(void *value, void *cl), 
+                          void *cl, size_t *visited)
+{
+        bool above_lo = true; 
+        bool below_hi = true; 
+        int c; 
+
+        if (n == NULL)
+                return false; 
+
+        if (lo != NULL) {
+                c = comparison_func(n->value, lo); 
+                above_lo = c > 0 || (c == 0 && lo_inclusive); 
+        }
+        if (hi != NULL) {
+                c = comparison_func(n->value, hi); 
+                below_hi = c < 0 || (c == 0 && hi_inclusive); 
+        }
+
+        if (above_lo && private_rb_rcu_range(comparison_func, n->left, lo, lo_inclusive, hi, 
+                                             hi_inclusive, func_to_apply, cl, visited))
+                return true; 
+
+        if (above_lo && below_hi) {
+                (*visited)++; 
+                if (func_to_apply(n->value, cl) != 0)
+                        return true; 
+        }
+
+        return below_hi && private_rb_rcu_range(comparison_func, n->right, lo, lo_inclusive, hi, 
+                                                hi_inclusive, func_to_apply, cl, visited); 
+}
@@ -0,0 +1,311 @@
+/**********************************************************************
+ * rb_rcu.h                                                           *
+ *                                                                    *
+ * Interface for a red black tree whose readers take no locks         *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_RCU_H
+#define RB_RCU_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "rb_tree.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * an rcu tree holds a set of values which any number of threads may read
+ * and write at once, for workloads which read far more than they write.
+ *
+ * the nodes of a published tree never change. a write copies the O(log n)
+ * nodes on the path it modifies, sharing every other subtree with the
+ * version it replaces, and then publishes the new root with a single
+ * atomic store. writers are serialized by a mutex, but readers take no
+ * lock at all: a lookup or walk loads the current root and works on that
+ * version throughout, so it never sees a half finished write.
+ *
+ * replaced nodes are freed with epoch based reclamation. each reading
+ * thread announces the global epoch it started in; a writer advances the
+ * epoch once every active reader has seen the current one, and frees the
+ * nodes a version dropped two epochs after it was replaced, when no reader
+ * can still be walking them. reclamation never waits: a reader which runs
+ * for a long time only delays the freeing of old nodes.
+ *
+ * values are owned by the caller. a value returned by rb_rcu_delete may
+ * still be in use by readers (its comparisons included) until
+ * rb_rcu_synchronize returns
+ */
+typedef struct rb_rcu *RedBlack_RCU_T;
+
+/*
+ * a snapshot is one version of an rcu tree, kept alive for as long as the
+ * caller likes. taking one costs O(1): it adds a reference to the current
+ * root, and the nodes it shares with later versions are only freed once
+ * both are done with them. a snapshot never changes, so it can be scanned
+ * at leisure, by any number of threads, while writers carry on. it holds
+ * on to the nodes that writers replace after it was taken, so long lived
+ * snapshots cost memory in proportion to the writes made meanwhile.
+ * values deleted from the tree after a snapshot was taken are still in
+ * the snapshot, and must not be freed until it is released
+ */
+typedef struct rb_snapshot *RedBlack_Snapshot_T;
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * rb_rcu_new
+ *
+ * returns a new, empty rcu tree
+ *
+ * CREs         n/a
+ * UREs         system out of memory
+ *
+ * @param       void * - pointer to a comparison function, as described for
+ *                              rb_new. if NULL is passed, strcmp is assumed
+ * @return      pointer to empty rcu tree
+ */
+RedBlack_RCU_T rb_rcu_new(void *comparison_func);
+
+/*
+ * rb_rcu_free
+ *
+ * deallocates the tree and every node it holds which no snapshot shares.
+ * snapshots of the tree remain usable
+ *
+ * CREs         tree == NULL
+ * UREs         another thread is using the tree
+ *
+ * @param       RedBlack_RCU_T - the tree to be freed
+ * @return      n/a
+ */
+void rb_rcu_free(RedBlack_RCU_T tree);
+
+/*
+ * rb_rcu_size
+ *
+ * returns the number of values stored in the tree
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_RCU_T - tree to be measured
+ * @return      size_t - number of values
+ */
+size_t rb_rcu_size(RedBlack_RCU_T tree);
+
+/*
+ * rb_rcu_insert
+ *
+ * inserts the value, unless an equal value is already stored
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_RCU_T - tree in which to insert value
+ * @param       void * - value to be inserted
+ * @return      bool - true if the value was inserted
+ */
+bool rb_rcu_insert(RedBlack_RCU_T tree, void *value);
+
+/*
+ * rb_rcu_delete
+ *
+ * removes the stored value equal to value, and returns it
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_RCU_T - tree to delete from
+ * @param       void * - value to be deleted
+ * @return      void * - the value that was removed, or NULL if there was
+ *                              none. see rb_rcu_synchronize before
+ *                              freeing it
+ */
+void *rb_rcu_delete(RedBlack_RCU_T tree, void *value);
+
+/*
+ * rb_rcu_synchronize
+ *
+ * waits until every read of any rcu tree which was in progress when it
+ * was called has finished, so that values deleted before the call can be
+ * freed
+ *
+ * CREs         n/a
+ * UREs         called from within a read, such as a map function, which
+ *                      never returns
+ *
+ * @return      n/a
+ */
+void rb_rcu_synchronize(void);
+
+/*
+ * rb_rcu_search
+ *
+ * returns the stored value equal to value, or NULL if there is none
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_RCU_T - tree in which to search
+ * @param       void * - value to search for
+ * @return      void * - the value that was found
+ */
+void *rb_rcu_search(RedBlack_RCU_T tree, void *value);
+
+/*
+ * rb_rcu_successor_of_value / rb_rcu_predecessor_of_value
+ *
+ * return the smallest stored value greater than value (or the largest one
+ * less than it), or NULL if there is none
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_RCU_T - tree in which to search
+ * @param       void * - value to search around
+ * @return      void * - the successor (or predecessor)
+ */
+void *rb_rcu_successor_of_value(RedBlack_RCU_T tree, void *value);
+void *rb_rcu_predecessor_of_value(RedBlack_RCU_T tree, void *value);
+
+/*
+ * rb_rcu_minimum / rb_rcu_maximum
+ *
+ * return the minimum (or maximum) stored value, or NULL if the tree is
+ * empty
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_RCU_T - tree to be searched
+ * @return      void * - the minimum (or maximum) value
+ */
+void *rb_rcu_minimum(RedBlack_RCU_T tree);
+void *rb_rcu_maximum(RedBlack_RCU_T tree);
+
+/*
+ * rb_rcu_map_inorder
+ *
+ * applies func_to_apply to every value in sorted order, as rb_map_inorder.
+ * the walk sees the version of the tree that was current when it started,
+ * whatever is written meanwhile
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply calls rb_rcu_synchronize
+ *
+ * @param       RedBlack_RCU_T - tree to walk
+ * @param       void func_to_apply(value, depth, cl) - as for rb_map_inorder
+ * @param       void * - a closure item for func_to_apply
+ * @return      n/a
+ */
+void rb_rcu_map_inorder(RedBlack_RCU_T tree,
+                        void func_to_apply(void *value, int depth, void *cl),
+                        void *cl);
+
+/*
+ * rb_rcu_map_range
+ *
+ * as rb_map_range, over the version of the tree that was current when the
+ * walk started
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply calls rb_rcu_synchronize
+ *
+ * @param       RedBlack_RCU_T - tree to walk
+ * @param       (see rb_map_range)
+ * @return      size_t - number of values passed to func_to_apply
+ */
+size_t rb_rcu_map_range(RedBlack_RCU_T tree,
+                        void *lo, bool lo_inclusive,
+                        void *hi, bool hi_inclusive,
+                        int func_to_apply(void *value, void *cl),
+                        void *cl);
+
+/*
+ * rb_snapshot
+ *
+ * returns the tree's current version, which later writes do not change
+ *
+ * CREs         tree == NULL
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_RCU_T - tree to take a snapshot of
+ * @return      RedBlack_Snapshot_T - the snapshot
+ */
+RedBlack_Snapshot_T rb_snapshot(RedBlack_RCU_T tree);
+
+/*
+ * rb_snapshot_release
+ *
+ * gives up the snapshot, freeing the nodes that no other version shares
+ *
+ * CREs         snapshot == NULL
+ * UREs         another thread is still using the snapshot
+ *
+ * @param       RedBlack_Snapshot_T - the snapshot to be released
+ * @return      n/a
+ */
+void rb_snapshot_release(RedBlack_Snapshot_T snapshot);
+
+/*
+ * rb_snapshot_size / rb_snapshot_search / rb_snapshot_map_inorder /
+ * rb_snapshot_map_range
+ *
+ * as rb_rcu_size, rb_rcu_search, rb_rcu_map_inorder and rb_rcu_map_range,
+ * on the version the snapshot holds. size costs O(1)
+ *
+ * CREs         snapshot == NULL
+ *              value == NULL, or func_to_apply == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Snapshot_T - the snapshot
+ * @param       (see rb_rcu_search and the rb_rcu map functions)
+ * @return      (see rb_rcu_search and the rb_rcu map functions)
+ */
+size_t rb_snapshot_size(RedBlack_Snapshot_T snapshot);
+void *rb_snapshot_search(RedBlack_Snapshot_T snapshot, void *value);
+void rb_snapshot_map_inorder(RedBlack_Snapshot_T snapshot,
+                             void func_to_apply(void *value, int depth, void *cl),
+                             void *cl);
+size_t rb_snapshot_map_range(RedBlack_Snapshot_T snapshot,
+                             void *lo, bool lo_inclusive,
+                             void *hi, bool hi_inclusive,
+                             int func_to_apply(void *value, void *cl),
+                             void *cl);
+
+/*
+ * rb_snapshot_save
+ *
+ * writes the snapshot's values to fd in the format of rb_tree_save, so
+ * that rb_tree_load can rebuild them. a snapshot never changes, so the
+ * save needs no lock and writers carry on while it streams
+ *
+ * CREs         snapshot == NULL
+ *              encode == NULL
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_Snapshot_T - the snapshot to save
+ * @param       int - file descriptor open for writing
+ * @param       size_t encode(value, buf, capacity) - as for rb_tree_save
+ * @return      bool - true if every byte was written
+ */
+bool rb_snapshot_save(RedBlack_Snapshot_T snapshot, int fd,
+                      size_t encode(void *value, unsigned char *buf, size_t capacity));
+
+#endif
@@ -0,0 +1,367 @@
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+
+#include "rb_sharded.h"
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+/*** MACRO DEFINITIONS ***/
+
+#define CACHE_LINE 64
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/* one shard's lock, alone on its cache lines */
+typedef union ShardLock {
+        pthread_mutex_t lock; 
+        char padding[2 * CACHE_LINE]; 
+} ShardLock; 
+
+struct rb_sharded {
+        size_t shard_count; 
+        RedBlack_T *shards; 
+        ShardLock *locks;       /* shard_count locks, cache line aligned */
+        int (*comparison_func)(void *, void *); 
+        uint64_t (*hash_func)(void *value);     /* NULL when split by range */
+        void **bounds;          /* shard_count - 1 bounds when split by range */
+}; 
+
+/* a shard's cursor, in the heap that merges hash shards */
+typedef struct MergeCursor {
+        struct rb_iter it; 
+        void *value; 
+} MergeCursor; 
+
+typedef RedBlack_Sharded_T T; 
+
+/*********************************
+ * PRIVATE FUNCTION DECLARATIONS *
+ *********************************/ 
+
+/*
+ * private_rb_sharded_new
+ * 
+ * allocates a tree of shard_count empty shards, which the two constructors
+ * then set up for hashing or for ranges
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @return      T - the new tree
+ */
+T private_rb_sharded_new(void *comparison_func, unsigned mode, size_t shard_count); 
+
+/*
+ * private_rb_sharded_index
+ * 
+ * returns the index of the shard which holds value
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+size_t private_rb_sharded_index(T tree, void *value); 
+
+/*
+ * private_rb_sharded_merge
+ * 
+ * walks every shard of a hash sharded tree at once, in sorted order, 
+ * keeping a binary heap of one cursor per shard ordered by the cursors' 
+ * values. called with every shard locked
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @return      size_t - number of values passed to func_to_apply
+ */
+size_t private_rb_sharded_merge(T tree, int func_to_apply(void *value, void *cl), 
+                                void *cl); 
+
+/*
+ * private_rb_sharded_sift_down
+ * 
+ * restores the heap order below heap[i], for a heap of count cursors
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ */
+void private_rb_sharded_sift_down(T tree, MergeCursor *heap, size_t count, size_t i); 
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+T rb_sharded_new_hash(void *comparison_func, unsigned mode, size_t shards, 
+                      uint64_t hash_func(void *value))
+{
+        assert(shards > 0 && shards <= RB_SHARDED_MAX_SHARDS && hash_func != NULL); 
+
+        T tree = private_rb_sharded_new(comparison_func, mode, shards); 
+
+        tree->hash_func = hash_func; 
+
+        return tree; 
+}
+
+T rb_sharded_new_range(void *comparison_func, unsigned mode, size_t shards, void **bounds)
+{
+        assert(shards < RB_SHARDED_MAX_SHARDS && (bounds != NULL || shards == 0)); 
+
+        T tree = private_rb_sharded_new(comparison_func, mode, shards + 1); 
+
+        if (shards > 0) {
+                tree->bounds = malloc(shards * sizeof(void *)); 
+                assert(tree->bounds != NULL); 
+                memcpy(tree->bounds, bounds, shards * sizeof(void *)); 
+        }
+
+        return tree; 
+}
+
+void rb_sharded_free(T tree)
+{
+        assert(tree != NULL); 
+
+        for (size_t i = 0; i < tree->shard_count; i++) {
+                pthread_mutex_destroy(&tree->locks[i].lock); 
+                rb_tree_free(tree->shards[i]); 
+        }
+
+        free(tree->bounds); 
+        free(tree->locks); 
+        free(tree->shards); 
+        free(tree); 
+}
+
+size_t rb_sharded_size(T tree)
+{
+        assert(tree != NULL); 
+
+        size_t size = 0; 
+
+        for (size_t i = 0; i < tree->shard_count; i++) {
+                pthread_mutex_lock(&tree->locks[i].lock); 
+                size += rb_tree_size(tree->shards[i]); 
+                pthread_mutex_unlock(&tree->locks[i].lock); 
+        }
+
+        return size; 
+}
+
+void rb_sharded_insert(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        size_t i = private_rb_sharded_index(tree, value); 
+
+        pthread_mutex_lock(&tree->locks[i].lock); 
+        rb_insert_value(tree->shards[i], value); 
+        pthread_mutex_unlock(&tree->locks[i].lock); 
+}
+
+bool rb_sharded_delete(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        size_t i = private_rb_sharded_index(tree, value); 
+
+        pthread_mutex_lock(&tree->locks[i].lock); 
+        bool deleted = rb_delete_one(tree->shards[i], value); 
+        pthread_mutex_unlock(&tree->locks[i].lock); 
+
+        return deleted; 
+}
+
+void *rb_sharded_search(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        size_t i = private_rb_sharded_index(tree, value); 
+
+        pthread_mutex_lock(&tree->locks[i].lock); 
+        void *found = rb_search(tree->shards[i], value); 
+        pthread_mutex_unlock(&tree->locks[i].lock); 
+
+        return found; 
+}
+
+size_t rb_sharded_map_inorder(T tree, 
+                              int func_to_apply(void *value, void *cl), 
+                              void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        size_t visited = 0; 
+
+        if (tree->hash_func != NULL) {
+                /* always in index order, so two walks cannot deadlock */
+                for (size_t i = 0; i < tree->shard_count; i++) 
+                        pthread_mutex_lock(&tree->locks[i].lock); 
+
+                visited = private_rb_sharded_merge(tree, func_to_apply, cl); 
+
+                for (size_t i = tree->shard_count; i > 0; i--) 
+                        pthread_mutex_unlock(&tree->locks[i - 1].lock); 
+
+                return visited; 
+        }
+
+        for (size_t i = 0; i < tree->shard_count; i++) {
+                bool stopped = false; 
+
+                pthread_mutex_lock(&tree->locks[i].lock); 
+
+                struct rb_iter it = rb_iter_first(tree->shards[i]); 
+                for (void *value = rb_iter_value(&it); value != NULL; value = rb_iter_next(&it)) {
+                        visited++; 
+                        if (func_to_apply(value, cl) != 0) {
+                                stopped = true; 
+                                break; 
+                        }
+                }
+
+                pthread_mutex_unlock(&tree->locks[i].lock); 
+
+                if (stopped)
+                        break; 
+        }
+
+        return visited; 
+}
+
+uint64_t rb_sharded_hash_string(void *value)
+{
+        assert(value != NULL); 
+
+        uint64_t hash = 14695981039346656037ull; 
+
+        for (const unsigned char *c = value; *c != '\0'; c++) {
+                hash ^= *c; 
+                hash *= 1099511628211ull; 
+        }
+
+        return hash; 
+}
+
+T private_rb_sharded_new(void *comparison_func, unsigned mode, size_t shard_count)
+{
+        T tree = malloc(sizeof(struct rb_sharded)); 
+        void *locks; 
+
+        assert(tree != NULL); 
+        assert((mode & (RB_INTERVAL | RB_MAP)) == 0); 
+
+        tree->shard_count = shard_count; 
+        tree->shards = malloc(shard_count * sizeof(RedBlack_T)); 
+        if (posix_memalign(&locks, CACHE_LINE, shard_count * sizeof(ShardLock)) != 0)
+                locks = NULL; 
+        assert(tree->shards != NULL && locks != NULL); 
+        tree->locks = locks; 
+
+        for (size_t i = 0; i < shard_count; i++) {
+                tree->shards[i] = rb_new_mode(comparison_func, mode); 
+                pthread_mutex_init(&tree->locks[i].lock, NULL); 
+        }
+
+        if (comparison_func == NULL) {
+                tree->comparison_func = (int (*)(void *, void *)) &strcmp; 
+        } else {
+                tree->comparison_func = (int (*)(void *, void *)) comparison_func; 
+        }
+
+        tree->hash_func = NULL; 
+        tree->bounds = NULL; 
+
+        return tree; 
+}
+
+size_t private_rb_sharded_index(T tree, void *value)
+{
+        if (tree->hash_func != NULL) {
+                /* the murmur3 finalizer, so that poorly mixed hashes spread */
+                uint64_t h = tree->hash_func(value); 
+
+                h ^= h >> 33; 
+                h *= 0xff51afd7ed558ccdull; 
+                h ^= h >> 33; 
+                h *= 0xc4ceb9fe1a85ec53ull; 
+                h ^= h >> 33; 
+
+                return (size_t) (h % tree->shard_count); 
+        }
+
+        /* the number of bounds at or below value */
+        size_t lo = 0; 
+        size_t hi = tree->shard_count - 1; 
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2; 
+
+                if (tree->comparison_func(value, tree->bounds[mid]) >= 0)
+                        lo = mid + 1; 
+                else
+                        hi = mid; 
+        }
+
+        return lo; 
+}
+
+size_t private_rb_sharded_merge(T tree, int func_to_apply(void *value, void *cl), 
+                                void *cl)
+{
+        MergeCursor *heap = malloc(tree->shard_count * sizeof(MergeCursor)); 
+        size_t count = 0; 
+        size_t visited = 0; 
+
+        assert(heap != NULL); 
+
+        for (size_t i = 0; i < tree->shard_count; i++) {
+                heap[count].it = rb_iter_first(tree->shards[i]); 
+                heap[count].value = rb_iter_value(&heap[count].it); 
+                if (heap[count].value != NULL)
+                        count++; 
+        }
+
+        for (size_t i = count / 2; i > 0; i--) 
+                private_rb_sharded_sift_down(tree, heap, count, i - 1); 
+
+        while (count > 0) {
+                visited++; 
+                if (func_to_apply(heap[0].value, cl) != 0)
+                        break; 
+
+                heap[0].value = rb_iter_next(&heap[0].it); 
+                if (heap[0].value == NULL)
+                        heap[0] = heap[--count]; 
+
+                private_rb_sharded_sift_down(tree, heap, count, 0); 
+        }
+
+        free(heap); 
+
+        return visited; 
+}
+
+void private_rb_sharded_sift_down(T tree, MergeCursor *heap, size_t count, size_t i)
+{
+        for (;;) {
+                size_t smallest = i; 
+                size_t left = 2 * i + 1; 
+                size_t right = left + 1; 
+
+                if (left < count && 
+                    tree->comparison_func(heap[left].value, heap[smallest].value) < 0)
+                        smallest = left; 
+                if (right < count && 
+                    tree->comparison_func(heap[right].value, heap[smallest].value) < 0)
+                        smallest = right; 
+
+                if (smallest == i)
+                        return; 
+
+                MergeCursor tmp = heap[i]; 
+                heap[i] = heap[smallest]; 
+                heap[smallest] = tmp; 
+                i = smallest; 
+        }
+}
@@ -0,0 +1,182 @@
+/**********************************************************************
+ * rb_sharded.h                                                       *
+ *                                                                    *
+ * Interface for a red black tree split into independently locked     *
+ * shards                                                             *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_SHARDED_H
+#define RB_SHARDED_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rb_tree.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * a sharded tree spreads its values over a number of RedBlack_T shards,
+ * each behind its own lock, so that writers to different shards never
+ * wait for one another or rebalance the same nodes. every function below
+ * may be called from any number of threads at once.
+ *
+ * values are assigned to shards either by hash, which spreads any mix of
+ * keys evenly but leaves no order between shards, or by key range, given
+ * as the values at which each shard after the first begins, which keeps
+ * the shards in order but only spreads writes as evenly as the bounds
+ * match the keys. either way an inorder walk sees every value in sorted
+ * order: range shards are walked one after another, while hash shards are
+ * merged
+ */
+typedef struct rb_sharded *RedBlack_Sharded_T;
+
+#define RB_SHARDED_MAX_SHARDS 4096
+
+/**********************
+ * FUNCTION CONTRACTS *
+ * AND DECLARATIONS   *
+ **********************/
+
+/*
+ * rb_sharded_new_hash
+ *
+ * returns a new, empty sharded tree which places each value in the shard
+ * picked by its hash. equal values must hash alike; the hash need not be
+ * well mixed, since it is mixed again before use
+ *
+ * CREs         shards == 0 or shards > RB_SHARDED_MAX_SHARDS
+ *              hash_func == NULL
+ *              mode includes RB_INTERVAL or RB_MAP
+ * UREs         system out of memory
+ *
+ * @param       void * - pointer to a comparison function, as described for
+ *                              rb_new. if NULL is passed, strcmp is assumed
+ * @param       unsigned - RB_* mode flags for each shard, as for
+ *                              rb_new_mode
+ * @param       size_t - number of shards
+ * @param       uint64_t hash_func(value) - hashes a value
+ * @return      pointer to empty sharded tree
+ */
+RedBlack_Sharded_T rb_sharded_new_hash(void *comparison_func, unsigned mode,
+                                       size_t shards,
+                                       uint64_t hash_func(void *value));
+
+/*
+ * rb_sharded_new_range
+ *
+ * returns a new, empty sharded tree of shards + 1 shards split by key
+ * range: values less than bounds[0] go to the first shard, values from
+ * bounds[i - 1] up to but excluding bounds[i] to shard i, and values from
+ * bounds[shards - 1] up to the last. the bounds array is copied, but the
+ * values it points to must outlive the tree
+ *
+ * CREs         shards > RB_SHARDED_MAX_SHARDS - 1
+ *              bounds == NULL and shards > 0
+ *              mode includes RB_INTERVAL or RB_MAP
+ * UREs         bounds are not in ascending order
+ *              system out of memory
+ *
+ * @param       void * - pointer to a comparison function, as for
+ *                              rb_sharded_new_hash
+ * @param       unsigned - RB_* mode flags for each shard
+ * @param       size_t - number of bounds, one less than the number of
+ *                              shards
+ * @param       void ** - the bounds, in ascending order
+ * @return      pointer to empty sharded tree
+ */
+RedBlack_Sharded_T rb_sharded_new_range(void *comparison_func, unsigned mode,
+                                        size_t shards, void **bounds);
+
+/*
+ * rb_sharded_free
+ *
+ * deallocates the tree and its shards. no other thread may be using it
+ *
+ * CREs         tree == NULL
+ * UREs         another thread is using the tree
+ *
+ * @param       RedBlack_Sharded_T - the tree to be freed
+ * @return      n/a
+ */
+void rb_sharded_free(RedBlack_Sharded_T tree);
+
+/*
+ * rb_sharded_size
+ *
+ * returns the number of values stored in the tree, summed over the shards
+ * one at a time
+ *
+ * CREs         tree == NULL
+ * UREs         n/a
+ *
+ * @param       RedBlack_Sharded_T - tree to be measured
+ * @return      size_t - number of values
+ */
+size_t rb_sharded_size(RedBlack_Sharded_T tree);
+
+/*
+ * rb_sharded_insert / rb_sharded_delete / rb_sharded_search
+ *
+ * as rb_insert_value, rb_delete_one and rb_search, on the value's shard,
+ * holding only that shard's lock
+ *
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         system out of memory
+ *
+ * @param       RedBlack_Sharded_T - the tree
+ * @param       void * - the value
+ * @return      rb_sharded_delete: bool - true if a value was deleted
+ *              rb_sharded_search: void * - the stored value, or NULL
+ */
+void rb_sharded_insert(RedBlack_Sharded_T tree, void *value);
+bool rb_sharded_delete(RedBlack_Sharded_T tree, void *value);
+void *rb_sharded_search(RedBlack_Sharded_T tree, void *value);
+
+/*
+ * rb_sharded_map_inorder
+ *
+ * applies func_to_apply to every value in sorted order. a hash sharded tree
+ * is merged across all its shards while holding every shard's lock, so the
+ * walk sees one consistent state; a range sharded tree is walked one shard
+ * at a time, holding only that shard's lock
+ *
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply calls any rb_sharded function on the same
+ *                      tree, which deadlocks
+ *              system out of memory
+ *
+ * @param       RedBlack_Sharded_T - tree to walk
+ * @param       int func_to_apply(value, cl) - returns zero to continue the
+ *                      walk, and non-zero to stop it
+ * @param       void * - a closure item for func_to_apply
+ * @return      size_t - number of values passed to func_to_apply
+ */
+size_t rb_sharded_map_inorder(RedBlack_Sharded_T tree,
+                              int func_to_apply(void *value, void *cl),
+                              void *cl);
+
+/*
+ * rb_sharded_hash_string
+ *
+ * a hash for nul terminated strings (FNV-1a), for use with
+ * rb_sharded_new_hash
+ *
+ * CREs         value == NULL
+ * UREs         n/a
+ *
+ * @param       void * - a nul terminated string
+ * @return      uint64_t - its hash
+ */
+uint64_t rb_sharded_hash_string(void *value);
+
+#endif
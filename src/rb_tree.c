@@ -1,860 +1,4286 @@
+#ifdef RB_PARALLEL
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "rb_tree.h"
 #include <assert.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef RB_PARALLEL
+#include <pthread.h>
+#endif
 
 /*** MACRO DEFINITIONS ***/
 
-#define BLACK 'b'
-#define RED 'r'
+/* 
+ * nodes are at least pointer aligned, so the low bit of the parent pointer 
+ * is always zero and is used to store the color of the node instead
+ */
+#define RED 0
+#define BLACK 1
+
+#define PARENT(n) ((Node *) ((n)->parent_color & ~(uintptr_t) 1))
+#define COLOR(n) ((int) ((n)->parent_color & 1))
+#define SET_PARENT(n, p) ((n)->parent_color = (uintptr_t) (p) | COLOR(n))
+#define SET_COLOR(n, c) ((n)->parent_color = ((n)->parent_color & ~(uintptr_t) 1) \
+                                             | (uintptr_t) (c))
+
+#define IS_BLACK(n) ((n) == NULL || COLOR(n) == BLACK)
+
+/* 
+ * nodes are carved out of chunks owned by the tree. the first chunk holds 
+ * RB_CHUNK_MIN_NODES nodes and each following chunk doubles in size, up to 
+ * RB_CHUNK_MAX_NODES
+ */
+#define RB_CHUNK_MIN_NODES 32
+#define RB_CHUNK_MAX_NODES 4096
+
+/* 
+ * a tree split off from another (see rb_split) does not know how many 
+ * values it holds until rb_tree_size first counts them; until then its 
+ * count is COUNT_UNKNOWN and is left alone by inserts and deletes
+ */
+#define COUNT_UNKNOWN SIZE_MAX
+#define COUNT_ADD(tree, n)                                                    \
+                ((tree)->count != COUNT_UNKNOWN ? (void) ((tree)->count += (n)) \
+                                                : (void) 0)
+#define COUNT_SUB(tree, n)                                                    \
+                ((tree)->count != COUNT_UNKNOWN ? (void) ((tree)->count -= (n)) \
+                                                : (void) 0)
+
+/* 
+ * the value of a node: intrusive trees recover the caller's record from the 
+ * embedded link, all other trees store a pointer to the value next to it
+ */
+#define NODE_VALUE(tree, n) ((tree)->intrusive                                \
+                ? (void *) ((char *) (n) - (tree)->link_offset)               \
+                : ((ValueNode *) (n))->value)
+
+/* 
+ * augmented trees keep extra fields after the value in each node; the tree 
+ * records where they live. the order statistics field is the number of 
+ * values in the subtree rooted at the node. interval trees order nodes by 
+ * the low endpoint, which is kept as the node's value, and keep the rest of
+ * the interval in an IntervalData
+ */
+#define IS_AUGMENTED(tree) \
+                (((tree)->mode & (RB_ORDER_STATISTICS | RB_INTERVAL)) != 0)
+#define SUBTREE_SIZE(tree, n) ((n) == NULL ? 0                                 \
+                : *(size_t *) ((char *) (n) + (tree)->size_offset))
+#define SET_SUBTREE_SIZE(tree, n, s)                                          \
+                (*(size_t *) ((char *) (n) + (tree)->size_offset) = (s))
+#define INTERVAL(tree, n) ((IntervalData *) ((char *) (n) + (tree)->interval_offset))
+
+/* 
+ * map trees keep the key as the node's value and the mapped value in a 
+ * separate slot after it
+ */
+#define MAPPED(tree, n) ((void **) ((char *) (n) + (tree)->map_offset))
+
+/* 
+ * multiset trees keep one node per distinct value, along with the number 
+ * of times it was inserted. the node counts that many times towards sizes
+ */
+#define MULTIPLICITY(tree, n) ((size_t *) ((char *) (n) + (tree)->multi_offset))
+#define NODE_WEIGHT(tree, n) (((tree)->mode & RB_MULTISET) ? *MULTIPLICITY(tree, n) : 1)
+
+/* 
+ * performance counters are only kept when compiled with RB_STATS; 
+ * otherwise STAT_INC expands to nothing and COMPARE to a plain call. 
+ * readers sharing a tree (see rb_concurrent.h) count through the same 
+ * counters, so they are bumped atomically; relaxed ordering is enough, 
+ * since nothing else is ordered by them
+ */
+#ifdef RB_STATS
+#define STAT_INC(tree, counter) STAT_ADD(tree, counter, 1)
+#define STAT_ADD(tree, counter, n) \
+                ((void) __atomic_add_fetch(&(tree)->stats.counter, (n), __ATOMIC_RELAXED))
+#define STAT_READ(tree, counter) __atomic_load_n(&(tree)->stats.counter, __ATOMIC_RELAXED)
+#else
+#define STAT_INC(tree, counter) ((void) 0)
+#define STAT_ADD(tree, counter, n) ((void) (n))
+#endif
+
+#define COMPARE(tree, cmp, a, b) (STAT_INC(tree, comparisons), (cmp)((a), (b)))
+
+/* 
+ * the node level rebalancing only calls back after a rotation when there 
+ * is something to do: augmented data to recompute, or rotations to count
+ */
+#ifdef RB_STATS
+#define ROTATED_HOOK(tree) (&private_rb_rotated)
+#else
+#define ROTATED_HOOK(tree) (IS_AUGMENTED(tree) ? &private_rb_rotated : NULL)
+#endif
+
+/* 
+ * likewise, calls are only recorded to a trace when compiled with RB_TRACE. 
+ * TRACE_OP writes nothing unless rb_trace_start was called on the tree
+ */
+#ifdef RB_TRACE
+#define TRACE_OP(tree, op, value)                                             \
+                do {                                                          \
+                        if ((tree)->trace != NULL)                            \
+                                private_rb_trace_record(tree, op, value);     \
+                } while (0)
+#else
+#define TRACE_OP(tree, op, value) ((void) 0)
+#endif
+
+/* 
+ * saves and loads go through a buffer of RB_SAVE_BUFFER_SIZE bytes, and a 
+ * varint takes at most RB_SAVE_MAX_VARINT of them
+ */
+#define RB_SAVE_BUFFER_SIZE 65536
+#define RB_SAVE_MAX_VARINT 10
+
+/* 
+ * when compiled with RB_PARALLEL, the set operations run the two halves of
+ * their recursion on separate threads, down to a depth which gives about 
+ * two tasks per processor, as long as both trees' black heights there are 
+ * at least RB_SET_FORK_HEIGHT (so each holds at least 2^10 - 1 values, 
+ * enough work to pay for starting a thread)
+ */
+#define RB_SET_FORK_HEIGHT 10
+
+typedef struct rb_node Node; 
 
-typedef struct Node {
+typedef struct ValueNode {
+        Node link; 
         void *value;
-        struct Node *parent;
-        struct Node *left; 
-        struct Node *right; 
-        char color; 
-} Node;
+} ValueNode;
+
+typedef struct IntervalData {
+        void *hi;               /* high endpoint of this node's interval */
+        void *max;              /* highest endpoint in this node's subtree */
+        void *value;            /* value stored with the interval */
+} IntervalData; 
+
+typedef struct rb_chunk {
+        struct rb_chunk *next; 
+        size_t capacity; 
+        ValueNode nodes[]; 
+} Chunk; 
+
+/* 
+ * split and join move nodes between trees without copying them, so the 
+ * chunks a node lives in may outlive the tree that allocated them. such 
+ * chunks are handed to a ChunkShare, held by every tree which may have 
+ * nodes in them, and are freed along with the last of those trees. a tree 
+ * which is freed while others still hold its share leaves its nodes on the
+ * share's orphan list, from which the others allocate before growing.
+ * 
+ * a tree holds at most one share: joining trees which hold different ones 
+ * moves the chunks of one into the other and leaves it merged_into the 
+ * other, for the trees still holding it to find. the trees holding a share
+ * may be used, and freed, on different threads, so its lists and counts 
+ * are only changed atomically
+ */
+typedef struct ChunkShare {
+        Chunk *chunks; 
+        Node *orphans;          /* free nodes, linked through ->right */
+        struct ChunkShare *merged_into; 
+        size_t refs;            /* trees and merged shares holding it */
+} ChunkShare; 
 
 struct rb_tree {
         Node *root; 
         void *comparison_func; 
+
+        bool intrusive;         /* nodes are embedded in caller records */
+        size_t link_offset;     /* offset of the rb_node in those records */
+
+        unsigned mode;          /* RB_* mode flags the tree was created with */
+        size_t node_size;       /* bytes per node, including augmentation */
+        size_t size_offset;     /* offset of the subtree size in a node */
+        size_t interval_offset; /* offset of the IntervalData in a node */
+        size_t map_offset;      /* offset of the mapped value in a node */
+        size_t multi_offset;    /* offset of the multiplicity in a node */
+        size_t count;           /* number of values in the tree */
+
+        Chunk *chunks;          /* most recently allocated chunk first */
+        size_t chunk_used;      /* nodes handed out from chunks->nodes */
+        Node *free_nodes;       /* released nodes, linked through ->right */
+        size_t free_count;      /* number of nodes on free_nodes */
+        ChunkShare *share;      /* chunks shared with split or joined trees */
+
+        Node *leftmost;         /* node holding the minimum, NULL if empty */
+        Node *rightmost;        /* node holding the maximum, NULL if empty */
+
+#ifdef RB_TRACE
+        FILE *trace;            /* where calls are recorded, or NULL */
+        size_t (*trace_encode)(void *value, unsigned char *buf, size_t capacity); 
+#endif
+
+#ifdef RB_STATS
+        struct {
+                size_t comparisons; 
+                size_t rotations; 
+                size_t insert_fixups; 
+                size_t delete_fixups; 
+                size_t node_allocations; 
+                size_t chunk_allocations; 
+        } stats; 
+#endif
 };
 
 typedef RedBlack_T T; 
 
+/* a saved tree being written; see rb_save_begin */
+struct rb_save {
+        int fd; 
+        size_t (*encode)(void *value, unsigned char *buf, size_t capacity); 
+        bool multiset;          /* records carry a count */
+        bool failed;            /* a write failed, or too many records */
+        size_t remaining;       /* records still to come */
+        uint32_t crc;           /* of everything written so far */
+        uint32_t crc_table[256]; 
+        unsigned char *record;  /* scratch for one value's encoding */
+        size_t record_capacity; 
+        size_t used;            /* bytes waiting in buffer */
+        unsigned char buffer[RB_SAVE_BUFFER_SIZE]; 
+}; 
+
+/* a saved tree being read; see rb_tree_load */
+typedef struct LoadStream {
+        int fd; 
+        uint32_t crc;           /* of everything consumed so far */
+        uint32_t crc_table[256]; 
+        size_t next;            /* next unconsumed byte of buffer */
+        size_t end;             /* bytes read into buffer */
+        unsigned char buffer[RB_SAVE_BUFFER_SIZE]; 
+} LoadStream; 
+
+typedef enum SetOp {
+        SET_UNION, 
+        SET_INTERSECTION, 
+        SET_DIFFERENCE
+} SetOp; 
+
+#ifdef RB_PARALLEL
+/* one half of a set operation, run on a thread of its own */
+typedef struct SetTask {
+        struct rb_tree context; /* private copy, whose root joins overwrite */
+        SetOp op; 
+        Node *a; 
+        int ha; 
+        Node *b; 
+        int hb; 
+        unsigned forks; 
+        Node *result; 
+        int height; 
+        size_t hits; 
+} SetTask; 
+
+/* levels of a set operation's recursion which fork, set once per process */
+unsigned private_rb_set_fork_levels = 0; 
+#endif
+
 /*********************************
  * PRIVATE FUNCTION DECLARATIONS *
  *********************************/ 
 
 /*
- * private_rb_deallocate_all_tree_nodes
+ * private_rb_deallocate_all_chunks
  * 
- * helper function for rb_tree_free. Recursively deletes all nodes in 
- * the subtree rooted at n (rb_tree_free passes in tree->root)
+ * helper function for rb_tree_free. releases every chunk of nodes owned by 
+ * the tree in a single pass over the chunk list, without visiting the nodes
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - the root of a subtree to delete
+ * @param       T - the tree whose chunks are released
  * @return      n/a
  */
-void private_rb_deallocate_all_tree_nodes(Node *n); 
+void private_rb_deallocate_all_chunks(T tree); 
 
-/* 
- * rotate_left
+/*
+ * private_rb_release_node
  * 
- * given a tree and a node n, moves n's right child to be the child of n's 
- * parent, and makes n the child of its right child
+ * returns a node that is no longer linked into the tree to the tree's free 
+ * list, so that the next rb_construct_node call can reuse it
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which rotation is occuring
- * @param       Node * - pointer to the node to be rotated
+ * @param       T - tree which owns the node
+ * @param       Node * - node to be released
  * @return      n/a
  */
-void rb_rotate_left(T tree, Node *n); 
+void private_rb_release_node(T tree, Node *n); 
 
-/* 
- * rb_rotate_right
+/*
+ * private_rb_give_free_nodes
  * 
- * given a tree and a node n, moves n's left child to be the child of n's 
- * parent, and makes n the child of its left child
+ * adds a list of free nodes, linked through ->right, to the tree's free 
+ * list. takes time proportional to the length of the list
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which rotation is occuring
- * @param       Node * - pointer to the node to be rotated
+ * @param       T - tree whose free list grows
+ * @param       Node * - the list; may be NULL
  * @return      n/a
  */
-void rb_rotate_right(T tree, Node *n); 
+void private_rb_give_free_nodes(T tree, Node *nodes); 
 
 /*
- * rb_construct_node
+ * private_rb_release_subtree
  * 
- * given a value, constructs a node containing that value, with all relational
- * pointers set to NULL, and color set to RED
+ * releases every node of a detached subtree, as private_rb_release_node
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       void * - value to go into the node
- * @return      Node * - pointer to the new node
- */ 
-Node *rb_construct_node(void *value);
-
+ * @param       T - tree which owns the nodes
+ * @param       Node * - root of the subtree, or NULL
+ * @return      n/a
+ */
+void private_rb_release_subtree(T tree, Node *n); 
 
 /*
- * private_insert_value
- *
- * helper function for rb_insert_value. does the actual work of inserting
- * the value. 
+ * private_rb_compact
+ * 
+ * moves the tree's values into a single new chunk, linked as by 
+ * rb_build_from_sorted, and gives up every node and chunk it held before
  * 
  * CREs         n/a
- * UREs         n/a
+ * UREs         the tree is intrusive, or does not know its count
+ *              system out of memory
  * 
- * @param       Node * - the root of the current subtree (rb_insert_value 
- *                      passes in tree->root)
- * @param       Node * - a pointer to the node with the value to be deleted
- * @param       void * - a pointer to the comparison function for the current
- *                      root
- * @return      a pointer to the most recently touched node 
+ * @param       T - tree to be compacted
+ * @return      n/a
  */
-Node *private_rb_insert_value(Node *root, Node *new_node, 
-                           void *comparison_func(void *val1, void *val2));
+void private_rb_compact(T tree); 
 
 /*
- * fix_insertion_violation
+ * private_rb_share_chunks
  * 
- * given a tree and a pointer to the most recently inserted node,
- * fixes any violations of the red-black properties in tree
+ * hands the tree's chunks over to its ChunkShare, making one if it holds 
+ * none, so that other trees can hold on to them too. the unused nodes of 
+ * the tree's newest chunk go on its free list, and its next node comes 
+ * from there or a chunk of its own
  * 
- * CREs         tree == NULL
- * UREs         n/a
+ * CREs         n/a
+ * UREs         system out of memory
  * 
- * @param       T - tree in which we are fixing violations
- * @param       Node * - pointer to the most recently inserted node
+ * @param       T - tree whose chunks are shared
  * @return      n/a
  */
-void fix_insertion_violation(T tree, Node *inserted);
+void private_rb_share_chunks(T tree); 
 
 /*
- * private_find_in_tree
+ * private_rb_find_share
  * 
- * private helper function for rb_search and rb_delete_value. 
- * given a tree, a value, and a comparison function, returns the first 
- * located node with the value we are looking for
+ * returns the share that share has been merged into, if any, following 
+ * the chain of merges, and otherwise share itself
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which we are searching
- * @param       void * - pointer to the value we are searching for
- * @param       void * - pointer to the comparison function for that tree
- * @return      Node * - pointer to the node containing value
+ * @param       ChunkShare * - a share, or NULL
+ * @return      ChunkShare * - the share holding its chunks, or NULL
  */
-Node *private_rb_find_in_tree(T tree, void *value, 
-                           void *comparison_func(void *val1, void *val2));
+ChunkShare *private_rb_find_share(ChunkShare *share); 
 
-/* 
- * rb_transplant
+/*
+ * private_rb_hold_share
  * 
- * given a tree, a pointer to node u and a pointer to node v, replaces u with v
- * in the tree
+ * makes the tree hold share. a tree already holding another share has that
+ * share merged into this one, and gives it up
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which we are transplanting
- * @param       Node * - pointer to node to be replaced
- * @param       Node * - pointer to node to replace with
+ * @param       T - tree which will hold the share
+ * @param       ChunkShare * - share to be held, not merged into another
  * @return      n/a
  */
-void rb_transplant(T tree, Node *u, Node *v); 
+void private_rb_hold_share(T tree, ChunkShare *share); 
 
-/* 
- * rb_delete_fixup
- *
- * given a tree and a pointer to the former subtree of the deleted node, 
- * restores the red black tree properties. all deleted nodes have at most one 
- * child; two child nodes are replaced by their successor, which by definition
- * has at most one child. that child is the second parameter to this function
+/*
+ * private_rb_drop_share
+ * 
+ * gives up a reference to share, freeing it once nothing holds it: along 
+ * with its chunks, or by passing anything left on it to the share it was 
+ * merged into, and giving that up in turn
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree where a value was deleted
- * @param       Node * - former child of the deleted node
+ * @param       ChunkShare * - share to be dropped
  * @return      n/a
  */
-void rb_delete_fixup(T tree, Node *x);
+void private_rb_drop_share(ChunkShare *share); 
 
 /*
- * private_rb_successor_of_value
+ * private_rb_give_chunks / private_rb_give_orphans
  * 
- * private helper function for rb_successor_of_value
+ * atomically add a list of chunks, or a list of free nodes linked through 
+ * ->right, to the front of share's 
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which to search
- * @param       void * - pointer to the value we want the successor of
- * @param       void * - pointer to the comparison function associated with tree
- * @return      void * - pointer to the successor's value (or NULL if no 
- *                      successor exists)
+ * @param       ChunkShare * - share to add to
+ * @param       Chunk * or Node * - the list; may be NULL
+ * @return      n/a
  */
-void *private_rb_successor_of_value(T tree, void *value, 
-                                 void *comparison_func(void *val1, void *val2));
+void private_rb_give_chunks(ChunkShare *share, Chunk *chunks); 
+void private_rb_give_orphans(ChunkShare *share, Node *nodes); 
 
 /*
- * private_rb_predecessor_of_value
+ * private_rb_orphan_nodes
  * 
- * private helper function for predcessor_of_value
+ * helper function for rb_tree_free on a tree which holds a share. leaves 
+ * every node of the tree, linked and free, on the share's orphan list, 
+ * unless the tree is the share's last holder
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       T - tree in which to search
- * @param       void * - pointer to the value we want the predecessor of
- * @param       void * - pointer to the comparison function associated with tree
- * @return      void * - pointer to the predecessor's value (or NULL if no 
- *                      predecessor exists)
+ * @param       T - tree being freed
+ * @return      n/a
  */
-void *private_rb_predecessor_of_value(T tree, void *value, 
-                                   void *comparison_func(void *val1, void *val2)); 
+void private_rb_orphan_nodes(T tree); 
 
 /*
- * private_rb_find_successor
+ * private_rb_collect_nodes
  * 
- * private general use helper function - given a pointer to node, returns the 
- * node containing the successor
+ * pushes every node of the subtree rooted at n onto list, linked through 
+ * ->right
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - node that we want the successor of
- * @return      Node * - node containing the successor
+ * @param       Node * - root of the subtree, or NULL
+ * @param       Node ** - head of the list
+ * @return      n/a
  */
-Node *private_rb_find_successor(Node *n); 
+void private_rb_collect_nodes(Node *n, Node **list); 
 
 /*
- * private_rb_find_predecessor
+ * private_rb_count_subtree
  * 
- * private general use helper function - given a pointer to node, returns the 
- * node containing the predecessor
+ * returns the number of values in the subtree rooted at n, by walking it
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - node that we want the predecessor of
- * @return      Node * - node containing the predecessor
+ * @param       T - tree containing the subtree
+ * @param       Node * - root of the subtree (may be NULL)
+ * @return      size_t - number of values, counting every copy in a multiset
  */
-Node *private_rb_find_predecessor(Node *n); 
+size_t private_rb_count_subtree(T tree, Node *n); 
 
 /*
- * private_subrb_tree_minimum
+ * private_rb_rotated
  * 
- * given a node, returns the node containing the minimum value in the subtree 
- * rooted at that node
+ * called by the node level rebalancing after each rotation, with the node 
+ * which moved down. counts the rotation and, in an augmented tree, 
+ * recomputes that node's data and then its new parent's
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - root of the subtree in question
- * @return      Node * - node containing the minimum
- */ 
-Node *private_subrb_tree_minimum(Node *curr_node);
+ * @param       Node * - node which moved down
+ * @param       void * - the tree, as a T
+ * @return      n/a
+ */
+void private_rb_rotated(Node *down, void *tree); 
 
 /*
- * private_subrb_tree_minimum
+ * private_rb_node_rotate
  * 
- * given a node, returns the node containing the minimum value in the subtree 
- * rooted at that node
+ * helper function for rb_node_insert_fixup and rb_node_erase_fixup. 
+ * rotates n left or right, then passes it to rotated, if that is not NULL
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - root of the subtree in question
- * @return      Node * - node containing the minimum
- */ 
-Node *private_subrb_tree_maximum(Node *curr_node);
+ * @param       struct rb_node ** - the root pointer
+ * @param       Node * - node to be rotated
+ * @param       bool - true to rotate left, false to rotate right
+ * @param       void rotated(down, cl) - called after the rotation; may be 
+ *                      NULL
+ * @param       void * - closure passed to rotated
+ * @return      n/a
+ */
+void private_rb_node_rotate(struct rb_node **root, Node *n, bool left, 
+                            void rotated(struct rb_node *down, void *cl), void *cl); 
 
 /*
- * rb_private_inorder_map
+ * private_rb_update_node
  * 
- * private helper function for rb_map_inorder
+ * recomputes the augmented fields of n (if the tree has any) from n's 
+ * children, which must already be up to date
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - root of the current subtree - rb_map_inorder passes 
- *                      in tree->root
- * @param       int - the current depth in the tree
- * @param       void - function to be applied to every node
- * @param       void * - pointer to closure, contains any data needed for 
- *                      evaluation of func_to_apply
+ * @param       T - tree containing the node
+ * @param       Node * - node to update
  * @return      n/a
  */
-void rb_private_inorder_map(Node *root, 
-                            int depth,
-                            void func_to_apply(void *value, int depth, void *cl), 
-                            void *cl);
+void private_rb_update_node(T tree, Node *n); 
 
 /*
- * rb_private_preorder_map
+ * private_rb_propagate
  * 
- * private helper function for rb_map_preorder
+ * recomputes the augmented fields of n and every one of its ancestors, 
+ * after the subtree rooted at n changed shape
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - root of the current subtree - rb_map_preorder passes 
- *                      in tree->root
- * @param       int - the current depth in the tree
- * @param       void - function to be applied to every node
- * @param       void * - pointer to closure, contains any data needed for 
- *                      evaluation of func_to_apply
+ * @param       T - tree containing the node
+ * @param       Node * - lowest node whose subtree changed (may be NULL)
  * @return      n/a
  */
-void rb_private_preorder_map(Node *root, 
-                             int depth, 
-                             void func_to_apply(void *value, int depth, void *cl), 
-                             void *cl);
+void private_rb_propagate(T tree, Node *n); 
 
 /*
- * rb_private_postorder_map
+ * private_rb_count_before
  * 
- * private helper function for rb_map_postorder
+ * returns the number of values in the tree that are less than value, or 
+ * less than or equal to value if inclusive is true. requires an order 
+ * statistics tree
  * 
  * CREs         n/a
  * UREs         n/a
  * 
- * @param       Node * - root of the current subtree - rb_map_postorder passes 
- *                      in tree->root
- * @param       int - the current depth in the tree
- * @param       void - function to be applied to every node
- * @param       void * - pointer to closure, contains any data needed for 
- *                      evaluation of func_to_apply
- * @return      n/a
+ * @param       T - tree in which to count
+ * @param       void * - value to compare against
+ * @param       bool - whether values equal to value are counted
+ * @return      size_t - number of values before value
  */
-void rb_private_postorder_map(Node *root, 
-                              int depth, 
-                              void func_to_apply(void *value, int depth, void *cl), 
-                              void *cl);
-
-/************************
- * FUNCTION DEFINITIONS *
- ************************/ 
+size_t private_rb_count_before(T tree, void *value, bool inclusive); 
 
-T rb_new(void *comparison_func)
-{
-        T tree = malloc(sizeof(struct rb_tree)); 
+/*
+ * private_rb_map_find_or_link
+ * 
+ * given a map tree and a key, descends the tree once. returns the node 
+ * holding a key equal to key if there is one; otherwise links a new node 
+ * holding key, with a NULL mapped value, where the descent ended and 
+ * returns it
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - map tree
+ * @param       void * - key to find or insert
+ * @param       bool * - set to true if a new node was linked, else false
+ * @return      Node * - node holding the key
+ */
+Node *private_rb_map_find_or_link(T tree, void *key, bool *inserted); 
 
-        tree->root = NULL; 
+/*
+ * private_rb_multiset_insert
+ * 
+ * given a multiset tree and a value, descends the tree once. if an equal 
+ * value is present its multiplicity goes up by one, otherwise a new node 
+ * is linked in
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - multiset tree
+ * @param       void * - value to insert
+ * @return      n/a
+ */
+void private_rb_multiset_insert(T tree, void *value); 
 
-        if (comparison_func == NULL) {
-                tree->comparison_func = &strcmp; 
-        } else {
-                tree->comparison_func = comparison_func; 
-        }
+/*
+ * private_rb_remove_one
+ * 
+ * removes one copy of the value held by n: in a multiset tree whose node 
+ * holds several copies this only lowers the count, otherwise the node is 
+ * deleted. no values are compared
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree containing n
+ * @param       Node * - node to remove a copy from
+ * @return      n/a
+ */
+void private_rb_remove_one(T tree, Node *n); 
 
-        return tree; 
-}
+/*
+ * private_rb_interval_overlaps
+ * 
+ * helper function for rb_interval_overlaps. reports every interval in the 
+ * subtree rooted at n which overlaps [lo, hi], in order of low endpoint, 
+ * skipping subtrees whose highest endpoint is below lo and right subtrees 
+ * of nodes that start after hi
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - interval tree being searched
+ * @param       Node * - root of the current subtree
+ * @param       void * - low end of the query
+ * @param       void * - high end of the query
+ * @param       int func_to_apply(lo, hi, value, cl) - callback
+ * @param       void * - closure for func_to_apply
+ * @param       size_t * - number of intervals reported so far
+ * @return      int - non-zero if func_to_apply asked to stop
+ */
+int private_rb_interval_overlaps(T tree, Node *n, void *lo, void *hi, 
+                                 int func_to_apply(void *lo, void *hi, 
+                                                   void *value, void *cl), 
+                                 void *cl, size_t *reported); 
 
-void rb_tree_free(T tree)
-{
-        assert(tree != NULL);
+/*
+ * rb_construct_node
+ * 
+ * given a value, constructs a node containing that value, with all relational
+ * pointers set to NULL, and color set to RED. the node is taken from the 
+ * tree's free list if possible, and otherwise from the tree's current chunk; 
+ * a new chunk is only allocated when the current one is exhausted
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - tree which will own the node
+ * @param       void * - value to go into the node
+ * @return      Node * - pointer to the new node
+ */ 
+Node *rb_construct_node(T tree, void *value);
 
-        private_rb_deallocate_all_tree_nodes(tree->root); 
-        free(tree); 
 
-        tree = NULL; 
-}
+/*
+ * private_rb_insert_node
+ * 
+ * links an initialized, red node into the tree and restores the red black 
+ * properties. shared by rb_insert_value and rb_insert_node. the descent is 
+ * iterative and only the link the node is attached to is written
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which to insert
+ * @param       Node * - node to be linked in
+ * @return      n/a
+ */
+void private_rb_insert_node(T tree, Node *new_node); 
 
-bool rb_tree_is_empty(T tree)
-{
-        assert(tree != NULL); 
+/*
+ * private_rb_link_node
+ * 
+ * attaches new_node as the left or right child of parent (which must not 
+ * already have a child on that side), keeps the cached leftmost and 
+ * rightmost nodes up to date and restores the red black properties. a NULL 
+ * parent makes new_node the root of an empty tree
+ * 
+ * CREs         n/a
+ * UREs         parent already has a child on the given side
+ * 
+ * @param       T - tree in which to insert
+ * @param       Node * - parent of the new node, or NULL
+ * @param       Node * - node to be linked in
+ * @param       bool - true to attach as the left child, false for the right
+ * @return      n/a
+ */
+void private_rb_link_node(T tree, Node *parent, Node *new_node, bool as_left); 
 
-        if (tree->root == NULL)
-                return true; 
-        else 
-                return false; 
-}
+/*
+ * private_rb_link_sorted
+ * 
+ * helper function for rb_build_from_sorted and rb_tree_load. given a chunk
+ * whose first n nodes already hold sorted values (and, in a multiset, 
+ * their counts), links them into a perfectly balanced tree and makes it 
+ * the tree's, without comparing any values. the tree takes the chunk
+ * 
+ * CREs         n/a
+ * UREs         the tree is not empty
+ * 
+ * @param       T - tree to be given the nodes
+ * @param       Chunk * - chunk of n filled in nodes
+ * @param       size_t - number of nodes, at least one
+ * @return      n/a
+ */
+void private_rb_link_sorted(T tree, Chunk *chunk, size_t n); 
 
-void private_rb_deallocate_all_tree_nodes(Node *n) {
+/*
+ * private_rb_build_subtree
+ * 
+ * helper function for private_rb_link_sorted. links nodes [lo, hi) of the
+ * array into a perfectly balanced subtree and returns its root. every 
+ * level but the deepest is full, so coloring the deepest level red (when 
+ * it is not full) and everything else black satisfies the red black 
+ * properties
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree whose node size and augmentation are used
+ * @param       char * - array of unlinked nodes, tree->node_size apart
+ * @param       size_t - first index of the subtree
+ * @param       size_t - one past the last index of the subtree
+ * @param       Node * - parent of the subtree's root
+ * @param       int - depth of the subtree's root
+ * @param       int - depth whose nodes are colored red, or -1
+ * @return      Node * - root of the subtree
+ */
+Node *private_rb_build_subtree(T tree, char *nodes, 
+                               size_t lo, size_t hi, Node *parent, 
+                               int depth, int red_depth); 
+
+/*
+ * fix_insertion_violation
+ * 
+ * given a tree and a pointer to the most recently inserted node,
+ * fixes any violations of the red-black properties in tree, through 
+ * rb_node_insert_fixup
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       T - tree in which we are fixing violations
+ * @param       Node * - pointer to the most recently inserted node
+ * @return      bool - true if the root ended up red and was painted black, 
+ *                      which adds one to the black height of the tree
+ */
+bool fix_insertion_violation(T tree, Node *inserted);
+
+/*
+ * private_find_in_tree
+ * 
+ * private helper function for rb_search and rb_delete_value. 
+ * given a tree, a value, and a comparison function, returns the first 
+ * located node with the value we are looking for
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which we are searching
+ * @param       void * - pointer to the value we are searching for
+ * @param       void * - pointer to the comparison function for that tree
+ * @return      Node * - pointer to the node containing value
+ */
+Node *private_rb_find_in_tree(T tree, void *value, 
+                           int comparison_func(void *val1, void *val2));
+
+/*
+ * private_rb_unlink_node
+ * 
+ * helper function for rb_delete_node. takes n out of the tree and restores
+ * the red black properties, but does not release n, so that rb_join2 can 
+ * link it back in elsewhere
+ * 
+ * CREs         n/a
+ * UREs         n does not belong to tree
+ * 
+ * @param       T - tree containing the node
+ * @param       Node * - node to be unlinked
+ * @return      n/a
+ */
+void private_rb_unlink_node(T tree, Node *n); 
+
+/*
+ * private_rb_new_like
+ * 
+ * returns a new, empty tree with the same comparison function, mode and 
+ * node layout as tree
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - tree to copy the configuration of
+ * @return      T - the new tree
+ */
+T private_rb_new_like(T tree); 
+
+/*
+ * private_rb_absorb
+ * 
+ * helper function for the joins. makes into hold every chunk that from 
+ * holds, so that from's nodes can be linked into into, adds from's free 
+ * list to into's, and frees from without touching its nodes
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - tree which takes over the nodes
+ * @param       T - tree to be freed
+ * @return      n/a
+ */
+void private_rb_absorb(T into, T from); 
+
+/*
+ * private_rb_set_root
+ * 
+ * makes root (a detached subtree with a black root) the tree's root, and 
+ * finds the tree's minimum and maximum. the count is taken from the root's
+ * subtree size in an order statistics tree, and is otherwise left unknown
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree to be given the root
+ * @param       Node * - the new root (may be NULL)
+ * @return      n/a
+ */
+void private_rb_set_root(T tree, Node *root); 
+
+/*
+ * private_rb_black_height
+ * 
+ * returns the number of black nodes on any path from n down to a leaf, 
+ * counting n itself, by following the left spine
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - root of the subtree (may be NULL)
+ * @return      int - black height of the subtree
+ */
+int private_rb_black_height(Node *n); 
+
+/*
+ * private_rb_detach
+ * 
+ * cuts n loose from its parent so that it can be joined as a tree of its 
+ * own, painting it black if it was red
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - root of the subtree (may be NULL)
+ * @param       int - black height of the subtree, as part of its old tree
+ * @return      int - black height of the detached subtree
+ */
+int private_rb_detach(Node *n, int height); 
+
+/*
+ * private_rb_join_subtrees
+ * 
+ * joins the detached subtrees a and b, every value in a ordered before 
+ * pivot and every value in b after it, into one subtree with pivot between
+ * them. when their black heights are equal pivot becomes a black root over
+ * both; otherwise it is linked, red, into the facing spine of the taller 
+ * subtree at the black height of the shorter one, and the fixup after an 
+ * insert repairs any red parent. costs O(|ha - hb| + 1), since the fixup 
+ * stops at the root of the taller subtree. tree->root is overwritten
+ * 
+ * CREs         n/a
+ * UREs         a or b is not detached, or has a red root
+ * 
+ * @param       T - tree whose comparison function and augmentation are used
+ * @param       Node * - the lower subtree (may be NULL)
+ * @param       int - its black height
+ * @param       Node * - the pivot node, unlinked
+ * @param       Node * - the upper subtree (may be NULL)
+ * @param       int - its black height
+ * @param       int * - set to the black height of the result
+ * @return      Node * - root of the joined subtree, which is black
+ */
+Node *private_rb_join_subtrees(T tree, Node *a, int ha, Node *pivot, 
+                               Node *b, int hb, int *height); 
+
+/*
+ * private_rb_split_subtree
+ * 
+ * helper function for rb_split and the set operations. splits the 
+ * detached subtree rooted at n into one subtree of the values less than 
+ * key and one of the rest: the side of n's children which key falls in is
+ * split recursively, and the other side is joined to the matching half 
+ * with n as the pivot. the black heights of successive joins telescope, so
+ * the whole split costs O(log n). if found is not NULL, a node equal to key
+ * is left out of both halves and returned through it instead
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree whose comparison function and augmentation are used
+ * @param       Node * - root of the subtree (may be NULL)
+ * @param       int - its black height
+ * @param       void * - the key to split at
+ * @param       Node ** - set to the subtree of values less than key
+ * @param       int * - set to its black height
+ * @param       Node ** - set to the subtree of the other values
+ * @param       int * - set to its black height
+ * @param       Node ** - set to the node equal to key, or NULL; may itself
+ *                      be NULL
+ * @return      n/a
+ */
+void private_rb_split_subtree(T tree, Node *n, int height, void *key, 
+                              Node **left, int *left_height, 
+                              Node **right, int *right_height, 
+                              Node **found); 
+
+/*
+ * private_rb_join
+ * 
+ * helper function for rb_join and rb_join2. links the unlinked pivot 
+ * between left and right, in left, and frees right
+ * 
+ * CREs         n/a
+ * UREs         the trees' values are not in order around pivot
+ *              system out of memory
+ * 
+ * @param       T - the lower tree, which becomes the joined tree
+ * @param       Node * - the pivot node
+ * @param       T - the upper tree, which is freed
+ * @return      T - the joined tree
+ */
+T private_rb_join(T left, Node *pivot, T right); 
+
+/*
+ * private_rb_join2_subtrees
+ * 
+ * joins the detached subtrees a and b, every value in a ordered before 
+ * every value in b, by unlinking the maximum of a and joining around it. 
+ * tree->root, leftmost, rightmost and count are overwritten
+ * 
+ * CREs         n/a
+ * UREs         a or b is not detached, or has a red root
+ * 
+ * @param       T - tree whose comparison function and augmentation are used
+ * @param       Node * - the lower subtree (may be NULL)
+ * @param       int - its black height
+ * @param       Node * - the upper subtree (may be NULL)
+ * @param       int - its black height
+ * @param       int * - set to the black height of the result
+ * @return      Node * - root of the joined subtree
+ */
+Node *private_rb_join2_subtrees(T tree, Node *a, int ha, Node *b, int hb, 
+                                int *height); 
+
+/*
+ * private_rb_set_operation
+ * 
+ * helper function for rb_union, rb_intersection and rb_difference. runs 
+ * the operation on the two trees' roots and leaves the result in a, 
+ * freeing b
+ * 
+ * CREs         a == NULL or b == NULL
+ *              the trees differ in comparison function, mode or 
+ *                      intrusiveness, or were created with RB_INTERVAL or 
+ *                      RB_MULTISET
+ * UREs         system out of memory
+ * 
+ * @param       T - the first tree, which holds the result
+ * @param       T - the second tree, which is freed
+ * @param       SetOp - the operation
+ * @return      T - the result, which is a
+ */
+T private_rb_set_operation(T a, T b, SetOp op); 
+
+/*
+ * private_rb_set_op
+ * 
+ * the divide and conquer step of the set operations, on detached subtrees.
+ * b's root is taken out and a is split at its value; the operation is 
+ * applied to the two lower halves and to the two upper halves, on two 
+ * threads while forks remains (see RB_SET_FORK_HEIGHT), and the results 
+ * are joined around the root of b, a's node equal to it, or neither. this 
+ * costs O(m log(n / m + 1)) work for trees of m <= n values, plus one step 
+ * for each node left out of the result, which goes on tree's free list
+ * 
+ * CREs         n/a
+ * UREs         a or b is not detached, or has a red root
+ * 
+ * @param       T - tree whose comparison function and augmentation are used
+ * @param       SetOp - the operation
+ * @param       Node * - root of the first subtree (may be NULL)
+ * @param       int - its black height
+ * @param       Node * - root of the second subtree (may be NULL)
+ * @param       int - its black height
+ * @param       unsigned - levels of the recursion which may still fork
+ * @param       int * - set to the black height of the result
+ * @param       size_t * - incremented for each value in both a and b
+ * @return      Node * - root of the result
+ */
+Node *private_rb_set_op(T tree, SetOp op, Node *a, int ha, Node *b, int hb, 
+                        unsigned forks, int *height, size_t *hits); 
+
+#ifdef RB_PARALLEL
+/*
+ * private_rb_count_fork_levels
+ * 
+ * sets private_rb_set_fork_levels from the number of online processors. 
+ * run once, through pthread_once
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @return      n/a
+ */
+void private_rb_count_fork_levels(void); 
+
+/*
+ * private_rb_set_task
+ * 
+ * thread start routine which runs private_rb_set_op on a SetTask, in the 
+ * task's own context
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       void * - the SetTask
+ * @return      NULL
+ */
+void *private_rb_set_task(void *arg); 
+#endif
+
+/*
+ * private_rb_depth_histogram
+ * 
+ * helper function for rb_tree_stats. counts the nodes of the subtree rooted
+ * at n by depth, and returns the height of the subtree
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - root of the subtree
+ * @param       size_t - depth of n in the tree
+ * @param       size_t * - histogram of RB_STATS_MAX_DEPTH buckets
+ * @return      size_t - number of nodes on the longest path down from n
+ */
+size_t private_rb_depth_histogram(Node *n, size_t depth, size_t *histogram); 
+
+/*
+ * private_rb_trace_record
+ * 
+ * appends one record to the tree's trace: the op, then, for ops which take
+ * a value, the length of its encoding as a LEB128 varint followed by the 
+ * encoding itself. only compiled with RB_TRACE
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree being traced
+ * @param       enum rb_trace_op - operation performed
+ * @param       void * - value passed to the operation, or NULL if none
+ * @return      n/a
+ */
+void private_rb_trace_record(T tree, enum rb_trace_op op, void *value); 
+
+/*
+ * private_rb_crc_init
+ * 
+ * fills in the lookup table for the CRC-32 (IEEE, reflected) of saved trees
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       uint32_t * - table of 256 entries
+ * @return      n/a
+ */
+void private_rb_crc_init(uint32_t *table); 
+
+/*
+ * private_rb_crc_update
+ * 
+ * returns crc extended over length more bytes. a CRC starts, and is 
+ * finished, by inverting every bit
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       const uint32_t * - table from private_rb_crc_init
+ * @param       uint32_t - CRC of the bytes so far
+ * @param       const unsigned char * - the next bytes
+ * @param       size_t - number of bytes
+ * @return      uint32_t - the extended CRC
+ */
+uint32_t private_rb_crc_update(const uint32_t *table, uint32_t crc, 
+                               const unsigned char *buf, size_t length); 
+
+/*
+ * private_rb_save_open
+ * 
+ * helper function for rb_save_begin and rb_tree_save. makes a writer and 
+ * buffers the header, with the given flags
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       int - file descriptor
+ * @param       size_t - number of records to come
+ * @param       unsigned - RB_SAVE_* flags
+ * @param       size_t encode(value, buf, capacity) - value encoder
+ * @return      RedBlack_Save_T - the writer
+ */
+RedBlack_Save_T private_rb_save_open(int fd, size_t count, unsigned flags, 
+                                     size_t encode(void *value, unsigned char *buf, 
+                                                   size_t capacity)); 
+
+/*
+ * private_rb_save_record
+ * 
+ * buffers one record: the value's encoding and, in a multiset, its count
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       RedBlack_Save_T - the writer
+ * @param       void * - the value
+ * @param       size_t - number of copies of the value
+ * @return      bool - false if the writer has failed
+ */
+bool private_rb_save_record(RedBlack_Save_T save, void *value, size_t copies); 
+
+/*
+ * private_rb_save_bytes / private_rb_save_varint
+ * 
+ * buffer bytes, or a LEB128 varint, for writing, flushing the buffer to the
+ * file whenever it fills up
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       RedBlack_Save_T - the writer
+ * @param       const unsigned char *, size_t - the bytes, or size_t - the 
+ *                      number to encode
+ * @return      n/a
+ */
+void private_rb_save_bytes(RedBlack_Save_T save, const unsigned char *bytes, 
+                           size_t length); 
+void private_rb_save_varint(RedBlack_Save_T save, size_t x); 
+
+/*
+ * private_rb_save_flush
+ * 
+ * adds the buffered bytes to the CRC and writes them out, retrying short 
+ * and interrupted writes. a failure marks the writer failed
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       RedBlack_Save_T - the writer
+ * @return      n/a
+ */
+void private_rb_save_flush(RedBlack_Save_T save); 
+
+/*
+ * private_rb_load_bytes / private_rb_load_varint
+ * 
+ * consume the next bytes, or the next varint, of a saved tree, refilling 
+ * the buffer from the file as needed and adding them to the CRC
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       LoadStream * - the reader
+ * @param       unsigned char *, size_t - where to put the bytes and how many
+ *                      to read, or size_t * - where to put the number
+ * @return      bool - false at the end of the file, on a read error or on
+ *                      a varint too long for a size_t
+ */
+bool private_rb_load_bytes(LoadStream *in, unsigned char *bytes, size_t length); 
+bool private_rb_load_varint(LoadStream *in, size_t *x); 
+
+/*
+ * private_rb_load_records
+ * 
+ * helper function for rb_tree_load. reads count records into the nodes 
+ * of chunk, decoding each value, and then checks the CRC. the chunk is 
+ * doubled in place whenever it fills, up to count nodes, so a damaged 
+ * count costs no more memory than the records which are really there. 
+ * returns the number of values it decoded, which is count only if it 
+ * succeeded
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       T - the tree being loaded, for its node layout
+ * @param       LoadStream * - the reader, positioned after the header
+ * @param       Chunk ** - the chunk, of at least one node; may be moved
+ * @param       size_t - number of records
+ * @param       void *decode(buf, length) - value decoder
+ * @param       bool * - set to true if the records and CRC were all read 
+ *                      and correct
+ * @return      size_t - number of values decoded
+ */
+size_t private_rb_load_records(T tree, LoadStream *in, Chunk **chunk, size_t count, 
+                               void *decode(const unsigned char *buf, size_t length), 
+                               bool *ok); 
+
+/*
+ * private_rb_successor_of_value
+ * 
+ * private helper function for rb_successor_of_value
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which to search
+ * @param       void * - pointer to the value we want the successor of
+ * @param       void * - pointer to the comparison function associated with tree
+ * @return      void * - pointer to the successor's value (or NULL if no 
+ *                      successor exists)
+ */
+void *private_rb_successor_of_value(T tree, void *value, 
+                                 int comparison_func(void *val1, void *val2));
+
+/*
+ * private_rb_predecessor_of_value
+ * 
+ * private helper function for predcessor_of_value
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which to search
+ * @param       void * - pointer to the value we want the predecessor of
+ * @param       void * - pointer to the comparison function associated with tree
+ * @return      void * - pointer to the predecessor's value (or NULL if no 
+ *                      predecessor exists)
+ */
+void *private_rb_predecessor_of_value(T tree, void *value, 
+                                   int comparison_func(void *val1, void *val2)); 
+
+/*
+ * private_rb_find_successor
+ * 
+ * private general use helper function - given a pointer to node, returns the 
+ * node containing the successor
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - node that we want the successor of
+ * @return      Node * - node containing the successor
+ */
+Node *private_rb_find_successor(Node *n); 
+
+/*
+ * private_rb_find_predecessor
+ * 
+ * private general use helper function - given a pointer to node, returns the 
+ * node containing the predecessor
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - node that we want the predecessor of
+ * @return      Node * - node containing the predecessor
+ */
+Node *private_rb_find_predecessor(Node *n); 
+
+/*
+ * private_rb_next_node
+ * 
+ * given a node, returns the node that follows it in an inorder walk, or NULL
+ * if it is the last node. unlike private_rb_find_successor, n need not have 
+ * a right child
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - node to start from
+ * @return      Node * - next node
+ */
+Node *private_rb_next_node(Node *n); 
+
+/*
+ * private_rb_prev_node
+ * 
+ * given a node, returns the node that precedes it in an inorder walk, or 
+ * NULL if it is the first node
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - node to start from
+ * @return      Node * - previous node
+ */
+Node *private_rb_prev_node(Node *n); 
+
+/*
+ * private_rb_lower_bound
+ * 
+ * given a tree and a value, returns the first node (in inorder) whose value 
+ * is not less than value, or NULL if every value in the tree is smaller
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which to search
+ * @param       void * - value to search for
+ * @return      Node * - first node not less than value
+ */
+Node *private_rb_lower_bound(T tree, void *value); 
+
+/*
+ * private_rb_upper_bound
+ * 
+ * given a tree and a value, returns the first node (in inorder) whose value 
+ * is greater than value, or NULL if there is none
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree in which to search
+ * @param       void * - value to search for
+ * @return      Node * - first node greater than value
+ */
+Node *private_rb_upper_bound(T tree, void *value); 
+
+/*
+ * private_subrb_tree_minimum
+ * 
+ * given a node, returns the node containing the minimum value in the subtree 
+ * rooted at that node
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - root of the subtree in question
+ * @return      Node * - node containing the minimum
+ */ 
+Node *private_subrb_tree_minimum(Node *curr_node);
+
+/*
+ * private_subrb_tree_maximum
+ * 
+ * given a node, returns the node containing the maximum value in the subtree 
+ * rooted at that node
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       Node * - root of the subtree in question
+ * @return      Node * - node containing the maximum
+ */ 
+Node *private_subrb_tree_maximum(Node *curr_node);
+
+/*
+ * rb_private_inorder_map
+ * 
+ * private helper function for rb_map_inorder
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree being walked
+ * @param       Node * - root of the current subtree - rb_map_inorder passes 
+ *                      in tree->root
+ * @param       int - the current depth in the tree
+ * @param       void - function to be applied to every node
+ * @param       void * - pointer to closure, contains any data needed for 
+ *                      evaluation of func_to_apply
+ * @return      n/a
+ */
+void rb_private_inorder_map(T tree, 
+                            Node *root, 
+                            int depth,
+                            void func_to_apply(void *value, int depth, void *cl), 
+                            void *cl);
+
+/*
+ * rb_private_preorder_map
+ * 
+ * private helper function for rb_map_preorder
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree being walked
+ * @param       Node * - root of the current subtree - rb_map_preorder passes 
+ *                      in tree->root
+ * @param       int - the current depth in the tree
+ * @param       void - function to be applied to every node
+ * @param       void * - pointer to closure, contains any data needed for 
+ *                      evaluation of func_to_apply
+ * @return      n/a
+ */
+void rb_private_preorder_map(T tree, 
+                             Node *root, 
+                             int depth, 
+                             void func_to_apply(void *value, int depth, void *cl), 
+                             void *cl);
+
+/*
+ * rb_private_postorder_map
+ * 
+ * private helper function for rb_map_postorder
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       T - tree being walked
+ * @param       Node * - root of the current subtree - rb_map_postorder passes 
+ *                      in tree->root
+ * @param       int - the current depth in the tree
+ * @param       void - function to be applied to every node
+ * @param       void * - pointer to closure, contains any data needed for 
+ *                      evaluation of func_to_apply
+ * @return      n/a
+ */
+void rb_private_postorder_map(T tree, 
+                              Node *root, 
+                              int depth, 
+                              void func_to_apply(void *value, int depth, void *cl), 
+                              void *cl);
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+T rb_new(void *comparison_func)
+{
+        return rb_new_mode(comparison_func, 0); 
+}
+
+T rb_new_mode(void *comparison_func, unsigned mode)
+{
+        T tree = malloc(sizeof(struct rb_tree)); 
+
+        tree->mode = mode; 
+        tree->node_size = sizeof(ValueNode); 
+        tree->size_offset = 0; 
+        tree->count = 0; 
+
+        tree->interval_offset = 0; 
+        tree->map_offset = 0; 
+        tree->multi_offset = 0; 
+
+        assert(!((mode & RB_MAP) && (mode & RB_INTERVAL))); 
+        assert(!((mode & RB_MULTISET) && (mode & (RB_MAP | RB_INTERVAL)))); 
+
+        if (mode & RB_ORDER_STATISTICS) {
+                tree->size_offset = tree->node_size; 
+                tree->node_size += sizeof(size_t); 
+        }
+        if (mode & RB_INTERVAL) {
+                tree->interval_offset = tree->node_size; 
+                tree->node_size += sizeof(IntervalData); 
+        }
+        if (mode & RB_MAP) {
+                tree->map_offset = tree->node_size; 
+                tree->node_size += sizeof(void *); 
+        }
+        if (mode & RB_MULTISET) {
+                tree->multi_offset = tree->node_size; 
+                tree->node_size += sizeof(size_t); 
+        }
+
+        tree->root = NULL; 
+        tree->intrusive = false; 
+        tree->link_offset = 0; 
+        tree->chunks = NULL; 
+        tree->chunk_used = 0; 
+        tree->free_nodes = NULL; 
+        tree->free_count = 0; 
+        tree->share = NULL; 
+        tree->leftmost = NULL; 
+        tree->rightmost = NULL; 
+
+#ifdef RB_STATS
+        memset(&tree->stats, 0, sizeof(tree->stats)); 
+#endif
+#ifdef RB_TRACE
+        tree->trace = NULL; 
+        tree->trace_encode = NULL; 
+#endif
+
+        if (comparison_func == NULL) {
+                tree->comparison_func = &strcmp; 
+        } else {
+                tree->comparison_func = comparison_func; 
+        }
+
+        return tree; 
+}
+
+void rb_tree_free(T tree)
+{
+        assert(tree != NULL);
+
+        rb_trace_stop(tree); 
+
+        private_rb_deallocate_all_chunks(tree); 
+        free(tree); 
+
+        tree = NULL; 
+}
+
+T rb_new_intrusive(void *comparison_func, size_t link_offset)
+{
+        T tree = rb_new(comparison_func); 
+
+        tree->intrusive = true; 
+        tree->node_size = 0; 
+        tree->link_offset = link_offset; 
+
+        return tree; 
+}
+
+T rb_build_from_sorted(void **values, size_t n, void *comparison_func)
+{
+        assert(values != NULL || n == 0); 
+        assert(n <= (SIZE_MAX - sizeof(Chunk)) / sizeof(ValueNode)); 
+
+        T tree = rb_new(comparison_func); 
+
+        if (n == 0)
+                return tree; 
+
+        Chunk *chunk = malloc(sizeof(Chunk) + n * sizeof(ValueNode)); 
+
+        assert(chunk != NULL); 
+
+        for (size_t i = 0; i < n; i++) 
+                chunk->nodes[i].value = values[i]; 
+
+        private_rb_link_sorted(tree, chunk, n); 
+        tree->count = n; 
+
+        return tree; 
+}
+
+void private_rb_link_sorted(T tree, Chunk *chunk, size_t n)
+{
+        chunk->next = NULL; 
+        chunk->capacity = n; 
+
+        tree->chunks = chunk; 
+        tree->chunk_used = n; 
+
+        int deepest = 0; 
+
+        while (((size_t) 2 << deepest) <= n)
+                deepest++; 
+
+        /* n + 1 is a power of two exactly when the deepest level is full */
+        int red_depth = ((n & (n + 1)) == 0) ? -1 : deepest; 
+        char *nodes = (char *) chunk->nodes; 
+
+        tree->root = private_rb_build_subtree(tree, nodes, 0, n, NULL, 
+                                              0, red_depth); 
+        tree->leftmost = (Node *) nodes; 
+        tree->rightmost = (Node *) (nodes + (n - 1) * tree->node_size); 
+}
+
+Node *private_rb_build_subtree(T tree, char *nodes, 
+                               size_t lo, size_t hi, Node *parent, 
+                               int depth, int red_depth)
+{
+        if (lo >= hi)
+                return NULL; 
+
+        size_t mid = lo + (hi - lo) / 2; 
+        Node *n = (Node *) (nodes + mid * tree->node_size); 
+
+        n->parent_color = (uintptr_t) parent | (depth == red_depth ? RED : BLACK); 
+        n->left = private_rb_build_subtree(tree, nodes, lo, mid, n, 
+                                           depth + 1, red_depth); 
+        n->right = private_rb_build_subtree(tree, nodes, mid + 1, hi, n, 
+                                            depth + 1, red_depth); 
+
+        if (tree->mode & RB_ORDER_STATISTICS)
+                private_rb_update_node(tree, n); 
+
+        return n; 
+}
+
+size_t rb_tree_size(T tree)
+{
+        assert(tree != NULL); 
+
+        if (tree->count == COUNT_UNKNOWN)
+                tree->count = private_rb_count_subtree(tree, tree->root); 
+
+        return tree->count; 
+}
+
+bool rb_tree_is_empty(T tree)
+{
+        assert(tree != NULL); 
+
+        if (tree->root == NULL)
+                return true; 
+        else 
+                return false; 
+}
+
+void private_rb_deallocate_all_chunks(T tree) 
+{
+        Chunk *curr = tree->chunks; 
+
+        if (tree->share != NULL) {
+                private_rb_orphan_nodes(tree); 
+                private_rb_drop_share(tree->share); 
+                tree->share = NULL; 
+                curr = NULL; 
+        }
+
+        rb_node_free_chunks(curr); 
+
+        tree->chunks = NULL; 
+        tree->chunk_used = 0; 
+        tree->free_nodes = NULL; 
+        tree->free_count = 0; 
+        tree->root = NULL; 
+        tree->leftmost = NULL; 
+        tree->rightmost = NULL; 
+        tree->count = 0; 
+}
+
+void private_rb_release_node(T tree, Node *n)
+{
+        if (tree->intrusive)
+                return; 
+
+        n->right = tree->free_nodes; 
+        tree->free_nodes = n; 
+        tree->free_count++; 
+}
+
+void private_rb_give_free_nodes(T tree, Node *nodes)
+{
+        if (nodes == NULL)
+                return; 
+
+        Node *last = nodes; 
+
+        tree->free_count++; 
+        while (last->right != NULL) {
+                last = last->right; 
+                tree->free_count++; 
+        }
+
+        last->right = tree->free_nodes; 
+        tree->free_nodes = nodes; 
+}
+
+void private_rb_release_subtree(T tree, Node *n)
+{
+        if (tree->intrusive)
+                return; 
+
+        while (n != NULL) {
+                Node *right = n->right; 
+
+                private_rb_release_subtree(tree, n->left); 
+                private_rb_release_node(tree, n); 
+                n = right; 
+        }
+}
+
+void private_rb_compact(T tree)
+{
+        size_t n = tree->count; 
+
+        if (n == 0) {
+                private_rb_deallocate_all_chunks(tree); 
+                return; 
+        }
+
+        Chunk *chunk = malloc(sizeof(Chunk) + n * tree->node_size); 
+        assert(chunk != NULL); 
+
+        char *nodes = (char *) chunk->nodes; 
+
+        for (Node *x = tree->leftmost; x != NULL; x = private_rb_next_node(x)) {
+                memcpy(nodes, x, tree->node_size); 
+                nodes += tree->node_size; 
+        }
+
+        private_rb_deallocate_all_chunks(tree); 
+        private_rb_link_sorted(tree, chunk, n); 
+
+        tree->count = n; 
+}
+
+void private_rb_share_chunks(T tree)
+{
+        if (tree->chunks == NULL && tree->share == NULL)
+                return; 
+
+        if (tree->share == NULL) {
+                tree->share = malloc(sizeof(ChunkShare)); 
+                assert(tree->share != NULL); 
+
+                tree->share->chunks = NULL; 
+                tree->share->orphans = NULL; 
+                tree->share->merged_into = NULL; 
+                tree->share->refs = 1; 
+        }
+
+        Chunk *chunk = tree->chunks; 
+
+        if (chunk == NULL)
+                return; 
+
+        while (tree->chunk_used < chunk->capacity) {
+                Node *n = (Node *) ((char *) chunk->nodes 
+                                    + tree->chunk_used++ * tree->node_size); 
+
+                private_rb_release_node(tree, n); 
+        }
+
+        private_rb_give_chunks(private_rb_find_share(tree->share), chunk); 
+
+        tree->chunks = NULL; 
+        tree->chunk_used = 0; 
+}
+
+ChunkShare *private_rb_find_share(ChunkShare *share)
+{
+        ChunkShare *next; 
+
+        while (share != NULL 
+               && (next = __atomic_load_n(&share->merged_into, __ATOMIC_SEQ_CST)) != NULL)
+                share = next; 
+
+        return share; 
+}
+
+void private_rb_hold_share(T tree, ChunkShare *share)
+{
+        ChunkShare *held = private_rb_find_share(tree->share); 
+
+        if (held == share)
+                return; 
+
+        __atomic_add_fetch(&share->refs, 1, __ATOMIC_SEQ_CST); 
+
+        if (held != NULL) {
+                /* held keeps share alive, for the trees still holding it */
+                __atomic_add_fetch(&share->refs, 1, __ATOMIC_SEQ_CST); 
+                private_rb_give_chunks(share, __atomic_exchange_n(&held->chunks, NULL, 
+                                                                  __ATOMIC_SEQ_CST)); 
+                private_rb_give_orphans(share, __atomic_exchange_n(&held->orphans, NULL, 
+                                                                   __ATOMIC_SEQ_CST)); 
+                __atomic_store_n(&held->merged_into, share, __ATOMIC_SEQ_CST); 
+        }
+
+        if (tree->share != NULL)
+                private_rb_drop_share(tree->share); 
+
+        tree->share = share; 
+}
+
+void private_rb_drop_share(ChunkShare *share)
+{
+        while (share != NULL && __atomic_sub_fetch(&share->refs, 1, __ATOMIC_SEQ_CST) == 0) {
+                ChunkShare *merged_into = share->merged_into; 
+                Chunk *curr = share->chunks; 
+
+                if (merged_into != NULL) {
+                        /* given to share by trees which had not yet seen the merge */
+                        private_rb_give_chunks(merged_into, curr); 
+                        private_rb_give_orphans(merged_into, share->orphans); 
+                        curr = NULL; 
+                }
+
+                rb_node_free_chunks(curr); 
+
+                free(share); 
+                share = merged_into; 
+        }
+}
+
+void private_rb_give_chunks(ChunkShare *share, Chunk *chunks)
+{
+        if (chunks == NULL)
+                return; 
+
+        Chunk *last = chunks; 
+
+        while (last->next != NULL)
+                last = last->next; 
+
+        Chunk *head = __atomic_load_n(&share->chunks, __ATOMIC_SEQ_CST); 
+
+        do {
+                last->next = head; 
+        } while (!__atomic_compare_exchange_n(&share->chunks, &head, chunks, false, 
+                                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)); 
+}
+
+void private_rb_give_orphans(ChunkShare *share, Node *nodes)
+{
+        if (nodes == NULL)
+                return; 
+
+        Node *last = nodes; 
+
+        while (last->right != NULL)
+                last = last->right; 
+
+        Node *head = __atomic_load_n(&share->orphans, __ATOMIC_SEQ_CST); 
+
+        do {
+                last->right = head; 
+        } while (!__atomic_compare_exchange_n(&share->orphans, &head, nodes, false, 
+                                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)); 
+}
+
+void private_rb_orphan_nodes(T tree)
+{
+        private_rb_share_chunks(tree); 
+
+        ChunkShare *share = private_rb_find_share(tree->share); 
+
+        /* the last holder frees the chunks, and has no one to leave nodes to */
+        if (share == tree->share && __atomic_load_n(&share->refs, __ATOMIC_SEQ_CST) == 1)
+                return; 
+
+        Node *nodes = tree->free_nodes; 
+
+        private_rb_collect_nodes(tree->root, &nodes); 
+        private_rb_give_orphans(share, nodes); 
+
+        tree->free_nodes = NULL; 
+        tree->free_count = 0; 
+        tree->root = NULL; 
+}
+
+void private_rb_collect_nodes(Node *n, Node **list)
+{
+        while (n != NULL) {
+                Node *right = n->right; 
+
+                private_rb_collect_nodes(n->left, list); 
+
+                n->right = *list; 
+                *list = n; 
+                n = right; 
+        }
+}
+
+size_t private_rb_count_subtree(T tree, Node *n)
+{
+        if (n == NULL)
+                return 0; 
+
+        return NODE_WEIGHT(tree, n) + private_rb_count_subtree(tree, n->left) 
+                                    + private_rb_count_subtree(tree, n->right); 
+}
+
+void rb_node_rotate_left(struct rb_node **root, struct rb_node *n)
+{
+        Node *right_child = n->right; 
+
+        n->right = right_child->left; 
+
+        if (n->right != NULL)
+                SET_PARENT(n->right, n); 
+
+        rb_node_replace(root, n, right_child); 
+
+        right_child->left = n; 
+        SET_PARENT(n, right_child); 
+}
+
+void rb_node_rotate_right(struct rb_node **root, struct rb_node *n)
+{ 
+        Node *left_child = n->left; 
+
+        n->left = left_child->right; 
+
+        if (n->left != NULL)
+                SET_PARENT(n->left, n); 
+
+        rb_node_replace(root, n, left_child); 
+
+        left_child->right = n; 
+        SET_PARENT(n, left_child); 
+}
+
+void rb_node_replace(struct rb_node **root, struct rb_node *u, struct rb_node *v) 
+{
+        if (PARENT(u) == NULL) {
+                *root = v; 
+        } else if (u == PARENT(u)->left) {
+                PARENT(u)->left = v; 
+        } else {
+                PARENT(u)->right = v;
+        }
+
+        if (v != NULL)
+                SET_PARENT(v, PARENT(u)); 
+}
+
+void private_rb_rotated(Node *down, void *tree)
+{
+        T t = tree; 
+
+        STAT_INC(t, rotations); 
+
+        if (IS_AUGMENTED(t)) {
+                private_rb_update_node(t, down); 
+                private_rb_update_node(t, PARENT(down)); 
+        }
+}
+
+void private_rb_update_node(T tree, Node *n)
+{
+        if (tree->mode & RB_ORDER_STATISTICS) 
+                SET_SUBTREE_SIZE(tree, n, NODE_WEIGHT(tree, n) 
+                                          + SUBTREE_SIZE(tree, n->left) 
+                                          + SUBTREE_SIZE(tree, n->right)); 
+
+        if (tree->mode & RB_INTERVAL) {
+                int (*comparison_func)(void *, void *) = tree->comparison_func; 
+                void *max = INTERVAL(tree, n)->hi; 
+
+                if (n->left != NULL && 
+                    COMPARE(tree, comparison_func, INTERVAL(tree, n->left)->max, max) > 0)
+                        max = INTERVAL(tree, n->left)->max; 
+                if (n->right != NULL && 
+                    COMPARE(tree, comparison_func, INTERVAL(tree, n->right)->max, max) > 0)
+                        max = INTERVAL(tree, n->right)->max; 
+
+                INTERVAL(tree, n)->max = max; 
+        }
+}
+
+void private_rb_propagate(T tree, Node *n)
+{
+        while (n != NULL) {
+                private_rb_update_node(tree, n); 
+                n = PARENT(n); 
+        }
+}
+
+int rb_insert_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL && !tree->intrusive); 
+        assert(!(tree->mode & (RB_INTERVAL | RB_MAP))); 
+
+        TRACE_OP(tree, RB_TRACE_INSERT, value); 
+
+        if (tree->mode & RB_MULTISET) {
+                private_rb_multiset_insert(tree, value); 
+                return 0; 
+        }
+
+        Node *new_node = rb_construct_node(tree, value); 
+        private_rb_insert_node(tree, new_node); 
+
+        return 0;
+}
+
+void rb_insert_node(T tree, struct rb_node *node)
+{
+        assert(tree != NULL && node != NULL && tree->intrusive); 
+
+        node->parent_color = RED; 
+        node->left = NULL; 
+        node->right = NULL; 
+
+        private_rb_insert_node(tree, node); 
+}
+
+struct rb_node *rb_insert_hint(T tree, struct rb_node *hint, void *value)
+{
+        assert(tree != NULL && value != NULL && !tree->intrusive); 
+        assert(!(tree->mode & (RB_INTERVAL | RB_MAP | RB_MULTISET))); 
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *new_node = rb_construct_node(tree, value); 
+
+        if (hint == NULL) {
+                private_rb_insert_node(tree, new_node); 
+                return new_node; 
+        }
+
+        /* 
+         * equal values are placed after existing ones, so the value belongs
+         * right after the hint when it is >= hint and < the hint's successor
+         */
+        if (COMPARE(tree, comparison_func, value, NODE_VALUE(tree, hint)) >= 0) {
+                Node *next = (hint == tree->rightmost) ? NULL 
+                                                       : private_rb_next_node(hint); 
+
+                if (next == NULL || 
+                    COMPARE(tree, comparison_func, value, NODE_VALUE(tree, next)) < 0) {
+                        if (hint->right == NULL)
+                                private_rb_link_node(tree, hint, new_node, false); 
+                        else 
+                                private_rb_link_node(tree, next, new_node, true); 
+
+                        return new_node; 
+                }
+        } else {
+                Node *prev = (hint == tree->leftmost) ? NULL 
+                                                      : private_rb_prev_node(hint); 
+
+                if (prev == NULL || 
+                    COMPARE(tree, comparison_func, value, NODE_VALUE(tree, prev)) >= 0) {
+                        if (hint->left == NULL)
+                                private_rb_link_node(tree, hint, new_node, true); 
+                        else 
+                                private_rb_link_node(tree, prev, new_node, false); 
+
+                        return new_node; 
+                }
+        }
+
+        private_rb_insert_node(tree, new_node); 
+        return new_node; 
+}
+
+void private_rb_multiset_insert(T tree, void *value)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *parent = NULL; 
+        Node *curr = tree->root; 
+        bool as_left = false; 
+
+        while (curr != NULL) {
+                int c = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)); 
+
+                if (c == 0) {
+                        (*MULTIPLICITY(tree, curr))++; 
+                        COUNT_ADD(tree, 1); 
+
+                        if (IS_AUGMENTED(tree))
+                                private_rb_propagate(tree, curr); 
+                        return; 
+                }
+
+                parent = curr; 
+                as_left = c < 0; 
+                curr = as_left ? curr->left : curr->right; 
+        }
+
+        private_rb_link_node(tree, parent, rb_construct_node(tree, value), as_left); 
+}
+
+void private_rb_insert_node(T tree, Node *new_node)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        void *value = NODE_VALUE(tree, new_node); 
+
+        Node *parent = NULL; 
+        Node *curr = tree->root; 
+        bool as_left = false; 
+
+        while (curr != NULL) {
+                parent = curr; 
+                as_left = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)) < 0; 
+                curr = as_left ? curr->left : curr->right; 
+        }
+
+        private_rb_link_node(tree, parent, new_node, as_left); 
+}
+
+void private_rb_link_node(T tree, Node *parent, Node *new_node, bool as_left)
+{
+        SET_PARENT(new_node, parent); 
+
+        if (parent == NULL) {
+                tree->root = new_node; 
+                tree->leftmost = new_node; 
+                tree->rightmost = new_node; 
+        } else if (as_left) {
+                parent->left = new_node; 
+                if (parent == tree->leftmost)
+                        tree->leftmost = new_node; 
+        } else {
+                parent->right = new_node; 
+                if (parent == tree->rightmost)
+                        tree->rightmost = new_node; 
+        }
+
+        COUNT_ADD(tree, 1); 
+
+        if (IS_AUGMENTED(tree))
+                private_rb_propagate(tree, parent); 
+
+        fix_insertion_violation(tree, new_node);  
+}
+
+Node *rb_construct_node(T tree, void *value)
+{
+        /* nodes left behind by a freed tree which shared our chunks */
+        if (tree->free_nodes == NULL && tree->share != NULL) {
+                ChunkShare *share = private_rb_find_share(tree->share); 
+
+                if (__atomic_load_n(&share->orphans, __ATOMIC_SEQ_CST) != NULL)
+                        private_rb_give_free_nodes(tree, __atomic_exchange_n(&share->orphans, 
+                                                                             NULL, 
+                                                                             __ATOMIC_SEQ_CST)); 
+        }
+
+        bool recycled = tree->free_nodes != NULL; 
+        ValueNode *new_node = (ValueNode *) rb_node_alloc(&tree->free_nodes, &tree->chunks, 
+                                               &tree->chunk_used, tree->node_size); 
+
+        if (recycled)
+                tree->free_count--; 
+        else if (tree->chunk_used == 1)
+                STAT_INC(tree, chunk_allocations); 
+
+        STAT_INC(tree, node_allocations); 
+
+        new_node->link.parent_color = RED; 
+        new_node->link.left = NULL; 
+        new_node->link.right = NULL; 
+        new_node->value = value; 
+
+        if (tree->mode & RB_ORDER_STATISTICS)
+                SET_SUBTREE_SIZE(tree, &new_node->link, 1); 
+        if (tree->mode & RB_MULTISET)
+                *MULTIPLICITY(tree, &new_node->link) = 1; 
+
+        return &new_node->link; 
+}
+
+struct rb_node *rb_node_alloc(struct rb_node **free_nodes, struct rb_chunk **chunks, 
+                              size_t *chunk_used, size_t node_size)
+{
+        Node *n = *free_nodes; 
+
+        if (n != NULL) {
+                *free_nodes = n->right; 
+                return n; 
+        }
+
+        Chunk *chunk = *chunks; 
+
+        if (chunk == NULL || *chunk_used == chunk->capacity) {
+                size_t capacity = RB_CHUNK_MIN_NODES; 
+
+                if (chunk != NULL && chunk->capacity < RB_CHUNK_MAX_NODES / 2)
+                        capacity = chunk->capacity * 2; 
+                else if (chunk != NULL)
+                        capacity = RB_CHUNK_MAX_NODES; 
+
+                chunk = malloc(sizeof(Chunk) + capacity * node_size); 
+                assert(chunk != NULL); 
+                chunk->next = *chunks; 
+                chunk->capacity = capacity; 
+
+                *chunks = chunk; 
+                *chunk_used = 0; 
+        }
+
+        return (Node *) ((char *) chunk->nodes + (*chunk_used)++ * node_size); 
+}
+
+void rb_node_free_chunks(struct rb_chunk *chunks)
+{
+        while (chunks != NULL) {
+                Chunk *next = chunks->next; 
+                free(chunks); 
+                chunks = next; 
+        }
+}
+
+bool fix_insertion_violation(T tree, Node *culprit)
+{
+        bool grew; 
+        size_t steps = rb_node_insert_fixup(&tree->root, culprit, &grew, 
+                                            ROTATED_HOOK(tree), tree); 
+
+        STAT_ADD(tree, insert_fixups, steps); 
+        return grew; 
+}
+
+size_t rb_node_insert_fixup(struct rb_node **root, struct rb_node *culprit, bool *grew, 
+                            void rotated(struct rb_node *down, void *cl), void *cl)
+{
+        Node *parent_node = NULL; 
+        Node *grand_parent_node = NULL; 
+        size_t steps = 0; 
+
+        while ((culprit != *root) && (COLOR(culprit) != BLACK) && (COLOR(PARENT(culprit)) == RED)) {
+                steps++; 
+
+                parent_node = PARENT(culprit); 
+                grand_parent_node = PARENT(PARENT(culprit)); 
+
+                if (parent_node == grand_parent_node->left){
+
+                        Node *uncle = grand_parent_node->right; 
+
+                        if (uncle != NULL && COLOR(uncle) == RED) {
+
+                                SET_COLOR(grand_parent_node, RED); 
+                                SET_COLOR(parent_node, BLACK); 
+                                SET_COLOR(uncle, BLACK); 
+                                culprit = grand_parent_node; 
+
+                        } else {
+
+                                if (culprit == parent_node->right) {
+                                        private_rb_node_rotate(root, parent_node, true, 
+                                                               rotated, cl); 
+                                        culprit = parent_node; 
+                                        parent_node = PARENT(culprit); 
+                                }
+
+                                private_rb_node_rotate(root, grand_parent_node, false, 
+                                                       rotated, cl); 
+
+                                int temp = COLOR(parent_node); 
+                                SET_COLOR(parent_node, COLOR(grand_parent_node)); 
+                                SET_COLOR(grand_parent_node, temp); 
+
+                                culprit = parent_node; 
+
+                        }
+                } else { // parent_node == grand_parent_node->right
+                        Node *uncle = grand_parent_node->left; 
+
+                        if ((uncle != NULL) && (COLOR(uncle) == RED)) {
+                                SET_COLOR(grand_parent_node, RED); 
+                                SET_COLOR(parent_node, BLACK); 
+                                SET_COLOR(uncle, BLACK); 
+                                culprit = grand_parent_node; 
+                        } else {
+                                if (culprit == parent_node->left) {
+                                        private_rb_node_rotate(root, parent_node, false, 
+                                                               rotated, cl); 
+                                        culprit = parent_node; 
+                                        parent_node = PARENT(culprit); 
+                                }
+
+                                private_rb_node_rotate(root, grand_parent_node, true, 
+                                                       rotated, cl); 
+
+                                int temp = COLOR(parent_node); 
+                                SET_COLOR(parent_node, COLOR(grand_parent_node)); 
+                                SET_COLOR(grand_parent_node, temp); 
+
+                                culprit = parent_node; 
+                        }
+                }
+        }
+
+        if (grew != NULL)
+                *grew = COLOR(*root) == RED; 
+
+        SET_COLOR(*root, BLACK); 
+        return steps; 
+}
+
+void private_rb_node_rotate(struct rb_node **root, Node *n, bool left, 
+                            void rotated(struct rb_node *down, void *cl), void *cl)
+{
+        if (left)
+                rb_node_rotate_left(root, n); 
+        else 
+                rb_node_rotate_right(root, n); 
+
+        if (rotated != NULL)
+                rotated(n, cl); 
+}
+
+void *rb_search(T tree, void *value)
+{
+        TRACE_OP(tree, RB_TRACE_SEARCH, value); 
+
+        Node *result = private_rb_find_in_tree(tree, value, tree->comparison_func); 
+
+        if (result != NULL) 
+                return NODE_VALUE(tree, result); 
+
+        return result; //AKA return NULL 
+}
+
+Node *private_rb_find_in_tree(T tree, void *value, 
+                           int comparison_func(void *val1, void *val2))
+{
+        bool found = false; 
+        Node *curr = tree->root; 
+        int c = 0; 
+
+        while (!found && curr != NULL) {
+                c = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)); 
+
+                if (c == 0) {
+                        found = true; 
+                } else if (c < 0) {
+                        curr = curr->left; 
+                } else if (c > 0) {
+                        curr = curr->right; 
+                }
+        }
+
+        return curr; 
+}
+
+void rb_delete_value(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        rb_delete_one(tree, value); 
+}
+
+bool rb_delete_one(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        TRACE_OP(tree, RB_TRACE_DELETE, value); 
+
+        Node *delete_me = private_rb_find_in_tree(tree, value, tree->comparison_func); 
+
+        if (delete_me == NULL) 
+                return false;
+
+        private_rb_remove_one(tree, delete_me); 
+        return true; 
+}
+
+void private_rb_remove_one(T tree, Node *n)
+{
+        if ((tree->mode & RB_MULTISET) && *MULTIPLICITY(tree, n) > 1) {
+                (*MULTIPLICITY(tree, n))--; 
+                COUNT_SUB(tree, 1); 
+
+                if (IS_AUGMENTED(tree))
+                        private_rb_propagate(tree, n); 
+                return; 
+        }
+
+        rb_delete_node(tree, n); 
+}
+
+size_t rb_delete_all(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        size_t deleted = 0; 
+        Node *delete_me; 
+
+        while ((delete_me = private_rb_find_in_tree(tree, value, 
+                                                    tree->comparison_func)) != NULL) {
+                deleted += NODE_WEIGHT(tree, delete_me); 
+                rb_delete_node(tree, delete_me); 
+        }
+
+        return deleted; 
+}
+
+size_t rb_count(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        if (tree->mode & RB_MULTISET) {
+                Node *n = private_rb_find_in_tree(tree, value, tree->comparison_func); 
+
+                return n == NULL ? 0 : *MULTIPLICITY(tree, n); 
+        }
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        size_t count = 0; 
+
+        for (Node *n = private_rb_lower_bound(tree, value); 
+             n != NULL && COMPARE(tree, comparison_func, value, NODE_VALUE(tree, n)) == 0; 
+             n = private_rb_next_node(n))
+                count++; 
+
+        return count; 
+}
+
+void rb_delete_node(T tree, struct rb_node *delete_me)
+{
+        assert(tree != NULL && delete_me != NULL); 
+
+        private_rb_unlink_node(tree, delete_me); 
+        private_rb_release_node(tree, delete_me); 
+}
+
+void private_rb_unlink_node(T tree, Node *delete_me)
+{
+        Node *subtree_of_deleted = NULL; 
+        Node *subtree_parent = NULL; 
+
+        if (delete_me == tree->leftmost)
+                tree->leftmost = private_rb_next_node(delete_me); 
+        if (delete_me == tree->rightmost)
+                tree->rightmost = private_rb_prev_node(delete_me); 
+
+        size_t weight = NODE_WEIGHT(tree, delete_me); 
+        bool unbalanced = rb_node_unlink(&tree->root, delete_me, 
+                                         &subtree_of_deleted, &subtree_parent); 
+
+        COUNT_SUB(tree, weight); 
+
+        if (IS_AUGMENTED(tree))
+                private_rb_propagate(tree, subtree_parent); 
+
+        if (unbalanced) {
+                size_t steps = rb_node_erase_fixup(&tree->root, subtree_of_deleted, 
+                                                   subtree_parent, ROTATED_HOOK(tree), 
+                                                   tree); 
+
+                STAT_ADD(tree, delete_fixups, steps); 
+        }
+}
+
+bool rb_node_unlink(struct rb_node **root, struct rb_node *delete_me, 
+                    struct rb_node **x, struct rb_node **x_parent)
+{
+        Node *y = delete_me; 
+        int y_original_color = COLOR(y); 
+
+        if (delete_me->left == NULL) {
+                *x = delete_me->right; 
+                *x_parent = PARENT(delete_me); 
+                rb_node_replace(root, delete_me, delete_me->right); 
+        } else if (delete_me->right == NULL) {
+                *x = delete_me->left; 
+                *x_parent = PARENT(delete_me); 
+                rb_node_replace(root, delete_me, delete_me->left);
+        } else {
+                y = private_rb_find_successor(delete_me); 
+                y_original_color = COLOR(y); 
+
+                *x = y->right; 
+
+                if (PARENT(y) == delete_me) {
+                        *x_parent = y; 
+                } else {
+                        *x_parent = PARENT(y); 
+                        rb_node_replace(root, y, y->right); 
+                        y->right = delete_me->right; 
+                        SET_PARENT(y->right, y); 
+                }
+
+                rb_node_replace(root, delete_me, y); 
+                y->left = delete_me->left; 
+                SET_PARENT(y->left, y); 
+                SET_COLOR(y, COLOR(delete_me)); 
+        }
+
+        return y_original_color == BLACK; 
+}
+
+size_t rb_node_erase_fixup(struct rb_node **root, struct rb_node *culprit, 
+                           struct rb_node *parent, 
+                           void rotated(struct rb_node *down, void *cl), void *cl)
+{
+        Node *sibling = NULL; 
+        size_t steps = 0; 
+
+        while (culprit != *root && IS_BLACK(culprit)) {
+                steps++; 
+
+                if (culprit == parent->left) {
+                        sibling = parent->right; 
+
+                        if (COLOR(sibling) == RED) {
+                                SET_COLOR(sibling, BLACK); 
+                                SET_COLOR(parent, RED); 
+                                private_rb_node_rotate(root, parent, true, rotated, cl); 
+                                sibling = parent->right; 
+                        }
+
+                        if (IS_BLACK(sibling->left) && IS_BLACK(sibling->right)) {
+                                SET_COLOR(sibling, RED); 
+                                culprit = parent; 
+                                parent = PARENT(culprit); 
+                        } else {
+                                if (IS_BLACK(sibling->right)) {
+                                        SET_COLOR(sibling->left, BLACK); 
+                                        SET_COLOR(sibling, RED); 
+                                        private_rb_node_rotate(root, sibling, false, rotated, cl); 
+                                        sibling = parent->right; 
+                                }
+                                SET_COLOR(sibling, COLOR(parent)); 
+                                SET_COLOR(parent, BLACK); 
+                                SET_COLOR(sibling->right, BLACK); 
+                                private_rb_node_rotate(root, parent, true, rotated, cl); 
+                                culprit = *root; 
+                        }
+                } else { //culprit == parent->right
+                        sibling = parent->left; 
+
+                        if (COLOR(sibling) == RED) {
+                                SET_COLOR(sibling, BLACK); 
+                                SET_COLOR(parent, RED); 
+                                private_rb_node_rotate(root, parent, false, rotated, cl); 
+                                sibling = parent->left; 
+                        }
+
+                        if (IS_BLACK(sibling->right) && IS_BLACK(sibling->left)) {
+                                SET_COLOR(sibling, RED); 
+                                culprit = parent; 
+                                parent = PARENT(culprit); 
+                        } else {
+                                if (IS_BLACK(sibling->left)) {
+                                        SET_COLOR(sibling->right, BLACK); 
+                                        SET_COLOR(sibling, RED); 
+                                        private_rb_node_rotate(root, sibling, true, rotated, cl); 
+                                        sibling = parent->left; 
+                                }
+                                SET_COLOR(sibling, COLOR(parent)); 
+                                SET_COLOR(parent, BLACK); 
+                                SET_COLOR(sibling->left, BLACK); 
+                                private_rb_node_rotate(root, parent, false, rotated, cl); 
+                                culprit = *root; 
+                        }
+                }
+
+        }
+
+        if (culprit != NULL)
+                SET_COLOR(culprit, BLACK); 
+
+        return steps; 
+}
+
+struct rb_node *rb_search_node(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        TRACE_OP(tree, RB_TRACE_SEARCH, value); 
+
+        return private_rb_find_in_tree(tree, value, tree->comparison_func); 
+}
+
+void *rb_node_value(T tree, struct rb_node *node)
+{
+        assert(tree != NULL && node != NULL); 
+
+        return NODE_VALUE(tree, node); 
+}
+
+struct rb_node *rb_root_node(T tree)
+{
+        assert(tree != NULL); 
+
+        return tree->root; 
+}
+
+void *rb_tree_maximum(T tree)
+{
+        assert(tree != NULL); 
+
+        if (tree->rightmost == NULL)
+                return NULL; 
+
+        return NODE_VALUE(tree, tree->rightmost); 
+}
+
+void *rb_tree_minimum(T tree)
+{
+        assert(tree != NULL); 
+
+        if (tree->leftmost == NULL)
+                return NULL; 
+
+        return NODE_VALUE(tree, tree->leftmost); 
+}
+
+void rb_tree_stats(T tree, struct rb_tree_stats *stats)
+{
+        assert(tree != NULL && stats != NULL); 
+
+        memset(stats, 0, sizeof(*stats)); 
+
+#ifdef RB_STATS
+        stats->counters_enabled = true; 
+        stats->comparisons = STAT_READ(tree, comparisons); 
+        stats->rotations = STAT_READ(tree, rotations); 
+        stats->insert_fixups = STAT_READ(tree, insert_fixups); 
+        stats->delete_fixups = STAT_READ(tree, delete_fixups); 
+        stats->node_allocations = STAT_READ(tree, node_allocations); 
+        stats->chunk_allocations = STAT_READ(tree, chunk_allocations); 
+#endif
+
+        stats->count = rb_tree_size(tree); 
+        stats->height = private_rb_depth_histogram(tree->root, 0, 
+                                                   stats->depth_histogram); 
+}
+
+void rb_tree_stats_reset(T tree)
+{
+        assert(tree != NULL); 
+
+#ifdef RB_STATS
+        memset(&tree->stats, 0, sizeof(tree->stats)); 
+#else
+        (void) tree; 
+#endif
+}
+
+size_t private_rb_depth_histogram(Node *n, size_t depth, size_t *histogram)
+{
+        if (n == NULL)
+                return 0; 
+
+        histogram[depth < RB_STATS_MAX_DEPTH ? depth : RB_STATS_MAX_DEPTH - 1]++; 
+
+        size_t left = private_rb_depth_histogram(n->left, depth + 1, histogram); 
+        size_t right = private_rb_depth_histogram(n->right, depth + 1, histogram); 
+
+        return 1 + (left > right ? left : right); 
+}
+
+size_t rb_trace_encode_string(void *value, unsigned char *buf, size_t capacity)
+{
+        return rb_save_encode_string(value, buf, capacity); 
+}
+
+#ifdef RB_TRACE
+
+bool rb_trace_start(T tree, FILE *out, 
+                    size_t encode(void *value, unsigned char *buf, size_t capacity))
+{
+        assert(tree != NULL && out != NULL); 
+
+        rb_trace_stop(tree); 
+
+        if (fwrite(RB_TRACE_MAGIC, 1, RB_TRACE_MAGIC_LENGTH, out) != RB_TRACE_MAGIC_LENGTH)
+                return false; 
+
+        tree->trace = out; 
+        tree->trace_encode = encode != NULL ? encode : &rb_trace_encode_string; 
+
+        return true; 
+}
+
+bool rb_trace_stop(T tree)
+{
+        assert(tree != NULL); 
+
+        if (tree->trace == NULL)
+                return true; 
+
+        bool ok = fflush(tree->trace) == 0 && !ferror(tree->trace); 
+
+        tree->trace = NULL; 
+        tree->trace_encode = NULL; 
+
+        return ok; 
+}
+
+void private_rb_trace_record(T tree, enum rb_trace_op op, void *value)
+{
+        /* room for the op, a varint of up to 10 bytes and the encoding */
+        unsigned char record[1 + 10 + RB_TRACE_MAX_KEY]; 
+        size_t used = 0; 
+
+        record[used++] = (unsigned char) op; 
+
+        if (value != NULL) {
+                unsigned char key[RB_TRACE_MAX_KEY]; 
+                unsigned char *encoding = key; 
+                size_t length = tree->trace_encode(value, key, RB_TRACE_MAX_KEY); 
+
+                /* a longer encoding is written out whole, then truncated */
+                if (length > RB_TRACE_MAX_KEY) {
+                        encoding = malloc(length); 
+                        assert(encoding != NULL); 
+                        tree->trace_encode(value, encoding, length); 
+                        length = RB_TRACE_MAX_KEY; 
+                }
+
+                size_t rest = length; 
+
+                do {
+                        record[used++] = (unsigned char) ((rest & 0x7f) | (rest > 0x7f ? 0x80 : 0)); 
+                        rest >>= 7; 
+                } while (rest != 0); 
+
+                memcpy(record + used, encoding, length); 
+                used += length; 
+
+                if (encoding != key)
+                        free(encoding); 
+        }
+
+        fwrite(record, 1, used, tree->trace); 
+}
+
+#else
+
+bool rb_trace_start(T tree, FILE *out, 
+                    size_t encode(void *value, unsigned char *buf, size_t capacity))
+{
+        assert(tree != NULL && out != NULL); 
+
+        (void) tree; 
+        (void) out; 
+        (void) encode; 
+
+        return false; 
+}
+
+bool rb_trace_stop(T tree)
+{
+        assert(tree != NULL); 
+
+        (void) tree; 
+
+        return true; 
+}
+
+#endif
+
+void *rb_pop_min(T tree)
+{
+        assert(tree != NULL); 
+
+        Node *min = tree->leftmost; 
+
+        if (min == NULL)
+                return NULL; 
+
+        void *value = NODE_VALUE(tree, min); 
+
+        private_rb_remove_one(tree, min); 
+
+        return value; 
+}
+
+void *rb_pop_max(T tree)
+{
+        assert(tree != NULL); 
+
+        Node *max = tree->rightmost; 
+
+        if (max == NULL)
+                return NULL; 
+
+        void *value = NODE_VALUE(tree, max); 
+
+        private_rb_remove_one(tree, max); 
+
+        return value; 
+}
+
+void *rb_select(T tree, size_t k)
+{
+        assert(tree != NULL && (tree->mode & RB_ORDER_STATISTICS)); 
+
+        Node *curr = tree->root; 
+
+        while (curr != NULL) {
+                size_t left_size = SUBTREE_SIZE(tree, curr->left); 
+                size_t weight = NODE_WEIGHT(tree, curr); 
+
+                if (k < left_size) {
+                        curr = curr->left; 
+                } else if (k < left_size + weight) {
+                        return NODE_VALUE(tree, curr); 
+                } else {
+                        k -= left_size + weight; 
+                        curr = curr->right; 
+                }
+        }
+
+        return NULL; 
+}
+
+size_t rb_rank(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+        assert(tree->mode & RB_ORDER_STATISTICS); 
+
+        return private_rb_count_before(tree, value, false); 
+}
+
+size_t rb_count_range(T tree, 
+                      void *lo, bool lo_inclusive, 
+                      void *hi, bool hi_inclusive)
+{
+        assert(tree != NULL && (tree->mode & RB_ORDER_STATISTICS)); 
+
+        size_t below_hi = tree->count; 
+        size_t below_lo = 0; 
+
+        if (hi != NULL)
+                below_hi = private_rb_count_before(tree, hi, hi_inclusive); 
+        if (lo != NULL)
+                below_lo = private_rb_count_before(tree, lo, !lo_inclusive); 
+
+        return below_hi > below_lo ? below_hi - below_lo : 0; 
+}
+
+size_t private_rb_count_before(T tree, void *value, bool inclusive)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = tree->root; 
+        size_t count = 0; 
+
+        while (curr != NULL) {
+                int c = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)); 
+
+                if (c < 0 || (c == 0 && !inclusive)) {
+                        curr = curr->left; 
+                } else {
+                        count += SUBTREE_SIZE(tree, curr->left) + NODE_WEIGHT(tree, curr); 
+                        curr = curr->right; 
+                }
+        }
+
+        return count; 
+}
+
+void *rb_map_put(T tree, void *key, void *value)
+{
+        assert(tree != NULL && key != NULL && (tree->mode & RB_MAP)); 
+
+        bool inserted; 
+        Node *n = private_rb_map_find_or_link(tree, key, &inserted); 
+        void *previous = *MAPPED(tree, n); 
+
+        *MAPPED(tree, n) = value; 
+
+        return inserted ? NULL : previous; 
+}
+
+void *rb_map_get(T tree, void *key)
+{
+        assert(tree != NULL && key != NULL && (tree->mode & RB_MAP)); 
+
+        Node *n = private_rb_find_in_tree(tree, key, tree->comparison_func); 
+
+        return n == NULL ? NULL : *MAPPED(tree, n); 
+}
+
+void **rb_map_get_or_insert(T tree, void *key, void *value, bool *inserted)
+{
+        assert(tree != NULL && key != NULL && (tree->mode & RB_MAP)); 
+
+        bool linked; 
+        Node *n = private_rb_map_find_or_link(tree, key, &linked); 
+
+        if (linked)
+                *MAPPED(tree, n) = value; 
+        if (inserted != NULL)
+                *inserted = linked; 
+
+        return MAPPED(tree, n); 
+}
+
+void *rb_map_update(T tree, void *key, 
+                    void *func_to_apply(void *key, void *value, void *cl), 
+                    void *cl)
+{
+        assert(tree != NULL && key != NULL && func_to_apply != NULL); 
+        assert(tree->mode & RB_MAP); 
+
+        bool inserted; 
+        Node *n = private_rb_map_find_or_link(tree, key, &inserted); 
+
+        *MAPPED(tree, n) = func_to_apply(NODE_VALUE(tree, n), *MAPPED(tree, n), cl); 
+
+        return *MAPPED(tree, n); 
+}
+
+Node *private_rb_map_find_or_link(T tree, void *key, bool *inserted)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *parent = NULL; 
+        Node *curr = tree->root; 
+        bool as_left = false; 
+
+        while (curr != NULL) {
+                int c = COMPARE(tree, comparison_func, key, NODE_VALUE(tree, curr)); 
+
+                if (c == 0) {
+                        *inserted = false; 
+                        return curr; 
+                }
+
+                parent = curr; 
+                as_left = c < 0; 
+                curr = as_left ? curr->left : curr->right; 
+        }
+
+        Node *new_node = rb_construct_node(tree, key); 
+
+        *MAPPED(tree, new_node) = NULL; 
+        private_rb_link_node(tree, parent, new_node, as_left); 
+        *inserted = true; 
+
+        return new_node; 
+}
+
+struct rb_node *rb_interval_insert(T tree, void *lo, void *hi, void *value)
+{
+        assert(tree != NULL && lo != NULL && hi != NULL && value != NULL); 
+        assert(tree->mode & RB_INTERVAL); 
+
+        Node *new_node = rb_construct_node(tree, lo); 
+
+        INTERVAL(tree, new_node)->hi = hi; 
+        INTERVAL(tree, new_node)->max = hi; 
+        INTERVAL(tree, new_node)->value = value; 
+
+        private_rb_insert_node(tree, new_node); 
+
+        return new_node; 
+}
+
+bool rb_interval_delete(T tree, void *lo, void *hi, void *value)
+{
+        assert(tree != NULL && lo != NULL && hi != NULL && value != NULL); 
+        assert(tree->mode & RB_INTERVAL); 
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = private_rb_lower_bound(tree, lo); 
+
+        while (curr != NULL && 
+               COMPARE(tree, comparison_func, lo, NODE_VALUE(tree, curr)) == 0) {
+                IntervalData *interval = INTERVAL(tree, curr); 
+
+                if (interval->value == value && 
+                    COMPARE(tree, comparison_func, hi, interval->hi) == 0) {
+                        rb_delete_node(tree, curr); 
+                        return true; 
+                }
+
+                curr = private_rb_next_node(curr); 
+        }
+
+        return false; 
+}
+
+void *rb_interval_any_overlap(T tree, void *lo, void *hi)
+{
+        assert(tree != NULL && lo != NULL && hi != NULL); 
+        assert(tree->mode & RB_INTERVAL); 
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = tree->root; 
+
+        while (curr != NULL) {
+                IntervalData *interval = INTERVAL(tree, curr); 
+
+                if (COMPARE(tree, comparison_func, NODE_VALUE(tree, curr), hi) <= 0 && 
+                    COMPARE(tree, comparison_func, lo, interval->hi) <= 0)
+                        return interval->value; 
+
+                /* 
+                 * if anything on the left reaches lo, the left subtree holds 
+                 * an overlap whenever the right one does, since everything 
+                 * on the right starts later
+                 */
+                if (curr->left != NULL && 
+                    COMPARE(tree, comparison_func, INTERVAL(tree, curr->left)->max, lo) >= 0)
+                        curr = curr->left; 
+                else 
+                        curr = curr->right; 
+        }
+
+        return NULL; 
+}
+
+size_t rb_interval_overlaps(T tree, void *lo, void *hi, 
+                            int func_to_apply(void *lo, void *hi, 
+                                              void *value, void *cl), 
+                            void *cl)
+{
+        assert(tree != NULL && lo != NULL && hi != NULL && func_to_apply != NULL); 
+        assert(tree->mode & RB_INTERVAL); 
+
+        size_t reported = 0; 
+
+        private_rb_interval_overlaps(tree, tree->root, lo, hi, func_to_apply, 
+                                     cl, &reported); 
+
+        return reported; 
+}
+
+int private_rb_interval_overlaps(T tree, Node *n, void *lo, void *hi, 
+                                 int func_to_apply(void *lo, void *hi, 
+                                                   void *value, void *cl), 
+                                 void *cl, size_t *reported)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+
+        if (n == NULL || COMPARE(tree, comparison_func, INTERVAL(tree, n)->max, lo) < 0)
+                return 0; 
+
+        if (private_rb_interval_overlaps(tree, n->left, lo, hi, func_to_apply, 
+                                         cl, reported) != 0)
+                return 1; 
+
+        void *n_lo = NODE_VALUE(tree, n); 
+        IntervalData *interval = INTERVAL(tree, n); 
+
+        if (COMPARE(tree, comparison_func, n_lo, hi) > 0)
+                return 0; 
+
+        if (COMPARE(tree, comparison_func, lo, interval->hi) <= 0) {
+                (*reported)++; 
+
+                if (func_to_apply(n_lo, interval->hi, interval->value, cl) != 0)
+                        return 1; 
+        }
+
+        return private_rb_interval_overlaps(tree, n->right, lo, hi, func_to_apply, 
+                                            cl, reported); 
+}
+
+void *rb_successor_of_value(T tree, void *value)
+{
+        TRACE_OP(tree, RB_TRACE_SUCCESSOR, value); 
+
+        return private_rb_successor_of_value(tree, value, tree->comparison_func); 
+}
+
+void *rb_predecessor_of_value(T tree, void *value)
+{
+        TRACE_OP(tree, RB_TRACE_PREDECESSOR, value); 
+
+        return private_rb_predecessor_of_value(tree, value, tree->comparison_func); 
+} 
+
+void *private_rb_successor_of_value(T tree, void *value, 
+                                 int comparison_func(void *val1, void *val2))
+{
+        Node *curr_node = tree->root; 
+        Node *successor = NULL; 
+        int c; 
+
+        while (curr_node != NULL) {
+                c = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr_node));
+
+                if (c < 0) {
+                        successor = curr_node; 
+                        curr_node = curr_node->left; 
+                } else {
+                        curr_node = curr_node->right; 
+                }
+        }
+
+        if (successor == NULL) 
+                return NULL; 
+        else
+                return NODE_VALUE(tree, successor); 
+}
+
+void *private_rb_predecessor_of_value(T tree, void *value, 
+                                   int comparison_func(void *val1, void *val2))
+{
+        Node *curr_node = tree->root; 
+        Node *successor = NULL; 
+        int c; 
+
+        while (curr_node != NULL) {
+                c = COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr_node));
+                if (c > 0) {
+                        successor = curr_node; 
+                        curr_node = curr_node->right; 
+                } else {
+                        curr_node = curr_node->left; 
+                }
+        }
+
+        if (successor == NULL) 
+                return NULL; 
+        else
+                return NODE_VALUE(tree, successor); 
+}
+
+Node *private_rb_find_successor(Node *n)
+{
+        return private_subrb_tree_minimum(n->right);  
+}
+
+Node *private_rb_find_predecessor(Node *n)
+{
+        return private_subrb_tree_maximum(n->left); 
+}
+
+Node *private_rb_next_node(Node *n)
+{
+        if (n->right != NULL)
+                return private_subrb_tree_minimum(n->right); 
+
+        Node *parent = PARENT(n); 
+
+        while (parent != NULL && n == parent->right) {
+                n = parent; 
+                parent = PARENT(n); 
+        }
+
+        return parent; 
+}
+
+Node *private_rb_prev_node(Node *n)
+{
+        if (n->left != NULL)
+                return private_subrb_tree_maximum(n->left); 
+
+        Node *parent = PARENT(n); 
+
+        while (parent != NULL && n == parent->left) {
+                n = parent; 
+                parent = PARENT(n); 
+        }
+
+        return parent; 
+}
+
+Node *private_rb_lower_bound(T tree, void *value)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = tree->root; 
+        Node *bound = NULL; 
+
+        while (curr != NULL) {
+                if (COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)) <= 0) {
+                        bound = curr; 
+                        curr = curr->left; 
+                } else {
+                        curr = curr->right; 
+                }
+        }
+
+        return bound; 
+}
+
+Node *private_rb_upper_bound(T tree, void *value)
+{
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = tree->root; 
+        Node *bound = NULL; 
+
+        while (curr != NULL) {
+                if (COMPARE(tree, comparison_func, value, NODE_VALUE(tree, curr)) < 0) {
+                        bound = curr; 
+                        curr = curr->left; 
+                } else {
+                        curr = curr->right; 
+                }
+        }
+
+        return bound; 
+}
+
+struct rb_iter rb_iter_first(T tree)
+{
+        assert(tree != NULL); 
+
+        struct rb_iter it = { tree, tree->leftmost }; 
+        return it; 
+}
+
+struct rb_iter rb_iter_last(T tree)
+{
+        assert(tree != NULL); 
+
+        struct rb_iter it = { tree, tree->rightmost }; 
+        return it; 
+}
+
+struct rb_iter rb_iter_seek(T tree, void *value)
+{
+        assert(tree != NULL && value != NULL); 
+
+        struct rb_iter it = { tree, private_rb_lower_bound(tree, value) }; 
+        return it; 
+}
+
+void *rb_iter_value(struct rb_iter *it)
+{
+        assert(it != NULL); 
+
+        if (it->node == NULL)
+                return NULL; 
+
+        return NODE_VALUE(it->tree, it->node); 
+}
+
+void *rb_iter_next(struct rb_iter *it)
+{
+        assert(it != NULL); 
+
+        if (it->node != NULL)
+                it->node = private_rb_next_node(it->node); 
+
+        return rb_iter_value(it); 
+}
+
+void *rb_iter_prev(struct rb_iter *it)
+{
+        assert(it != NULL); 
+
+        if (it->node != NULL)
+                it->node = private_rb_prev_node(it->node); 
+
+        return rb_iter_value(it); 
+}
+
+Node *private_subrb_tree_maximum(Node *curr_node)
+{
+        while (curr_node->right != NULL)
+                curr_node = curr_node->right; 
+
+        return curr_node;
+}
+
+Node *private_subrb_tree_minimum(Node *curr_node)
+{
+        while (curr_node->left != NULL)
+                curr_node = curr_node->left; 
+
+        return curr_node;
+}
+
+void rb_map_inorder(T tree,  
+                    void func_to_apply(void *value, int depth, void *cl), 
+                    void *cl)
+{
+        int depth = 0; 
+
+        TRACE_OP(tree, RB_TRACE_MAP_INORDER, NULL); 
+
+        if (tree->root == NULL)
+                return; 
+
+        rb_private_inorder_map(tree, tree->root, depth, func_to_apply, cl); 
+}
+
+void rb_private_inorder_map(T tree, 
+                            Node *root, 
+                            int depth, 
+                            void func_to_apply(void *value, int depth, void *cl), 
+                            void *cl)
+{
+
+        if (root->left != NULL)
+                rb_private_inorder_map(tree, root->left, depth + 1, func_to_apply, cl); 
+
+        func_to_apply(NODE_VALUE(tree, root), depth, cl); 
+
+        if (root->right != NULL)
+                rb_private_inorder_map(tree, root->right, depth + 1, func_to_apply, cl); 
+}
+
+void rb_map_preorder(T tree, 
+                     void func_to_apply(void *value, int depth, void *cl), 
+                     void *cl)
+{
+        int depth = 0; 
+
+        TRACE_OP(tree, RB_TRACE_MAP_PREORDER, NULL); 
+
+        if (tree->root == NULL)
+                return; 
+
+        rb_private_preorder_map(tree, tree->root, depth, func_to_apply, cl); 
+}
+
+void rb_private_preorder_map(T tree, 
+                             Node *root, 
+                            int depth, 
+                            void func_to_apply(void *value, int depth, void *cl), 
+                            void *cl)
+{
+        func_to_apply(NODE_VALUE(tree, root), depth, cl); 
+
+        if (root->left != NULL)
+                rb_private_preorder_map(tree, root->left, depth + 1, func_to_apply, cl); 
+
+        if (root->right != NULL)
+                rb_private_preorder_map(tree, root->right, depth + 1, func_to_apply, cl); 
+}
+
+void rb_map_postorder(T tree, 
+                      void func_to_apply(void *value, int depth, void *cl), 
+                      void *cl)
+{
+        int depth = 0; 
+
+        TRACE_OP(tree, RB_TRACE_MAP_POSTORDER, NULL); 
+
+        if (tree->root == NULL)
+                return; 
+
+        rb_private_postorder_map(tree, tree->root, depth, func_to_apply, cl); 
+}
+
+size_t rb_map_range(T tree, 
+                    void *lo, bool lo_inclusive, 
+                    void *hi, bool hi_inclusive, 
+                    int func_to_apply(void *value, void *cl), 
+                    void *cl)
+{
+        assert(tree != NULL && func_to_apply != NULL); 
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        Node *curr = tree->leftmost; 
+        size_t visited = 0; 
+
+        /* 
+         * a single descent skips everything left of the range; the walk 
+         * then stops at the first value past hi, so no subtree outside the 
+         * bounds is entered
+         */
+        if (lo != NULL)
+                curr = lo_inclusive ? private_rb_lower_bound(tree, lo) 
+                                    : private_rb_upper_bound(tree, lo); 
+
+        while (curr != NULL) {
+                void *value = NODE_VALUE(tree, curr); 
+
+                if (hi != NULL) {
+                        int c = COMPARE(tree, comparison_func, hi, value); 
+
+                        if (c < 0 || (c == 0 && !hi_inclusive))
+                                break; 
+                }
+
+                visited++; 
+
+                if (func_to_apply(value, cl) != 0)
+                        break; 
+
+                curr = private_rb_next_node(curr); 
+        }
+
+        return visited; 
+}
+
+void rb_private_postorder_map(T tree, 
+                              Node *root, 
+                              int depth, 
+                              void func_to_apply(void *value, int depth, void *cl), 
+                              void *cl)
+{
+        if (root->left != NULL)
+                rb_private_postorder_map(tree, root->left, depth + 1, func_to_apply, cl); 
+
+        if (root->right != NULL)
+                rb_private_postorder_map(tree, root->right, depth + 1, func_to_apply, cl); 
+
+        func_to_apply(NODE_VALUE(tree, root), depth, cl); 
+}
+
+T private_rb_new_like(T tree)
+{
+        T copy = rb_new_mode(tree->comparison_func, tree->mode); 
+
+        copy->intrusive = tree->intrusive; 
+        copy->link_offset = tree->link_offset; 
+        copy->node_size = tree->node_size; 
+
+        return copy; 
+}
+
+void private_rb_absorb(T into, T from)
+{
+        private_rb_share_chunks(from); 
+
+        if (from->share != NULL) {
+                private_rb_hold_share(into, private_rb_find_share(from->share)); 
+                private_rb_drop_share(from->share); 
+                from->share = NULL; 
+        }
+
+        private_rb_give_free_nodes(into, from->free_nodes); 
+
+        from->free_nodes = NULL; 
+        from->root = NULL; 
+        rb_tree_free(from); 
+}
+
+void private_rb_set_root(T tree, Node *root)
+{
+        tree->root = root; 
+        tree->leftmost = (root == NULL) ? NULL : private_subrb_tree_minimum(root); 
+        tree->rightmost = (root == NULL) ? NULL : private_subrb_tree_maximum(root); 
+
+        if (tree->mode & RB_ORDER_STATISTICS)
+                tree->count = SUBTREE_SIZE(tree, root); 
+        else 
+                tree->count = (root == NULL) ? 0 : COUNT_UNKNOWN; 
+}
+
+int private_rb_black_height(Node *n)
+{
+        int height = 0; 
+
+        for (; n != NULL; n = n->left)
+                if (COLOR(n) == BLACK)
+                        height++; 
+
+        return height; 
+}
+
+int private_rb_detach(Node *n, int height)
+{
         if (n == NULL)
+                return 0; 
+
+        if (COLOR(n) == RED)
+                height++; 
+
+        n->parent_color = BLACK; 
+        return height; 
+}
+
+Node *private_rb_join_subtrees(T tree, Node *a, int ha, Node *pivot, 
+                               Node *b, int hb, int *height)
+{
+        if (ha == hb) {
+                pivot->parent_color = BLACK; 
+                pivot->left = a; 
+                pivot->right = b; 
+
+                if (a != NULL)
+                        SET_PARENT(a, pivot); 
+                if (b != NULL)
+                        SET_PARENT(b, pivot); 
+                if (IS_AUGMENTED(tree))
+                        private_rb_update_node(tree, pivot); 
+
+                *height = ha + 1; 
+                return pivot; 
+        }
+
+        bool left_taller = ha > hb; 
+        int target = left_taller ? hb : ha; 
+        int h = left_taller ? ha : hb; 
+        Node *parent = NULL; 
+        Node *curr = left_taller ? a : b; 
+
+        while (curr != NULL && (COLOR(curr) == RED || h > target)) {
+                if (COLOR(curr) == BLACK)
+                        h--; 
+
+                parent = curr; 
+                curr = left_taller ? curr->right : curr->left; 
+        }
+
+        pivot->parent_color = (uintptr_t) parent | RED; 
+
+        if (left_taller) {
+                pivot->left = curr; 
+                pivot->right = b; 
+                parent->right = pivot; 
+        } else {
+                pivot->left = a; 
+                pivot->right = curr; 
+                parent->left = pivot; 
+        }
+
+        if (pivot->left != NULL)
+                SET_PARENT(pivot->left, pivot); 
+        if (pivot->right != NULL)
+                SET_PARENT(pivot->right, pivot); 
+
+        tree->root = left_taller ? a : b; 
+
+        if (IS_AUGMENTED(tree))
+                private_rb_propagate(tree, pivot); 
+
+        *height = (left_taller ? ha : hb) + fix_insertion_violation(tree, pivot); 
+        return tree->root; 
+}
+
+void private_rb_split_subtree(T tree, Node *n, int height, void *key, 
+                              Node **left, int *left_height, 
+                              Node **right, int *right_height, 
+                              Node **found)
+{
+        if (found != NULL)
+                *found = NULL; 
+
+        if (n == NULL) {
+                *left = NULL; 
+                *right = NULL; 
+                *left_height = 0; 
+                *right_height = 0; 
                 return; 
+        }
+
+        int (*comparison_func)(void *, void *) = tree->comparison_func; 
+        int child_height = height - (COLOR(n) == BLACK); 
+        Node *lower = n->left; 
+        Node *upper = n->right; 
+        int lower_height = private_rb_detach(lower, child_height); 
+        int upper_height = private_rb_detach(upper, child_height); 
+        Node *middle; 
+        int middle_height; 
+        int c = COMPARE(tree, comparison_func, key, NODE_VALUE(tree, n)); 
+
+        if (c == 0 && found != NULL) {
+                *found = n; 
+                *left = lower; 
+                *left_height = lower_height; 
+                *right = upper; 
+                *right_height = upper_height; 
+        } else if (c <= 0) {
+                private_rb_split_subtree(tree, lower, lower_height, key, 
+                                         left, left_height, 
+                                         &middle, &middle_height, found); 
+                *right = private_rb_join_subtrees(tree, middle, middle_height, n, 
+                                                  upper, upper_height, 
+                                                  right_height); 
+        } else {
+                private_rb_split_subtree(tree, upper, upper_height, key, 
+                                         &middle, &middle_height, 
+                                         right, right_height, found); 
+                *left = private_rb_join_subtrees(tree, lower, lower_height, n, 
+                                                 middle, middle_height, 
+                                                 left_height); 
+        }
+}
+
+void rb_split(T tree, void *key, T *left, T *right)
+{
+        assert(tree != NULL && key != NULL && left != NULL && right != NULL); 
+
+        size_t count = tree->count; 
+        Node *lower; 
+        Node *upper; 
+        int lower_height; 
+        int upper_height; 
+
+        private_rb_split_subtree(tree, tree->root, 
+                                 private_rb_black_height(tree->root), key, 
+                                 &lower, &lower_height, &upper, &upper_height, 
+                                 NULL); 
+
+        *left = private_rb_new_like(tree); 
+        *right = private_rb_new_like(tree); 
+
+        private_rb_share_chunks(tree); 
+
+        if (tree->share != NULL) {
+                private_rb_hold_share(*left, private_rb_find_share(tree->share)); 
+                private_rb_hold_share(*right, private_rb_find_share(tree->share)); 
+                private_rb_drop_share(tree->share); 
+                tree->share = NULL; 
+        }
+
+        (*left)->free_nodes = tree->free_nodes; 
+        (*left)->free_count = tree->free_count; 
+        tree->free_nodes = NULL; 
+        tree->free_count = 0; 
+
+        private_rb_set_root(*left, lower); 
+        private_rb_set_root(*right, upper); 
+
+        if (lower == NULL)
+                (*right)->count = count; 
+        if (upper == NULL)
+                (*left)->count = count; 
+
+        tree->root = NULL; 
+        rb_tree_free(tree); 
+}
+
+T rb_join(T left, void *pivot, T right)
+{
+        assert(left != NULL && pivot != NULL && right != NULL); 
+        assert(!(left->mode & (RB_INTERVAL | RB_MAP))); 
+
+        Node *n; 
+
+        if (left->intrusive)
+                n = (Node *) ((char *) pivot + left->link_offset); 
+        else 
+                n = rb_construct_node(left, pivot); 
+
+        return private_rb_join(left, n, right); 
+}
+
+T rb_join2(T left, T right)
+{
+        assert(left != NULL && right != NULL); 
+
+        if (left->root == NULL) {
+                left->root = right->root; 
+                left->leftmost = right->leftmost; 
+                left->rightmost = right->rightmost; 
+                left->count = right->count; 
+        }
+
+        if (right->root == NULL || left->root == right->root) {
+                private_rb_absorb(left, right); 
+                return left; 
+        }
+
+        Node *pivot = left->rightmost; 
 
-        if (n->left != NULL) 
-                private_rb_deallocate_all_tree_nodes(n->left);
-        if (n->right != NULL)
-                private_rb_deallocate_all_tree_nodes(n->right); 
+        private_rb_unlink_node(left, pivot); 
 
-        free(n); 
+        return private_rb_join(left, pivot, right); 
 }
 
-void rb_rotate_left(T tree, Node *n)
+T private_rb_join(T left, Node *pivot, T right)
 {
-        Node *right_child = n->right; 
+        assert(left->comparison_func == right->comparison_func); 
+        assert(left->mode == right->mode && left->intrusive == right->intrusive); 
+        assert(left->link_offset == right->link_offset); 
+
+        Node *a = left->root; 
+        Node *b = right->root; 
+        Node *first = (a == NULL) ? pivot : left->leftmost; 
+        Node *last = (b == NULL) ? pivot : right->rightmost; 
+        size_t count = COUNT_UNKNOWN; 
+        int height; 
+
+        if (left->count != COUNT_UNKNOWN && right->count != COUNT_UNKNOWN)
+                count = left->count + NODE_WEIGHT(left, pivot) + right->count; 
+
+        Node *root = private_rb_join_subtrees(left, a, private_rb_black_height(a), 
+                                              pivot, 
+                                              b, private_rb_black_height(b), 
+                                              &height); 
+
+        right->root = NULL; 
+        private_rb_absorb(left, right); 
+
+        left->root = root; 
+        left->leftmost = first; 
+        left->rightmost = last; 
+        left->count = count; 
+
+        return left; 
+}
 
-        n->right = right_child->left; 
+Node *private_rb_join2_subtrees(T tree, Node *a, int ha, Node *b, int hb, 
+                                int *height)
+{
+        if (a == NULL || b == NULL) {
+                *height = (a == NULL) ? hb : ha; 
+                return (a == NULL) ? b : a; 
+        }
 
-        if (n->right != NULL)
-                n->right->parent = n; 
+        Node *pivot = private_subrb_tree_maximum(a); 
 
-        right_child->parent = n->parent; 
+        tree->root = a; 
+        tree->leftmost = NULL; 
+        tree->rightmost = NULL; 
+        tree->count = COUNT_UNKNOWN; 
+        private_rb_unlink_node(tree, pivot); 
 
-        if(n->parent == NULL) {
-                tree->root = right_child; 
-        } else if (n == n->parent->left) {
-                (void) tree; 
-                n->parent->left = right_child; 
-        } else {
-                (void) tree; 
-                n->parent->right = right_child; 
-        }
+        a = tree->root; 
 
-        right_child->left = n; 
-        n->parent = right_child; 
+        return private_rb_join_subtrees(tree, a, private_rb_black_height(a), 
+                                        pivot, b, hb, height); 
 }
 
-void rb_rotate_right(T tree, Node *n)
-{ 
-        Node *left_child = n->left; 
+T rb_union(T a, T b)
+{
+        return private_rb_set_operation(a, b, SET_UNION); 
+}
 
-        n->left = left_child->right; 
+T rb_intersection(T a, T b)
+{
+        return private_rb_set_operation(a, b, SET_INTERSECTION); 
+}
 
-        if (n->left != NULL)
-                n->left->parent = n; 
+T rb_difference(T a, T b)
+{
+        return private_rb_set_operation(a, b, SET_DIFFERENCE); 
+}
 
-        left_child->parent = n->parent; 
+T private_rb_set_operation(T a, T b, SetOp op)
+{
+        assert(a != NULL && b != NULL); 
+        assert(a->comparison_func == b->comparison_func); 
+        assert(a->mode == b->mode && a->intrusive == b->intrusive); 
+        assert(a->link_offset == b->link_offset); 
+        assert(!(a->mode & (RB_INTERVAL | RB_MULTISET))); 
+
+        unsigned forks = 0; 
+
+#ifdef RB_PARALLEL
+        static pthread_once_t once = PTHREAD_ONCE_INIT; 
+
+        pthread_once(&once, private_rb_count_fork_levels); 
+        forks = private_rb_set_fork_levels; 
+#endif
+
+        Node *root = a->root; 
+        size_t a_count = a->count; 
+        size_t b_count = b->count; 
+        size_t hits = 0; 
+        int height; 
+
+        root = private_rb_set_op(a, op, root, private_rb_black_height(root), 
+                                 b->root, private_rb_black_height(b->root), 
+                                 forks, &height, &hits); 
+
+        b->root = NULL; 
+        private_rb_absorb(a, b); 
+        private_rb_set_root(a, root); 
+
+        if (op == SET_INTERSECTION)
+                a->count = hits; 
+        else if (op == SET_DIFFERENCE && a_count != COUNT_UNKNOWN)
+                a->count = a_count - hits; 
+        else if (op == SET_UNION && a_count != COUNT_UNKNOWN && b_count != COUNT_UNKNOWN)
+                a->count = a_count + b_count - hits; 
+
+        /* 
+         * nodes dropped from the result are only reused by later inserts. 
+         * once they outnumber the values, moving the values into a chunk of
+         * their own frees them, at a cost paid for by the drops
+         */
+        if (a->count != COUNT_UNKNOWN && a->free_count > a->count)
+                private_rb_compact(a); 
+
+        return a; 
+}
 
-        if(n->parent == NULL) {
-                tree->root = left_child; 
-        } else if (n == n->parent->left) {
-                (void) tree; 
-                n->parent->left = left_child; 
-        } else {
-                (void) tree; 
-                n->parent->right = left_child; 
+Node *private_rb_set_op(T tree, SetOp op, Node *a, int ha, Node *b, int hb, 
+                        unsigned forks, int *height, size_t *hits)
+{
+        if (a == NULL || b == NULL) {
+                bool keep_a = (op == SET_DIFFERENCE || op == SET_UNION); 
+                bool keep_b = (op == SET_UNION); 
+
+                if (a != NULL && keep_a) {
+                        *height = ha; 
+                        return a; 
+                } else if (b != NULL && keep_b) {
+                        *height = hb; 
+                        return b; 
+                }
+
+                private_rb_release_subtree(tree, a); 
+                private_rb_release_subtree(tree, b); 
+
+                *height = 0; 
+                return NULL; 
         }
 
-        left_child->right = n; 
-        n->parent = left_child; 
+        int child_height = hb - (COLOR(b) == BLACK); 
+        Node *b_lower = b->left; 
+        Node *b_upper = b->right; 
+        int b_lower_height = private_rb_detach(b_lower, child_height); 
+        int b_upper_height = private_rb_detach(b_upper, child_height); 
+
+        Node *a_lower; 
+        Node *a_upper; 
+        Node *found; 
+        int a_lower_height; 
+        int a_upper_height; 
+
+        private_rb_split_subtree(tree, a, ha, NODE_VALUE(tree, b), 
+                                 &a_lower, &a_lower_height, 
+                                 &a_upper, &a_upper_height, &found); 
+
+        Node *lower = NULL; 
+        Node *upper; 
+        int lower_height = 0; 
+        int upper_height; 
+        bool forked = false; 
+
+#ifdef RB_PARALLEL
+        SetTask task; 
+        pthread_t thread; 
+
+        if (forks > 0 && ha >= RB_SET_FORK_HEIGHT && hb >= RB_SET_FORK_HEIGHT) {
+                task.context = *tree; 
+                task.context.free_nodes = NULL; 
+                task.context.free_count = 0; 
+                task.hits = 0; 
+                task.op = op; 
+                task.a = a_lower; 
+                task.ha = a_lower_height; 
+                task.b = b_lower; 
+                task.hb = b_lower_height; 
+                task.forks = forks - 1; 
+
+                forked = pthread_create(&thread, NULL, private_rb_set_task, 
+                                        &task) == 0; 
+        }
+#endif
+
+        if (!forked)
+                lower = private_rb_set_op(tree, op, a_lower, a_lower_height, 
+                                          b_lower, b_lower_height, 
+                                          forks > 0 ? forks - 1 : 0, 
+                                          &lower_height, hits); 
+
+        upper = private_rb_set_op(tree, op, a_upper, a_upper_height, 
+                                  b_upper, b_upper_height, 
+                                  forks > 0 ? forks - 1 : 0, &upper_height, hits); 
+
+#ifdef RB_PARALLEL
+        if (forked) {
+                pthread_join(thread, NULL); 
+                lower = task.result; 
+                lower_height = task.height; 
+                private_rb_give_free_nodes(tree, task.context.free_nodes); 
+                *hits += task.hits; 
+        }
+#endif
+
+        /* 
+         * a union keeps a's node where both trees hold a value, and an 
+         * intersection keeps only those; a difference keeps neither
+         */
+        Node *pivot = NULL; 
+
+        if (op == SET_UNION)
+                pivot = (found != NULL) ? found : b; 
+        else if (op == SET_INTERSECTION)
+                pivot = found; 
+
+        if (found != NULL)
+                (*hits)++; 
+        if (pivot != b)
+                private_rb_release_node(tree, b); 
+        if (found != NULL && pivot != found)
+                private_rb_release_node(tree, found); 
+
+        if (pivot != NULL)
+                return private_rb_join_subtrees(tree, lower, lower_height, pivot, 
+                                                upper, upper_height, height); 
+
+        return private_rb_join2_subtrees(tree, lower, lower_height, 
+                                         upper, upper_height, height); 
 }
 
-int rb_insert_value(T tree, void *value)
+#ifdef RB_PARALLEL
+void private_rb_count_fork_levels(void)
 {
-        assert(tree != NULL && value != NULL); 
+        long processors = sysconf(_SC_NPROCESSORS_ONLN); 
 
-        Node *new_node = rb_construct_node(value); 
-        tree->root = private_rb_insert_value(tree->root, new_node, tree->comparison_func); 
+        while (processors > 0 
+               && ((long) 1 << private_rb_set_fork_levels) < 2 * processors)
+                private_rb_set_fork_levels++; 
+}
 
-        fix_insertion_violation(tree, new_node);  
+void *private_rb_set_task(void *arg)
+{
+        SetTask *task = arg; 
 
-        return 0;
+        task->result = private_rb_set_op(&task->context, task->op, 
+                                         task->a, task->ha, task->b, task->hb, 
+                                         task->forks, &task->height, &task->hits); 
+
+        return NULL; 
 }
+#endif
 
-Node *rb_construct_node(void *value)
+void private_rb_crc_init(uint32_t *table)
 {
-        Node *new_node = (Node *) malloc(sizeof(Node)); 
+        for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i; 
 
-        new_node->parent = NULL;
-        new_node->left = NULL; 
-        new_node->right = NULL; 
-        new_node->value = value; 
+                for (int bit = 0; bit < 8; bit++) 
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1; 
+
+                table[i] = c; 
+        }
+}
 
-        new_node->color = RED; 
+uint32_t private_rb_crc_update(const uint32_t *table, uint32_t crc, 
+                               const unsigned char *buf, size_t length)
+{
+        for (size_t i = 0; i < length; i++) 
+                crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8); 
 
-        return new_node; 
+        return crc; 
 }
 
-Node *private_rb_insert_value(Node *root, Node *new_node, 
-                           void *comparison_func(void *val1, void *val2)) 
+bool rb_tree_save(T tree, int fd, 
+                  size_t encode(void *value, unsigned char *buf, size_t capacity))
 {
-        if (root == NULL) { 
-                return new_node; 
-        }
+        assert(tree != NULL && encode != NULL && !tree->intrusive); 
+        assert(!(tree->mode & (RB_INTERVAL | RB_MAP))); 
 
-        if ((int)(intptr_t) comparison_func(new_node->value, root->value) < 0) {
-                root->left = private_rb_insert_value(root->left, new_node, comparison_func); 
-                root->left->parent = root; 
-        } else {
-                root->right = private_rb_insert_value(root->right, new_node, comparison_func); 
-                root->right->parent = root; 
+        unsigned flags = 0; 
+        size_t count = rb_tree_size(tree); 
+
+        if (tree->mode & RB_ORDER_STATISTICS)
+                flags |= RB_SAVE_ORDER_STATISTICS; 
+
+        /* a multiset saves a record per node, not per copy */
+        if (tree->mode & RB_MULTISET) {
+                flags |= RB_SAVE_MULTISET; 
+                count = 0; 
+                for (Node *n = tree->leftmost; n != NULL; n = private_rb_next_node(n)) 
+                        count++; 
         }
 
-        return root; 
+        RedBlack_Save_T save = private_rb_save_open(fd, count, flags, encode); 
+
+        for (Node *n = tree->leftmost; n != NULL; n = private_rb_next_node(n)) 
+                if (!private_rb_save_record(save, NODE_VALUE(tree, n), 
+                                            NODE_WEIGHT(tree, n)))
+                        break; 
+
+        return rb_save_end(save); 
 }
 
-//TODO: Refactor this, breaking it into smaller pieces
-void fix_insertion_violation(T tree, Node *culprit)
+RedBlack_Save_T rb_save_begin(int fd, size_t count, 
+                              size_t encode(void *value, unsigned char *buf, 
+                                            size_t capacity))
 {
-        Node *parent_node = NULL; 
-        Node *grand_parent_node = NULL; 
+        assert(encode != NULL); 
 
-        while ((culprit != tree->root) && (culprit->color != BLACK) && (culprit->parent->color == RED)) {
-                
-                parent_node = culprit->parent; 
-                grand_parent_node = culprit->parent->parent; 
+        return private_rb_save_open(fd, count, 0, encode); 
+}
 
-                if (parent_node == grand_parent_node->left){
+RedBlack_Save_T private_rb_save_open(int fd, size_t count, unsigned flags, 
+                                     size_t encode(void *value, unsigned char *buf, 
+                                                   size_t capacity))
+{
+        RedBlack_Save_T save = malloc(sizeof(struct rb_save)); 
+        unsigned char header[RB_SAVE_MAGIC_LENGTH + 2]; 
+
+        assert(save != NULL); 
+
+        save->fd = fd; 
+        save->encode = encode; 
+        save->multiset = (flags & RB_SAVE_MULTISET) != 0; 
+        save->failed = false; 
+        save->remaining = count; 
+        save->crc = 0xffffffffu; 
+        save->record_capacity = 256; 
+        save->record = malloc(save->record_capacity); 
+        assert(save->record != NULL); 
+        save->used = 0; 
+        private_rb_crc_init(save->crc_table); 
+
+        memcpy(header, RB_SAVE_MAGIC, RB_SAVE_MAGIC_LENGTH); 
+        header[RB_SAVE_MAGIC_LENGTH] = RB_SAVE_VERSION; 
+        header[RB_SAVE_MAGIC_LENGTH + 1] = (unsigned char) flags; 
+
+        private_rb_save_bytes(save, header, sizeof(header)); 
+        private_rb_save_varint(save, count); 
+
+        return save; 
+}
 
-                        Node *uncle = grand_parent_node->right; 
+bool rb_save_value(RedBlack_Save_T save, void *value)
+{
+        assert(save != NULL && value != NULL); 
 
-                        if (uncle != NULL && uncle->color == RED) {
+        return private_rb_save_record(save, value, 1); 
+}
 
-                                grand_parent_node->color = RED; 
-                                parent_node->color = BLACK; 
-                                uncle->color = BLACK; 
-                                culprit = grand_parent_node; 
+bool private_rb_save_record(RedBlack_Save_T save, void *value, size_t copies)
+{
+        if (save->failed || save->remaining == 0) {
+                save->failed = true; 
+                return false; 
+        }
 
-                        } else {
+        size_t length = save->encode(value, save->record, save->record_capacity); 
 
-                                if (culprit == parent_node->right) {
-                                        rb_rotate_left(tree, parent_node); 
-                                        culprit = parent_node; 
-                                        parent_node = culprit->parent; 
-                                }
+        if (length > save->record_capacity) {
+                free(save->record); 
+                save->record_capacity = length; 
+                save->record = malloc(length); 
+                assert(save->record != NULL); 
+                length = save->encode(value, save->record, length); 
+        }
 
-                                rb_rotate_right(tree, grand_parent_node); 
+        save->remaining--; 
+        private_rb_save_varint(save, length); 
+        private_rb_save_bytes(save, save->record, length); 
 
-                                char temp = parent_node->color; 
-                                parent_node->color = grand_parent_node->color; 
-                                grand_parent_node->color = temp; 
+        if (save->multiset)
+                private_rb_save_varint(save, copies); 
 
-                                culprit = parent_node; 
+        return !save->failed; 
+}
 
-                        }
-                } else { // parent_node == grand_parent_node->right
-                        Node *uncle = grand_parent_node->left; 
+bool rb_save_end(RedBlack_Save_T save)
+{
+        assert(save != NULL); 
 
-                        if ((uncle != NULL) && (uncle->color == RED)) {
-                                grand_parent_node->color = RED; 
-                                parent_node->color = BLACK; 
-                                uncle->color = BLACK; 
-                                culprit = grand_parent_node; 
-                        } else {
-                                if (culprit == parent_node->left) {
-                                        rb_rotate_right(tree, parent_node); 
-                                        culprit = parent_node; 
-                                        parent_node = culprit->parent; 
-                                }
+        unsigned char trailer[4]; 
 
-                                rb_rotate_left(tree, grand_parent_node);
+        private_rb_save_flush(save); 
 
-                                char temp = parent_node->color; 
-                                parent_node->color = grand_parent_node->color; 
-                                grand_parent_node->color = temp; 
+        uint32_t crc = save->crc ^ 0xffffffffu; 
 
-                                culprit = parent_node; 
-                        }
-                }
-        }
+        for (int i = 0; i < 4; i++) 
+                trailer[i] = (unsigned char) (crc >> (8 * i)); 
 
-        tree->root->color = BLACK; 
-}
+        /* the trailer is not part of its own checksum */
+        memcpy(save->buffer, trailer, sizeof(trailer)); 
+        save->used = sizeof(trailer); 
+        private_rb_save_flush(save); 
 
-void *rb_search(T tree, void *value)
-{
-        Node *result = private_rb_find_in_tree(tree, value, tree->comparison_func); 
+        bool ok = !save->failed && save->remaining == 0; 
 
-        if (result != NULL) 
-                return (void *) result->value; 
+        free(save->record); 
+        free(save); 
 
-        return result; //AKA return NULL 
+        return ok; 
 }
 
-Node *private_rb_find_in_tree(T tree, void *value, 
-                           void *comparison_func(void *val1, void *val2))
+void private_rb_save_bytes(RedBlack_Save_T save, const unsigned char *bytes, 
+                           size_t length)
 {
-        bool found = false; 
-        Node *curr = tree->root; 
-        int c = 0; 
+        while (length > 0) {
+                size_t room = RB_SAVE_BUFFER_SIZE - save->used; 
+                size_t step = length < room ? length : room; 
 
-        while (!found && curr != NULL) {
-                c = (int)(intptr_t) comparison_func(value, curr->value); 
+                memcpy(save->buffer + save->used, bytes, step); 
+                save->used += step; 
+                bytes += step; 
+                length -= step; 
 
-                if (c == 0) {
-                        found = true; 
-                } else if (c < 0) {
-                        curr = curr->left; 
-                } else if (c > 0) {
-                        curr = curr->right; 
-                }
+                if (save->used == RB_SAVE_BUFFER_SIZE)
+                        private_rb_save_flush(save); 
         }
-
-        return curr; 
 }
 
-void rb_delete_value(T tree, void *value)
+void private_rb_save_varint(RedBlack_Save_T save, size_t x)
 {
-        assert(tree != NULL && value != NULL); 
-
-        Node *subtree_of_deleted = NULL; 
+        unsigned char bytes[RB_SAVE_MAX_VARINT]; 
+        size_t used = 0; 
 
-        Node *delete_me = private_rb_find_in_tree(tree, value, tree->comparison_func); 
+        do {
+                bytes[used++] = (unsigned char) ((x & 0x7f) | (x > 0x7f ? 0x80 : 0)); 
+                x >>= 7; 
+        } while (x != 0); 
 
-        if (delete_me == NULL) 
-                return;
+        private_rb_save_bytes(save, bytes, used); 
+}
 
-        Node *y = delete_me; 
-        char y_original_color = y->color; 
+void private_rb_save_flush(RedBlack_Save_T save)
+{
+        unsigned char *next = save->buffer; 
+        size_t left = save->used; 
 
-        if (delete_me->left == NULL) {
-                subtree_of_deleted = delete_me->right; 
-                rb_transplant(tree, delete_me, delete_me->right); 
-        } else if (delete_me->right == NULL) {
-                subtree_of_deleted = delete_me->left; 
-                rb_transplant(tree, delete_me, delete_me->left);
-        } else {
-                y = private_rb_find_successor(delete_me); 
-                y_original_color = y->color; 
+        save->crc = private_rb_crc_update(save->crc_table, save->crc, 
+                                          save->buffer, save->used); 
+        save->used = 0; 
 
-                subtree_of_deleted = y->right; 
+        while (left > 0 && !save->failed) {
+                ssize_t written = write(save->fd, next, left); 
 
-                if (y->parent == delete_me && subtree_of_deleted != NULL) {
-                        subtree_of_deleted->parent = y; 
-                } else {
-                        rb_transplant(tree, y, y->right); 
-                        y->right = delete_me->right; 
-                        if (y->right != NULL)
-                                y->right->parent = y; 
+                if (written < 0 && errno == EINTR)
+                        continue; 
+                if (written <= 0) {
+                        save->failed = true; 
+                        break; 
                 }
 
-                rb_transplant(tree, delete_me, y); 
-                y->left = delete_me->left; 
-                y->left->parent = y; 
-                y->color = delete_me->color; 
+                next += written; 
+                left -= (size_t) written; 
         }
-
-        free(delete_me); 
-
-        if (y_original_color == BLACK) 
-                rb_delete_fixup(tree, subtree_of_deleted); 
 }
 
-void rb_transplant(T tree, Node *u, Node *v) 
+T rb_tree_load(int fd, void *comparison_func, 
+               void *decode(const unsigned char *buf, size_t length), 
+               void discard(void *value))
 {
-        if (u->parent == NULL) {
-                tree->root = v; 
-        } else if (u == u->parent->left) {
-                u->parent->left = v; 
-        } else {
-                u->parent->right = v;
+        assert(decode != NULL); 
+
+        LoadStream *in = malloc(sizeof(LoadStream)); 
+        unsigned char header[RB_SAVE_MAGIC_LENGTH + 2]; 
+        size_t count; 
+
+        assert(in != NULL); 
+
+        in->fd = fd; 
+        in->crc = 0xffffffffu; 
+        in->next = 0; 
+        in->end = 0; 
+        private_rb_crc_init(in->crc_table); 
+
+        if (!private_rb_load_bytes(in, header, sizeof(header)) || 
+            memcmp(header, RB_SAVE_MAGIC, RB_SAVE_MAGIC_LENGTH) != 0 || 
+            header[RB_SAVE_MAGIC_LENGTH] != RB_SAVE_VERSION || 
+            (header[RB_SAVE_MAGIC_LENGTH + 1] 
+             & ~(RB_SAVE_MULTISET | RB_SAVE_ORDER_STATISTICS)) != 0 || 
+            !private_rb_load_varint(in, &count)) {
+                free(in); 
+                return NULL; 
         }
 
-        if (v != NULL)
-                v->parent = u->parent; 
-}
+        unsigned flags = header[RB_SAVE_MAGIC_LENGTH + 1]; 
+        unsigned mode = 0; 
 
-//TODO: Refactor this, breaking it into smaller pieces. 
-void rb_delete_fixup(T tree, Node *culprit)
-{
-        if (culprit == NULL)
-                return; 
+        if (flags & RB_SAVE_MULTISET)
+                mode |= RB_MULTISET; 
+        if (flags & RB_SAVE_ORDER_STATISTICS)
+                mode |= RB_ORDER_STATISTICS; 
 
-        Node *sibling = NULL; 
+        T tree = rb_new_mode(comparison_func, mode); 
+        Chunk *chunk = NULL; 
+        bool ok = false; 
+        size_t decoded = 0; 
 
-        while (culprit != tree->root && culprit->color == BLACK) {
-                if (culprit == culprit->parent->left) {
-                        sibling = culprit->parent->right; 
+        /* 
+         * the count is not checked until the end, so the chunk grows with the
+         * records that are actually there rather than trusting it
+         */
+        size_t capacity = count < RB_CHUNK_MAX_NODES ? count : RB_CHUNK_MAX_NODES; 
 
-                        if (sibling->color == RED) {
-                                sibling->color = BLACK; 
-                                culprit->parent->color = RED; 
-                                rb_rotate_left(tree, culprit->parent); 
-                                sibling = culprit->parent->right; 
-                        }
+        chunk = malloc(sizeof(Chunk) + (capacity > 0 ? capacity : 1) * tree->node_size); 
+        assert(chunk != NULL); 
+        chunk->capacity = capacity; 
 
-                        if (sibling->left->color == BLACK && sibling->right->color == BLACK) {
-                                sibling->color = RED; 
-                                culprit = culprit->parent; 
-                        } else {
-                                if (sibling->right->color == BLACK) {
-                                        sibling->left->color = BLACK; 
-                                        sibling->color = RED; 
-                                        rb_rotate_right(tree, sibling); 
-                                        sibling = culprit->parent->right; 
-                                }
-                                sibling->color = culprit->parent->color; 
-                                culprit->parent->color = BLACK; 
-                                sibling->right->color = BLACK; 
-                                rb_rotate_left(tree, culprit->parent); 
-                                culprit = tree->root; 
-                        }
-                } else { //culprit == culprit->parent->right
-                        sibling = culprit->parent->left; 
-
-                        if (sibling->color == RED) {
-                                sibling->color = BLACK; 
-                                culprit->parent->color = RED; 
-                                rb_rotate_left(tree, culprit->parent); 
-                                sibling = culprit->parent->left; 
-                        }
+        decoded = private_rb_load_records(tree, in, &chunk, count, decode, &ok); 
 
-                        if (sibling->right->color == BLACK && sibling->left->color == BLACK) {
-                                sibling->color = RED; 
-                                culprit = culprit->parent; 
-                        } else {
-                                if (sibling->left->color == BLACK) {
-                                        sibling->right->color = BLACK; 
-                                        sibling->color = RED; 
-                                        rb_rotate_left(tree, sibling); 
-                                        sibling = culprit->parent->left; 
-                                }
-                                sibling->color = culprit->parent->color; 
-                                culprit->parent->color = BLACK; 
-                                sibling->left->color = BLACK; 
-                                rb_rotate_right(tree, culprit->parent); 
-                                culprit = tree->root; 
-                        }
-                }
+        free(in); 
 
+        if (!ok) {
+                for (size_t i = 0; i < decoded && discard != NULL; i++) 
+                        discard(((ValueNode *) ((char *) chunk->nodes 
+                                                + i * tree->node_size))->value); 
+
+                free(chunk); 
+                rb_tree_free(tree); 
+                return NULL; 
         }
-        culprit->color = BLACK; 
-}
 
-void *rb_tree_maximum(T tree)
-{
-        Node *result = private_subrb_tree_maximum(tree->root); 
-        return result->value; 
-}
+        if (count == 0) {
+                free(chunk); 
+                return tree; 
+        }
 
-void *rb_tree_minimum(T tree)
-{
-        Node *result = private_subrb_tree_minimum(tree->root); 
-        return result->value; 
-}
+        private_rb_link_sorted(tree, chunk, count); 
+        tree->count = private_rb_count_subtree(tree, tree->root); 
 
-void *rb_successor_of_value(T tree, void *value)
-{
-        return private_rb_successor_of_value(tree, value, tree->comparison_func); 
+        return tree; 
 }
 
-void *rb_predecessor_of_value(T tree, void *value)
+size_t private_rb_load_records(T tree, LoadStream *in, Chunk **chunk, size_t count, 
+                               void *decode(const unsigned char *buf, size_t length), 
+                               bool *ok)
 {
-        return private_rb_predecessor_of_value(tree, value, tree->comparison_func); 
-} 
+        size_t capacity = 256; 
+        unsigned char *record = malloc(capacity); 
+        size_t i; 
 
-void *private_rb_successor_of_value(T tree, void *value, 
-                                 void *comparison_func(void *val1, void *val2))
-{
-        Node *curr_node = tree->root; 
-        Node *successor = NULL; 
-        int c; 
+        assert(record != NULL); 
+        *ok = false; 
 
-        while (curr_node != NULL) {
-                c = (int)(intptr_t) comparison_func(value, curr_node->value);
+        for (i = 0; i < count; i++) {
+                size_t length; 
 
-                if (c < 0) {
-                        successor = curr_node; 
-                        curr_node = curr_node->left; 
-                } else {
-                        curr_node = curr_node->right; 
+                if (!private_rb_load_varint(in, &length))
+                        break; 
+
+                if (i == (*chunk)->capacity) {
+                        size_t more = count - i < i ? count - i : i; 
+                        Chunk *larger = realloc(*chunk, sizeof(Chunk) 
+                                                + (i + more) * tree->node_size); 
+
+                        assert(larger != NULL); 
+                        larger->capacity = i + more; 
+                        *chunk = larger; 
                 }
-        }
 
-        if (successor == NULL) 
-                return NULL; 
-        else
-                return successor->value; 
-}
+                ValueNode *node = (ValueNode *) ((char *) (*chunk)->nodes 
+                                                 + i * tree->node_size); 
 
-void *private_rb_predecessor_of_value(T tree, void *value, 
-                                   void *comparison_func(void *val1, void *val2))
-{
-        Node *curr_node = tree->root; 
-        Node *successor = NULL; 
-        int c; 
+                if (length > capacity) {
+                        unsigned char *larger = realloc(record, length); 
 
-        while (curr_node != NULL) {
-                c = (int)(intptr_t) comparison_func(value, curr_node->value);
-                if (c > 0) {
-                        successor = curr_node; 
-                        curr_node = curr_node->right; 
-                } else {
-                        curr_node = curr_node->left; 
+                        if (larger == NULL)
+                                break; 
+
+                        record = larger; 
+                        capacity = length; 
+                }
+
+                if (!private_rb_load_bytes(in, record, length))
+                        break; 
+
+                if (tree->mode & RB_MULTISET) {
+                        size_t copies; 
+
+                        if (!private_rb_load_varint(in, &copies) || copies == 0)
+                                break; 
+
+                        *MULTIPLICITY(tree, &node->link) = copies; 
                 }
+
+                node->value = decode(record, length); 
+
+                if (node->value == NULL)
+                        break; 
         }
 
-        if (successor == NULL) 
-                return NULL; 
-        else
-                return successor->value; 
-}
+        free(record); 
 
-Node *private_rb_find_successor(Node *n)
-{
-        return private_subrb_tree_minimum(n->right);  
-}
+        if (i < count)
+                return i; 
 
-Node *private_rb_find_predecessor(Node *n)
-{
-        return private_subrb_tree_maximum(n->left); 
-}
+        unsigned char trailer[4]; 
+        uint32_t crc = in->crc ^ 0xffffffffu; 
 
-Node *private_subrb_tree_maximum(Node *curr_node)
-{
-        while (curr_node->right != NULL)
-                curr_node = curr_node->right; 
+        if (!private_rb_load_bytes(in, trailer, sizeof(trailer)))
+                return i; 
 
-        return curr_node;
+        *ok = (uint32_t) trailer[0] == (crc & 0xff) 
+              && (uint32_t) trailer[1] == ((crc >> 8) & 0xff) 
+              && (uint32_t) trailer[2] == ((crc >> 16) & 0xff) 
+              && (uint32_t) trailer[3] == (crc >> 24); 
+
+        return i; 
 }
 
-Node *private_subrb_tree_minimum(Node *curr_node)
+bool private_rb_load_bytes(LoadStream *in, unsigned char *bytes, size_t length)
 {
-        while (curr_node->left != NULL)
-                curr_node = curr_node->left; 
+        while (length > 0) {
+                if (in->next == in->end) {
+                        ssize_t got = read(in->fd, in->buffer, RB_SAVE_BUFFER_SIZE); 
 
-        return curr_node;
-}
+                        if (got < 0 && errno == EINTR)
+                                continue; 
+                        if (got <= 0)
+                                return false; 
 
-void rb_map_inorder(T tree,  
-                    void func_to_apply(void *value, int depth, void *cl), 
-                    void *cl)
-{
-        int depth = 0; 
-        rb_private_inorder_map(tree->root, depth, func_to_apply, cl); 
-}
+                        in->next = 0; 
+                        in->end = (size_t) got; 
+                }
 
-void rb_private_inorder_map(Node *root, 
-                            int depth, 
-                            void func_to_apply(void *value, int depth, void *cl), 
-                            void *cl)
-{
+                size_t step = in->end - in->next; 
 
-        if (root->left != NULL)
-                rb_private_inorder_map(root->left, depth + 1, func_to_apply, cl); 
+                if (step > length)
+                        step = length; 
 
-        func_to_apply(root->value, depth, cl); 
+                memcpy(bytes, in->buffer + in->next, step); 
+                in->crc = private_rb_crc_update(in->crc_table, in->crc, bytes, step); 
+                in->next += step; 
+                bytes += step; 
+                length -= step; 
+        }
 
-        if (root->right != NULL)
-                rb_private_inorder_map(root->right, depth + 1, func_to_apply, cl); 
+        return true; 
 }
 
-void rb_map_preorder(T tree, 
-                     void func_to_apply(void *value, int depth, void *cl), 
-                     void *cl)
+bool private_rb_load_varint(LoadStream *in, size_t *x)
 {
-        int depth = 0; 
-        rb_private_preorder_map(tree->root, depth, func_to_apply, cl); 
-}
+        unsigned char byte; 
 
-void rb_private_preorder_map(Node *root, 
-                            int depth, 
-                            void func_to_apply(void *value, int depth, void *cl), 
-                            void *cl)
-{
-        func_to_apply(root->value, depth, cl); 
+        *x = 0; 
 
-        if (root->left != NULL)
-                rb_private_preorder_map(root->left, depth + 1, func_to_apply, cl); 
+        for (int shift = 0; shift < 64; shift += 7) {
+                if (!private_rb_load_bytes(in, &byte, 1))
+                        return false; 
 
-        if (root->right != NULL)
-                rb_private_preorder_map(root->right, depth + 1, func_to_apply, cl); 
+                *x |= (size_t) (byte & 0x7f) << shift; 
+
+                if ((byte & 0x80) == 0)
+                        return true; 
+        }
+
+        return false; 
 }
 
-void rb_map_postorder(T tree, 
-                      void func_to_apply(void *value, int depth, void *cl), 
-                      void *cl)
+size_t rb_save_encode_string(void *value, unsigned char *buf, size_t capacity)
 {
-        int depth = 0; 
-        rb_private_postorder_map(tree->root, depth, func_to_apply, cl); 
+        assert(value != NULL && buf != NULL); 
+
+        size_t length = strlen((char *) value); 
+
+        if (length <= capacity)
+                memcpy(buf, value, length); 
+
+        return length; 
 }
 
-void rb_private_postorder_map(Node *root, 
-                              int depth, 
-                              void func_to_apply(void *value, int depth, void *cl), 
-                              void *cl)
+void *rb_load_decode_string(const unsigned char *buf, size_t length)
 {
-        if (root->left != NULL)
-                rb_private_postorder_map(root->left, depth + 1, func_to_apply, cl); 
+        assert(buf != NULL); 
 
-        if (root->right != NULL)
-                rb_private_postorder_map(root->right, depth + 1, func_to_apply, cl); 
+        char *copy = malloc(length + 1); 
+
+        assert(copy != NULL); 
+        memcpy(copy, buf, length); 
+        copy[length] = '\0'; 
 
-        func_to_apply(root->value, depth, cl); 
+        return copy; 
 }
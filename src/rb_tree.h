@@ -14,7 +14,9 @@
 /*** INCLUDED FILES ***/
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <assert.h>
 #include <stdbool.h>
 
@@ -22,6 +24,169 @@
 
 typedef struct rb_tree *RedBlack_T;
 
+/*
+ * mode flags for rb_new_mode
+ * 
+ * RB_ORDER_STATISTICS  every node also records the size of its subtree, 
+ *                      which enables rb_select, rb_rank and rb_count_range
+ * RB_INTERVAL          every node holds a closed interval [lo, hi] and the 
+ *                      highest endpoint in its subtree. values are added 
+ *                      with rb_interval_insert and ordered by their low 
+ *                      endpoint, which is what rb_search, rb_iter_value 
+ *                      and the map functions see. endpoints are compared 
+ *                      with the tree's comparison function
+ * RB_MAP               every node holds a key, as its value, and a separate 
+ *                      mapped value. keys are unique and are added with 
+ *                      rb_map_put, rb_map_get_or_insert or rb_map_update. 
+ *                      rb_search, rb_iter_value and the map functions see 
+ *                      the keys. may not be combined with RB_INTERVAL
+ * RB_MULTISET          equal values share one node, which counts how many 
+ *                      times the value was inserted. sizes, ranks and 
+ *                      rb_select count every insertion, while the map 
+ *                      functions, cursors and rb_map_range visit each 
+ *                      distinct value once (see rb_count). rb_delete_value
+ *                      removes a single insertion. may not be combined 
+ *                      with RB_INTERVAL or RB_MAP
+ */
+#define RB_ORDER_STATISTICS 0x1u
+#define RB_INTERVAL 0x2u
+#define RB_MAP 0x4u
+#define RB_MULTISET 0x8u
+
+/*
+ * a snapshot of a tree's shape and, when rb_tree.c is compiled with 
+ * RB_STATS defined, of the work it has done since it was created or last 
+ * reset. without RB_STATS the counters are not kept at all, cost nothing, 
+ * and read as zero
+ * 
+ * comparisons          calls to the comparison function
+ * rotations            single rotations while rebalancing
+ * insert_fixups        iterations of the insertion fixup loop
+ * delete_fixups        iterations of the deletion fixup loop
+ * node_allocations     nodes handed out by the tree's allocator
+ * chunk_allocations    calls to malloc for blocks of nodes
+ * count                number of values in the tree
+ * height               number of nodes on the longest root to leaf path
+ * depth_histogram      depth_histogram[d] is the number of nodes at depth d
+ *                      (the root is at depth 0). a red black tree is never 
+ *                      deep enough to reach the last bucket
+ */
+#define RB_STATS_MAX_DEPTH 128
+
+/*
+ * call traces
+ * 
+ * when rb_tree.c is compiled with RB_TRACE defined, rb_trace_start makes a 
+ * tree record each call to rb_insert_value, rb_delete_value (and 
+ * rb_delete_one), rb_search (and rb_search_node), rb_successor_of_value, 
+ * rb_predecessor_of_value and the three rb_map_*order functions to a file. 
+ * the trace is RB_TRACE_MAGIC followed by one record per call: the op as 
+ * a single byte, then, for ops which take a value, the length of the 
+ * value's encoding as a LEB128 varint and the encoding itself. 
+ * 
+ * values are encoded by a function supplied to rb_trace_start. a trace is 
+ * replayed (see bench/rb_replay.c) by comparing encodings bytewise, with a 
+ * shorter encoding ordered before any it is a prefix of, so the encoding 
+ * should order values the way the tree's comparison function does; 
+ * rb_trace_encode_string does so for strcmp. encodings longer than 
+ * RB_TRACE_MAX_KEY bytes are truncated
+ */
+#define RB_TRACE_MAGIC "RBTRACE1"
+#define RB_TRACE_MAGIC_LENGTH 8
+#define RB_TRACE_MAX_KEY 256
+
+enum rb_trace_op {
+        RB_TRACE_INSERT = 1, 
+        RB_TRACE_DELETE, 
+        RB_TRACE_SEARCH, 
+        RB_TRACE_SUCCESSOR, 
+        RB_TRACE_PREDECESSOR, 
+        RB_TRACE_MAP_INORDER, 
+        RB_TRACE_MAP_PREORDER, 
+        RB_TRACE_MAP_POSTORDER
+}; 
+
+/*
+ * saved trees
+ * 
+ * rb_tree_save writes a tree's values to a file descriptor in sorted order,
+ * and rb_tree_load reads them back into a new tree. a saved tree is 
+ * RB_SAVE_MAGIC, a version byte (RB_SAVE_VERSION) and a byte of flags 
+ * (RB_SAVE_MULTISET, RB_SAVE_ORDER_STATISTICS: the mode of the tree), then 
+ * the number of records as a LEB128 varint, then one record per node: the 
+ * length of the value's encoding as a varint and the encoding itself, 
+ * followed in a multiset by the node's count as a varint. the file ends 
+ * with the CRC-32 of everything before it, as four bytes, least 
+ * significant first. 
+ * 
+ * values are encoded and decoded by functions supplied by the caller; 
+ * rb_save_encode_string and rb_load_decode_string do so for nul terminated
+ * strings. RedBlack_Save_T writes the same format from any other source of 
+ * sorted values, such as a snapshot of an rcu tree (see rb_snapshot_save)
+ */
+#define RB_SAVE_MAGIC "RBSAVE"
+#define RB_SAVE_MAGIC_LENGTH 6
+#define RB_SAVE_VERSION 1
+#define RB_SAVE_MULTISET 0x1u
+#define RB_SAVE_ORDER_STATISTICS 0x2u
+
+typedef struct rb_save *RedBlack_Save_T; 
+
+struct rb_tree_stats {
+        bool counters_enabled; 
+        size_t comparisons; 
+        size_t rotations; 
+        size_t insert_fixups; 
+        size_t delete_fixups; 
+        size_t node_allocations; 
+        size_t chunk_allocations; 
+        size_t count; 
+        size_t height; 
+        size_t depth_histogram[RB_STATS_MAX_DEPTH]; 
+};
+
+/*
+ * the links of a single node in the tree. ordinary trees allocate these 
+ * themselves; intrusive trees (see rb_new_intrusive) link rb_nodes which are 
+ * embedded in records owned by the caller. the fields are managed by the tree
+ * and must not be modified while the node is linked in. the color of the 
+ * node is kept in the low bit of the parent pointer, which keeps a node at 
+ * three words
+ */
+struct rb_node {
+        uintptr_t parent_color; 
+        struct rb_node *left; 
+        struct rb_node *right; 
+};
+
+/*
+ * a block of nodes handed out by rb_node_alloc. chunks form a list, newest
+ * first, and are only ever freed all together
+ */
+struct rb_chunk; 
+
+/*
+ * a cursor over the values of a tree, in sorted order. cursors live on the 
+ * caller's stack and never allocate; stepping a cursor follows the nodes' 
+ * parent links, so walking the whole tree costs O(1) amortized per step. 
+ * a cursor stays usable across calls as long as the node it points at is 
+ * not deleted. once it steps past either end, its node is NULL and it stays 
+ * there
+ */
+struct rb_iter {
+        RedBlack_T tree; 
+        struct rb_node *node; 
+};
+
+/*
+ * rb_entry
+ * 
+ * given a pointer to an rb_node embedded in a record, the type of the record 
+ * and the name of the rb_node member, returns a pointer to the record
+ */
+#define rb_entry(node, type, member) \
+        ((type *) ((char *) (node) - offsetof(type, member)))
+
 /**********************
  * FUNCTION CONTRACTS *
  * AND DECLARATIONS   *
@@ -51,11 +216,79 @@ typedef struct rb_tree *RedBlack_T;
  */
 RedBlack_T rb_new(void *comparison_func); 
 
+/*
+ * rb_new_mode
+ * 
+ * returns a pointer to a new, empty red black tree with the given mode 
+ * flags (see RB_ORDER_STATISTICS and friends). rb_new(f) is equivalent to 
+ * rb_new_mode(f, 0). modes which store extra data make every node larger
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ * 
+ * @param       void * - pointer to a comparison function, as for rb_new
+ * @param       unsigned - bitwise or of RB_* mode flags
+ * @return      pointer to empty rb_tree
+ */
+RedBlack_T rb_new_mode(void *comparison_func, unsigned mode); 
+
+/*
+ * rb_new_intrusive
+ * 
+ * returns a pointer to a new, empty intrusive red black tree. an intrusive 
+ * tree does not allocate nodes; instead, every record stored in it embeds a 
+ * struct rb_node, and the tree links those directly. the values passed to 
+ * the comparison function, and returned by rb_search and friends, are 
+ * pointers to the records themselves
+ * 
+ * use rb_insert_node rather than rb_insert_value to add records. deleting a 
+ * record only unlinks it; the record is still owned by the caller
+ * 
+ * CREs         n/a
+ * UREs         system out of memory
+ *              records whose rb_node is not at link_offset
+ * 
+ * @param       void * - pointer to a comparison function over records, as 
+ *                              described for rb_new
+ * @param       size_t - offset of the struct rb_node within each record, 
+ *                              usually offsetof(record type, member)
+ * @return      pointer to empty rb_tree
+ */
+RedBlack_T rb_new_intrusive(void *comparison_func, size_t link_offset); 
+
+/*
+ * rb_build_from_sorted
+ * 
+ * given an array of n values already sorted according to comparison_func, 
+ * returns a new tree holding those values. the tree is built perfectly 
+ * balanced in linear time, with a single allocation for all of its nodes 
+ * and without calling the comparison function
+ * 
+ * CREs         values == NULL and n > 0
+ *              n nodes would not fit in a single allocation
+ * UREs         system out of memory
+ *              values are not sorted in nondecreasing order
+ *              values contains NULL
+ * 
+ * @param       void ** - array of sorted values
+ * @param       size_t - number of values in the array
+ * @param       void * - pointer to a comparison function, as for rb_new
+ * @return      pointer to the new rb_tree
+ */
+RedBlack_T rb_build_from_sorted(void **values, size_t n, void *comparison_func); 
+
 /*
  * rb_tree_free
  * 
  * given a pointer to a red black tree, deallocates the tree and all nodes
- * contained within it, then sets the value of the pointer to NULL
+ * contained within it, then sets the value of the pointer to NULL. nodes are 
+ * allocated in chunks owned by the tree, so this runs in time proportional 
+ * to the number of chunks rather than the number of nodes. chunks whose 
+ * nodes were split or joined into other trees are only freed along with 
+ * the last tree holding nodes from them; until then, freeing a tree which 
+ * shares chunks hands its nodes to the trees sharing them, for reuse by 
+ * their inserts, and takes time proportional to its size. the records 
+ * linked into an intrusive tree belong to the caller and are not freed
  *
  * CREs         tree == NULL
  * UREs         n/a
@@ -78,6 +311,21 @@ void rb_tree_free(RedBlack_T tree);
  */ 
 bool rb_tree_is_empty(RedBlack_T tree); 
 
+/*
+ * rb_tree_size
+ * 
+ * returns the number of values stored in the tree, in constant time. the 
+ * first call on a tree made by rb_split (or joined from one) walks the 
+ * tree to count its values, unless it keeps order statistics
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to be measured
+ * @return      size_t - number of values
+ */
+size_t rb_tree_size(RedBlack_T tree); 
+
 /*
  * insert_value
  * 
@@ -85,6 +333,7 @@ bool rb_tree_is_empty(RedBlack_T tree);
  * 
  * CREs         tree == NULL
  *              value == NULL
+ *              tree was created with RB_INTERVAL or RB_MAP
  * 
  * UREs         system out of memory
  *              attempting to pass in a value which cannot be compared with 
@@ -96,6 +345,50 @@ bool rb_tree_is_empty(RedBlack_T tree);
  */
 int rb_insert_value(RedBlack_T tree, void *value);
 
+/*
+ * rb_insert_hint
+ * 
+ * given a value and a hint node close to where the value belongs, inserts 
+ * the value into the tree and returns the node holding it. when the value 
+ * belongs immediately before or after the hint (for instance, appending 
+ * values in sorted order and passing the previously returned node as the 
+ * hint) the insertion costs a constant number of comparisons and amortized 
+ * constant time; otherwise it falls back to an ordinary insertion. a NULL 
+ * hint always performs an ordinary insertion
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ *              tree was created with rb_new_intrusive, RB_INTERVAL, RB_MAP
+ *                      or RB_MULTISET
+ * UREs         system out of memory
+ *              hint does not belong to tree
+ * 
+ * @param       RedBlack_T - tree in which to insert value
+ * @param       struct rb_node * - node near the insertion point, or NULL
+ * @param       void * - a pointer to any item to be inserted
+ * @return      struct rb_node * - node holding the inserted value, usable
+ *                      as the hint for the next insertion
+ */
+struct rb_node *rb_insert_hint(RedBlack_T tree, struct rb_node *hint, 
+                               void *value); 
+
+/*
+ * rb_insert_node
+ * 
+ * given an intrusive tree and the rb_node embedded in a record, links the 
+ * record into the tree. no memory is allocated
+ * 
+ * CREs         tree == NULL
+ *              node == NULL
+ *              tree was not created with rb_new_intrusive
+ * UREs         node is already linked into a tree
+ * 
+ * @param       RedBlack_T - intrusive tree in which to insert
+ * @param       struct rb_node * - link embedded in the record to insert
+ * @return      n/a
+ */
+void rb_insert_node(RedBlack_T tree, struct rb_node *node); 
+
 /*
  * rb_search
  * 
@@ -109,6 +402,54 @@ int rb_insert_value(RedBlack_T tree, void *value);
  */
 void *rb_search(RedBlack_T tree, void *value); 
 
+/*
+ * rb_search_node
+ * 
+ * given a tree and a value to search for, returns the node holding that 
+ * value, or NULL if the value is not found. for intrusive trees this is the 
+ * rb_node embedded in the matching record
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree in which to search
+ * @param       void * - value to search for
+ * @return      struct rb_node * - node containing the value
+ */
+struct rb_node *rb_search_node(RedBlack_T tree, void *value); 
+
+/*
+ * rb_node_value
+ * 
+ * given a tree and one of its nodes, returns the value stored in the node 
+ * (for intrusive trees, the record containing the node)
+ * 
+ * CREs         tree == NULL
+ *              node == NULL
+ * UREs         node does not belong to tree
+ * 
+ * @param       RedBlack_T - tree which the node belongs to
+ * @param       struct rb_node * - node to read
+ * @return      void * - value stored in the node
+ */
+void *rb_node_value(RedBlack_T tree, struct rb_node *node); 
+
+/*
+ * rb_root_node
+ * 
+ * given a tree, returns its root node, or NULL if the tree is empty. the 
+ * tree's shape can then be walked through the nodes' left and right links, 
+ * as the parallel walks do
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to read
+ * @return      struct rb_node * - the root node
+ */
+struct rb_node *rb_root_node(RedBlack_T tree); 
+
 /*
  * rb_delete_value
  * 
@@ -124,10 +465,78 @@ void *rb_search(RedBlack_T tree, void *value);
  */
 void rb_delete_value(RedBlack_T tree, void *value); 
 
+/*
+ * rb_delete_one
+ * 
+ * as rb_delete_value, but reports whether anything was deleted. in a 
+ * multiset tree this lowers the value's count, and only removes its node 
+ * once the count reaches zero
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to delete from
+ * @param       void * - value to be deleted
+ * @return      bool - true if a value was deleted
+ */
+bool rb_delete_one(RedBlack_T tree, void *value); 
+
+/*
+ * rb_delete_all
+ * 
+ * deletes every stored value equal to value
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to delete from
+ * @param       void * - value to be deleted
+ * @return      size_t - number of values deleted
+ */
+size_t rb_delete_all(RedBlack_T tree, void *value); 
+
+/*
+ * rb_count
+ * 
+ * returns the number of stored values equal to value. takes O(log n) time 
+ * in a multiset tree, and O(log n + k) for k equal values otherwise
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to search
+ * @param       void * - value to count
+ * @return      size_t - number of equal values
+ */
+size_t rb_count(RedBlack_T tree, void *value); 
+
+/*
+ * rb_delete_node
+ * 
+ * given a tree and one of its nodes, removes that node from the tree without 
+ * searching for it. for intrusive trees, the record is handed back to the 
+ * caller; otherwise the node is released and must not be used again. in a 
+ * multiset tree every copy of the node's value is removed
+ * 
+ * CREs         tree == NULL
+ *              node == NULL
+ * UREs         node does not belong to tree
+ * 
+ * @param       RedBlack_T - tree containing the node
+ * @param       struct rb_node * - node to remove
+ * @return      n/a
+ */
+void rb_delete_node(RedBlack_T tree, struct rb_node *node); 
+
 /*
  * rb_tree_minimum
  * 
- * given a tree, returns the minimum value stored in the tree
+ * given a tree, returns the minimum value stored in the tree, or NULL if 
+ * the tree is empty. the node holding the minimum is cached, so this takes
+ * constant time
  * 
  * CREs         tree == NULL
  * UREs         n/a
@@ -140,7 +549,9 @@ void *rb_tree_minimum(RedBlack_T tree);
 /*
  * rb_tree_maximum
  * 
- * given a tree, returns the maximum value stored in the tree
+ * given a tree, returns the maximum value stored in the tree, or NULL if 
+ * the tree is empty. the node holding the maximum is cached, so this takes
+ * constant time
  * 
  * CREs         tree == NULL
  * UREs         n/a
@@ -150,6 +561,351 @@ void *rb_tree_minimum(RedBlack_T tree);
  */
 void *rb_tree_maximum(RedBlack_T tree); 
 
+/*
+ * rb_tree_stats
+ * 
+ * fills in stats for the tree. the height and histogram are measured by 
+ * walking the tree, which takes O(n) time
+ * 
+ * CREs         tree == NULL
+ *              stats == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to be measured
+ * @param       struct rb_tree_stats * - filled in with the tree's stats
+ * @return      n/a
+ */
+void rb_tree_stats(RedBlack_T tree, struct rb_tree_stats *stats); 
+
+/*
+ * rb_tree_stats_reset
+ * 
+ * sets the tree's performance counters back to zero. has no effect unless 
+ * compiled with RB_STATS
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree whose counters are reset
+ * @return      n/a
+ */
+void rb_tree_stats_reset(RedBlack_T tree); 
+
+/*
+ * rb_trace_start
+ * 
+ * starts recording the tree's calls to out, as described above. out is 
+ * left open, and must stay open until rb_trace_stop or rb_tree_free. if 
+ * the tree is already being traced, that trace is stopped first. returns 
+ * false, recording nothing, if rb_tree.c was compiled without RB_TRACE or 
+ * the header could not be written
+ * 
+ * CREs         tree == NULL
+ *              out == NULL
+ * UREs         out is not open for writing
+ * 
+ * @param       RedBlack_T - tree to trace
+ * @param       FILE * - file to record to
+ * @param       size_t encode(value, buf, capacity) - as for rb_tree_save,
+ *                      writes the encoding of value to buf, if it fits in 
+ *                      capacity bytes, and returns its length either way. 
+ *                      a longer encoding is fetched whole and truncated. 
+ *                      if NULL, rb_trace_encode_string is used
+ * @return      bool - true if recording started
+ */
+bool rb_trace_start(RedBlack_T tree, FILE *out, 
+                    size_t encode(void *value, unsigned char *buf, size_t capacity)); 
+
+/*
+ * rb_trace_stop
+ * 
+ * stops recording the tree's calls and flushes the trace. has no effect if 
+ * the tree is not being traced
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree being traced
+ * @return      bool - false if writing the trace failed
+ */
+bool rb_trace_stop(RedBlack_T tree); 
+
+/*
+ * rb_trace_encode_string
+ * 
+ * an encoder for rb_trace_start which copies a nul terminated string, 
+ * without the nul. it follows the encoder contract of rb_tree_save, and is
+ * the same as rb_save_encode_string: nothing is copied if the string is 
+ * longer than capacity
+ * 
+ * CREs         value == NULL, or buf == NULL
+ * UREs         value is not a string
+ * 
+ * @param       void * - string to encode
+ * @param       unsigned char * - buffer to write to
+ * @param       size_t - size of the buffer
+ * @return      size_t - length of the string
+ */
+size_t rb_trace_encode_string(void *value, unsigned char *buf, size_t capacity); 
+
+/*
+ * rb_pop_min
+ * 
+ * given a tree, removes the minimum value and returns it, or returns NULL 
+ * if the tree is empty. the cached minimum node is deleted directly, so no 
+ * values are compared, and among equal values the first inserted is 
+ * removed first. in a multiset tree one copy is removed. intrusive trees 
+ * hand the record back to the caller
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to remove from
+ * @return      void * - the value that was removed
+ */
+void *rb_pop_min(RedBlack_T tree); 
+
+/*
+ * rb_pop_max
+ * 
+ * as rb_pop_min, but removes the maximum value. among equal values the 
+ * last inserted is removed first
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to remove from
+ * @return      void * - the value that was removed
+ */
+void *rb_pop_max(RedBlack_T tree); 
+
+/*
+ * rb_select
+ * 
+ * given an order statistics tree and an index k, returns the value which 
+ * is k-th in sorted order (counting from zero), or NULL if k is not less 
+ * than the size of the tree. takes O(log n) time
+ * 
+ * CREs         tree == NULL
+ *              tree was not created with RB_ORDER_STATISTICS
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to be searched
+ * @param       size_t - zero based position in sorted order
+ * @return      void * - value at that position
+ */
+void *rb_select(RedBlack_T tree, size_t k); 
+
+/*
+ * rb_rank
+ * 
+ * given an order statistics tree and a value, returns the number of values 
+ * in the tree which are less than it; for a value in the tree, this is the 
+ * index rb_select returns it for. takes O(log n) time
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ *              tree was not created with RB_ORDER_STATISTICS
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to be searched
+ * @param       void * - value to rank
+ * @return      size_t - number of smaller values
+ */
+size_t rb_rank(RedBlack_T tree, void *value); 
+
+/*
+ * rb_count_range
+ * 
+ * given an order statistics tree and bounds as for rb_map_range, returns 
+ * the number of values inside the bounds in O(log n) time, without 
+ * visiting them
+ * 
+ * CREs         tree == NULL
+ *              tree was not created with RB_ORDER_STATISTICS
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to be searched
+ * @param       void * - lower bound, or NULL
+ * @param       bool - true if values equal to lo are counted
+ * @param       void * - upper bound, or NULL
+ * @param       bool - true if values equal to hi are counted
+ * @return      size_t - number of values in the range
+ */
+size_t rb_count_range(RedBlack_T tree, 
+                      void *lo, bool lo_inclusive, 
+                      void *hi, bool hi_inclusive); 
+
+/*
+ * rb_map_put
+ * 
+ * given a map tree, maps key to value. if an equal key is already present 
+ * its mapped value is replaced (the stored key pointer is kept); otherwise 
+ * a new node is added. takes a single descent of the tree
+ * 
+ * CREs         tree == NULL
+ *              key == NULL
+ *              tree was not created with RB_MAP
+ * UREs         system out of memory
+ * 
+ * @param       RedBlack_T - map tree
+ * @param       void * - key
+ * @param       void * - value to map key to
+ * @return      void * - the value key was mapped to before, or NULL
+ */
+void *rb_map_put(RedBlack_T tree, void *key, void *value); 
+
+/*
+ * rb_map_get
+ * 
+ * given a map tree, returns the value mapped to key, or NULL if key is 
+ * not present
+ * 
+ * CREs         tree == NULL
+ *              key == NULL
+ *              tree was not created with RB_MAP
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - map tree
+ * @param       void * - key to look up
+ * @return      void * - mapped value
+ */
+void *rb_map_get(RedBlack_T tree, void *key); 
+
+/*
+ * rb_map_get_or_insert
+ * 
+ * given a map tree, returns the slot holding the value mapped to key. if 
+ * key is not present it is first added, mapped to value; if it is, 
+ * nothing is allocated and value is ignored. the slot may be written 
+ * through, and stays valid until key is deleted
+ * 
+ * CREs         tree == NULL
+ *              key == NULL
+ *              tree was not created with RB_MAP
+ * UREs         system out of memory
+ * 
+ * @param       RedBlack_T - map tree
+ * @param       void * - key
+ * @param       void * - value to map key to if it is not present
+ * @param       bool * - if not NULL, set to true if key was added
+ * @return      void ** - slot holding the mapped value
+ */
+void **rb_map_get_or_insert(RedBlack_T tree, void *key, void *value, 
+                            bool *inserted); 
+
+/*
+ * rb_map_update
+ * 
+ * given a map tree, replaces the value mapped to key with the result of 
+ * func_to_apply(stored key, current value, cl). if key is not present it 
+ * is added first, and func_to_apply sees a current value of NULL. takes 
+ * a single descent of the tree
+ * 
+ * CREs         tree == NULL
+ *              key == NULL or func_to_apply == NULL
+ *              tree was not created with RB_MAP
+ * UREs         system out of memory
+ *              func_to_apply modifies the tree
+ * 
+ * @param       RedBlack_T - map tree
+ * @param       void * - key
+ * @param       void *func_to_apply(key, value, cl) - returns the new value
+ * @param       void * - a closure item for func_to_apply
+ * @return      void * - the new mapped value
+ */
+void *rb_map_update(RedBlack_T tree, void *key, 
+                    void *func_to_apply(void *key, void *value, void *cl), 
+                    void *cl); 
+
+/*
+ * rb_interval_insert
+ * 
+ * given an interval tree, inserts the closed interval [lo, hi] together 
+ * with value, and returns the node holding them (which may be passed to 
+ * rb_delete_node). intervals may overlap and may repeat
+ * 
+ * CREs         tree == NULL
+ *              lo == NULL, hi == NULL or value == NULL
+ *              tree was not created with RB_INTERVAL
+ * UREs         system out of memory
+ *              hi is less than lo
+ * 
+ * @param       RedBlack_T - interval tree
+ * @param       void * - low endpoint
+ * @param       void * - high endpoint
+ * @param       void * - value stored with the interval
+ * @return      struct rb_node * - node holding the interval
+ */
+struct rb_node *rb_interval_insert(RedBlack_T tree, void *lo, void *hi, 
+                                   void *value); 
+
+/*
+ * rb_interval_delete
+ * 
+ * given an interval tree, deletes one interval whose endpoints compare 
+ * equal to lo and hi and whose value is the same pointer as value
+ * 
+ * CREs         tree == NULL
+ *              lo == NULL, hi == NULL or value == NULL
+ *              tree was not created with RB_INTERVAL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - interval tree
+ * @param       void * - low endpoint
+ * @param       void * - high endpoint
+ * @param       void * - value stored with the interval
+ * @return      bool - true if an interval was deleted
+ */
+bool rb_interval_delete(RedBlack_T tree, void *lo, void *hi, void *value); 
+
+/*
+ * rb_interval_any_overlap
+ * 
+ * given an interval tree and a closed query interval [lo, hi], returns the 
+ * value of some stored interval which overlaps it, or NULL if none does. 
+ * follows a single path down the tree, so takes O(log n) time
+ * 
+ * CREs         tree == NULL
+ *              lo == NULL or hi == NULL
+ *              tree was not created with RB_INTERVAL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - interval tree
+ * @param       void * - low end of the query
+ * @param       void * - high end of the query
+ * @return      void * - value of an overlapping interval
+ */
+void *rb_interval_any_overlap(RedBlack_T tree, void *lo, void *hi); 
+
+/*
+ * rb_interval_overlaps
+ * 
+ * given an interval tree and a closed query interval [lo, hi], applies the 
+ * function to every stored interval which overlaps it, in order of low 
+ * endpoint. subtrees which cannot hold an overlap are skipped using the 
+ * highest endpoint kept in each node, so the cost grows with the number of
+ * reported intervals rather than the size of the tree. the function may 
+ * stop the search by returning non-zero
+ * 
+ * CREs         tree == NULL
+ *              lo == NULL, hi == NULL or func_to_apply == NULL
+ *              tree was not created with RB_INTERVAL
+ * UREs         func_to_apply modifies the tree
+ * 
+ * @param       RedBlack_T - interval tree
+ * @param       void * - low end of the query
+ * @param       void * - high end of the query
+ * @param       int func_to_apply(lo, hi, value, cl) - called for each 
+ *                      overlapping interval; returns non-zero to stop
+ * @param       void * - a closure item for func_to_apply
+ * @return      size_t - number of intervals passed to func_to_apply
+ */
+size_t rb_interval_overlaps(RedBlack_T tree, void *lo, void *hi, 
+                            int func_to_apply(void *lo, void *hi, 
+                                              void *value, void *cl), 
+                            void *cl); 
+
 /*
  * rb_successor_of_value
  * 
@@ -271,4 +1027,478 @@ void rb_map_postorder(RedBlack_T tree,
                       void func_to_apply(void *value, int depth, void *cl), 
                       void *cl); 
 
+/*
+ * rb_map_range
+ * 
+ * given a tree, bounds lo and hi and a pointer to a function, applies the 
+ * function, in sorted order, to every value v with lo <= v <= hi (or 
+ * lo < v, v < hi when the matching inclusive flag is false). a NULL bound 
+ * leaves that side of the range open. the bounds are compared with the 
+ * tree's comparison function, and the walk costs O(log n + k) for k values 
+ * in the range. the function may stop the walk early by returning non-zero
+ * 
+ * CREs         tree == NULL
+ *              func_to_apply == NULL
+ * UREs         func_to_apply modifies the tree
+ * 
+ * @param       RedBlack_T - tree to walk
+ * @param       void * - lower bound, or NULL
+ * @param       bool - true if values equal to lo are included
+ * @param       void * - upper bound, or NULL
+ * @param       bool - true if values equal to hi are included
+ * @param       int func_to_apply(value, cl) - returns zero to continue the
+ *                      walk, and non-zero to stop it
+ * @param       void * - a closure item for func_to_apply
+ * @return      size_t - number of values passed to func_to_apply
+ */
+size_t rb_map_range(RedBlack_T tree, 
+                    void *lo, bool lo_inclusive, 
+                    void *hi, bool hi_inclusive, 
+                    int func_to_apply(void *value, void *cl), 
+                    void *cl); 
+
+/*
+ * rb_iter_first
+ * 
+ * returns a cursor positioned at the minimum value of the tree (or past the 
+ * end, if the tree is empty)
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to walk
+ * @return      struct rb_iter - the cursor
+ */
+struct rb_iter rb_iter_first(RedBlack_T tree); 
+
+/*
+ * rb_iter_last
+ * 
+ * returns a cursor positioned at the maximum value of the tree (or past the 
+ * end, if the tree is empty)
+ * 
+ * CREs         tree == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to walk
+ * @return      struct rb_iter - the cursor
+ */
+struct rb_iter rb_iter_last(RedBlack_T tree); 
+
+/*
+ * rb_iter_seek
+ * 
+ * returns a cursor positioned at the first value in the tree that is not 
+ * less than value (the first of several equal values, if there are 
+ * duplicates), or past the end if there is none
+ * 
+ * CREs         tree == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_T - tree to walk
+ * @param       void * - value to seek to
+ * @return      struct rb_iter - the cursor
+ */
+struct rb_iter rb_iter_seek(RedBlack_T tree, void *value); 
+
+/*
+ * rb_iter_value
+ * 
+ * returns the value the cursor is positioned at, or NULL if it is past 
+ * either end of the tree
+ * 
+ * CREs         it == NULL
+ * UREs         the node the cursor points at has been deleted
+ * 
+ * @param       struct rb_iter * - the cursor
+ * @return      void * - current value
+ */
+void *rb_iter_value(struct rb_iter *it); 
+
+/*
+ * rb_iter_next
+ * 
+ * advances the cursor to the next value in sorted order and returns it, or 
+ * returns NULL if the cursor moved past the end
+ * 
+ * CREs         it == NULL
+ * UREs         the node the cursor points at has been deleted
+ * 
+ * @param       struct rb_iter * - the cursor
+ * @return      void * - new current value
+ */
+void *rb_iter_next(struct rb_iter *it); 
+
+/*
+ * rb_iter_prev
+ * 
+ * moves the cursor to the previous value in sorted order and returns it, 
+ * or returns NULL if the cursor moved past the beginning
+ * 
+ * CREs         it == NULL
+ * UREs         the node the cursor points at has been deleted
+ * 
+ * @param       struct rb_iter * - the cursor
+ * @return      void * - new current value
+ */
+void *rb_iter_prev(struct rb_iter *it); 
+
+/*
+ * rb_split
+ * 
+ * splits the tree in two at key: *left gets every value less than key and 
+ * *right every other value. the nodes are relinked, not copied, by joining
+ * the subtrees hanging off the search path for key, which takes O(log n) 
+ * time. tree is consumed, and must not be used afterwards. the two halves 
+ * share the chunks tree's nodes were allocated in, which are freed once 
+ * both are: freeing one half leaves its nodes for the other to reuse. the 
+ * halves may be used, and freed, on different threads. unless the tree 
+ * keeps order statistics, the first rb_tree_size on a nonempty half counts
+ * its values
+ * 
+ * CREs         tree == NULL
+ *              key == NULL
+ *              left == NULL or right == NULL
+ * UREs         system out of memory
+ * 
+ * @param       RedBlack_T - tree to split
+ * @param       void * - the key to split at; need not be in the tree
+ * @param       RedBlack_T * - set to the tree of values less than key
+ * @param       RedBlack_T * - set to the tree of values not less than key
+ * @return      n/a
+ */
+void rb_split(RedBlack_T tree, void *key, RedBlack_T *left, RedBlack_T *right); 
+
+/*
+ * rb_join
+ * 
+ * joins two trees created alike, every value in left ordered before pivot 
+ * and every value in right after it, into one tree holding all of them and
+ * pivot. the nodes of right are relinked into left under pivot, at the 
+ * height where their black heights match, which takes O(log n) time. for 
+ * an intrusive tree pivot is a record, as for rb_insert_node. right is 
+ * consumed, and must not be used afterwards
+ * 
+ * CREs         left == NULL or right == NULL
+ *              pivot == NULL
+ *              left was created with RB_INTERVAL or RB_MAP
+ *              left and right differ in comparison function, mode or 
+ *                      intrusiveness
+ * UREs         a value in left is greater than pivot, or pivot greater than
+ *                      a value in right (in a multiset, equal to one)
+ *              system out of memory
+ * 
+ * @param       RedBlack_T - the tree of lower values
+ * @param       void * - the value to go between them
+ * @param       RedBlack_T - the tree of higher values
+ * @return      RedBlack_T - the joined tree, which is left
+ */
+RedBlack_T rb_join(RedBlack_T left, void *pivot, RedBlack_T right); 
+
+/*
+ * rb_join2
+ * 
+ * as rb_join, without a pivot: the maximum of left is unlinked and used as
+ * the pivot. works on trees of every mode
+ * 
+ * CREs         left == NULL or right == NULL
+ *              left and right differ in comparison function, mode or 
+ *                      intrusiveness
+ * UREs         a value in left is greater than a value in right (in a 
+ *                      multiset, equal to one)
+ *              system out of memory
+ * 
+ * @param       RedBlack_T - the tree of lower values
+ * @param       RedBlack_T - the tree of higher values
+ * @return      RedBlack_T - the joined tree, which is left
+ */
+RedBlack_T rb_join2(RedBlack_T left, RedBlack_T right); 
+
+/*
+ * rb_union / rb_intersection / rb_difference
+ * 
+ * combine two trees created alike into the set of values in either, in 
+ * both, or in a but not b. where both hold equal values, the result keeps 
+ * a's (and, in a map tree, a's mapped value). the operations divide and 
+ * conquer with splits and joins: b's root is taken out, a is split at it, 
+ * the two lower halves and the two upper halves are combined recursively, 
+ * and the results are joined back together. for trees of m and n values, 
+ * m <= n, that costs O(m log(n / m + 1)) work, plus a step for each value
+ * left out of the result, so merging a few values into a large tree costs 
+ * little more than inserting them. when rb_tree.c is compiled with 
+ * RB_PARALLEL (and -pthread), the recursive halves of a large operation 
+ * run on separate threads, about two per processor.
+ * 
+ * both trees are consumed: nodes are relinked into a, which holds the 
+ * result, and b must not be used afterwards. nodes left out of the result 
+ * are kept for the result's later inserts; once they outnumber its values,
+ * the values are moved into fresh memory and the rest is freed, so 
+ * repeatedly merging into the same tree stays bounded in memory. the 
+ * records of an intrusive tree are simply no longer linked
+ * 
+ * CREs         a == NULL or b == NULL
+ *              a and b differ in comparison function, mode or intrusiveness
+ *              a was created with RB_INTERVAL or RB_MULTISET
+ * UREs         either tree holds equal values more than once
+ *              system out of memory
+ * 
+ * @param       RedBlack_T - the first tree
+ * @param       RedBlack_T - the second tree
+ * @return      RedBlack_T - the result, which is a
+ */
+RedBlack_T rb_union(RedBlack_T a, RedBlack_T b); 
+RedBlack_T rb_intersection(RedBlack_T a, RedBlack_T b); 
+RedBlack_T rb_difference(RedBlack_T a, RedBlack_T b); 
+
+/*
+ * rb_tree_save
+ * 
+ * writes the tree's values to fd in sorted order, in the format described
+ * above, through a buffer and without allocating per value. fd is left 
+ * open, and is not synced
+ * 
+ * CREs         tree == NULL
+ *              encode == NULL
+ *              tree is intrusive, or was created with RB_INTERVAL or 
+ *                      RB_MAP
+ * UREs         the tree is modified while it is saved
+ * 
+ * @param       RedBlack_T - tree to save
+ * @param       int - file descriptor open for writing
+ * @param       size_t encode(value, buf, capacity) - writes the encoding 
+ *                      of value to buf, if it fits in capacity bytes, and 
+ *                      returns its length either way; when that is more 
+ *                      than capacity it is called again with a larger buf
+ * @return      bool - false if a write failed
+ */
+bool rb_tree_save(RedBlack_T tree, int fd, 
+                  size_t encode(void *value, unsigned char *buf, size_t capacity)); 
+
+/*
+ * rb_tree_load
+ * 
+ * reads a tree saved by rb_tree_save (or RedBlack_Save_T) from fd and 
+ * returns it, with the mode it was saved with. the values are stored in 
+ * the order they were saved in and the tree is built perfectly balanced, 
+ * as by rb_build_from_sorted, in O(n) time without comparing any values. 
+ * returns NULL if the file is not a saved tree, is of another version, is
+ * cut short or fails its checksum; every value decoded by then is passed 
+ * to discard, if it is not NULL
+ * 
+ * CREs         decode == NULL
+ * UREs         the values were saved under another ordering than 
+ *                      comparison_func
+ *              system out of memory
+ * 
+ * @param       int - file descriptor open for reading, positioned at the 
+ *                      start of the saved tree
+ * @param       void * - pointer to a comparison function, as for rb_new
+ * @param       void *decode(buf, length) - returns a new value from its 
+ *                      encoding, or NULL to fail the load
+ * @param       void discard(value) - frees a decoded value; may be NULL
+ * @return      RedBlack_T - the loaded tree, or NULL
+ */
+RedBlack_T rb_tree_load(int fd, void *comparison_func, 
+                        void *decode(const unsigned char *buf, size_t length), 
+                        void discard(void *value)); 
+
+/*
+ * rb_save_begin
+ * 
+ * starts writing a saved tree of count values to fd, for sources other 
+ * than a RedBlack_T: the values are then passed to rb_save_value in sorted
+ * order, and rb_save_end finishes the file. the result loads with 
+ * rb_tree_load like any other
+ * 
+ * CREs         encode == NULL
+ * UREs         values are not passed in sorted order
+ *              system out of memory
+ * 
+ * @param       int - file descriptor open for writing
+ * @param       size_t - number of values that will be written
+ * @param       size_t encode(value, buf, capacity) - as for rb_tree_save
+ * @return      RedBlack_Save_T - the writer
+ */
+RedBlack_Save_T rb_save_begin(int fd, size_t count, 
+                              size_t encode(void *value, unsigned char *buf, 
+                                            size_t capacity)); 
+
+/*
+ * rb_save_value
+ * 
+ * writes the next value
+ * 
+ * CREs         save == NULL
+ *              value == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_Save_T - the writer
+ * @param       void * - the value
+ * @return      bool - false if a write has failed, or more values were 
+ *                      written than rb_save_begin was told of
+ */
+bool rb_save_value(RedBlack_Save_T save, void *value); 
+
+/*
+ * rb_save_end
+ * 
+ * writes the checksum, flushes the buffer and frees the writer
+ * 
+ * CREs         save == NULL
+ * UREs         n/a
+ * 
+ * @param       RedBlack_Save_T - the writer
+ * @return      bool - true if every write succeeded and as many values were
+ *                      written as rb_save_begin was told of
+ */
+bool rb_save_end(RedBlack_Save_T save); 
+
+/*
+ * rb_save_encode_string / rb_load_decode_string
+ * 
+ * an encoder for nul terminated strings, which copies the characters 
+ * without the nul, and the matching decoder, which returns a copy made 
+ * with malloc (and so can be discarded with free). as rb_tree_save 
+ * requires, the encoder returns the string's length and copies nothing if
+ * that is more than capacity; rb_trace_encode_string is the same function
+ * under rb_trace_start's name
+ * 
+ * CREs         value == NULL, or buf == NULL
+ * UREs         system out of memory
+ */
+size_t rb_save_encode_string(void *value, unsigned char *buf, size_t capacity); 
+void *rb_load_decode_string(const unsigned char *buf, size_t length); 
+
+/*
+ * node level functions
+ * 
+ * the balancing and node allocation every RedBlack_T uses, working on bare
+ * rb_nodes whose tree is known only by the address of its root pointer. 
+ * they never compare values, so code which keeps its own nodes, such as 
+ * the trees generated by rb_define.h, can share them. a tree which keeps 
+ * data about each subtree passes a function rotated, which is called 
+ * after every rotation with the node that moved down and the closure cl, 
+ * and must recompute that node's data and then its new parent's; rotated 
+ * may be NULL
+ */
+
+/*
+ * rb_node_rotate_left / rb_node_rotate_right
+ * 
+ * moves n's right (left) child up into n's place, and makes n that child's
+ * left (right) child
+ * 
+ * CREs         n/a
+ * UREs         n has no right (left) child
+ * 
+ * @param       struct rb_node ** - the root pointer
+ * @param       struct rb_node * - the node to rotate
+ * @return      n/a
+ */
+void rb_node_rotate_left(struct rb_node **root, struct rb_node *n); 
+void rb_node_rotate_right(struct rb_node **root, struct rb_node *n); 
+
+/*
+ * rb_node_replace
+ * 
+ * hangs v, which may be NULL, where u hangs from its parent (or at the 
+ * root), leaving u's own links alone
+ * 
+ * CREs         n/a
+ * UREs         n/a
+ * 
+ * @param       struct rb_node ** - the root pointer
+ * @param       struct rb_node * - node to be replaced
+ * @param       struct rb_node * - node to replace it with
+ * @return      n/a
+ */
+void rb_node_replace(struct rb_node **root, struct rb_node *u, struct rb_node *v); 
+
+/*
+ * rb_node_insert_fixup
+ * 
+ * restores the red black properties after n was linked in red, as a leaf 
+ * or as the root of a subtree joined in at the right black height
+ * 
+ * CREs         n/a
+ * UREs         n is not linked into the tree at *root
+ * 
+ * @param       struct rb_node ** - the root pointer
+ * @param       struct rb_node * - the red node just linked in
+ * @param       bool * - if not NULL, set to true if the root ended up red 
+ *                      and was painted black, which adds one to the black 
+ *                      height of the tree
+ * @param       void rotated(down, cl) - as described above; may be NULL
+ * @param       void * - closure passed to rotated
+ * @return      size_t - iterations of the fixup loop
+ */
+size_t rb_node_insert_fixup(struct rb_node **root, struct rb_node *n, bool *grew, 
+                            void rotated(struct rb_node *down, void *cl), void *cl); 
+
+/*
+ * rb_node_unlink
+ * 
+ * takes n out of the tree, moving its successor into its place if it has 
+ * two children. the node which moved into the removed position, which may 
+ * be NULL, and its parent are stored to x and x_parent; when this returns 
+ * true a black node was removed from above x, and rb_node_erase_fixup 
+ * must be called with them. a tree keeping data about each subtree must 
+ * recompute it from x_parent up first
+ * 
+ * CREs         n/a
+ * UREs         n is not linked into the tree at *root
+ * 
+ * @param       struct rb_node ** - the root pointer
+ * @param       struct rb_node * - node to remove
+ * @param       struct rb_node ** - set to the node in the removed position
+ * @param       struct rb_node ** - set to that position's parent
+ * @return      bool - true if the tree must be fixed up
+ */
+bool rb_node_unlink(struct rb_node **root, struct rb_node *n, 
+                    struct rb_node **x, struct rb_node **x_parent); 
+
+/*
+ * rb_node_erase_fixup
+ * 
+ * restores the red black properties after rb_node_unlink
+ * 
+ * CREs         n/a
+ * UREs         x and x_parent are not as rb_node_unlink left them
+ * 
+ * @param       struct rb_node ** - the root pointer
+ * @param       struct rb_node * - x, from rb_node_unlink (may be NULL)
+ * @param       struct rb_node * - x_parent, from rb_node_unlink
+ * @param       void rotated(down, cl) - as described above; may be NULL
+ * @param       void * - closure passed to rotated
+ * @return      size_t - iterations of the fixup loop
+ */
+size_t rb_node_erase_fixup(struct rb_node **root, struct rb_node *x, 
+                           struct rb_node *x_parent, 
+                           void rotated(struct rb_node *down, void *cl), void *cl); 
+
+/*
+ * rb_node_alloc / rb_node_free_chunks
+ * 
+ * rb_node_alloc returns a node of node_size bytes, its rb_node first: the
+ * head of the free list (nodes linked through ->right) if there is one, 
+ * and otherwise the next unused node of the newest chunk. a full chunk is
+ * followed by one of twice as many nodes, from 32 up to 4096. nothing is 
+ * initialized. rb_node_free_chunks frees a whole list of chunks
+ * 
+ * CREs         n/a
+ * UREs         node_size differs between calls for the same chunks
+ *              system out of memory
+ * 
+ * @param       struct rb_node ** - the free list
+ * @param       struct rb_chunk ** - the list of chunks, newest first; 
+ *                      initially NULL
+ * @param       size_t * - nodes handed out from the newest chunk
+ * @param       size_t - bytes per node
+ * @return      struct rb_node * - the node
+ */
+struct rb_node *rb_node_alloc(struct rb_node **free_nodes, struct rb_chunk **chunks, 
+                              size_t *chunk_used, size_t node_size); 
+void rb_node_free_chunks(struct rb_chunk *chunks); 
+
 #endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "rb_typed.h"
+#include <string.h>
+
+/************************
+ * FUNCTION DEFINITIONS *
+ ************************/ 
+
+RB_DEFINE(rb_int64, int64_t, (a > b) - (a < b))
+RB_DEFINE(rb_uint64, uint64_t, (a > b) - (a < b))
+RB_DEFINE(rb_double, double, (a > b) - (a < b))
+RB_DEFINE(rb_string, const char *, strcmp(a, b))
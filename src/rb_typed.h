@@ -0,0 +1,38 @@
+/**********************************************************************
+ * rb_typed.h                                                         *
+ *                                                                    *
+ * Interface for red black trees specialized to common key types      *
+ **********************************************************************/
+
+/***************************
+ * PREPROCESSOR DIRECTIVES *
+ ***************************/
+
+#ifndef RB_TYPED_H
+#define RB_TYPED_H
+
+/*** INCLUDED FILES ***/
+
+#include <stdint.h>
+
+#include "rb_define.h"
+
+/*** DEFINITIONS AND TYPEDEFS ***/
+
+/*
+ * each line below declares a tree type and the functions listed in 
+ * rb_define.h, e.g. rb_int64_T, rb_int64_new and rb_int64_insert. keys are 
+ * stored in the nodes and compared without a function pointer
+ * 
+ * rb_int64     int64_t keys
+ * rb_uint64    uint64_t keys
+ * rb_double    double keys, which must not be NaN
+ * rb_string    nul terminated strings ordered by strcmp. only the pointer 
+ *              is stored, so the string must outlive its key
+ */
+RB_DECLARE(rb_int64, int64_t)
+RB_DECLARE(rb_uint64, uint64_t)
+RB_DECLARE(rb_double, double)
+RB_DECLARE(rb_string, const char *)
+
+#endif
@@ -0,0 +1,162 @@
+#include "vendor/unity.h"
+#include "../src/rb_compact.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int integer_comparison(void *val_one, void *val_two)
+{
+        if (*(int *) val_one == *(int *) val_two) {
+                return 0; 
+        } else if (*(int *) val_one > *(int *) val_two) {
+                return 1; 
+        } else {
+                return -1; 
+        }
+}
+
+struct int_walk_closure {
+        int count; 
+        int max_depth; 
+        int previous; 
+        bool sorted; 
+};
+
+void function_to_apply_int_walk(void *value, int depth, void *cl)
+{
+        struct int_walk_closure *closure = (struct int_walk_closure *) cl; 
+        int current = *(int *) value; 
+
+        if (closure->count > 0 && current < closure->previous)
+                closure->sorted = false; 
+        if (depth > closure->max_depth)
+                closure->max_depth = depth; 
+
+        closure->previous = current; 
+        closure->count++; 
+}
+
+void assert_int_tree_shape(RedBlack_Compact_T tree, int expected_count)
+{
+        struct int_walk_closure cl = { 0, 0, 0, true }; 
+        int bound = 0; 
+
+        while ((1 << bound) <= expected_count)
+                bound++; 
+
+        rb_compact_map_inorder(tree, &function_to_apply_int_walk, &cl); 
+
+        TEST_ASSERT_EQUAL(expected_count, cl.count); 
+        TEST_ASSERT_EQUAL(expected_count, (int) rb_compact_size(tree)); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+
+        if (expected_count > 0) {
+                TEST_ASSERT_TRUE(cl.max_depth + 1 <= 2 * bound); 
+        }
+}
+
+void test_rb_compact_strings(void)
+{
+        RedBlack_Compact_T test_tree = rb_compact_new(NULL); 
+        TEST_ASSERT_TRUE(rb_compact_is_empty(test_tree)); 
+        TEST_ASSERT_NULL(rb_compact_minimum(test_tree)); 
+
+        char *word_ray[] = {"hello", "world", "the", "earth", "says", "hello"}; 
+
+        for (int i = 0; i < 6; i++) 
+                rb_compact_insert(test_tree, word_ray[i]); 
+
+        TEST_ASSERT_FALSE(rb_compact_is_empty(test_tree)); 
+        TEST_ASSERT_EQUAL_STRING("earth", rb_compact_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL_STRING("world", rb_compact_maximum(test_tree)); 
+        TEST_ASSERT_EQUAL_STRING("says", rb_compact_search(test_tree, "says")); 
+        TEST_ASSERT_NULL(rb_compact_search(test_tree, "not_in_tree")); 
+
+        TEST_ASSERT_TRUE(rb_compact_delete(test_tree, "hello")); 
+        TEST_ASSERT_EQUAL_STRING("hello", rb_compact_search(test_tree, "hello")); 
+        TEST_ASSERT_TRUE(rb_compact_delete(test_tree, "hello")); 
+        TEST_ASSERT_NULL(rb_compact_search(test_tree, "hello")); 
+        TEST_ASSERT_FALSE(rb_compact_delete(test_tree, "hello")); 
+        TEST_ASSERT_EQUAL(4, (int) rb_compact_size(test_tree)); 
+
+        rb_compact_free(test_tree); 
+}
+
+void test_rb_compact_churn(void)
+{
+        RedBlack_Compact_T test_tree = rb_compact_new(&integer_comparison); 
+
+        int a[3000]; 
+        unsigned state = 777; 
+
+        rb_compact_reserve(test_tree, 3000); 
+
+        for (int i = 0; i < 3000; i++) {
+                state = state * 1103515245 + 12345; 
+                a[i] = (int) ((state >> 16) % 100000); 
+                rb_compact_insert(test_tree, &a[i]); 
+        }
+
+        assert_int_tree_shape(test_tree, 3000); 
+
+        for (int round = 0; round < 4; round++) {
+                for (int i = round % 2; i < 3000; i += 2) 
+                        TEST_ASSERT_TRUE(rb_compact_delete(test_tree, &a[i])); 
+
+                assert_int_tree_shape(test_tree, 1500); 
+
+                for (int i = round % 2; i < 3000; i += 2) 
+                        rb_compact_insert(test_tree, &a[i]); 
+
+                assert_int_tree_shape(test_tree, 3000); 
+        }
+
+        for (int i = 0; i < 3000; i++) 
+                TEST_ASSERT_TRUE(rb_compact_delete(test_tree, &a[i])); 
+
+        TEST_ASSERT_TRUE(rb_compact_is_empty(test_tree)); 
+
+        rb_compact_free(test_tree); 
+}
+
+void test_rb_compact_sorted_insert_and_delete(void)
+{
+        RedBlack_Compact_T test_tree = rb_compact_new(&integer_comparison); 
+
+        int a[1000]; 
+
+        for (int i = 0; i < 1000; i++) {
+                a[i] = i; 
+                rb_compact_insert(test_tree, &a[i]); 
+        }
+
+        assert_int_tree_shape(test_tree, 1000); 
+        TEST_ASSERT_EQUAL(0, *(int *) rb_compact_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL(999, *(int *) rb_compact_maximum(test_tree)); 
+
+        for (int i = 999; i >= 0; i--) {
+                TEST_ASSERT_TRUE(rb_compact_delete(test_tree, &a[i])); 
+
+                if (i % 100 == 0)
+                        assert_int_tree_shape(test_tree, i); 
+        }
+
+        rb_compact_free(test_tree); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_compact.c");
+
+        RUN_TEST(test_rb_compact_strings); 
+        RUN_TEST(test_rb_compact_churn); 
+        RUN_TEST(test_rb_compact_sorted_insert_and_delete); 
+
+        UnityEnd();
+        return 0;
+}
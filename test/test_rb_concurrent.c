@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "vendor/unity.h"
+#include "../src/rb_concurrent.h"
+
+#include <pthread.h>
+
+#define KEY_COUNT 1000
+#define READER_COUNT 4
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int int_comparison(void *val_one, void *val_two)
+{
+        return *(int *) val_one - *(int *) val_two; 
+}
+
+int keys[KEY_COUNT]; 
+
+struct sorted_closure {
+        int count; 
+        int previous; 
+        bool sorted; 
+};
+
+void function_to_apply_check_sorted(void *value, int depth, void *cl)
+{
+        struct sorted_closure *closure = (struct sorted_closure *) cl; 
+        int key = *(int *) value; 
+
+        (void) depth; 
+
+        if (closure->count > 0 && key <= closure->previous)
+                closure->sorted = false; 
+
+        closure->previous = key; 
+        closure->count++; 
+}
+
+struct reader_result {
+        RedBlack_Concurrent_T tree; 
+        int missing;            /* stable keys a lookup failed to find */
+        int unsorted;           /* walks which saw values out of order */
+};
+
+/* 
+ * keys equal to 2 mod 4 are present throughout, while the writer inserts the
+ * odd keys and deletes the multiples of 4
+ */
+void *reader(void *arg)
+{
+        struct reader_result *result = (struct reader_result *) arg; 
+
+        for (int round = 0; round < 20; round++) {
+                for (int i = 2; i < KEY_COUNT; i += 4) {
+                        if (rb_concurrent_search(result->tree, &keys[i]) != &keys[i])
+                                result->missing++; 
+                }
+
+                struct sorted_closure cl = { 0, 0, true }; 
+                rb_concurrent_map_inorder(result->tree, &function_to_apply_check_sorted, &cl); 
+                if (!cl.sorted)
+                        result->unsorted++; 
+        }
+
+        return NULL; 
+}
+
+void *writer(void *arg)
+{
+        RedBlack_Concurrent_T tree = (RedBlack_Concurrent_T) arg; 
+
+        for (int i = 0; i < KEY_COUNT; i += 2) {
+                rb_concurrent_insert(tree, &keys[i + 1]); 
+                if (i % 4 == 0)
+                        rb_concurrent_delete(tree, &keys[i]); 
+        }
+
+        return NULL; 
+}
+
+void test_rb_concurrent_readers_and_writer(void)
+{
+        RedBlack_Concurrent_T test_tree = rb_concurrent_new(&int_comparison, 0); 
+        struct reader_result results[READER_COUNT]; 
+        pthread_t readers[READER_COUNT]; 
+        pthread_t writer_thread; 
+
+        for (int i = 0; i < KEY_COUNT; i++) {
+                keys[i] = i; 
+                if (i % 2 == 0)
+                        rb_concurrent_insert(test_tree, &keys[i]); 
+        }
+
+        for (int i = 0; i < READER_COUNT; i++) {
+                results[i] = (struct reader_result) { test_tree, 0, 0 }; 
+                TEST_ASSERT_EQUAL(0, pthread_create(&readers[i], NULL, &reader, &results[i])); 
+        }
+        TEST_ASSERT_EQUAL(0, pthread_create(&writer_thread, NULL, &writer, test_tree)); 
+
+        pthread_join(writer_thread, NULL); 
+        for (int i = 0; i < READER_COUNT; i++) {
+                pthread_join(readers[i], NULL); 
+                TEST_ASSERT_EQUAL(0, results[i].missing); 
+                TEST_ASSERT_EQUAL(0, results[i].unsorted); 
+        }
+
+        /* odd keys and those equal to 2 mod 4 remain */
+        TEST_ASSERT_EQUAL(KEY_COUNT * 3 / 4, rb_concurrent_size(test_tree)); 
+        for (int i = 0; i < KEY_COUNT; i++) {
+                void *expected = i % 4 == 0 ? NULL : &keys[i]; 
+                TEST_ASSERT_EQUAL_PTR(expected, rb_concurrent_search(test_tree, &keys[i])); 
+        }
+
+        TEST_ASSERT_EQUAL_PTR(&keys[1], rb_concurrent_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL_PTR(&keys[KEY_COUNT - 1], rb_concurrent_maximum(test_tree)); 
+        TEST_ASSERT_EQUAL_PTR(&keys[5], rb_concurrent_successor_of_value(test_tree, &keys[3])); 
+        TEST_ASSERT_EQUAL_PTR(&keys[2], rb_concurrent_predecessor_of_value(test_tree, &keys[3])); 
+
+        rb_concurrent_free(test_tree); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_concurrent.c");
+
+        RUN_TEST(test_rb_concurrent_readers_and_writer); 
+
+        UnityEnd();
+        return 0;
+}
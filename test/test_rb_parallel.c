@@ -0,0 +1,223 @@
+#include "vendor/unity.h"
+#include "../src/rb_parallel.h"
+
+#define KEY_COUNT 10000
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int int_comparison(void *val_one, void *val_two)
+{
+        return *(int *) val_one - *(int *) val_two; 
+}
+
+int keys[KEY_COUNT]; 
+int visits[KEY_COUNT]; 
+
+/* each thread's partial count and sum, folded into the caller's */
+struct aggregate {
+        long count; 
+        long sum; 
+        int threads; 
+};
+
+void *function_to_init_aggregate(void *cl)
+{
+        struct aggregate *thread_cl = calloc(1, sizeof(struct aggregate)); 
+
+        (void) cl; 
+        TEST_ASSERT_NOT_NULL(thread_cl); 
+
+        return thread_cl; 
+}
+
+void function_to_apply_aggregate(void *value, void *thread_cl)
+{
+        struct aggregate *aggregate = (struct aggregate *) thread_cl; 
+        int key = *(int *) value; 
+
+        /* each value belongs to one task, so no two threads write one slot */
+        visits[key]++; 
+        aggregate->count++; 
+        aggregate->sum += key; 
+}
+
+void function_to_reduce_aggregate(void *cl, void *thread_cl)
+{
+        struct aggregate *total = (struct aggregate *) cl; 
+        struct aggregate *aggregate = (struct aggregate *) thread_cl; 
+
+        total->count += aggregate->count; 
+        total->sum += aggregate->sum; 
+        total->threads++; 
+        free(aggregate); 
+}
+
+void function_to_apply_shared_count(void *value, void *cl)
+{
+        (void) value; 
+
+        __atomic_add_fetch((long *) cl, 1, __ATOMIC_RELAXED); 
+}
+
+void test_rb_map_parallel_reduce(void)
+{
+        RedBlack_T test_tree = rb_new(&int_comparison); 
+        size_t thread_counts[] = { 1, 2, 3, 4, 8, 0 }; 
+        long expected_sum = 0; 
+
+        for (int i = 0; i < KEY_COUNT; i++) {
+                keys[i] = i; 
+                rb_insert_value(test_tree, &keys[(i * 7919) % KEY_COUNT]); 
+                expected_sum += i; 
+        }
+
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+                struct aggregate total = { 0, 0, 0 }; 
+
+                for (int i = 0; i < KEY_COUNT; i++) 
+                        visits[i] = 0; 
+
+                rb_map_parallel_reduce(test_tree, thread_counts[t], &function_to_apply_aggregate, 
+                                       &function_to_init_aggregate, 
+                                       &function_to_reduce_aggregate, &total); 
+
+                TEST_ASSERT_EQUAL(KEY_COUNT, total.count); 
+                TEST_ASSERT_EQUAL(expected_sum, total.sum); 
+                if (thread_counts[t] != 0)
+                        TEST_ASSERT_EQUAL(thread_counts[t], total.threads); 
+                for (int i = 0; i < KEY_COUNT; i++) 
+                        TEST_ASSERT_EQUAL(1, visits[i]); 
+        }
+
+        long shared = 0; 
+        rb_map_parallel(test_tree, 4, &function_to_apply_shared_count, &shared); 
+        TEST_ASSERT_EQUAL(KEY_COUNT, shared); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_map_parallel_small_trees(void)
+{
+        RedBlack_T test_tree = rb_new(&int_comparison); 
+        struct aggregate total = { 0, 0, 0 }; 
+
+        /* an empty tree still makes and reduces each thread's closure */
+        rb_map_parallel_reduce(test_tree, 4, &function_to_apply_aggregate, 
+                               &function_to_init_aggregate, 
+                               &function_to_reduce_aggregate, &total); 
+        TEST_ASSERT_EQUAL(0, total.count); 
+        TEST_ASSERT_EQUAL(4, total.threads); 
+
+        /* fewer nodes than tasks, and a multiset visited once per node */
+        rb_tree_free(test_tree); 
+        test_tree = rb_new_mode(&int_comparison, RB_MULTISET); 
+        for (int i = 0; i < 5; i++) {
+                keys[i] = i; 
+                rb_insert_value(test_tree, &keys[i]); 
+                rb_insert_value(test_tree, &keys[i]); 
+        }
+
+        long shared = 0; 
+        rb_map_parallel(test_tree, 8, &function_to_apply_shared_count, &shared); 
+        TEST_ASSERT_EQUAL(5, shared); 
+
+        rb_tree_free(test_tree); 
+}
+
+/* 
+ * trees large enough for the set operations to fork, when rb_tree.c is 
+ * compiled with RB_PARALLEL: a holds the multiples of 2 and b those of 3
+ */
+void build_set_operands(RedBlack_T *a, RedBlack_T *b)
+{
+        *a = rb_new(&int_comparison); 
+        *b = rb_new(&int_comparison); 
+
+        for (int i = 0; i < KEY_COUNT; i++) {
+                keys[i] = i; 
+                if (i % 2 == 0)
+                        rb_insert_value(*a, &keys[i]); 
+                if (i % 3 == 0)
+                        rb_insert_value(*b, &keys[i]); 
+        }
+}
+
+struct membership {
+        bool (*expected)(int key); 
+        int count; 
+        int previous; 
+        bool matched; 
+};
+
+void function_to_apply_membership(void *value, int depth, void *cl)
+{
+        struct membership *walk = (struct membership *) cl; 
+        int key = *(int *) value; 
+
+        (void) depth; 
+
+        if (!walk->expected(key) || (walk->count > 0 && key <= walk->previous))
+                walk->matched = false; 
+
+        walk->previous = key; 
+        walk->count++; 
+}
+
+bool in_union(int key) { return key % 2 == 0 || key % 3 == 0; }
+bool in_intersection(int key) { return key % 6 == 0; }
+bool in_difference(int key) { return key % 2 == 0 && key % 3 != 0; }
+
+void assert_set(RedBlack_T tree, bool expected(int key))
+{
+        struct membership walk = { expected, 0, 0, true }; 
+        int count = 0; 
+
+        for (int i = 0; i < KEY_COUNT; i++) 
+                if (expected(i))
+                        count++; 
+
+        rb_map_inorder(tree, &function_to_apply_membership, &walk); 
+
+        TEST_ASSERT_TRUE(walk.matched); 
+        TEST_ASSERT_EQUAL(count, walk.count); 
+        TEST_ASSERT_EQUAL(count, rb_tree_size(tree)); 
+}
+
+void test_rb_parallel_set_operations(void)
+{
+        RedBlack_T a; 
+        RedBlack_T b; 
+
+        build_set_operands(&a, &b); 
+        a = rb_union(a, b); 
+        assert_set(a, &in_union); 
+        rb_tree_free(a); 
+
+        build_set_operands(&a, &b); 
+        a = rb_intersection(a, b); 
+        assert_set(a, &in_intersection); 
+        rb_tree_free(a); 
+
+        build_set_operands(&a, &b); 
+        a = rb_difference(a, b); 
+        assert_set(a, &in_difference); 
+        rb_tree_free(a); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_parallel.c");
+
+        RUN_TEST(test_rb_map_parallel_reduce); 
+        RUN_TEST(test_rb_map_parallel_small_trees); 
+        RUN_TEST(test_rb_parallel_set_operations); 
+
+        UnityEnd();
+        return 0;
+}
@@ -0,0 +1,405 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "vendor/unity.h"
+#include "../src/rb_rcu.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KEY_COUNT 2000
+#define READER_COUNT 4
+#define WRITER_COUNT 2
+#define WRITER_ROUNDS 20
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int int_comparison(void *val_one, void *val_two)
+{
+        return *(int *) val_one - *(int *) val_two; 
+}
+
+struct walk_closure {
+        int count; 
+        int previous; 
+        int max_depth; 
+        bool sorted; 
+};
+
+void function_to_apply_walk(void *value, int depth, void *cl)
+{
+        struct walk_closure *closure = (struct walk_closure *) cl; 
+        int key = *(int *) value; 
+
+        if (closure->count > 0 && key <= closure->previous)
+                closure->sorted = false; 
+        if (depth > closure->max_depth)
+                closure->max_depth = depth; 
+
+        closure->previous = key; 
+        closure->count++; 
+}
+
+int function_to_apply_count(void *value, void *cl)
+{
+        (void) value; 
+
+        (*(int *) cl)++; 
+        return 0; 
+}
+
+void test_rb_rcu_churn(void)
+{
+        RedBlack_RCU_T test_tree = rb_rcu_new(&int_comparison); 
+        int keys[KEY_COUNT]; 
+        bool present[KEY_COUNT] = { false }; 
+        int expected = 0; 
+        unsigned state = 7; 
+
+        TEST_ASSERT_NULL(rb_rcu_minimum(test_tree)); 
+        TEST_ASSERT_NULL(rb_rcu_delete(test_tree, &state)); 
+
+        for (int i = 0; i < KEY_COUNT; i++) 
+                keys[i] = i; 
+
+        for (int i = 0; i < 20000; i++) {
+                state = state * 1103515245 + 12345; 
+                int k = (state >> 16) % KEY_COUNT; 
+
+                if ((state >> 8) % 3 != 0) {
+                        TEST_ASSERT_EQUAL(!present[k], rb_rcu_insert(test_tree, &keys[k])); 
+                        expected += !present[k]; 
+                        present[k] = true; 
+                } else {
+                        void *expected_removed = present[k] ? &keys[k] : NULL; 
+
+                        TEST_ASSERT_EQUAL_PTR(expected_removed, rb_rcu_delete(test_tree, &keys[k])); 
+                        expected -= present[k]; 
+                        present[k] = false; 
+                }
+        }
+
+        TEST_ASSERT_EQUAL(expected, rb_rcu_size(test_tree)); 
+
+        int lowest = -1, highest = -1; 
+        for (int k = 0; k < KEY_COUNT; k++) {
+                void *found = rb_rcu_search(test_tree, &keys[k]); 
+
+                TEST_ASSERT_EQUAL_PTR(present[k] ? &keys[k] : NULL, found); 
+                if (present[k]) {
+                        if (lowest < 0)
+                                lowest = k; 
+                        highest = k; 
+                }
+        }
+
+        TEST_ASSERT_EQUAL_PTR(&keys[lowest], rb_rcu_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL_PTR(&keys[highest], rb_rcu_maximum(test_tree)); 
+
+        /* a red black tree of n nodes is at most 2 log2(n + 1) deep */
+        struct walk_closure cl = { 0, 0, 0, true }; 
+        rb_rcu_map_inorder(test_tree, &function_to_apply_walk, &cl); 
+        TEST_ASSERT_EQUAL(expected, cl.count); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+        TEST_ASSERT_TRUE(cl.max_depth < 2 * 11); 
+
+        int in_range = 0; 
+        for (int k = 100; k < 200; k++) 
+                in_range += present[k]; 
+        int visited = 0; 
+        TEST_ASSERT_EQUAL(in_range, rb_rcu_map_range(test_tree, &keys[100], true, &keys[200], 
+                                                      false, &function_to_apply_count, &visited)); 
+        TEST_ASSERT_EQUAL(in_range, visited); 
+
+        int next = 501; 
+        while (!present[next]) 
+                next++; 
+        TEST_ASSERT_EQUAL_PTR(&keys[next], rb_rcu_successor_of_value(test_tree, &keys[500])); 
+
+        int previous = 499; 
+        while (!present[previous]) 
+                previous--; 
+        TEST_ASSERT_EQUAL_PTR(&keys[previous], rb_rcu_predecessor_of_value(test_tree, &keys[500])); 
+
+        for (int k = 0; k < KEY_COUNT; k++) 
+                rb_rcu_delete(test_tree, &keys[k]); 
+        TEST_ASSERT_EQUAL(0, rb_rcu_size(test_tree)); 
+        TEST_ASSERT_NULL(rb_rcu_maximum(test_tree)); 
+
+        rb_rcu_free(test_tree); 
+}
+
+void test_rb_rcu_snapshot(void)
+{
+        RedBlack_RCU_T test_tree = rb_rcu_new(&int_comparison); 
+        int keys[100]; 
+
+        for (int i = 0; i < 100; i++) {
+                keys[i] = i; 
+                if (i % 2 == 0)
+                        rb_rcu_insert(test_tree, &keys[i]); 
+        }
+
+        RedBlack_Snapshot_T before = rb_snapshot(test_tree); 
+
+        for (int i = 0; i < 100; i++) {
+                if (i % 2 == 0)
+                        rb_rcu_delete(test_tree, &keys[i]); 
+                else
+                        rb_rcu_insert(test_tree, &keys[i]); 
+        }
+        rb_rcu_delete(test_tree, &keys[1]); 
+
+        RedBlack_Snapshot_T after = rb_snapshot(test_tree); 
+
+        TEST_ASSERT_EQUAL(50, rb_snapshot_size(before)); 
+        TEST_ASSERT_EQUAL(49, rb_snapshot_size(after)); 
+        TEST_ASSERT_EQUAL_PTR(&keys[4], rb_snapshot_search(before, &keys[4])); 
+        TEST_ASSERT_NULL(rb_snapshot_search(before, &keys[5])); 
+        TEST_ASSERT_NULL(rb_snapshot_search(after, &keys[4])); 
+        TEST_ASSERT_EQUAL_PTR(&keys[5], rb_snapshot_search(after, &keys[5])); 
+
+        /* both snapshots outlive the tree */
+        rb_rcu_free(test_tree); 
+
+        struct walk_closure cl = { 0, 0, 0, true }; 
+        rb_snapshot_map_inorder(before, &function_to_apply_walk, &cl); 
+        TEST_ASSERT_EQUAL(50, cl.count); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+        TEST_ASSERT_EQUAL(98, cl.previous); 
+
+        int visited = 0; 
+        TEST_ASSERT_EQUAL(5, rb_snapshot_map_range(after, &keys[10], false, &keys[20], true, 
+                                                   &function_to_apply_count, &visited)); 
+
+        rb_snapshot_release(before); 
+        rb_snapshot_release(after); 
+
+        RedBlack_RCU_T empty = rb_rcu_new(&int_comparison); 
+        RedBlack_Snapshot_T none = rb_snapshot(empty); 
+        TEST_ASSERT_EQUAL(0, rb_snapshot_size(none)); 
+        TEST_ASSERT_NULL(rb_snapshot_search(none, &keys[0])); 
+        rb_snapshot_release(none); 
+        rb_rcu_free(empty); 
+}
+
+/* 
+ * the stress test: values are allocated per insertion and freed after 
+ * rb_rcu_synchronize, so a reader touching a freed node or value shows up 
+ * under AddressSanitizer or ThreadSanitizer. keys equal to 0 mod 4 are 
+ * present throughout; writer w churns the keys equal to w + 1 mod 4
+ */
+int stable_keys[KEY_COUNT]; 
+
+struct reader_result {
+        RedBlack_RCU_T tree; 
+        int missing; 
+        int unsorted; 
+};
+
+void *reader(void *arg)
+{
+        struct reader_result *result = (struct reader_result *) arg; 
+
+        for (int round = 0; round < WRITER_ROUNDS; round++) {
+                for (int k = 0; k < KEY_COUNT; k += 4) {
+                        if (rb_rcu_search(result->tree, &stable_keys[k]) != &stable_keys[k])
+                                result->missing++; 
+                }
+
+                struct walk_closure cl = { 0, 0, 0, true }; 
+                rb_rcu_map_inorder(result->tree, &function_to_apply_walk, &cl); 
+                if (!cl.sorted || cl.count < KEY_COUNT / 4)
+                        result->unsorted++; 
+
+                int visited = 0; 
+                rb_rcu_map_range(result->tree, &stable_keys[0], true, &stable_keys[100], 
+                                 true, &function_to_apply_count, &visited); 
+                if (visited < 26)
+                        result->missing++; 
+
+                /* 
+                 * a snapshot's size always matches what a walk of it finds. 
+                 * writers free values a snapshot may still hold, so the walk
+                 * does not look at them
+                 */
+                RedBlack_Snapshot_T snapshot = rb_snapshot(result->tree); 
+                visited = 0; 
+                rb_snapshot_map_range(snapshot, NULL, true, NULL, true, 
+                                      &function_to_apply_count, &visited); 
+                if ((size_t) visited != rb_snapshot_size(snapshot))
+                        result->unsorted++; 
+                rb_snapshot_release(snapshot); 
+        }
+
+        return NULL; 
+}
+
+struct writer_args {
+        RedBlack_RCU_T tree; 
+        int offset; 
+};
+
+void *writer(void *arg)
+{
+        RedBlack_RCU_T tree = ((struct writer_args *) arg)->tree; 
+        int offset = ((struct writer_args *) arg)->offset; 
+
+        for (int round = 0; round < WRITER_ROUNDS; round++) {
+                for (int k = offset; k < KEY_COUNT; k += 4) {
+                        int *value = malloc(sizeof(int)); 
+
+                        *value = k; 
+                        rb_rcu_insert(tree, value); 
+                }
+
+                for (int k = offset; k < KEY_COUNT; k += 4) {
+                        int *value = rb_rcu_delete(tree, &stable_keys[k]); 
+
+                        TEST_ASSERT_NOT_NULL(value); 
+                        rb_rcu_synchronize(); 
+                        free(value); 
+                }
+        }
+
+        return NULL; 
+}
+
+void test_rb_rcu_readers_and_writers(void)
+{
+        RedBlack_RCU_T test_tree = rb_rcu_new(&int_comparison); 
+        struct reader_result results[READER_COUNT]; 
+        struct writer_args args[WRITER_COUNT]; 
+        pthread_t readers[READER_COUNT]; 
+        pthread_t writers[WRITER_COUNT]; 
+
+        for (int k = 0; k < KEY_COUNT; k++) {
+                stable_keys[k] = k; 
+                if (k % 4 == 0)
+                        rb_rcu_insert(test_tree, &stable_keys[k]); 
+        }
+
+        for (int i = 0; i < WRITER_COUNT; i++) {
+                args[i] = (struct writer_args) { test_tree, i + 1 }; 
+                TEST_ASSERT_EQUAL(0, pthread_create(&writers[i], NULL, &writer, &args[i])); 
+        }
+        for (int i = 0; i < READER_COUNT; i++) {
+                results[i] = (struct reader_result) { test_tree, 0, 0 }; 
+                TEST_ASSERT_EQUAL(0, pthread_create(&readers[i], NULL, &reader, &results[i])); 
+        }
+
+        for (int i = 0; i < WRITER_COUNT; i++) 
+                pthread_join(writers[i], NULL); 
+        for (int i = 0; i < READER_COUNT; i++) {
+                pthread_join(readers[i], NULL); 
+                TEST_ASSERT_EQUAL(0, results[i].missing); 
+                TEST_ASSERT_EQUAL(0, results[i].unsorted); 
+        }
+
+        TEST_ASSERT_EQUAL(KEY_COUNT / 4, rb_rcu_size(test_tree)); 
+
+        rb_rcu_free(test_tree); 
+}
+
+size_t encode_int(void *value, unsigned char *buf, size_t capacity)
+{
+        if (capacity >= sizeof(int))
+                memcpy(buf, value, sizeof(int)); 
+
+        return sizeof(int); 
+}
+
+void *decode_int(const unsigned char *buf, size_t length)
+{
+        int *value = malloc(sizeof(int)); 
+
+        TEST_ASSERT_EQUAL(sizeof(int), length); 
+        memcpy(value, buf, sizeof(int)); 
+
+        return value; 
+}
+
+void free_value(void *value, int depth, void *cl)
+{
+        (void) depth; 
+        (void) cl; 
+
+        free(value); 
+}
+
+/* the keys not equal to 0 mod 4 come and go while a snapshot is saved */
+void *churner(void *arg)
+{
+        RedBlack_RCU_T tree = (RedBlack_RCU_T) arg; 
+
+        for (int round = 0; round < WRITER_ROUNDS; round++) {
+                for (int k = 1; k < KEY_COUNT; k++) {
+                        if (k % 4 != 0)
+                                rb_rcu_insert(tree, &stable_keys[k]); 
+                }
+                for (int k = 1; k < KEY_COUNT; k++) {
+                        if (k % 4 != 0)
+                                rb_rcu_delete(tree, &stable_keys[k]); 
+                }
+        }
+
+        return NULL; 
+}
+
+void test_rb_snapshot_save(void)
+{
+        RedBlack_RCU_T test_tree = rb_rcu_new(&int_comparison); 
+        pthread_t writer_thread; 
+        FILE *file = tmpfile(); 
+
+        for (int k = 0; k < KEY_COUNT; k++) {
+                stable_keys[k] = k; 
+                if (k % 4 == 0)
+                        rb_rcu_insert(test_tree, &stable_keys[k]); 
+        }
+
+        TEST_ASSERT_NOT_NULL(file); 
+        TEST_ASSERT_EQUAL(0, pthread_create(&writer_thread, NULL, &churner, test_tree)); 
+
+        RedBlack_Snapshot_T snapshot = rb_snapshot(test_tree); 
+        size_t size = rb_snapshot_size(snapshot); 
+
+        TEST_ASSERT_TRUE(rb_snapshot_save(snapshot, fileno(file), &encode_int)); 
+        pthread_join(writer_thread, NULL); 
+
+        TEST_ASSERT_EQUAL(0, lseek(fileno(file), 0, SEEK_SET)); 
+        RedBlack_T loaded = rb_tree_load(fileno(file), &int_comparison, &decode_int, &free); 
+
+        /* the file holds exactly the snapshot, whatever was written since */
+        TEST_ASSERT_NOT_NULL(loaded); 
+        TEST_ASSERT_EQUAL(size, rb_tree_size(loaded)); 
+        for (int k = 0; k < KEY_COUNT; k++) {
+                TEST_ASSERT_EQUAL(rb_snapshot_search(snapshot, &stable_keys[k]) != NULL, 
+                                  rb_search(loaded, &stable_keys[k]) != NULL); 
+        }
+
+        rb_map_inorder(loaded, &free_value, NULL); 
+        rb_tree_free(loaded); 
+        rb_snapshot_release(snapshot); 
+        rb_rcu_free(test_tree); 
+        fclose(file); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_rcu.c");
+
+        RUN_TEST(test_rb_rcu_churn); 
+        RUN_TEST(test_rb_rcu_snapshot); 
+        RUN_TEST(test_rb_rcu_readers_and_writers); 
+        RUN_TEST(test_rb_snapshot_save); 
+
+        UnityEnd();
+        return 0;
+}
@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "vendor/unity.h"
+#include "../src/rb_sharded.h"
+
+#include <pthread.h>
+
+#define KEY_COUNT 4000
+#define WRITER_COUNT 4
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int int_comparison(void *val_one, void *val_two)
+{
+        return *(int *) val_one - *(int *) val_two; 
+}
+
+uint64_t int_hash(void *value)
+{
+        return (uint64_t) *(int *) value; 
+}
+
+int keys[KEY_COUNT]; 
+
+struct sorted_closure {
+        int count; 
+        int previous; 
+        bool sorted; 
+        int stop_after;         /* 0 walks everything */
+};
+
+int function_to_apply_check_sorted(void *value, void *cl)
+{
+        struct sorted_closure *closure = (struct sorted_closure *) cl; 
+        int key = *(int *) value; 
+
+        if (closure->count > 0 && key <= closure->previous)
+                closure->sorted = false; 
+
+        closure->previous = key; 
+        closure->count++; 
+
+        return closure->count == closure->stop_after; 
+}
+
+void check_tree(RedBlack_Sharded_T test_tree)
+{
+        for (int i = 0; i < KEY_COUNT; i++) 
+                keys[i] = i; 
+
+        /* every third key, in a scattered order */
+        for (int i = 0; i < KEY_COUNT; i++) {
+                int k = (i * 7919) % KEY_COUNT; 
+
+                if (k % 3 == 0)
+                        rb_sharded_insert(test_tree, &keys[k]); 
+        }
+
+        int expected = (KEY_COUNT + 2) / 3; 
+        TEST_ASSERT_EQUAL(expected, rb_sharded_size(test_tree)); 
+
+        for (int k = 0; k < KEY_COUNT; k++) 
+                TEST_ASSERT_EQUAL_PTR(k % 3 == 0 ? &keys[k] : NULL, 
+                                      rb_sharded_search(test_tree, &keys[k])); 
+
+        struct sorted_closure cl = { 0, 0, true, 0 }; 
+        TEST_ASSERT_EQUAL(expected, rb_sharded_map_inorder(test_tree, &function_to_apply_check_sorted, &cl)); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+        TEST_ASSERT_EQUAL(expected, cl.count); 
+
+        struct sorted_closure stopped = { 0, 0, true, 10 }; 
+        TEST_ASSERT_EQUAL(10, rb_sharded_map_inorder(test_tree, &function_to_apply_check_sorted, &stopped)); 
+        TEST_ASSERT_EQUAL(27, stopped.previous); 
+
+        TEST_ASSERT_TRUE(rb_sharded_delete(test_tree, &keys[300])); 
+        TEST_ASSERT_FALSE(rb_sharded_delete(test_tree, &keys[300])); 
+        TEST_ASSERT_FALSE(rb_sharded_delete(test_tree, &keys[301])); 
+        TEST_ASSERT_NULL(rb_sharded_search(test_tree, &keys[300])); 
+        TEST_ASSERT_EQUAL(expected - 1, rb_sharded_size(test_tree)); 
+}
+
+void test_rb_sharded_hash(void)
+{
+        RedBlack_Sharded_T test_tree = rb_sharded_new_hash(&int_comparison, 0, 16, &int_hash); 
+
+        check_tree(test_tree); 
+        rb_sharded_free(test_tree); 
+}
+
+void test_rb_sharded_range(void)
+{
+        int bounds[] = { 500, 1000, 2000, 3000 }; 
+        void *bound_values[] = { &bounds[0], &bounds[1], &bounds[2], &bounds[3] }; 
+        RedBlack_Sharded_T test_tree = rb_sharded_new_range(&int_comparison, 0, 4, bound_values); 
+
+        check_tree(test_tree); 
+        rb_sharded_free(test_tree); 
+
+        /* no bounds at all is a single shard */
+        test_tree = rb_sharded_new_range(&int_comparison, 0, 0, NULL); 
+        check_tree(test_tree); 
+        rb_sharded_free(test_tree); 
+}
+
+void test_rb_sharded_strings(void)
+{
+        RedBlack_Sharded_T test_tree = rb_sharded_new_hash(NULL, RB_MULTISET, 8, 
+                                                           &rb_sharded_hash_string); 
+        char *words[] = { "pear", "apple", "fig", "kiwi", "apple", "banana" }; 
+
+        for (int i = 0; i < 6; i++) 
+                rb_sharded_insert(test_tree, words[i]); 
+
+        TEST_ASSERT_EQUAL(6, rb_sharded_size(test_tree)); 
+        TEST_ASSERT_EQUAL_STRING("fig", rb_sharded_search(test_tree, "fig")); 
+        TEST_ASSERT_TRUE(rb_sharded_delete(test_tree, "apple")); 
+        TEST_ASSERT_EQUAL_STRING("apple", rb_sharded_search(test_tree, "apple")); 
+
+        rb_sharded_free(test_tree); 
+}
+
+struct writer_args {
+        RedBlack_Sharded_T tree; 
+        int offset; 
+};
+
+void *writer(void *arg)
+{
+        struct writer_args *args = (struct writer_args *) arg; 
+
+        for (int k = args->offset; k < KEY_COUNT; k += WRITER_COUNT) 
+                rb_sharded_insert(args->tree, &keys[k]); 
+        for (int k = args->offset; k < KEY_COUNT; k += 2 * WRITER_COUNT) 
+                rb_sharded_delete(args->tree, &keys[k]); 
+
+        return NULL; 
+}
+
+void test_rb_sharded_concurrent_writers(void)
+{
+        RedBlack_Sharded_T test_tree = rb_sharded_new_hash(&int_comparison, 0, 8, &int_hash); 
+        struct writer_args args[WRITER_COUNT]; 
+        pthread_t writers[WRITER_COUNT]; 
+
+        for (int i = 0; i < KEY_COUNT; i++) 
+                keys[i] = i; 
+
+        for (int i = 0; i < WRITER_COUNT; i++) {
+                args[i] = (struct writer_args) { test_tree, i }; 
+                TEST_ASSERT_EQUAL(0, pthread_create(&writers[i], NULL, &writer, &args[i])); 
+        }
+        for (int i = 0; i < WRITER_COUNT; i++) 
+                pthread_join(writers[i], NULL); 
+
+        TEST_ASSERT_EQUAL(KEY_COUNT / 2, rb_sharded_size(test_tree)); 
+        for (int k = 0; k < KEY_COUNT; k++) {
+                bool deleted = (k % WRITER_COUNT) == (k % (2 * WRITER_COUNT)); 
+                TEST_ASSERT_EQUAL_PTR(deleted ? NULL : &keys[k], 
+                                      rb_sharded_search(test_tree, &keys[k])); 
+        }
+
+        struct sorted_closure cl = { 0, 0, true, 0 }; 
+        rb_sharded_map_inorder(test_tree, &function_to_apply_check_sorted, &cl); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+
+        rb_sharded_free(test_tree); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_sharded.c");
+
+        RUN_TEST(test_rb_sharded_hash); 
+        RUN_TEST(test_rb_sharded_range); 
+        RUN_TEST(test_rb_sharded_strings); 
+        RUN_TEST(test_rb_sharded_concurrent_writers); 
+
+        UnityEnd();
+        return 0;
+}
@@ -1,6 +1,11 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "vendor/unity.h"
 #include "../src/rb_tree.h"
 
+#include <string.h>
+#include <unistd.h>
+
 void setUp(void)
 {
 }
@@ -414,6 +419,1539 @@ void test_rb_predecessor_of_value(void)
         rb_tree_free(test_tree); 
 }
 
+struct int_walk_closure {
+        int count; 
+        int max_depth; 
+        int previous; 
+        bool sorted; 
+};
+
+void function_to_apply_int_walk(void *value, int depth, void *cl)
+{
+        struct int_walk_closure *closure = (struct int_walk_closure *) cl; 
+        int current = *(int *) value; 
+
+        if (closure->count > 0 && current < closure->previous)
+                closure->sorted = false; 
+        if (depth > closure->max_depth)
+                closure->max_depth = depth; 
+
+        closure->previous = current; 
+        closure->count++; 
+}
+
+/* 
+ * a red black tree with n nodes has height at most 2 * lg(n + 1); checking
+ * the deepest node against that bound catches broken fixups
+ */
+void assert_int_tree_shape(RedBlack_T tree, int expected_count)
+{
+        struct int_walk_closure cl = { 0, 0, 0, true }; 
+        int bound = 0; 
+
+        while ((1 << bound) <= expected_count)
+                bound++; 
+
+        rb_map_inorder(tree, &function_to_apply_int_walk, &cl); 
+
+        TEST_ASSERT_EQUAL(expected_count, cl.count); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+
+        if (expected_count > 0) {
+                TEST_ASSERT_TRUE(cl.max_depth + 1 <= 2 * bound); 
+        }
+}
+
+void test_rb_insert_delete_churn_reuses_nodes(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[2000]; 
+        unsigned state = 12345; 
+
+        for (int i = 0; i < 2000; i++) {
+                state = state * 1103515245 + 12345; 
+                a[i] = (int) ((state >> 16) % 100000); 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        assert_int_tree_shape(test_tree, 2000); 
+
+        for (int round = 0; round < 3; round++) {
+                for (int i = round % 2; i < 2000; i += 2) 
+                        rb_delete_value(test_tree, &a[i]); 
+
+                assert_int_tree_shape(test_tree, 1000); 
+
+                for (int i = round % 2; i < 2000; i += 2) 
+                        rb_insert_value(test_tree, &a[i]); 
+
+                assert_int_tree_shape(test_tree, 2000); 
+        }
+
+        for (int i = 0; i < 2000; i++) 
+                rb_delete_value(test_tree, &a[i]); 
+
+        TEST_ASSERT_TRUE(rb_tree_is_empty(test_tree)); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_delete_in_sorted_order(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[500]; 
+
+        for (int i = 0; i < 500; i++) {
+                a[i] = i; 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        for (int i = 0; i < 500; i++) {
+                rb_delete_value(test_tree, &a[i]); 
+
+                if (i % 50 == 0)
+                        assert_int_tree_shape(test_tree, 499 - i); 
+        }
+
+        TEST_ASSERT_TRUE(rb_tree_is_empty(test_tree)); 
+
+        rb_tree_free(test_tree); 
+}
+
+struct int_record {
+        int key; 
+        struct rb_node link; 
+};
+
+int int_record_comparison(void *val_one, void *val_two)
+{
+        return integer_comparison(&((struct int_record *) val_one)->key, 
+                                  &((struct int_record *) val_two)->key); 
+}
+
+void test_rb_intrusive_insert_search_delete(void)
+{
+        RedBlack_T test_tree = rb_new_intrusive(&int_record_comparison, 
+                                   offsetof(struct int_record, link)); 
+
+        struct int_record records[100]; 
+
+        for (int i = 0; i < 100; i++) {
+                records[i].key = (i * 37) % 100; 
+                rb_insert_node(test_tree, &records[i].link); 
+        }
+
+        struct int_record probe = { 42, { 0, NULL, NULL } }; 
+        struct int_record *found = rb_search(test_tree, &probe); 
+
+        TEST_ASSERT_NOT_NULL(found); 
+        TEST_ASSERT_EQUAL(42, found->key); 
+
+        struct rb_node *node = rb_search_node(test_tree, &probe); 
+        TEST_ASSERT_EQUAL_PTR(&found->link, node); 
+        TEST_ASSERT_EQUAL_PTR(found, rb_entry(node, struct int_record, link)); 
+        TEST_ASSERT_EQUAL_PTR(found, rb_node_value(test_tree, node)); 
+
+        TEST_ASSERT_EQUAL(0, ((struct int_record *) rb_tree_minimum(test_tree))->key); 
+        TEST_ASSERT_EQUAL(99, ((struct int_record *) rb_tree_maximum(test_tree))->key); 
+
+        rb_delete_node(test_tree, node); 
+        TEST_ASSERT_NULL(rb_search(test_tree, &probe)); 
+        TEST_ASSERT_EQUAL(42, found->key); 
+
+        for (int i = 0; i < 100; i += 2) 
+                rb_delete_value(test_tree, &records[i]); 
+
+        for (int i = 1; i < 100; i += 2) {
+                if (records[i].key == 42)
+                        continue; 
+                TEST_ASSERT_EQUAL_PTR(&records[i], rb_search(test_tree, &records[i])); 
+        }
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_insert_hint_sorted_appends(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[1000]; 
+        struct rb_node *hint = NULL; 
+
+        for (int i = 0; i < 1000; i++) {
+                a[i] = i; 
+                hint = rb_insert_hint(test_tree, hint, &a[i]); 
+                TEST_ASSERT_EQUAL_PTR(&a[i], rb_node_value(test_tree, hint)); 
+        }
+
+        assert_int_tree_shape(test_tree, 1000); 
+        TEST_ASSERT_EQUAL(0, *(int *) rb_tree_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL(999, *(int *) rb_tree_maximum(test_tree)); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_insert_hint_wrong_and_interior_hints(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[] = { 10, 20, 30, 40, 50 }; 
+        int b[] = { 25, 35, 5, 60, 45, 30 }; 
+
+        for (int i = 0; i < 5; i++) 
+                rb_insert_value(test_tree, &a[i]); 
+
+        struct rb_node *thirty = rb_search_node(test_tree, &a[2]); 
+
+        /* 25 and 35 sit next to the hint, the others do not */
+        for (int i = 0; i < 6; i++) 
+                rb_insert_hint(test_tree, thirty, &b[i]); 
+
+        assert_int_tree_shape(test_tree, 11); 
+        TEST_ASSERT_EQUAL(5, *(int *) rb_tree_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL(60, *(int *) rb_tree_maximum(test_tree)); 
+        TEST_ASSERT_EQUAL(35, *(int *) rb_successor_of_value(test_tree, &a[2])); 
+        TEST_ASSERT_EQUAL(25, *(int *) rb_predecessor_of_value(test_tree, &a[2])); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_minimum_and_maximum_follow_deletes(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        TEST_ASSERT_NULL(rb_tree_minimum(test_tree)); 
+        TEST_ASSERT_NULL(rb_tree_maximum(test_tree)); 
+
+        int a[100]; 
+
+        for (int i = 0; i < 100; i++) {
+                a[i] = (i * 59) % 100; 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        for (int i = 0; i < 50; i++) {
+                int low = i; 
+                int high = 99 - i; 
+
+                TEST_ASSERT_EQUAL(low, *(int *) rb_tree_minimum(test_tree)); 
+                TEST_ASSERT_EQUAL(high, *(int *) rb_tree_maximum(test_tree)); 
+
+                rb_delete_value(test_tree, &low); 
+                rb_delete_value(test_tree, &high); 
+        }
+
+        TEST_ASSERT_NULL(rb_tree_minimum(test_tree)); 
+        TEST_ASSERT_NULL(rb_tree_maximum(test_tree)); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_build_from_sorted(void)
+{
+        int a[1000]; 
+        void *values[1000]; 
+
+        for (int i = 0; i < 1000; i++) {
+                a[i] = 2 * i; 
+                values[i] = &a[i]; 
+        }
+
+        /* sizes with and without a full bottom level */
+        int sizes[] = { 0, 1, 2, 3, 7, 8, 100, 1000 }; 
+
+        for (int s = 0; s < 8; s++) {
+                int n = sizes[s]; 
+                RedBlack_T test_tree = rb_build_from_sorted(values, n, &integer_comparison); 
+
+                assert_int_tree_shape(test_tree, n); 
+
+                if (n == 0) {
+                        TEST_ASSERT_TRUE(rb_tree_is_empty(test_tree)); 
+                        rb_tree_free(test_tree); 
+                        continue; 
+                }
+
+                TEST_ASSERT_EQUAL(0, *(int *) rb_tree_minimum(test_tree)); 
+                TEST_ASSERT_EQUAL(2 * (n - 1), *(int *) rb_tree_maximum(test_tree)); 
+
+                for (int i = 0; i < n; i++) 
+                        TEST_ASSERT_EQUAL_PTR(&a[i], rb_search(test_tree, &a[i])); 
+
+                /* the fixups only hold up if the coloring was valid */
+                int odd[1000]; 
+
+                for (int i = 0; i < n; i++) {
+                        odd[i] = 2 * i + 1; 
+                        rb_insert_value(test_tree, &odd[i]); 
+                }
+
+                assert_int_tree_shape(test_tree, 2 * n); 
+
+                for (int i = 0; i < n; i += 2) 
+                        rb_delete_value(test_tree, &a[i]); 
+
+                assert_int_tree_shape(test_tree, 2 * n - (n + 1) / 2); 
+
+                rb_tree_free(test_tree); 
+        }
+}
+
+void test_rb_iter_walks_in_both_directions(void)
+{
+        RedBlack_T test_tree = rb_new(NULL); 
+
+        char *word_ray[] = {"hello", "world", "the", "earth", "says", "hello"}; 
+        char *expected_words[] = {"earth", "hello", "hello", "says", "the", "world"};
+
+        struct rb_iter it = rb_iter_first(test_tree); 
+        TEST_ASSERT_NULL(rb_iter_value(&it)); 
+        TEST_ASSERT_NULL(rb_iter_next(&it)); 
+
+        for (int i = 0; i < 6; i++) 
+                rb_insert_value(test_tree, word_ray[i]); 
+
+        int i = 0; 
+        it = rb_iter_first(test_tree); 
+
+        for (char *word = rb_iter_value(&it); word != NULL; word = rb_iter_next(&it)) 
+                TEST_ASSERT_EQUAL_STRING(expected_words[i++], word); 
+
+        TEST_ASSERT_EQUAL(6, i); 
+
+        it = rb_iter_last(test_tree); 
+
+        for (char *word = rb_iter_value(&it); word != NULL; word = rb_iter_prev(&it)) 
+                TEST_ASSERT_EQUAL_STRING(expected_words[--i], word); 
+
+        TEST_ASSERT_EQUAL(0, i); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_iter_seek_and_resume(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[200]; 
+
+        for (int i = 0; i < 200; i++) {
+                a[i] = 2 * ((i * 71) % 200); 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        int key = 101; 
+        struct rb_iter it = rb_iter_seek(test_tree, &key); 
+        TEST_ASSERT_EQUAL(102, *(int *) rb_iter_value(&it)); 
+
+        key = 100; 
+        it = rb_iter_seek(test_tree, &key); 
+        TEST_ASSERT_EQUAL(100, *(int *) rb_iter_value(&it)); 
+        TEST_ASSERT_EQUAL(98, *(int *) rb_iter_prev(&it)); 
+        TEST_ASSERT_EQUAL(100, *(int *) rb_iter_next(&it)); 
+
+        /* page through the rest ten values at a time, resuming the cursor */
+        int expected = 100; 
+
+        while (rb_iter_value(&it) != NULL) {
+                for (int n = 0; n < 10 && rb_iter_value(&it) != NULL; n++) {
+                        TEST_ASSERT_EQUAL(expected, *(int *) rb_iter_value(&it)); 
+                        expected += 2; 
+                        rb_iter_next(&it); 
+                }
+        }
+
+        TEST_ASSERT_EQUAL(400, expected); 
+
+        key = 1000; 
+        it = rb_iter_seek(test_tree, &key); 
+        TEST_ASSERT_NULL(rb_iter_value(&it)); 
+
+        rb_tree_free(test_tree); 
+}
+
+struct int_range_closure {
+        int count; 
+        int sum; 
+        int stop_after; 
+};
+
+int function_to_apply_int_range(void *value, void *cl)
+{
+        struct int_range_closure *closure = (struct int_range_closure *) cl; 
+
+        closure->count++; 
+        closure->sum += *(int *) value; 
+
+        return closure->count == closure->stop_after; 
+}
+
+void test_rb_map_range(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+
+        int a[100]; 
+
+        for (int i = 0; i < 100; i++) {
+                a[i] = (i * 31) % 100; 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        int lo = 10; 
+        int hi = 20; 
+        struct int_range_closure cl = { 0, 0, -1 }; 
+
+        TEST_ASSERT_EQUAL(11, rb_map_range(test_tree, &lo, true, &hi, true, 
+                                           &function_to_apply_int_range, &cl)); 
+        TEST_ASSERT_EQUAL(165, cl.sum); 
+
+        cl.count = cl.sum = 0; 
+        TEST_ASSERT_EQUAL(9, rb_map_range(test_tree, &lo, false, &hi, false, 
+                                          &function_to_apply_int_range, &cl)); 
+        TEST_ASSERT_EQUAL(135, cl.sum); 
+
+        cl.count = cl.sum = 0; 
+        TEST_ASSERT_EQUAL(10, rb_map_range(test_tree, NULL, false, &lo, false, 
+                                           &function_to_apply_int_range, &cl)); 
+        TEST_ASSERT_EQUAL(45, cl.sum); 
+
+        cl.count = cl.sum = 0; 
+        TEST_ASSERT_EQUAL(80, rb_map_range(test_tree, &hi, true, NULL, false, 
+                                           &function_to_apply_int_range, &cl)); 
+
+        cl.count = cl.sum = 0; 
+        cl.stop_after = 3; 
+        TEST_ASSERT_EQUAL(3, rb_map_range(test_tree, &lo, true, NULL, false, 
+                                          &function_to_apply_int_range, &cl)); 
+        TEST_ASSERT_EQUAL(33, cl.sum); 
+
+        cl.count = cl.sum = 0; 
+        cl.stop_after = -1; 
+        TEST_ASSERT_EQUAL(0, rb_map_range(test_tree, &hi, false, &lo, true, 
+                                          &function_to_apply_int_range, &cl)); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_order_statistics(void)
+{
+        RedBlack_T test_tree = rb_new_mode(&integer_comparison, RB_ORDER_STATISTICS); 
+
+        /* present[v] counts the copies of v in the tree */
+        int a[600]; 
+        int present[300] = { 0 }; 
+        unsigned state = 99; 
+
+        for (int i = 0; i < 600; i++) {
+                state = state * 1103515245 + 12345; 
+                a[i] = (int) ((state >> 16) % 300); 
+                rb_insert_value(test_tree, &a[i]); 
+                present[a[i]]++; 
+        }
+
+        for (int i = 0; i < 600; i += 3) {
+                rb_delete_value(test_tree, &a[i]); 
+                present[a[i]]--; 
+        }
+
+        TEST_ASSERT_EQUAL(400, rb_tree_size(test_tree)); 
+
+        size_t k = 0; 
+
+        for (int v = 0; v < 300; v++) {
+                TEST_ASSERT_EQUAL(k, rb_rank(test_tree, &v)); 
+
+                for (int copy = 0; copy < present[v]; copy++) 
+                        TEST_ASSERT_EQUAL(v, *(int *) rb_select(test_tree, k++)); 
+        }
+
+        TEST_ASSERT_EQUAL(400, k); 
+        TEST_ASSERT_NULL(rb_select(test_tree, 400)); 
+
+        int lo = 50; 
+        int hi = 100; 
+        size_t expected = 0; 
+
+        for (int v = 50; v <= 100; v++) 
+                expected += present[v]; 
+
+        TEST_ASSERT_EQUAL(expected, rb_count_range(test_tree, &lo, true, &hi, true)); 
+        TEST_ASSERT_EQUAL(expected - present[50] - present[100], 
+                          rb_count_range(test_tree, &lo, false, &hi, false)); 
+        TEST_ASSERT_EQUAL(rb_rank(test_tree, &lo), 
+                          rb_count_range(test_tree, NULL, false, &lo, false)); 
+        TEST_ASSERT_EQUAL(0, rb_count_range(test_tree, &hi, true, &lo, true)); 
+        TEST_ASSERT_EQUAL(400, rb_count_range(test_tree, NULL, false, NULL, false)); 
+
+        rb_tree_free(test_tree); 
+}
+
+struct interval_closure {
+        int count; 
+        bool seen[300]; 
+};
+
+int function_to_apply_interval(void *lo, void *hi, void *value, void *cl)
+{
+        struct interval_closure *closure = (struct interval_closure *) cl; 
+
+        (void) lo; 
+        (void) hi; 
+
+        closure->seen[*(int *) value] = true; 
+        closure->count++; 
+
+        return 0; 
+}
+
+void test_rb_interval_overlaps(void)
+{
+        RedBlack_T test_tree = rb_new_mode(&integer_comparison, RB_INTERVAL); 
+
+        int lo[300]; 
+        int hi[300]; 
+        int id[300]; 
+        unsigned state = 4242; 
+
+        for (int i = 0; i < 300; i++) {
+                state = state * 1103515245 + 12345; 
+                lo[i] = (int) ((state >> 16) % 1000); 
+                state = state * 1103515245 + 12345; 
+                hi[i] = lo[i] + (int) ((state >> 16) % 40); 
+                id[i] = i; 
+                rb_interval_insert(test_tree, &lo[i], &hi[i], &id[i]); 
+        }
+
+        /* every third interval is removed again */
+        for (int i = 0; i < 300; i += 3) 
+                TEST_ASSERT_TRUE(rb_interval_delete(test_tree, &lo[i], &hi[i], &id[i])); 
+
+        TEST_ASSERT_FALSE(rb_interval_delete(test_tree, &lo[0], &hi[0], &id[0])); 
+        TEST_ASSERT_EQUAL(200, rb_tree_size(test_tree)); 
+
+        for (int q_lo = -50; q_lo < 1050; q_lo += 37) {
+                int q_hi = q_lo + 15; 
+                struct interval_closure cl; 
+                int expected = 0; 
+
+                memset(&cl, 0, sizeof(cl)); 
+
+                size_t reported = rb_interval_overlaps(test_tree, &q_lo, &q_hi, 
+                                        &function_to_apply_interval, &cl); 
+
+                TEST_ASSERT_EQUAL(reported, cl.count); 
+
+                for (int i = 0; i < 300; i++) {
+                        bool overlaps = (i % 3 != 0) && lo[i] <= q_hi && q_lo <= hi[i]; 
+
+                        TEST_ASSERT_EQUAL(overlaps, cl.seen[i]); 
+                        expected += overlaps; 
+                }
+
+                TEST_ASSERT_EQUAL(expected, cl.count); 
+
+                int *any = rb_interval_any_overlap(test_tree, &q_lo, &q_hi); 
+
+                if (expected == 0) {
+                        TEST_ASSERT_NULL(any); 
+                } else {
+                        TEST_ASSERT_NOT_NULL(any); 
+                        TEST_ASSERT_TRUE(cl.seen[*any]); 
+                }
+        }
+
+        rb_tree_free(test_tree); 
+}
+
+struct map_count_closure {
+        int calls; 
+        int used; 
+        int counts[16]; 
+};
+
+void *function_to_apply_map_increment(void *key, void *value, void *cl)
+{
+        struct map_count_closure *closure = (struct map_count_closure *) cl; 
+        int *count = (int *) value; 
+
+        (void) key; 
+
+        if (count == NULL) 
+                count = &closure->counts[closure->used++]; 
+
+        (*count)++; 
+        closure->calls++; 
+
+        return count; 
+}
+
+void test_rb_map_operations(void)
+{
+        RedBlack_T test_tree = rb_new_mode(NULL, RB_MAP | RB_ORDER_STATISTICS); 
+        char *words[] = { "to", "be", "or", "not", "to", "be", "that", "is", 
+                          "the", "question", "to", "be" }; 
+        char other_to[] = "to"; 
+        int x = 1; 
+        int y = 2; 
+        struct map_count_closure cl = { 0, 0, { 0 } }; 
+
+        TEST_ASSERT_NULL(rb_map_get(test_tree, "to")); 
+
+        for (int i = 0; i < 12; i++) 
+                rb_map_update(test_tree, words[i], 
+                              &function_to_apply_map_increment, &cl); 
+
+        TEST_ASSERT_EQUAL(12, cl.calls); 
+        TEST_ASSERT_EQUAL(8, cl.used); 
+        TEST_ASSERT_EQUAL(8, rb_tree_size(test_tree)); 
+        TEST_ASSERT_EQUAL(3, *(int *) rb_map_get(test_tree, other_to)); 
+        TEST_ASSERT_EQUAL(1, *(int *) rb_map_get(test_tree, "question")); 
+        TEST_ASSERT_EQUAL_STRING("be", rb_select(test_tree, 0)); 
+
+        TEST_ASSERT_NULL(rb_map_put(test_tree, "x", &x)); 
+        TEST_ASSERT_EQUAL_PTR(&x, rb_map_put(test_tree, "x", &y)); 
+        TEST_ASSERT_EQUAL_PTR(&y, rb_map_get(test_tree, "x")); 
+        TEST_ASSERT_EQUAL(9, rb_tree_size(test_tree)); 
+
+        bool inserted = true; 
+        void **slot = rb_map_get_or_insert(test_tree, "x", &x, &inserted); 
+
+        TEST_ASSERT_FALSE(inserted); 
+        TEST_ASSERT_EQUAL_PTR(&y, *slot); 
+        *slot = &x; 
+        TEST_ASSERT_EQUAL_PTR(&x, rb_map_get(test_tree, "x")); 
+
+        slot = rb_map_get_or_insert(test_tree, "y", &y, &inserted); 
+        TEST_ASSERT_TRUE(inserted); 
+        TEST_ASSERT_EQUAL_PTR(&y, *slot); 
+        TEST_ASSERT_EQUAL(10, rb_tree_size(test_tree)); 
+
+        rb_delete_value(test_tree, "x"); 
+        TEST_ASSERT_NULL(rb_map_get(test_tree, "x")); 
+        TEST_ASSERT_EQUAL_PTR(&y, rb_map_get(test_tree, "y")); 
+        TEST_ASSERT_EQUAL(9, rb_tree_size(test_tree)); 
+        TEST_ASSERT_EQUAL(8, rb_rank(test_tree, "y")); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_multiset_counts(void)
+{
+        RedBlack_T test_tree = rb_new_mode(&integer_comparison, 
+                                           RB_MULTISET | RB_ORDER_STATISTICS); 
+        RedBlack_T plain_tree = rb_new(&integer_comparison); 
+        int values[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }; 
+        int counts[10] = { 0 }; 
+        unsigned state = 7; 
+
+        for (int i = 0; i < 10000; i++) {
+                state = state * 1103515245 + 12345; 
+
+                /* heavily skewed towards small values */
+                int v = (int) ((state >> 16) % 100); 
+                v = v < 70 ? 0 : v < 90 ? 1 : v % 8 + 2; 
+
+                rb_insert_value(test_tree, &values[v]); 
+                counts[v]++; 
+        }
+
+        TEST_ASSERT_EQUAL(10000, rb_tree_size(test_tree)); 
+
+        struct int_walk_closure cl = { 0, 0, 0, true }; 
+        rb_map_inorder(test_tree, &function_to_apply_int_walk, &cl); 
+        TEST_ASSERT_EQUAL(10, cl.count); 
+
+        int below = 0; 
+        for (int v = 0; v < 10; v++) {
+                TEST_ASSERT_EQUAL(counts[v], rb_count(test_tree, &values[v])); 
+                TEST_ASSERT_EQUAL(below, rb_rank(test_tree, &values[v])); 
+                below += counts[v]; 
+        }
+
+        TEST_ASSERT_EQUAL_PTR(&values[1], rb_select(test_tree, counts[0])); 
+
+        TEST_ASSERT_TRUE(rb_delete_one(test_tree, &values[0])); 
+        TEST_ASSERT_EQUAL(counts[0] - 1, rb_count(test_tree, &values[0])); 
+        TEST_ASSERT_EQUAL(9999, rb_tree_size(test_tree)); 
+
+        TEST_ASSERT_EQUAL(counts[1], rb_delete_all(test_tree, &values[1])); 
+        TEST_ASSERT_EQUAL(0, rb_count(test_tree, &values[1])); 
+        TEST_ASSERT_FALSE(rb_delete_one(test_tree, &values[1])); 
+        TEST_ASSERT_EQUAL(9999 - counts[1], rb_tree_size(test_tree)); 
+        TEST_ASSERT_EQUAL(9999 - counts[1], rb_count_range(test_tree, &values[0], 
+                                                true, &values[9], true)); 
+
+        /* ordinary trees keep a node per insertion, but count the same way */
+        for (int i = 0; i < 5; i++) 
+                rb_insert_value(plain_tree, &values[3]); 
+        rb_insert_value(plain_tree, &values[4]); 
+
+        TEST_ASSERT_EQUAL(5, rb_count(plain_tree, &values[3])); 
+        TEST_ASSERT_TRUE(rb_delete_one(plain_tree, &values[3])); 
+        TEST_ASSERT_EQUAL(4, rb_delete_all(plain_tree, &values[3])); 
+        TEST_ASSERT_EQUAL(1, rb_tree_size(plain_tree)); 
+
+        rb_tree_free(plain_tree); 
+        rb_tree_free(test_tree); 
+}
+
+struct task {
+        int priority; 
+        int id; 
+};
+
+int task_comparisons = 0; 
+
+int task_comparison(void *val_one, void *val_two)
+{
+        task_comparisons++; 
+        return integer_comparison(&((struct task *) val_one)->priority, 
+                                  &((struct task *) val_two)->priority); 
+}
+
+void test_rb_pop_min_and_max(void)
+{
+        RedBlack_T test_tree = rb_new(&task_comparison); 
+        struct task tasks[200]; 
+
+        TEST_ASSERT_NULL(rb_pop_min(test_tree)); 
+        TEST_ASSERT_NULL(rb_pop_max(test_tree)); 
+
+        /* many tasks share a priority; they should come out first in first out */
+        for (int i = 0; i < 200; i++) {
+                tasks[i].priority = (i * 7) % 10; 
+                tasks[i].id = i; 
+                rb_insert_value(test_tree, &tasks[i]); 
+        }
+
+        task_comparisons = 0; 
+
+        int last_priority = -1; 
+        int last_id = -1; 
+
+        for (int i = 0; i < 150; i++) {
+                struct task *t = rb_pop_min(test_tree); 
+
+                TEST_ASSERT_TRUE(t->priority >= last_priority); 
+                if (t->priority == last_priority) {
+                        TEST_ASSERT_TRUE(t->id > last_id); 
+                }
+
+                last_priority = t->priority; 
+                last_id = t->id; 
+        }
+
+        struct task *max = rb_pop_max(test_tree); 
+
+        TEST_ASSERT_EQUAL(9, max->priority); 
+        TEST_ASSERT_EQUAL(197, max->id); 
+        TEST_ASSERT_EQUAL(0, task_comparisons); 
+        TEST_ASSERT_EQUAL(49, rb_tree_size(test_tree)); 
+
+        while (rb_pop_max(test_tree) != NULL)
+                ; 
+
+        TEST_ASSERT_TRUE(rb_tree_is_empty(test_tree)); 
+        TEST_ASSERT_EQUAL(0, task_comparisons); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_tree_stats(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+        struct rb_tree_stats stats; 
+        int values[1000]; 
+
+        rb_tree_stats(test_tree, &stats); 
+        TEST_ASSERT_EQUAL(0, stats.count); 
+        TEST_ASSERT_EQUAL(0, stats.height); 
+
+        for (int i = 0; i < 1000; i++) {
+                values[i] = i; 
+                rb_insert_value(test_tree, &values[i]); 
+        }
+
+        rb_tree_stats(test_tree, &stats); 
+
+        size_t total = 0; 
+        for (int d = 0; d < RB_STATS_MAX_DEPTH; d++) 
+                total += stats.depth_histogram[d]; 
+
+        TEST_ASSERT_EQUAL(1000, stats.count); 
+        TEST_ASSERT_EQUAL(1000, total); 
+        TEST_ASSERT_EQUAL(1, stats.depth_histogram[0]); 
+        TEST_ASSERT_TRUE(stats.height >= 10 && stats.height <= 20); 
+        TEST_ASSERT_EQUAL(0, stats.depth_histogram[stats.height]); 
+        TEST_ASSERT_TRUE(stats.depth_histogram[stats.height - 1] > 0); 
+
+        if (stats.counters_enabled) {
+                TEST_ASSERT_TRUE(stats.comparisons >= 1000); 
+                TEST_ASSERT_TRUE(stats.rotations > 0); 
+                TEST_ASSERT_TRUE(stats.insert_fixups > 0); 
+                TEST_ASSERT_EQUAL(0, stats.delete_fixups); 
+                TEST_ASSERT_EQUAL(1000, stats.node_allocations); 
+                TEST_ASSERT_TRUE(stats.chunk_allocations > 0 && 
+                                 stats.chunk_allocations < 10); 
+        } else {
+                TEST_ASSERT_EQUAL(0, stats.comparisons); 
+                TEST_ASSERT_EQUAL(0, stats.rotations); 
+        }
+
+        rb_tree_stats_reset(test_tree); 
+
+        for (int i = 0; i < 1000; i += 2) 
+                rb_delete_value(test_tree, &values[i]); 
+
+        rb_tree_stats(test_tree, &stats); 
+        TEST_ASSERT_EQUAL(500, stats.count); 
+
+        if (stats.counters_enabled) {
+                TEST_ASSERT_TRUE(stats.delete_fixups > 0); 
+                TEST_ASSERT_EQUAL(0, stats.insert_fixups); 
+                TEST_ASSERT_EQUAL(0, stats.node_allocations); 
+        }
+
+        rb_tree_free(test_tree); 
+}
+
+void ignore_value(void *value, int depth, void *cl)
+{
+        (void) value; 
+        (void) depth; 
+        (void) cl; 
+}
+
+void test_rb_trace_recording(void)
+{
+        RedBlack_T test_tree = rb_new(NULL); 
+        FILE *trace = tmpfile(); 
+
+        TEST_ASSERT_NOT_NULL(trace); 
+
+        if (!rb_trace_start(test_tree, trace, NULL)) {
+                /* compiled without RB_TRACE: nothing may be written */
+                rb_insert_value(test_tree, "kiwi"); 
+                TEST_ASSERT_EQUAL(0, ftell(trace)); 
+                TEST_ASSERT_TRUE(rb_trace_stop(test_tree)); 
+
+                fclose(trace); 
+                rb_tree_free(test_tree); 
+                return; 
+        }
+
+        rb_insert_value(test_tree, "kiwi"); 
+        rb_insert_value(test_tree, "fig"); 
+        rb_search(test_tree, "fig"); 
+        rb_successor_of_value(test_tree, "fig"); 
+        rb_map_inorder(test_tree, &ignore_value, NULL); 
+        rb_delete_value(test_tree, "kiwi"); 
+        TEST_ASSERT_TRUE(rb_trace_stop(test_tree)); 
+
+        /* calls after stopping are not recorded */
+        rb_search(test_tree, "fig"); 
+
+        unsigned char expected[] = {
+                'R', 'B', 'T', 'R', 'A', 'C', 'E', '1', 
+                RB_TRACE_INSERT, 4, 'k', 'i', 'w', 'i', 
+                RB_TRACE_INSERT, 3, 'f', 'i', 'g', 
+                RB_TRACE_SEARCH, 3, 'f', 'i', 'g', 
+                RB_TRACE_SUCCESSOR, 3, 'f', 'i', 'g', 
+                RB_TRACE_MAP_INORDER, 
+                RB_TRACE_DELETE, 4, 'k', 'i', 'w', 'i'
+        }; 
+        unsigned char actual[sizeof(expected) + 1]; 
+
+        rewind(trace); 
+        TEST_ASSERT_EQUAL(sizeof(expected), fread(actual, 1, sizeof(actual), trace)); 
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected)); 
+
+        /* a key longer than RB_TRACE_MAX_KEY is recorded truncated */
+        char long_key[RB_TRACE_MAX_KEY + 45]; 
+
+        memset(long_key, 'a', sizeof(long_key) - 1); 
+        long_key[sizeof(long_key) - 1] = '\0'; 
+        rewind(trace); 
+        TEST_ASSERT_TRUE(rb_trace_start(test_tree, trace, NULL)); 
+        rb_search(test_tree, long_key); 
+        TEST_ASSERT_TRUE(rb_trace_stop(test_tree)); 
+        TEST_ASSERT_EQUAL(RB_TRACE_MAGIC_LENGTH + 3 + RB_TRACE_MAX_KEY, ftell(trace)); 
+
+        fclose(trace); 
+        rb_tree_free(test_tree); 
+}
+
+/* 
+ * checks the red black properties and parent links of the subtree rooted at
+ * n, and returns its black height. the color is the low bit of parent_color,
+ * set for black
+ */
+int assert_red_black(struct rb_node *n, struct rb_node *parent)
+{
+        if (n == NULL)
+                return 0; 
+
+        bool black = (n->parent_color & 1) != 0; 
+
+        TEST_ASSERT_EQUAL_PTR(parent, (struct rb_node *) (n->parent_color & ~(uintptr_t) 1)); 
+
+        if (!black) {
+                TEST_ASSERT_TRUE(parent != NULL); 
+                TEST_ASSERT_TRUE(n->left == NULL || (n->left->parent_color & 1)); 
+                TEST_ASSERT_TRUE(n->right == NULL || (n->right->parent_color & 1)); 
+        }
+
+        int left_height = assert_red_black(n->left, n); 
+        int right_height = assert_red_black(n->right, n); 
+
+        TEST_ASSERT_EQUAL(left_height, right_height); 
+
+        return left_height + black; 
+}
+
+void assert_int_range_tree(RedBlack_T tree, int lo, int hi)
+{
+        struct int_walk_closure cl = { 0, 0, 0, true }; 
+
+        assert_red_black(rb_root_node(tree), NULL); 
+        rb_map_inorder(tree, &function_to_apply_int_walk, &cl); 
+
+        TEST_ASSERT_EQUAL(hi - lo, cl.count); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+        TEST_ASSERT_EQUAL(hi - lo, rb_tree_size(tree)); 
+
+        if (hi > lo) {
+                TEST_ASSERT_EQUAL(lo, *(int *) rb_tree_minimum(tree)); 
+                TEST_ASSERT_EQUAL(hi - 1, *(int *) rb_tree_maximum(tree)); 
+        } else {
+                TEST_ASSERT_NULL(rb_tree_minimum(tree)); 
+                TEST_ASSERT_NULL(rb_tree_maximum(tree)); 
+        }
+}
+
+void test_rb_split_and_join(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+        RedBlack_T left; 
+        RedBlack_T right; 
+
+        int a[1000]; 
+
+        for (int i = 0; i < 1000; i++) {
+                a[i] = i; 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        rb_split(test_tree, &a[400], &left, &right); 
+        assert_int_range_tree(left, 0, 400); 
+        assert_int_range_tree(right, 400, 1000); 
+
+        /* both halves keep allocating and releasing nodes of their own */
+        rb_delete_value(right, &a[999]); 
+        rb_insert_value(right, &a[999]); 
+        rb_delete_value(left, &a[0]); 
+        rb_insert_value(left, &a[0]); 
+
+        test_tree = rb_join2(left, right); 
+        assert_int_range_tree(test_tree, 0, 1000); 
+
+        /* a pivot between trees of very different heights */
+        int key = 990; 
+
+        rb_split(test_tree, &key, &left, &right); 
+        assert_int_range_tree(left, 0, 990); 
+        assert_int_range_tree(right, 990, 1000); 
+
+        rb_delete_value(right, &a[990]); 
+        test_tree = rb_join(left, &a[990], right); 
+        assert_int_range_tree(test_tree, 0, 1000); 
+
+        /* splits beyond either end leave one side empty */
+        key = -1; 
+        rb_split(test_tree, &key, &left, &right); 
+        assert_int_range_tree(left, 0, 0); 
+        assert_int_range_tree(right, 0, 1000); 
+        test_tree = rb_join2(left, right); 
+
+        key = 1000; 
+        rb_split(test_tree, &key, &left, &right); 
+        assert_int_range_tree(left, 0, 1000); 
+        assert_int_range_tree(right, 0, 0); 
+        test_tree = rb_join2(left, right); 
+        assert_int_range_tree(test_tree, 0, 1000); 
+
+        /* carve the tree into pieces at random keys and glue them back */
+        RedBlack_T pieces[8]; 
+        unsigned state = 7; 
+        int bounds[8]; 
+
+        bounds[0] = 0; 
+        for (int i = 1; i < 8; i++) {
+                state = state * 1103515245 + 12345; 
+                bounds[i] = bounds[i - 1] + 1 + (int) ((state >> 16) % 200); 
+        }
+
+        for (int i = 7; i > 0; i--) {
+                rb_split(test_tree, &bounds[i], &left, &pieces[i]); 
+                test_tree = left; 
+        }
+        pieces[0] = test_tree; 
+
+        for (int i = 0; i < 8; i++) 
+                assert_int_range_tree(pieces[i], bounds[i], 
+                                      i == 7 ? 1000 : bounds[i + 1]); 
+
+        for (int i = 1; i < 8; i++) 
+                test_tree = rb_join2(test_tree, pieces[i]); 
+
+        assert_int_range_tree(test_tree, 0, 1000); 
+
+        rb_tree_free(test_tree); 
+}
+
+void test_rb_split_and_join_augmented(void)
+{
+        RedBlack_T test_tree = rb_new_mode(&integer_comparison, 
+                                           RB_ORDER_STATISTICS | RB_MULTISET); 
+        RedBlack_T left; 
+        RedBlack_T right; 
+
+        int a[300]; 
+
+        for (int i = 0; i < 300; i++) {
+                a[i] = i / 3; 
+                rb_insert_value(test_tree, &a[i]); 
+        }
+
+        int key = 40; 
+
+        rb_split(test_tree, &key, &left, &right); 
+        assert_red_black(rb_root_node(left), NULL); 
+        assert_red_black(rb_root_node(right), NULL); 
+        TEST_ASSERT_EQUAL(120, rb_tree_size(left)); 
+        TEST_ASSERT_EQUAL(180, rb_tree_size(right)); 
+        TEST_ASSERT_EQUAL(3, rb_count(right, &key)); 
+        TEST_ASSERT_EQUAL(40, *(int *) rb_select(right, 0)); 
+        TEST_ASSERT_EQUAL(99, *(int *) rb_select(right, 179)); 
+        TEST_ASSERT_EQUAL(39, *(int *) rb_select(left, 119)); 
+
+        rb_delete_all(right, &key); 
+        test_tree = rb_join(left, &key, right); 
+
+        assert_red_black(rb_root_node(test_tree), NULL); 
+        TEST_ASSERT_EQUAL(298, rb_tree_size(test_tree)); 
+        TEST_ASSERT_EQUAL(1, rb_count(test_tree, &key)); 
+        TEST_ASSERT_EQUAL(120, rb_rank(test_tree, &key)); 
+
+        for (size_t k = 0; k < 298; k++) 
+                TEST_ASSERT_EQUAL(k < 120 ? k / 3 : (k < 121 ? 40 : (k - 121) / 3 + 41), 
+                                  *(int *) rb_select(test_tree, k)); 
+
+        rb_tree_free(test_tree); 
+}
+
+/* the inorder walk of tree must be exactly the values in expected */
+struct expected_walk {
+        int **expected; 
+        int count; 
+        bool matched; 
+};
+
+void function_to_apply_expected(void *value, int depth, void *cl)
+{
+        struct expected_walk *walk = (struct expected_walk *) cl; 
+
+        (void) depth; 
+
+        if (walk->expected[walk->count] != value)
+                walk->matched = false; 
+
+        walk->count++; 
+}
+
+/* 
+ * adds the addresses of the nodes under n to seen, once each, so that a 
+ * test can tell how many distinct nodes a tree has used over time
+ */
+void record_nodes(struct rb_node *n, struct rb_node **seen, size_t *count, 
+                  size_t capacity)
+{
+        if (n == NULL)
+                return; 
+
+        record_nodes(n->left, seen, count, capacity); 
+        record_nodes(n->right, seen, count, capacity); 
+
+        for (size_t i = 0; i < *count; i++) 
+                if (seen[i] == n)
+                        return; 
+
+        TEST_ASSERT_TRUE(*count < capacity); 
+        seen[(*count)++] = n; 
+}
+
+#define ARCHIVE_ROUNDS 20
+#define ARCHIVE_BATCH 200
+
+void test_rb_split_and_free_reuses_nodes(void)
+{
+        RedBlack_T live = rb_new(&integer_comparison); 
+        int *keys = malloc(ARCHIVE_ROUNDS * ARCHIVE_BATCH * sizeof(int)); 
+        struct rb_node **seen = malloc(4 * ARCHIVE_BATCH * sizeof(struct rb_node *)); 
+        size_t used = 0; 
+
+        /* 
+         * each round adds a batch of newer keys, then splits off the older 
+         * batch and frees it, as when archiving old entries. the freed 
+         * half's nodes must be reused by the surviving half
+         */
+        for (int round = 0; round < ARCHIVE_ROUNDS; round++) {
+                int *batch = keys + round * ARCHIVE_BATCH; 
+                RedBlack_T old; 
+
+                for (int i = 0; i < ARCHIVE_BATCH; i++) {
+                        batch[i] = round * ARCHIVE_BATCH + i; 
+                        rb_insert_value(live, &batch[i]); 
+                }
+
+                record_nodes(rb_root_node(live), seen, &used, 4 * ARCHIVE_BATCH); 
+
+                rb_split(live, &batch[0], &old, &live); 
+                rb_tree_free(old); 
+
+                assert_int_range_tree(live, batch[0], batch[0] + ARCHIVE_BATCH); 
+        }
+
+        /* two batches are live at once, plus whatever a chunk has spare */
+        TEST_ASSERT_TRUE(used <= 3 * ARCHIVE_BATCH); 
+
+        rb_tree_free(live); 
+        free(seen); 
+        free(keys); 
+}
+
+void assert_tree_holds(RedBlack_T tree, int **expected, int count)
+{
+        struct expected_walk walk = { expected, 0, true }; 
+
+        assert_red_black(rb_root_node(tree), NULL); 
+        rb_map_inorder(tree, &function_to_apply_expected, &walk); 
+
+        TEST_ASSERT_EQUAL(count, walk.count); 
+        TEST_ASSERT_TRUE(walk.matched); 
+        TEST_ASSERT_EQUAL(count, rb_tree_size(tree)); 
+}
+
+/* a gets the multiples of 2 below 600 and b the multiples of 3 */
+void build_set_operands(int *evens, int *threes, RedBlack_T *a, RedBlack_T *b)
+{
+        *a = rb_new(&integer_comparison); 
+        *b = rb_new(&integer_comparison); 
+
+        for (int i = 0; i < 300; i++) {
+                evens[i] = 2 * i; 
+                rb_insert_value(*a, &evens[i]); 
+        }
+        for (int i = 0; i < 200; i++) {
+                threes[i] = 3 * i; 
+                rb_insert_value(*b, &threes[i]); 
+        }
+}
+
+void test_rb_set_operations(void)
+{
+        int evens[300]; 
+        int threes[200]; 
+        int *expected[500]; 
+        int count; 
+        RedBlack_T a; 
+        RedBlack_T b; 
+
+        /* equal values come from a */
+        build_set_operands(evens, threes, &a, &b); 
+        a = rb_union(a, b); 
+        count = 0; 
+        for (int v = 0; v < 600; v++) {
+                if (v % 2 == 0)
+                        expected[count++] = &evens[v / 2]; 
+                else if (v % 3 == 0)
+                        expected[count++] = &threes[v / 3]; 
+        }
+        assert_tree_holds(a, expected, count); 
+        rb_tree_free(a); 
+
+        build_set_operands(evens, threes, &a, &b); 
+        a = rb_intersection(a, b); 
+        count = 0; 
+        for (int v = 0; v < 600; v += 6) 
+                expected[count++] = &evens[v / 2]; 
+        assert_tree_holds(a, expected, count); 
+        rb_tree_free(a); 
+
+        build_set_operands(evens, threes, &a, &b); 
+        a = rb_difference(a, b); 
+        count = 0; 
+        for (int v = 0; v < 600; v += 2) 
+                if (v % 3 != 0)
+                        expected[count++] = &evens[v / 2]; 
+        assert_tree_holds(a, expected, count); 
+
+        /* the result is an ordinary tree, and empty operands are allowed */
+        rb_insert_value(a, &threes[1]); 
+        a = rb_union(a, rb_new(&integer_comparison)); 
+        TEST_ASSERT_EQUAL(count + 1, rb_tree_size(a)); 
+        a = rb_intersection(rb_new(&integer_comparison), a); 
+        TEST_ASSERT_TRUE(rb_tree_is_empty(a)); 
+        TEST_ASSERT_EQUAL(0, rb_tree_size(a)); 
+        rb_tree_free(a); 
+}
+
+bool holds_node(struct rb_node **nodes, size_t count, struct rb_node *n)
+{
+        for (size_t i = 0; i < count; i++) 
+                if (nodes[i] == n)
+                        return true; 
+
+        return false; 
+}
+
+void test_rb_set_operations_release_nodes(void)
+{
+        int keys[400]; 
+        struct rb_node *seen[400]; 
+        struct rb_node *now[400]; 
+        size_t seen_count = 0; 
+        size_t now_count = 0; 
+
+        for (int i = 0; i < 400; i++) 
+                keys[i] = i; 
+
+        for (int op = 0; op < 2; op++) {
+                RedBlack_T live = rb_new(&integer_comparison); 
+                RedBlack_T delta = rb_new(&integer_comparison); 
+
+                for (int i = 0; i < 224; i++) 
+                        rb_insert_value(live, &keys[i]); 
+                for (int i = 0; i < 32; i++) 
+                        rb_insert_value(delta, &keys[i]); 
+
+                /* 
+                 * sizes fill whole chunks, so every node the result may use
+                 * from here on is in one of the two trees
+                 */
+                seen_count = 0; 
+                record_nodes(rb_root_node(live), seen, &seen_count, 400); 
+                record_nodes(rb_root_node(delta), seen, &seen_count, 400); 
+
+                /* a union drops delta's nodes, a difference both trees' */
+                if (op == 0) {
+                        live = rb_union(live, delta); 
+                        TEST_ASSERT_EQUAL(224, rb_tree_size(live)); 
+                } else {
+                        live = rb_difference(live, delta); 
+                        TEST_ASSERT_EQUAL(192, rb_tree_size(live)); 
+                }
+
+                for (int i = 224; i < 256; i++) 
+                        rb_insert_value(live, &keys[i]); 
+
+                now_count = 0; 
+                record_nodes(rb_root_node(live), now, &now_count, 400); 
+                for (size_t i = 0; i < now_count; i++) 
+                        TEST_ASSERT_TRUE(holds_node(seen, seen_count, now[i])); 
+
+                rb_tree_free(live); 
+        }
+
+        /* merging full overlaps over and over keeps a valid, exact tree */
+        RedBlack_T base = rb_new(&integer_comparison); 
+
+        for (int i = 0; i < 400; i++) 
+                rb_insert_value(base, &keys[i]); 
+
+        for (int round = 0; round < 10; round++) {
+                RedBlack_T delta = rb_new(&integer_comparison); 
+
+                for (int i = round; i < 400; i += 2) 
+                        rb_insert_value(delta, &keys[i]); 
+
+                base = rb_union(delta, base); 
+                assert_int_range_tree(base, 0, 400); 
+        }
+
+        rb_tree_free(base); 
+}
+
+void test_rb_set_operations_small_delta(void)
+{
+        RedBlack_T base = rb_new_mode(NULL, RB_MAP | RB_ORDER_STATISTICS); 
+        RedBlack_T delta = rb_new_mode(NULL, RB_MAP | RB_ORDER_STATISTICS); 
+        char keys[1000][8]; 
+        int old_value = 0; 
+        int new_value = 1; 
+
+        for (int i = 0; i < 1000; i++) {
+                sprintf(keys[i], "k%04d", i); 
+                rb_map_put(base, keys[i], &old_value); 
+        }
+
+        /* the delta replaces a few mapped values and adds one key */
+        char extra[] = "k9999"; 
+
+        rb_map_put(delta, keys[10], &new_value); 
+        rb_map_put(delta, keys[500], &new_value); 
+        rb_map_put(delta, extra, &new_value); 
+
+        base = rb_union(delta, base); 
+
+        assert_red_black(rb_root_node(base), NULL); 
+        TEST_ASSERT_EQUAL(1001, rb_tree_size(base)); 
+        TEST_ASSERT_EQUAL_PTR(&new_value, rb_map_get(base, keys[10])); 
+        TEST_ASSERT_EQUAL_PTR(&new_value, rb_map_get(base, keys[500])); 
+        TEST_ASSERT_EQUAL_PTR(&old_value, rb_map_get(base, keys[11])); 
+        TEST_ASSERT_EQUAL_PTR(&new_value, rb_map_get(base, extra)); 
+        TEST_ASSERT_EQUAL_STRING("k0500", rb_select(base, 500)); 
+
+        rb_tree_free(base); 
+}
+
+size_t encode_int(void *value, unsigned char *buf, size_t capacity)
+{
+        unsigned x = (unsigned) *(int *) value; 
+
+        if (capacity >= 4) {
+                for (int i = 0; i < 4; i++) 
+                        buf[i] = (unsigned char) (x >> (8 * i)); 
+        }
+
+        return 4; 
+}
+
+void *decode_int(const unsigned char *buf, size_t length)
+{
+        if (length != 4)
+                return NULL; 
+
+        int *value = malloc(sizeof(int)); 
+
+        *value = (int) ((unsigned) buf[0] | (unsigned) buf[1] << 8 
+                        | (unsigned) buf[2] << 16 | (unsigned) buf[3] << 24); 
+
+        return value; 
+}
+
+int discarded = 0; 
+
+void discard_value(void *value)
+{
+        discarded++; 
+        free(value); 
+}
+
+void free_value(void *value, int depth, void *cl)
+{
+        (void) depth; 
+        (void) cl; 
+
+        free(value); 
+}
+
+/* returns a file holding length bytes, positioned at its start */
+FILE *file_holding(const unsigned char *bytes, size_t length)
+{
+        FILE *file = tmpfile(); 
+
+        TEST_ASSERT_NOT_NULL(file); 
+        TEST_ASSERT_EQUAL(length, fwrite(bytes, 1, length, file)); 
+        fflush(file); 
+        rewind(file); 
+
+        return file; 
+}
+
+void test_rb_save_and_load(void)
+{
+        RedBlack_T words = rb_new(NULL); 
+        char *fruit[] = { "kiwi", "fig", "apple", "banana", "cherry", "", 
+                          "a much longer name than the others" }; 
+        FILE *file = tmpfile(); 
+
+        for (int i = 0; i < 7; i++) 
+                rb_insert_value(words, fruit[i]); 
+
+        TEST_ASSERT_TRUE(rb_tree_save(words, fileno(file), &rb_save_encode_string)); 
+        TEST_ASSERT_EQUAL(0, lseek(fileno(file), 0, SEEK_SET)); 
+
+        RedBlack_T loaded = rb_tree_load(fileno(file), NULL, &rb_load_decode_string, 
+                                         &free); 
+
+        TEST_ASSERT_NOT_NULL(loaded); 
+        assert_red_black(rb_root_node(loaded), NULL); 
+        TEST_ASSERT_EQUAL(7, rb_tree_size(loaded)); 
+        for (int i = 0; i < 7; i++) 
+                TEST_ASSERT_EQUAL_STRING(fruit[i], rb_search(loaded, fruit[i])); 
+        TEST_ASSERT_EQUAL_STRING("", rb_tree_minimum(loaded)); 
+        TEST_ASSERT_EQUAL_STRING("kiwi", rb_tree_maximum(loaded)); 
+
+        /* a loaded tree takes inserts and deletes like any other */
+        rb_insert_value(loaded, "date"); 
+        TEST_ASSERT_EQUAL_STRING("date", rb_successor_of_value(loaded, "cherry")); 
+        rb_delete_value(loaded, "date"); 
+
+        rb_map_inorder(loaded, &free_value, NULL); 
+        rb_tree_free(loaded); 
+        rb_tree_free(words); 
+        fclose(file); 
+
+        /* a multiset keeps its counts, and order statistics are rebuilt */
+        RedBlack_T counted = rb_new_mode(&integer_comparison, 
+                                         RB_MULTISET | RB_ORDER_STATISTICS); 
+        int values[1000]; 
+
+        for (int i = 0; i < 1000; i++) {
+                values[i] = i; 
+                for (int copies = 0; copies <= i % 3; copies++) 
+                        rb_insert_value(counted, &values[i]); 
+        }
+
+        file = tmpfile(); 
+        TEST_ASSERT_TRUE(rb_tree_save(counted, fileno(file), &encode_int)); 
+        TEST_ASSERT_EQUAL(0, lseek(fileno(file), 0, SEEK_SET)); 
+        loaded = rb_tree_load(fileno(file), &integer_comparison, &decode_int, &free); 
+
+        TEST_ASSERT_NOT_NULL(loaded); 
+        assert_red_black(rb_root_node(loaded), NULL); 
+        TEST_ASSERT_EQUAL(rb_tree_size(counted), rb_tree_size(loaded)); 
+        for (int i = 0; i < 1000; i += 7) {
+                TEST_ASSERT_EQUAL(i % 3 + 1, rb_count(loaded, &values[i])); 
+                TEST_ASSERT_EQUAL(rb_rank(counted, &values[i]), rb_rank(loaded, &values[i])); 
+        }
+        TEST_ASSERT_EQUAL(500, *(int *) rb_select(loaded, rb_rank(counted, &values[500]))); 
+
+        rb_map_inorder(loaded, &free_value, NULL); 
+        rb_tree_free(loaded); 
+        rb_tree_free(counted); 
+        fclose(file); 
+
+        /* an empty tree saves a header and a checksum */
+        RedBlack_T empty = rb_new(&integer_comparison); 
+
+        file = tmpfile(); 
+        TEST_ASSERT_TRUE(rb_tree_save(empty, fileno(file), &encode_int)); 
+        TEST_ASSERT_EQUAL(RB_SAVE_MAGIC_LENGTH + 7, lseek(fileno(file), 0, SEEK_CUR)); 
+        TEST_ASSERT_EQUAL(0, lseek(fileno(file), 0, SEEK_SET)); 
+        loaded = rb_tree_load(fileno(file), &integer_comparison, &decode_int, &free); 
+
+        TEST_ASSERT_NOT_NULL(loaded); 
+        TEST_ASSERT_TRUE(rb_tree_is_empty(loaded)); 
+        rb_insert_value(loaded, &values[3]); 
+        TEST_ASSERT_EQUAL_PTR(&values[3], rb_search(loaded, &values[3])); 
+
+        rb_tree_free(loaded); 
+        rb_tree_free(empty); 
+        fclose(file); 
+}
+
+void test_rb_load_rejects_damaged_files(void)
+{
+        RedBlack_T test_tree = rb_new(&integer_comparison); 
+        int values[100]; 
+        unsigned char saved[1024]; 
+        FILE *file = tmpfile(); 
+
+        for (int i = 0; i < 100; i++) {
+                values[i] = i * 1000; 
+                rb_insert_value(test_tree, &values[i]); 
+        }
+
+        TEST_ASSERT_TRUE(rb_tree_save(test_tree, fileno(file), &encode_int)); 
+        rewind(file); 
+
+        size_t length = fread(saved, 1, sizeof(saved), file); 
+
+        fclose(file); 
+
+        /* magic, version, flags, count, then 100 records of 5 bytes, and the CRC */
+        TEST_ASSERT_EQUAL(RB_SAVE_MAGIC_LENGTH + 3 + 500 + 4, length); 
+
+        file = file_holding(saved, length); 
+        RedBlack_T loaded = rb_tree_load(fileno(file), &integer_comparison, 
+                                         &decode_int, &discard_value); 
+        TEST_ASSERT_NOT_NULL(loaded); 
+        TEST_ASSERT_EQUAL(100, rb_tree_size(loaded)); 
+        rb_map_inorder(loaded, &free_value, NULL); 
+        rb_tree_free(loaded); 
+        fclose(file); 
+
+        /* a flipped bit in a value fails the checksum */
+        discarded = 0; 
+        saved[RB_SAVE_MAGIC_LENGTH + 3 + 251] ^= 0x10; 
+        file = file_holding(saved, length); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, 
+                                      &decode_int, &discard_value)); 
+        TEST_ASSERT_EQUAL(100, discarded); 
+        fclose(file); 
+        saved[RB_SAVE_MAGIC_LENGTH + 3 + 251] ^= 0x10; 
+
+        /* as does a damaged checksum */
+        saved[length - 1] ^= 0x01; 
+        file = file_holding(saved, length); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, 
+                                      &decode_int, &free)); 
+        fclose(file); 
+        saved[length - 1] ^= 0x01; 
+
+        /* a file cut short gives back what was decoded */
+        discarded = 0; 
+        file = file_holding(saved, length - 200); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, 
+                                      &decode_int, &discard_value)); 
+        TEST_ASSERT_EQUAL(60, discarded); 
+        fclose(file); 
+
+        /* a record the decoder rejects */
+        discarded = 0; 
+        saved[RB_SAVE_MAGIC_LENGTH + 3 + 5] = 3; 
+        file = file_holding(saved, length); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, 
+                                      &decode_int, &discard_value)); 
+        TEST_ASSERT_EQUAL(1, discarded); 
+        fclose(file); 
+        saved[RB_SAVE_MAGIC_LENGTH + 3 + 5] = 4; 
+
+        /* a count of 2^48 records is not believed until they arrive */
+        unsigned char inflated[1024 + 8]; 
+        unsigned char huge_count[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40 }; 
+
+        memcpy(inflated, saved, RB_SAVE_MAGIC_LENGTH + 2); 
+        memcpy(inflated + RB_SAVE_MAGIC_LENGTH + 2, huge_count, sizeof(huge_count)); 
+        memcpy(inflated + RB_SAVE_MAGIC_LENGTH + 2 + sizeof(huge_count), 
+               saved + RB_SAVE_MAGIC_LENGTH + 3, length - RB_SAVE_MAGIC_LENGTH - 3); 
+        file = file_holding(inflated, length - 1 + sizeof(huge_count)); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, &decode_int, &free)); 
+        fclose(file); 
+
+        /* not a saved tree, or a later version of the format */
+        saved[0] = 'X'; 
+        file = file_holding(saved, length); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, &decode_int, NULL)); 
+        fclose(file); 
+        saved[0] = RB_SAVE_MAGIC[0]; 
+
+        saved[RB_SAVE_MAGIC_LENGTH]++; 
+        file = file_holding(saved, length); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, &decode_int, NULL)); 
+        fclose(file); 
+
+        file = file_holding(saved, 3); 
+        TEST_ASSERT_NULL(rb_tree_load(fileno(file), &integer_comparison, &decode_int, NULL)); 
+        fclose(file); 
+
+        rb_tree_free(test_tree); 
+}
+
 int main(void)
 {
         UnityBegin("test/test_rb_tree.c");
@@ -437,6 +1975,31 @@ int main(void)
         RUN_TEST(test_rb_tree_maximum); 
         RUN_TEST(test_rb_successor_of_value); 
         RUN_TEST(test_rb_predecessor_of_value); 
+        RUN_TEST(test_rb_insert_delete_churn_reuses_nodes); 
+        RUN_TEST(test_rb_delete_in_sorted_order); 
+        RUN_TEST(test_rb_intrusive_insert_search_delete); 
+        RUN_TEST(test_rb_insert_hint_sorted_appends); 
+        RUN_TEST(test_rb_insert_hint_wrong_and_interior_hints); 
+        RUN_TEST(test_rb_minimum_and_maximum_follow_deletes); 
+        RUN_TEST(test_rb_build_from_sorted); 
+        RUN_TEST(test_rb_iter_walks_in_both_directions); 
+        RUN_TEST(test_rb_iter_seek_and_resume); 
+        RUN_TEST(test_rb_map_range); 
+        RUN_TEST(test_rb_order_statistics); 
+        RUN_TEST(test_rb_interval_overlaps); 
+        RUN_TEST(test_rb_map_operations); 
+        RUN_TEST(test_rb_multiset_counts); 
+        RUN_TEST(test_rb_pop_min_and_max); 
+        RUN_TEST(test_rb_tree_stats); 
+        RUN_TEST(test_rb_trace_recording); 
+        RUN_TEST(test_rb_split_and_join); 
+        RUN_TEST(test_rb_split_and_join_augmented); 
+        RUN_TEST(test_rb_split_and_free_reuses_nodes); 
+        RUN_TEST(test_rb_set_operations); 
+        RUN_TEST(test_rb_set_operations_small_delta); 
+        RUN_TEST(test_rb_set_operations_release_nodes); 
+        RUN_TEST(test_rb_save_and_load); 
+        RUN_TEST(test_rb_load_rejects_damaged_files); 
 
         UnityEnd();
         return 0;
@@ -0,0 +1,142 @@
+#include "vendor/unity.h"
+#include "../src/rb_typed.h"
+
+#include <string.h>
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+struct int64_walk_closure {
+        int count; 
+        int64_t previous; 
+        bool sorted; 
+};
+
+void function_to_apply_int64_walk(int64_t key, void *cl)
+{
+        struct int64_walk_closure *closure = (struct int64_walk_closure *) cl; 
+
+        if (closure->count > 0 && key < closure->previous)
+                closure->sorted = false; 
+
+        closure->previous = key; 
+        closure->count++; 
+}
+
+void test_rb_int64_churn(void)
+{
+        rb_int64_T test_tree = rb_int64_new(); 
+        int present[500] = { 0 }; 
+        int expected = 0; 
+        unsigned state = 99; 
+
+        TEST_ASSERT_NULL(rb_int64_minimum(test_tree)); 
+        TEST_ASSERT_FALSE(rb_int64_delete(test_tree, 7)); 
+
+        for (int i = 0; i < 5000; i++) {
+                state = state * 1103515245 + 12345; 
+                int64_t key = (int64_t) ((state >> 16) % 500) - 250; 
+
+                if ((state >> 8) & 1) {
+                        rb_int64_insert(test_tree, key); 
+                        present[key + 250]++; 
+                        expected++; 
+                } else {
+                        bool deleted = rb_int64_delete(test_tree, key); 
+
+                        TEST_ASSERT_EQUAL(present[key + 250] > 0, deleted); 
+                        if (deleted) {
+                                present[key + 250]--; 
+                                expected--; 
+                        }
+                }
+        }
+
+        struct int64_walk_closure cl = { 0, 0, true }; 
+
+        rb_int64_map_inorder(test_tree, &function_to_apply_int64_walk, &cl); 
+
+        TEST_ASSERT_EQUAL(expected, cl.count); 
+        TEST_ASSERT_EQUAL(expected, (int) rb_int64_size(test_tree)); 
+        TEST_ASSERT_TRUE(cl.sorted); 
+
+        for (int64_t key = -250; key < 250; key++) {
+                TEST_ASSERT_EQUAL(present[key + 250] > 0, 
+                                  rb_int64_contains(test_tree, key)); 
+        }
+
+        rb_int64_free(test_tree); 
+}
+
+void test_rb_uint64_extremes(void)
+{
+        rb_uint64_T test_tree = rb_uint64_new(); 
+
+        rb_uint64_insert(test_tree, UINT64_MAX); 
+        rb_uint64_insert(test_tree, 0); 
+        rb_uint64_insert(test_tree, (uint64_t) 1 << 63); 
+
+        /* a subtracting comparator would get these wrong */
+        TEST_ASSERT_TRUE(*rb_uint64_minimum(test_tree) == 0); 
+        TEST_ASSERT_TRUE(*rb_uint64_maximum(test_tree) == UINT64_MAX); 
+        TEST_ASSERT_TRUE(*rb_uint64_search(test_tree, (uint64_t) 1 << 63) 
+                         == (uint64_t) 1 << 63); 
+        TEST_ASSERT_NULL(rb_uint64_search(test_tree, 1)); 
+
+        rb_uint64_free(test_tree); 
+}
+
+void test_rb_double_order(void)
+{
+        rb_double_T test_tree = rb_double_new(); 
+
+        for (int i = 0; i < 100; i++) 
+                rb_double_insert(test_tree, (i * 37 % 100) / 8.0 - 6.0); 
+
+        TEST_ASSERT_EQUAL_FLOAT(-6.0, *rb_double_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL_FLOAT(99 / 8.0 - 6.0, *rb_double_maximum(test_tree)); 
+        TEST_ASSERT_TRUE(rb_double_delete(test_tree, 0.5)); 
+        TEST_ASSERT_FALSE(rb_double_contains(test_tree, 0.5)); 
+        TEST_ASSERT_EQUAL(99, rb_double_size(test_tree)); 
+
+        rb_double_free(test_tree); 
+}
+
+void test_rb_string_lookup(void)
+{
+        rb_string_T test_tree = rb_string_new(); 
+        const char *words[] = { "pear", "apple", "fig", "kiwi", "banana" }; 
+
+        for (int i = 0; i < 5; i++) 
+                rb_string_insert(test_tree, words[i]); 
+
+        char key[] = "fig"; 
+
+        /* lookups compare contents, not pointers */
+        TEST_ASSERT_EQUAL_PTR(words[2], *rb_string_search(test_tree, key)); 
+        TEST_ASSERT_EQUAL_STRING("apple", *rb_string_minimum(test_tree)); 
+        TEST_ASSERT_EQUAL_STRING("pear", *rb_string_maximum(test_tree)); 
+
+        TEST_ASSERT_TRUE(rb_string_delete(test_tree, "pear")); 
+        TEST_ASSERT_EQUAL_STRING("kiwi", *rb_string_maximum(test_tree)); 
+
+        rb_string_free(test_tree); 
+}
+
+int main(void)
+{
+        UnityBegin("test/test_rb_typed.c");
+
+        RUN_TEST(test_rb_int64_churn); 
+        RUN_TEST(test_rb_uint64_extremes); 
+        RUN_TEST(test_rb_double_order); 
+        RUN_TEST(test_rb_string_lookup); 
+
+        UnityEnd();
+        return 0;
+}